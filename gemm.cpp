@@ -0,0 +1,619 @@
+#include "gemm.hpp"
+#include "qgemm.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/**
+ * Vectorized GEMM micro-kernels and runtime instruction set dispatch
+ *
+ * Every kernel is compiled into the library regardless of the build flags.
+ * Each instruction set gets its own `target` region so only the functions in
+ * that region may use its instructions; detect_gemm_isa picks the widest one
+ * the running CPU supports.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define RY_GEMM_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#if defined(__clang__)
+#define RY_TARGET_BEGIN_SSE42                                                  \
+  _Pragma("clang attribute push(__attribute__((target(\"sse4.2\"))), "       \
+          "apply_to = function)")
+#define RY_TARGET_BEGIN_AVX2                                                   \
+  _Pragma("clang attribute push(__attribute__((target(\"avx2,fma\"))), "     \
+          "apply_to = function)")
+#define RY_TARGET_BEGIN_AVX512                                                 \
+  _Pragma("clang attribute push(__attribute__((target(\"avx512f\"))), "      \
+          "apply_to = function)")
+#define RY_TARGET_BEGIN_AVX512BW                                               \
+  _Pragma("clang attribute push(__attribute__((target("                      \
+          "\"avx512f,avx512bw\"))), apply_to = function)")
+#define RY_TARGET_BEGIN_AVX512VNNI                                             \
+  _Pragma("clang attribute push(__attribute__((target("                      \
+          "\"avx512f,avx512bw,avx512vnni\"))), apply_to = function)")
+#define RY_TARGET_END _Pragma("clang attribute pop")
+#else
+#define RY_TARGET_BEGIN_SSE42                                                  \
+  _Pragma("GCC push_options") _Pragma("GCC target(\"sse4.2\")")
+#define RY_TARGET_BEGIN_AVX2                                                   \
+  _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+#define RY_TARGET_BEGIN_AVX512                                                 \
+  _Pragma("GCC push_options") _Pragma("GCC target(\"avx512f\")")
+#define RY_TARGET_BEGIN_AVX512BW                                               \
+  _Pragma("GCC push_options") _Pragma("GCC target(\"avx512f,avx512bw\")")
+#define RY_TARGET_BEGIN_AVX512VNNI                                             \
+  _Pragma("GCC push_options")                                                  \
+      _Pragma("GCC target(\"avx512f,avx512bw,avx512vnni\")")
+#define RY_TARGET_END _Pragma("GCC pop_options")
+#endif
+
+namespace ry {
+
+#ifdef RY_GEMM_X86_KERNELS
+// The micro-kernel body is shared by every instruction set. It has to be
+// defined inside each target region so it is compiled for that instruction
+// set, hence the macro. V supplies the vector type and its operations.
+//
+// Register tile: MV vectors of A (MR = MV * V::width rows) by NR columns.
+#define RY_DEFINE_SIMD_MICRO_KERNEL                                            \
+  template <typename V, std::size_t MV, std::size_t NR>                        \
+  void simd_micro_kernel(std::size_t kc, typename V::scalar alpha,             \
+                         const typename V::scalar *a,                          \
+                         const typename V::scalar *b,                          \
+                         typename V::scalar *c, std::size_t rsc,               \
+                         std::size_t csc) {                                    \
+    using T = typename V::scalar;                                              \
+    constexpr std::size_t W = V::width;                                        \
+    constexpr std::size_t MR = MV * W;                                         \
+    typename V::vec acc[NR][MV];                                               \
+    for (std::size_t j = 0; j < NR; ++j) {                                     \
+      for (std::size_t v = 0; v < MV; ++v) {                                   \
+        acc[j][v] = V::zero();                                                 \
+      }                                                                        \
+    }                                                                          \
+    for (std::size_t p = 0; p < kc; ++p) {                                     \
+      typename V::vec av[MV];                                                  \
+      for (std::size_t v = 0; v < MV; ++v) {                                   \
+        av[v] = V::load(a + v * W);                                            \
+      }                                                                        \
+      for (std::size_t j = 0; j < NR; ++j) {                                   \
+        const typename V::vec bj = V::broadcast(b + j);                        \
+        for (std::size_t v = 0; v < MV; ++v) {                                 \
+          acc[j][v] = V::fmadd(av[v], bj, acc[j][v]);                          \
+        }                                                                      \
+      }                                                                        \
+      a += MR;                                                                 \
+      b += NR;                                                                 \
+    }                                                                          \
+    const typename V::vec valpha = V::set1(alpha);                             \
+    if (rsc == 1) {                                                            \
+      for (std::size_t j = 0; j < NR; ++j) {                                   \
+        T *cj = c + j * csc;                                                   \
+        for (std::size_t v = 0; v < MV; ++v) {                                 \
+          V::storeu(cj + v * W,                                                \
+                    V::fmadd(valpha, acc[j][v], V::loadu(cj + v * W)));        \
+        }                                                                      \
+      }                                                                        \
+    } else {                                                                   \
+      alignas(64) T tile[MR];                                                  \
+      for (std::size_t j = 0; j < NR; ++j) {                                   \
+        for (std::size_t v = 0; v < MV; ++v) {                                 \
+          V::storeu(tile + v * W, V::mul(valpha, acc[j][v]));                  \
+        }                                                                      \
+        for (std::size_t i = 0; i < MR; ++i) {                                 \
+          c[i * rsc + j * csc] += tile[i];                                     \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }
+
+// Integer counterpart: V::vec holds int32 lanes, each loaded with a pair of
+// int16 from A, and madd multiplies the pairs and adds both products to acc
+#define RY_DEFINE_QGEMM_MICRO_KERNEL                                           \
+  template <typename V, std::size_t MV, std::size_t NR>                        \
+  void qgemm_micro_kernel(std::size_t kp, const std::int16_t *a,               \
+                          const std::int16_t *b, std::int32_t *c,              \
+                          std::size_t rsc, std::size_t csc) {                  \
+    constexpr std::size_t W = V::width;                                        \
+    constexpr std::size_t MR = MV * W;                                         \
+    typename V::vec acc[NR][MV];                                               \
+    for (std::size_t j = 0; j < NR; ++j) {                                     \
+      for (std::size_t v = 0; v < MV; ++v) {                                   \
+        acc[j][v] = V::zero();                                                 \
+      }                                                                        \
+    }                                                                          \
+    for (std::size_t p = 0; p < kp; ++p) {                                     \
+      typename V::vec av[MV];                                                  \
+      for (std::size_t v = 0; v < MV; ++v) {                                   \
+        av[v] = V::load(a + 2 * v * W);                                        \
+      }                                                                        \
+      for (std::size_t j = 0; j < NR; ++j) {                                   \
+        const typename V::vec bj = V::broadcast_pair(b + 2 * j);               \
+        for (std::size_t v = 0; v < MV; ++v) {                                 \
+          acc[j][v] = V::madd(av[v], bj, acc[j][v]);                           \
+        }                                                                      \
+      }                                                                        \
+      a += 2 * MR;                                                             \
+      b += 2 * NR;                                                             \
+    }                                                                          \
+    if (rsc == 1) {                                                            \
+      for (std::size_t j = 0; j < NR; ++j) {                                   \
+        std::int32_t *cj = c + j * csc;                                        \
+        for (std::size_t v = 0; v < MV; ++v) {                                 \
+          V::storeu(cj + v * W, V::add(acc[j][v], V::loadu(cj + v * W)));      \
+        }                                                                      \
+      }                                                                        \
+    } else {                                                                   \
+      alignas(64) std::int32_t tile[MR];                                       \
+      for (std::size_t j = 0; j < NR; ++j) {                                   \
+        for (std::size_t v = 0; v < MV; ++v) {                                 \
+          V::storeu(tile + v * W, acc[j][v]);                                  \
+        }                                                                      \
+        for (std::size_t i = 0; i < MR; ++i) {                                 \
+          c[i * rsc + j * csc] += tile[i];                                     \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  }
+
+// Both int16 of a packed B pair as one 32-bit value, to broadcast to every
+// lane
+inline std::int32_t load_pair(const std::int16_t *p) {
+  std::int32_t pair;
+  std::memcpy(&pair, p, sizeof(pair));
+  return pair;
+}
+
+RY_TARGET_BEGIN_SSE42
+namespace sse42 {
+// No FMA on this level so fmadd is a separate multiply and add
+struct VecF64 {
+  using scalar = double;
+  using vec = __m128d;
+  static constexpr std::size_t width = 2;
+  static vec zero() {
+    return _mm_setzero_pd();
+  }
+  static vec set1(scalar x) {
+    return _mm_set1_pd(x);
+  }
+  static vec load(const scalar *p) {
+    return _mm_load_pd(p);
+  }
+  static vec loadu(const scalar *p) {
+    return _mm_loadu_pd(p);
+  }
+  static void storeu(scalar *p, vec x) {
+    _mm_storeu_pd(p, x);
+  }
+  static vec broadcast(const scalar *p) {
+    return _mm_load1_pd(p);
+  }
+  static vec mul(vec x, vec y) {
+    return _mm_mul_pd(x, y);
+  }
+  static vec fmadd(vec x, vec y, vec z) {
+    return _mm_add_pd(_mm_mul_pd(x, y), z);
+  }
+};
+
+struct VecF32 {
+  using scalar = float;
+  using vec = __m128;
+  static constexpr std::size_t width = 4;
+  static vec zero() {
+    return _mm_setzero_ps();
+  }
+  static vec set1(scalar x) {
+    return _mm_set1_ps(x);
+  }
+  static vec load(const scalar *p) {
+    return _mm_load_ps(p);
+  }
+  static vec loadu(const scalar *p) {
+    return _mm_loadu_ps(p);
+  }
+  static void storeu(scalar *p, vec x) {
+    _mm_storeu_ps(p, x);
+  }
+  static vec broadcast(const scalar *p) {
+    return _mm_load1_ps(p);
+  }
+  static vec mul(vec x, vec y) {
+    return _mm_mul_ps(x, y);
+  }
+  static vec fmadd(vec x, vec y, vec z) {
+    return _mm_add_ps(_mm_mul_ps(x, y), z);
+  }
+};
+
+struct VecI16Pairs {
+  using vec = __m128i;
+  static constexpr std::size_t width = 4;
+  static vec zero() {
+    return _mm_setzero_si128();
+  }
+  static vec load(const std::int16_t *p) {
+    return _mm_load_si128(reinterpret_cast<const vec *>(p));
+  }
+  static vec loadu(const std::int32_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const vec *>(p));
+  }
+  static void storeu(std::int32_t *p, vec x) {
+    _mm_storeu_si128(reinterpret_cast<vec *>(p), x);
+  }
+  static vec broadcast_pair(const std::int16_t *p) {
+    return _mm_set1_epi32(load_pair(p));
+  }
+  static vec add(vec x, vec y) {
+    return _mm_add_epi32(x, y);
+  }
+  static vec madd(vec x, vec y, vec z) {
+    return _mm_add_epi32(_mm_madd_epi16(x, y), z);
+  }
+};
+
+RY_DEFINE_SIMD_MICRO_KERNEL
+RY_DEFINE_QGEMM_MICRO_KERNEL
+} // namespace sse42
+RY_TARGET_END
+
+RY_TARGET_BEGIN_AVX2
+namespace avx2 {
+struct VecF64 {
+  using scalar = double;
+  using vec = __m256d;
+  static constexpr std::size_t width = 4;
+  static vec zero() {
+    return _mm256_setzero_pd();
+  }
+  static vec set1(scalar x) {
+    return _mm256_set1_pd(x);
+  }
+  static vec load(const scalar *p) {
+    return _mm256_load_pd(p);
+  }
+  static vec loadu(const scalar *p) {
+    return _mm256_loadu_pd(p);
+  }
+  static void storeu(scalar *p, vec x) {
+    _mm256_storeu_pd(p, x);
+  }
+  static vec broadcast(const scalar *p) {
+    return _mm256_broadcast_sd(p);
+  }
+  static vec mul(vec x, vec y) {
+    return _mm256_mul_pd(x, y);
+  }
+  static vec fmadd(vec x, vec y, vec z) {
+    return _mm256_fmadd_pd(x, y, z);
+  }
+};
+
+struct VecF32 {
+  using scalar = float;
+  using vec = __m256;
+  static constexpr std::size_t width = 8;
+  static vec zero() {
+    return _mm256_setzero_ps();
+  }
+  static vec set1(scalar x) {
+    return _mm256_set1_ps(x);
+  }
+  static vec load(const scalar *p) {
+    return _mm256_load_ps(p);
+  }
+  static vec loadu(const scalar *p) {
+    return _mm256_loadu_ps(p);
+  }
+  static void storeu(scalar *p, vec x) {
+    _mm256_storeu_ps(p, x);
+  }
+  static vec broadcast(const scalar *p) {
+    return _mm256_broadcast_ss(p);
+  }
+  static vec mul(vec x, vec y) {
+    return _mm256_mul_ps(x, y);
+  }
+  static vec fmadd(vec x, vec y, vec z) {
+    return _mm256_fmadd_ps(x, y, z);
+  }
+};
+
+struct VecI16Pairs {
+  using vec = __m256i;
+  static constexpr std::size_t width = 8;
+  static vec zero() {
+    return _mm256_setzero_si256();
+  }
+  static vec load(const std::int16_t *p) {
+    return _mm256_load_si256(reinterpret_cast<const vec *>(p));
+  }
+  static vec loadu(const std::int32_t *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const vec *>(p));
+  }
+  static void storeu(std::int32_t *p, vec x) {
+    _mm256_storeu_si256(reinterpret_cast<vec *>(p), x);
+  }
+  static vec broadcast_pair(const std::int16_t *p) {
+    return _mm256_set1_epi32(load_pair(p));
+  }
+  static vec add(vec x, vec y) {
+    return _mm256_add_epi32(x, y);
+  }
+  static vec madd(vec x, vec y, vec z) {
+    return _mm256_add_epi32(_mm256_madd_epi16(x, y), z);
+  }
+};
+
+RY_DEFINE_SIMD_MICRO_KERNEL
+RY_DEFINE_QGEMM_MICRO_KERNEL
+} // namespace avx2
+RY_TARGET_END
+
+RY_TARGET_BEGIN_AVX512
+namespace avx512 {
+struct VecF64 {
+  using scalar = double;
+  using vec = __m512d;
+  static constexpr std::size_t width = 8;
+  static vec zero() {
+    return _mm512_setzero_pd();
+  }
+  static vec set1(scalar x) {
+    return _mm512_set1_pd(x);
+  }
+  static vec load(const scalar *p) {
+    return _mm512_load_pd(p);
+  }
+  static vec loadu(const scalar *p) {
+    return _mm512_loadu_pd(p);
+  }
+  static void storeu(scalar *p, vec x) {
+    _mm512_storeu_pd(p, x);
+  }
+  static vec broadcast(const scalar *p) {
+    return _mm512_set1_pd(*p);
+  }
+  static vec mul(vec x, vec y) {
+    return _mm512_mul_pd(x, y);
+  }
+  static vec fmadd(vec x, vec y, vec z) {
+    return _mm512_fmadd_pd(x, y, z);
+  }
+};
+
+struct VecF32 {
+  using scalar = float;
+  using vec = __m512;
+  static constexpr std::size_t width = 16;
+  static vec zero() {
+    return _mm512_setzero_ps();
+  }
+  static vec set1(scalar x) {
+    return _mm512_set1_ps(x);
+  }
+  static vec load(const scalar *p) {
+    return _mm512_load_ps(p);
+  }
+  static vec loadu(const scalar *p) {
+    return _mm512_loadu_ps(p);
+  }
+  static void storeu(scalar *p, vec x) {
+    _mm512_storeu_ps(p, x);
+  }
+  static vec broadcast(const scalar *p) {
+    return _mm512_set1_ps(*p);
+  }
+  static vec mul(vec x, vec y) {
+    return _mm512_mul_ps(x, y);
+  }
+  static vec fmadd(vec x, vec y, vec z) {
+    return _mm512_fmadd_ps(x, y, z);
+  }
+};
+
+RY_DEFINE_SIMD_MICRO_KERNEL
+} // namespace avx512
+RY_TARGET_END
+
+// 512-bit integer multiply-adds are in AVX-512BW, not the foundation
+RY_TARGET_BEGIN_AVX512BW
+namespace avx512bw {
+struct VecI16Pairs {
+  using vec = __m512i;
+  static constexpr std::size_t width = 16;
+  static vec zero() {
+    return _mm512_setzero_si512();
+  }
+  static vec load(const std::int16_t *p) {
+    return _mm512_load_si512(p);
+  }
+  static vec loadu(const std::int32_t *p) {
+    return _mm512_loadu_si512(p);
+  }
+  static void storeu(std::int32_t *p, vec x) {
+    _mm512_storeu_si512(p, x);
+  }
+  static vec broadcast_pair(const std::int16_t *p) {
+    return _mm512_set1_epi32(load_pair(p));
+  }
+  static vec add(vec x, vec y) {
+    return _mm512_add_epi32(x, y);
+  }
+  static vec madd(vec x, vec y, vec z) {
+    return _mm512_add_epi32(_mm512_madd_epi16(x, y), z);
+  }
+};
+
+RY_DEFINE_QGEMM_MICRO_KERNEL
+} // namespace avx512bw
+RY_TARGET_END
+
+// VNNI fuses the multiply-add and the accumulation into one instruction
+RY_TARGET_BEGIN_AVX512VNNI
+namespace avx512vnni {
+struct VecI16Pairs : avx512bw::VecI16Pairs {
+  static vec madd(vec x, vec y, vec z) {
+    return _mm512_dpwssd_epi32(z, x, y);
+  }
+};
+
+RY_DEFINE_QGEMM_MICRO_KERNEL
+} // namespace avx512vnni
+RY_TARGET_END
+
+#undef RY_DEFINE_SIMD_MICRO_KERNEL
+#undef RY_DEFINE_QGEMM_MICRO_KERNEL
+#endif // RY_GEMM_X86_KERNELS
+
+namespace {
+bool cpu_supports(GemmIsa isa) {
+#ifdef RY_GEMM_X86_KERNELS
+  switch (isa) {
+  case GemmIsa::Scalar:
+    return true;
+  case GemmIsa::Sse42:
+    return __builtin_cpu_supports("sse4.2");
+  case GemmIsa::Avx2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case GemmIsa::Avx512:
+    return __builtin_cpu_supports("avx512f");
+  }
+  return false;
+#else
+  return isa == GemmIsa::Scalar;
+#endif
+}
+
+GemmIsa widest_supported_isa() {
+  for (auto isa : {GemmIsa::Avx512, GemmIsa::Avx2, GemmIsa::Sse42}) {
+    if (cpu_supports(isa)) {
+      return isa;
+    }
+  }
+  return GemmIsa::Scalar;
+}
+
+GemmIsa select_isa() {
+  auto best = widest_supported_isa();
+  // RY_GEMM_ISA can only narrow the choice, never enable unsupported code
+  if (const char *env = std::getenv("RY_GEMM_ISA")) {
+    for (auto isa : {GemmIsa::Scalar, GemmIsa::Sse42, GemmIsa::Avx2,
+                     GemmIsa::Avx512}) {
+      if (std::string(env) == gemm_isa_name(isa) && cpu_supports(isa) &&
+          isa <= best) {
+        return isa;
+      }
+    }
+  }
+  return best;
+}
+} // namespace
+
+const char *gemm_isa_name(GemmIsa isa) {
+  switch (isa) {
+  case GemmIsa::Scalar:
+    return "scalar";
+  case GemmIsa::Sse42:
+    return "sse4.2";
+  case GemmIsa::Avx2:
+    return "avx2";
+  case GemmIsa::Avx512:
+    return "avx512";
+  }
+  return "unknown";
+}
+
+bool gemm_isa_supported(GemmIsa isa) {
+  return cpu_supports(isa);
+}
+
+GemmIsa active_gemm_isa() {
+  static const GemmIsa isa = select_isa();
+  return isa;
+}
+
+template <> GemmMicroKernel<double> gemm_kernel_for_isa<double>(GemmIsa isa) {
+  if (!cpu_supports(isa)) {
+    throw std::runtime_error(std::string("GEMM instruction set not supported "
+                                         "by this CPU: ") +
+                             gemm_isa_name(isa));
+  }
+  switch (isa) {
+#ifdef RY_GEMM_X86_KERNELS
+  case GemmIsa::Sse42:
+    return {4, 4, &sse42::simd_micro_kernel<sse42::VecF64, 2, 4>,
+            "sse4.2-4x4"};
+  case GemmIsa::Avx2:
+    return {8, 6, &avx2::simd_micro_kernel<avx2::VecF64, 2, 6>, "avx2-8x6"};
+  case GemmIsa::Avx512:
+    return {16, 12, &avx512::simd_micro_kernel<avx512::VecF64, 2, 12>,
+            "avx512-16x12"};
+#endif
+  default:
+    return {4, 4, &gemm_micro_kernel_generic<double, 4, 4>, "generic-4x4"};
+  }
+}
+
+template <> GemmMicroKernel<float> gemm_kernel_for_isa<float>(GemmIsa isa) {
+  if (!cpu_supports(isa)) {
+    throw std::runtime_error(std::string("GEMM instruction set not supported "
+                                         "by this CPU: ") +
+                             gemm_isa_name(isa));
+  }
+  switch (isa) {
+#ifdef RY_GEMM_X86_KERNELS
+  case GemmIsa::Sse42:
+    return {8, 4, &sse42::simd_micro_kernel<sse42::VecF32, 2, 4>,
+            "sse4.2-8x4"};
+  case GemmIsa::Avx2:
+    return {16, 6, &avx2::simd_micro_kernel<avx2::VecF32, 2, 6>,
+            "avx2-16x6"};
+  case GemmIsa::Avx512:
+    return {32, 12, &avx512::simd_micro_kernel<avx512::VecF32, 2, 12>,
+            "avx512-32x12"};
+#endif
+  default:
+    return {4, 4, &gemm_micro_kernel_generic<float, 4, 4>, "generic-4x4"};
+  }
+}
+QGemmMicroKernel qgemm_kernel_for_isa(GemmIsa isa) {
+  if (!cpu_supports(isa)) {
+    throw std::runtime_error(std::string("GEMM instruction set not supported "
+                                         "by this CPU: ") +
+                             gemm_isa_name(isa));
+  }
+#ifdef RY_GEMM_X86_KERNELS
+  if (isa == GemmIsa::Avx512 && !__builtin_cpu_supports("avx512bw")) {
+    isa = GemmIsa::Avx2;
+  }
+  if (isa == GemmIsa::Avx512 && __builtin_cpu_supports("avx512vnni")) {
+    return {32, 12,
+            &avx512vnni::qgemm_micro_kernel<avx512vnni::VecI16Pairs, 2, 12>,
+            "avx512vnni-i16-32x12"};
+  }
+#endif
+  switch (isa) {
+#ifdef RY_GEMM_X86_KERNELS
+  case GemmIsa::Sse42:
+    return {8, 4, &sse42::qgemm_micro_kernel<sse42::VecI16Pairs, 2, 4>,
+            "sse4.2-i16-8x4"};
+  case GemmIsa::Avx2:
+    return {16, 6, &avx2::qgemm_micro_kernel<avx2::VecI16Pairs, 2, 6>,
+            "avx2-i16-16x6"};
+  case GemmIsa::Avx512:
+    return {32, 12,
+            &avx512bw::qgemm_micro_kernel<avx512bw::VecI16Pairs, 2, 12>,
+            "avx512bw-i16-32x12"};
+#endif
+  default:
+    return {4, 4, &qgemm_micro_kernel_generic<4, 4>, "generic-i16-4x4"};
+  }
+}
+} // namespace ry
@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "data_structures.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Packed, cache-blocked GEMM in the style of BLIS / GotoBLAS
+ *
+ * C = alpha * A * B + beta * C is computed as five nested loops around a
+ * register-tiled micro-kernel:
+ *
+ *   jc: NC columns of B/C   - packed B panel (KC x NC) lives in L3
+ *   pc: KC deep slice       - rank-KC update
+ *   ic: MC rows of A/C      - packed A block (MC x KC) lives in L2
+ *   jr: NR columns          - KC x NR sliver of B stays in L1
+ *   ir: MR rows             - MR x NR accumulators stay in registers
+ *
+ * Packing copies the operands into contiguous slivers so the micro-kernel
+ * streams through memory with unit stride no matter how the operands are laid
+ * out. All operands are addressed through a row stride and a column stride,
+ * so column-major (rs = 1, cs = ld), row-major (rs = ld, cs = 1) and
+ * transposed operands go through the same code.
+ */
+namespace ry {
+
+/**
+ * @brief Signature of a micro-kernel computing
+ *   C[0:mr, 0:nr] += alpha * A_packed * B_packed
+ * where A_packed holds kc columns of mr contiguous elements and B_packed holds
+ * kc rows of nr contiguous elements.
+ *
+ * @tparam T
+ */
+template <typename T>
+using gemm_micro_kernel_fn = void (*)(std::size_t kc, T alpha, const T *a,
+                                      const T *b, T *c, std::size_t rsc,
+                                      std::size_t csc);
+
+/**
+ * @brief A micro-kernel and the register tile it computes
+ *
+ * @tparam T
+ */
+template <typename T> struct GemmMicroKernel {
+  std::size_t mr;
+  std::size_t nr;
+  gemm_micro_kernel_fn<T> fn;
+  const char *name;
+};
+
+/**
+ * @brief Cache blocking parameters. gemm rounds mc and nc up to multiples of
+ * the micro-kernel's mr and nr respectively.
+ *
+ */
+struct GemmBlocking {
+  std::size_t mc;
+  std::size_t kc;
+  std::size_t nc;
+};
+
+/**
+ * @brief Portable register-tiled micro-kernel. The fixed trip counts let the
+ * compiler keep acc in registers and vectorize the i loop.
+ *
+ * @tparam T
+ * @tparam MR
+ * @tparam NR
+ */
+template <typename T, std::size_t MR, std::size_t NR>
+void gemm_micro_kernel_generic(std::size_t kc, T alpha, const T *a, const T *b,
+                               T *c, std::size_t rsc, std::size_t csc) {
+  T acc[MR * NR] = {};
+  for (std::size_t p = 0; p < kc; ++p) {
+    for (std::size_t j = 0; j < NR; ++j) {
+      const T bval = b[p * NR + j];
+      for (std::size_t i = 0; i < MR; ++i) {
+        acc[i + j * MR] += a[p * MR + i] * bval;
+      }
+    }
+  }
+  for (std::size_t j = 0; j < NR; ++j) {
+    for (std::size_t i = 0; i < MR; ++i) {
+      c[i * rsc + j * csc] += alpha * acc[i + j * MR];
+    }
+  }
+}
+
+/**
+ * @brief Instruction sets with dedicated micro-kernels, narrowest first
+ *
+ */
+enum class GemmIsa { Scalar, Sse42, Avx2, Avx512 };
+
+const char *gemm_isa_name(GemmIsa isa);
+
+/**
+ * @brief True if the running CPU (and OS) can execute kernels for isa
+ *
+ */
+bool gemm_isa_supported(GemmIsa isa);
+
+/**
+ * @brief The instruction set chosen at startup: the widest one the CPU
+ * supports. Setting the environment variable RY_GEMM_ISA to scalar, sse4.2,
+ * avx2 or avx512 selects a narrower one, e.g. for benchmarking.
+ *
+ * @return GemmIsa
+ */
+GemmIsa active_gemm_isa();
+
+/**
+ * @brief Micro-kernel for T targeting isa. Only float and double have
+ * vectorized kernels; other types always get the portable kernel.
+ *
+ * @tparam T
+ * @param isa
+ * @return GemmMicroKernel<T>
+ */
+template <typename T> GemmMicroKernel<T> gemm_kernel_for_isa(GemmIsa isa) {
+  (void)isa;
+  return {4, 4, &gemm_micro_kernel_generic<T, 4, 4>, "generic-4x4"};
+}
+
+// Throw std::runtime_error if isa is not supported by the CPU
+template <> GemmMicroKernel<double> gemm_kernel_for_isa<double>(GemmIsa isa);
+template <> GemmMicroKernel<float> gemm_kernel_for_isa<float>(GemmIsa isa);
+
+/**
+ * @brief Micro-kernel used when the caller does not pick one
+ *
+ * @tparam T
+ * @return GemmMicroKernel<T>
+ */
+template <typename T> GemmMicroKernel<T> default_gemm_kernel() {
+  static const GemmMicroKernel<T> kernel =
+      gemm_kernel_for_isa<T>(active_gemm_isa());
+  return kernel;
+}
+
+/**
+ * @brief Blocking sized for a typical 32K L1 / 1M L2 / multi-MB L3 so that a
+ * KC x NR sliver of B fits in L1, the MC x KC block of A fits in L2 and the
+ * KC x NC panel of B fits in L3.
+ *
+ * @tparam T
+ * @param kernel
+ * @return GemmBlocking
+ */
+template <typename T>
+GemmBlocking default_gemm_blocking(const GemmMicroKernel<T> &kernel) {
+  // Sizes are tuned for 8 byte elements and scaled for others
+  const std::size_t scale = std::max<std::size_t>(1, 8 / sizeof(T));
+  std::size_t kc = 256 * scale;
+  std::size_t mc = 96 * scale;
+  std::size_t nc = 2048;
+  mc = std::max(kernel.mr, mc / kernel.mr * kernel.mr);
+  nc = std::max(kernel.nr, nc / kernel.nr * kernel.nr);
+  return {mc, kc, nc};
+}
+
+namespace detail {
+struct aligned_deleter {
+  void operator()(void *p) const {
+    aligned_free(p);
+  }
+};
+
+template <typename T>
+using aligned_buffer_t = std::unique_ptr<T[], aligned_deleter>;
+
+template <typename T> aligned_buffer_t<T> make_aligned_buffer(std::size_t n) {
+  // 64 bytes covers a cache line and the widest vector registers
+  T *ptr = aligned_alloc<T>(64, std::max<std::size_t>(n, 1) * sizeof(T));
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return aligned_buffer_t<T>(ptr);
+}
+
+inline std::size_t round_up(std::size_t x, std::size_t multiple) {
+  return (x + multiple - 1) / multiple * multiple;
+}
+
+/**
+ * @brief Pack an mc x kc block of A into mr-row slivers, zero padding the last
+ * sliver
+ */
+template <typename T>
+void pack_a(std::size_t mc, std::size_t kc, const T *a, std::size_t rsa,
+            std::size_t csa, std::size_t mr, T *dst) {
+  for (std::size_t i0 = 0; i0 < mc; i0 += mr) {
+    const std::size_t mcur = std::min(mr, mc - i0);
+    for (std::size_t p = 0; p < kc; ++p) {
+      const T *src = a + i0 * rsa + p * csa;
+      std::size_t i = 0;
+      for (; i < mcur; ++i) {
+        dst[i] = src[i * rsa];
+      }
+      for (; i < mr; ++i) {
+        dst[i] = T{0};
+      }
+      dst += mr;
+    }
+  }
+}
+
+/**
+ * @brief Pack a kc x nc block of B into nr-column slivers, zero padding the
+ * last sliver
+ */
+template <typename T>
+void pack_b(std::size_t kc, std::size_t nc, const T *b, std::size_t rsb,
+            std::size_t csb, std::size_t nr, T *dst) {
+  for (std::size_t j0 = 0; j0 < nc; j0 += nr) {
+    const std::size_t ncur = std::min(nr, nc - j0);
+    for (std::size_t p = 0; p < kc; ++p) {
+      const T *src = b + p * rsb + j0 * csb;
+      std::size_t j = 0;
+      for (; j < ncur; ++j) {
+        dst[j] = src[j * csb];
+      }
+      for (; j < nr; ++j) {
+        dst[j] = T{0};
+      }
+      dst += nr;
+    }
+  }
+}
+
+/**
+ * @brief Multiply a packed mc x kc block of A by a packed kc x nc panel of B
+ * into C. Partial edge tiles are computed into a scratch tile and then added.
+ */
+template <typename T>
+void gemm_macro_kernel(std::size_t mc, std::size_t nc, std::size_t kc,
+                       T alpha, const T *packA, const T *packB, T *c,
+                       std::size_t rsc, std::size_t csc,
+                       const GemmMicroKernel<T> &kernel, T *scratch) {
+  const std::size_t mr = kernel.mr, nr = kernel.nr;
+  for (std::size_t j0 = 0; j0 < nc; j0 += nr) {
+    const std::size_t ncur = std::min(nr, nc - j0);
+    const T *bSliver = packB + j0 * kc;
+    for (std::size_t i0 = 0; i0 < mc; i0 += mr) {
+      const std::size_t mcur = std::min(mr, mc - i0);
+      const T *aSliver = packA + i0 * kc;
+      T *cTile = c + i0 * rsc + j0 * csc;
+      if (mcur == mr && ncur == nr) {
+        kernel.fn(kc, alpha, aSliver, bSliver, cTile, rsc, csc);
+      } else {
+        std::fill(scratch, scratch + mr * nr, T{0});
+        kernel.fn(kc, alpha, aSliver, bSliver, scratch, 1, mr);
+        for (std::size_t j = 0; j < ncur; ++j) {
+          for (std::size_t i = 0; i < mcur; ++i) {
+            cTile[i * rsc + j * csc] += scratch[i + j * mr];
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief C = beta * C. beta == 0 overwrites C so NaN/Inf in uninitialized
+ * output do not leak into the result.
+ */
+template <typename T>
+void gemm_scale_c(std::size_t m, std::size_t n, T beta, T *c, std::size_t rsc,
+                  std::size_t csc) {
+  if (beta == T{1}) {
+    return;
+  }
+  for (std::size_t j = 0; j < n; ++j) {
+    for (std::size_t i = 0; i < m; ++i) {
+      T &val = c[i * rsc + j * csc];
+      val = beta == T{0} ? T{0} : beta * val;
+    }
+  }
+}
+} // namespace detail
+
+/**
+ * @brief General matrix multiply C = alpha * A * B + beta * C for strided
+ * operands. A is m x k, B is k x n and C is m x n. Element (i, j) of X lives
+ * at x[i * rsx + j * csx].
+ *
+ * @tparam T
+ * @param kernel - Register-tiled micro-kernel to use
+ * @param blocking - Cache blocking sizes
+ */
+template <typename T>
+void gemm(std::size_t m, std::size_t n, std::size_t k, T alpha, const T *a,
+          std::size_t rsa, std::size_t csa, const T *b, std::size_t rsb,
+          std::size_t csb, T beta, T *c, std::size_t rsc, std::size_t csc,
+          const GemmMicroKernel<T> &kernel, const GemmBlocking &blocking) {
+  if (m == 0 || n == 0) {
+    return;
+  }
+  detail::gemm_scale_c(m, n, beta, c, rsc, csc);
+  if (k == 0 || alpha == T{0}) {
+    return;
+  }
+
+  const std::size_t mr = kernel.mr, nr = kernel.nr;
+  // Blocks must hold whole slivers
+  const std::size_t MC =
+      detail::round_up(std::max<std::size_t>(blocking.mc, 1), mr);
+  const std::size_t KC = std::max<std::size_t>(blocking.kc, 1);
+  const std::size_t NC =
+      detail::round_up(std::max<std::size_t>(blocking.nc, 1), nr);
+  // Do not allocate full blocks for products smaller than a block
+  const std::size_t mcMax = std::min(MC, detail::round_up(m, mr));
+  const std::size_t ncMax = std::min(NC, detail::round_up(n, nr));
+  const std::size_t kcMax = std::min(KC, k);
+  auto packA = detail::make_aligned_buffer<T>(mcMax * kcMax);
+  auto packB = detail::make_aligned_buffer<T>(kcMax * ncMax);
+  auto scratch = detail::make_aligned_buffer<T>(mr * nr);
+
+  for (std::size_t jc = 0; jc < n; jc += NC) {
+    const std::size_t nc = std::min(NC, n - jc);
+    for (std::size_t pc = 0; pc < k; pc += KC) {
+      const std::size_t kc = std::min(KC, k - pc);
+      detail::pack_b(kc, nc, b + pc * rsb + jc * csb, rsb, csb, nr,
+                     packB.get());
+      for (std::size_t ic = 0; ic < m; ic += MC) {
+        const std::size_t mc = std::min(MC, m - ic);
+        detail::pack_a(mc, kc, a + ic * rsa + pc * csa, rsa, csa, mr,
+                       packA.get());
+        detail::gemm_macro_kernel(mc, nc, kc, alpha, packA.get(), packB.get(),
+                                  c + ic * rsc + jc * csc, rsc, csc, kernel,
+                                  scratch.get());
+      }
+    }
+  }
+}
+
+/**
+ * @brief Split an m x n output into tiles of tileM x tileN for parallel_gemm.
+ * Aims for a few tiles per thread so dynamic scheduling can balance them,
+ * while keeping tiles whole multiples of the register tile.
+ *
+ * @return std::pair<std::size_t, std::size_t> - {tileM, tileN}
+ */
+inline std::pair<std::size_t, std::size_t>
+gemm_output_tiling(std::size_t m, std::size_t n, std::size_t mr,
+                   std::size_t nr, std::size_t numThreads) {
+  const double tilesWanted = 4.0 * static_cast<double>(numThreads);
+  const double side = std::sqrt(static_cast<double>(m) *
+                                static_cast<double>(n) / tilesWanted);
+  // Tiles narrower than this spend more time packing than computing
+  const std::size_t minSide = 64;
+  std::size_t tileM = std::max(static_cast<std::size_t>(side), minSide);
+  tileM = std::min(detail::round_up(tileM, mr), detail::round_up(m, mr));
+  std::size_t tileN = static_cast<std::size_t>(
+      static_cast<double>(m) * static_cast<double>(n) / tilesWanted /
+      static_cast<double>(tileM));
+  tileN = std::max(tileN, minSide);
+  tileN = std::min(detail::round_up(tileN, nr), detail::round_up(n, nr));
+  return {tileM, tileN};
+}
+
+/**
+ * @brief gemm computed by every thread of pool. C is split into 2-D tiles
+ * (see gemm_output_tiling) and each tile runs the serial blocked gemm with its
+ * own packing buffers.
+ *
+ * The beta scaling of a tile is done by the thread that computes it, so with
+ * beta == 0 and freshly allocated, untouched output (e.g. ry::aligned_alloc)
+ * each page is first touched by, and on NUMA systems placed near, the thread
+ * that will write it.
+ *
+ * @tparam T
+ */
+template <typename T>
+void gemm_parallel(std::size_t m, std::size_t n, std::size_t k, T alpha,
+                   const T *a, std::size_t rsa, std::size_t csa, const T *b,
+                   std::size_t rsb, std::size_t csb, T beta, T *c,
+                   std::size_t rsc, std::size_t csc,
+                   const GemmMicroKernel<T> &kernel,
+                   const GemmBlocking &blocking, ThreadPool &pool) {
+  if (m == 0 || n == 0) {
+    return;
+  }
+  auto [tileM, tileN] =
+      gemm_output_tiling(m, n, kernel.mr, kernel.nr, pool.size());
+  const std::size_t tilesM = (m + tileM - 1) / tileM;
+  const std::size_t tilesN = (n + tileN - 1) / tileN;
+  pool.parallel_for(tilesM * tilesN, [&](std::size_t tile, std::size_t) {
+    const std::size_t i0 = (tile % tilesM) * tileM;
+    const std::size_t j0 = (tile / tilesM) * tileN;
+    const std::size_t mcur = std::min(tileM, m - i0);
+    const std::size_t ncur = std::min(tileN, n - j0);
+    gemm(mcur, ncur, k, alpha, a + i0 * rsa, rsa, csa, b + j0 * csb, rsb, csb,
+         beta, c + i0 * rsc + j0 * csc, rsc, csc, kernel, blocking);
+  });
+}
+
+/**
+ * @brief Products with fewer multiply-adds than this run on a single thread
+ *
+ */
+inline constexpr double kGemmParallelThreshold = 128.0 * 128.0 * 128.0;
+
+/**
+ * @brief gemm with the default micro-kernel and blocking for T. Large products
+ * run on default_thread_pool().
+ *
+ * @tparam T
+ */
+template <typename T>
+void gemm(std::size_t m, std::size_t n, std::size_t k, T alpha, const T *a,
+          std::size_t rsa, std::size_t csa, const T *b, std::size_t rsb,
+          std::size_t csb, T beta, T *c, std::size_t rsc, std::size_t csc) {
+  auto kernel = default_gemm_kernel<T>();
+  auto blocking = default_gemm_blocking(kernel);
+  auto &pool = default_thread_pool();
+  const double work = static_cast<double>(m) * static_cast<double>(n) *
+                      static_cast<double>(k);
+  if (pool.size() > 1 && work >= kGemmParallelThreshold) {
+    gemm_parallel(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc,
+                  kernel, blocking, pool);
+  } else {
+    gemm(m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc, kernel,
+         blocking);
+  }
+}
+} // namespace ry
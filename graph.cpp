@@ -1,11 +1,13 @@
 #include "graph.hpp"
 #include <algorithm>
+#include <atomic>
+#include <bit>
 #include <iterator>
 #include <limits>
 #include <queue>
 #include <stack>
 #include <string>
-#include <unordered_set>
+#include <thread>
 
 /**
  * Algorithms to review / practice
@@ -42,163 +44,732 @@
  */
 
 namespace ry {
-std::vector<nodeId_t> AdjacencyListGraph::getNodes() const {
-  std::vector<nodeId_t> res(fAdjacencyList.size());
-  std::size_t i = 0;
-  for (auto [nodeId, _] : fAdjacencyList) {
-    res[i++] = nodeId;
-  }
-  std::sort(std::begin(res), std::end(res));
+std::vector<nodeId_t> Graph::getNeighbors(nodeId_t node) const {
+  std::vector<nodeId_t> res;
+  auto append = [&res](std::span<const nodeId_t> ids,
+                       std::span<const std::size_t>) {
+    res.insert(res.end(), ids.begin(), ids.end());
+  };
+  visitNeighbors(node, append);
   return res;
 }
 
-auto maybe_add_node(AdjacencyListGraph::AdjacencyList_t &map, nodeId_t node) {
-  return map.emplace(node, 0).first;
+std::optional<nodeId_t> Graph::firstNode() const {
+  auto nodes = getNodes();
+  if (nodes.empty()) {
+    return std::nullopt;
+  }
+  return *std::min_element(nodes.begin(), nodes.end());
+}
+
+std::size_t AdjacencyListGraph::find(nodeId_t node) const {
+  auto it = fIndex.find(node);
+  return it == fIndex.end() ? kNoIndex : it->second;
+}
+
+std::size_t AdjacencyListGraph::checked_find(nodeId_t node) const {
+  auto index = find(node);
+  if (index == kNoIndex) {
+    throw InvalidNodeIdError("Non-existent node: " + std::to_string(node));
+  }
+  return index;
+}
+
+std::size_t AdjacencyListGraph::denseIndex(nodeId_t node) const {
+  return checked_find(node);
+}
+
+std::vector<nodeId_t> AdjacencyListGraph::getNodes() const {
+  return {fSortedIds.begin(), fSortedIds.end()};
 }
 
 void AdjacencyListGraph::add_node(nodeId_t node) {
-  maybe_add_node(fAdjacencyList, node);
+  auto [it, isNew] = fIndex.try_emplace(node, fIds.size());
+  if (!isNew) {
+    return;
+  }
+  if (fFreeIndices.empty()) {
+    fIds.push_back(node);
+    fAdjacencyList.emplace_back();
+    fUnsortedIds.emplace_back();
+    if (fReverseIndex) {
+      fPredecessors.emplace_back();
+      fReversePositions.emplace_back();
+    }
+  } else {
+    it->second = fFreeIndices.back();
+    fFreeIndices.pop_back();
+    fIds[it->second] = node;
+  }
+  fSortedIds.insert(node);
+}
+
+const AdjacencyListGraph::Neighbors &
+AdjacencyListGraph::sorted_neighbors(std::size_t index) const {
+  auto &neighbors = fAdjacencyList[index];
+  std::atomic_ref<std::uint8_t> state(neighbors.state);
+  auto current = state.load(std::memory_order_acquire);
+  while (current != kSorted) {
+    if (current == kSorting) {
+      // Another reader is sorting this list
+      std::this_thread::yield();
+      current = state.load(std::memory_order_acquire);
+    } else if (state.compare_exchange_weak(current, kSorting,
+                                           std::memory_order_acquire)) {
+      sort_neighbors(index);
+      state.store(kSorted, std::memory_order_release);
+      break;
+    }
+  }
+  return neighbors;
+}
+
+void AdjacencyListGraph::sort_neighbors(std::size_t index) const {
+  auto &neighbors = fAdjacencyList[index];
+  const auto &ids = neighbors.ids;
+  const auto &indices = neighbors.indices;
+  // Positions of the edges left, sorted ones first
+  std::vector<std::size_t> order;
+  order.reserve(ids.size());
+  std::size_t sortedLeft = 0;
+  for (std::size_t k = 0; k < ids.size(); ++k) {
+    if (indices[k] != kNoIndex) {
+      sortedLeft += k < neighbors.sortedPrefix;
+      order.push_back(k);
+    }
+  }
+  auto byId = [&ids](std::size_t a, std::size_t b) { return ids[a] < ids[b]; };
+  const auto middle = order.begin() + static_cast<std::ptrdiff_t>(sortedLeft);
+  std::sort(middle, order.end(), byId);
+  std::inplace_merge(order.begin(), middle, order.end(), byId);
+
+  std::vector<nodeId_t> sortedIds(order.size());
+  std::vector<std::size_t> sortedIndices(order.size());
+  std::vector<std::size_t> sortedPositions;
+  for (std::size_t j = 0; j < order.size(); ++j) {
+    sortedIds[j] = ids[order[j]];
+    sortedIndices[j] = indices[order[j]];
+  }
+  if (fReverseIndex) {
+    // The edges' entries in their dests' Predecessors follow them
+    const auto &positions = fReversePositions[index];
+    sortedPositions.resize(order.size());
+    for (std::size_t j = 0; j < order.size(); ++j) {
+      sortedPositions[j] = positions[order[j]];
+      fPredecessors[sortedIndices[j]].positions[sortedPositions[j]] = j;
+    }
+    fReversePositions[index].swap(sortedPositions);
+  }
+  neighbors.ids.swap(sortedIds);
+  neighbors.indices.swap(sortedIndices);
+  neighbors.sortedPrefix = order.size();
+  fUnsortedIds[index].clear();
 }
 
 bool AdjacencyListGraph::isAdjacent(nodeId_t src, nodeId_t dest) const {
-  auto it = fAdjacencyList.find(src);
-  if (it == std::end(fAdjacencyList)) {
+  auto index = find(src);
+  if (index == kNoIndex) {
     return false;
   }
-  return it->second.contains(dest);
+  const auto &ids = sorted_neighbors(index).ids;
+  return std::binary_search(ids.begin(), ids.end(), dest);
 }
 
 std::vector<nodeId_t> AdjacencyListGraph::getNeighbors(nodeId_t node) const {
-  auto it = fAdjacencyList.find(node);
-  if (it == std::end(fAdjacencyList)) {
+  auto index = find(node);
+  if (index == kNoIndex) {
+    return {};
+  }
+  return sorted_neighbors(index).ids;
+}
+
+void AdjacencyListGraph::visitNeighbors(nodeId_t node,
+                                        NeighborVisitor visit) const {
+  auto index = find(node);
+  if (index != kNoIndex) {
+    const auto &neighbors = sorted_neighbors(index);
+    visit(neighbors.ids, neighbors.indices);
+  }
+}
+
+std::vector<nodeId_t> AdjacencyListGraph::getPredecessors(nodeId_t node) const {
+  auto index = find(node);
+  if (index == kNoIndex) {
     return {};
   }
-  std::vector<nodeId_t> res(it->second.begin(), it->second.end());
+  std::vector<nodeId_t> res;
+  if (fReverseIndex) {
+    for (auto src : fPredecessors[index].indices) {
+      res.push_back(fIds[src]);
+    }
+  } else {
+    // Lists of free indices are empty
+    for (std::size_t src = 0; src < fAdjacencyList.size(); ++src) {
+      const auto &ids = sorted_neighbors(src).ids;
+      if (std::binary_search(ids.begin(), ids.end(), node)) {
+        res.push_back(fIds[src]);
+      }
+    }
+  }
   std::sort(res.begin(), res.end());
   return res;
 }
 
+void AdjacencyListGraph::insert_edge(std::size_t srcIndex, nodeId_t dest,
+                                     std::size_t destIndex) {
+  auto &neighbors = fAdjacencyList[srcIndex];
+  auto &ids = neighbors.ids;
+  auto k = ids.size();
+  if (neighbors.sortedPrefix == ids.size() &&
+      (ids.empty() || ids.back() < dest)) {
+    // In order, so the list stays sorted
+    ++neighbors.sortedPrefix;
+  } else {
+    const auto sortedEnd =
+        ids.begin() + static_cast<std::ptrdiff_t>(neighbors.sortedPrefix);
+    auto edge = std::lower_bound(ids.begin(), sortedEnd, dest);
+    if (edge != sortedEnd && *edge == dest) {
+      k = static_cast<std::size_t>(edge - ids.begin());
+      if (neighbors.indices[k] != kNoIndex) {
+        return;
+      }
+      // Removed since the last read, so its slot is still in order
+    } else if (find_in_tail(srcIndex, dest) != kNoIndex) {
+      return;
+    } else {
+      neighbors.state = kUnsorted;
+    }
+  }
+  if (k == ids.size()) {
+    ids.push_back(dest);
+    neighbors.indices.push_back(destIndex);
+    if (fReverseIndex) {
+      fReversePositions[srcIndex].push_back(0);
+    }
+    // Short tails are scanned, and longer ones indexed from here on
+    const auto tail = ids.size() - neighbors.sortedPrefix;
+    if (tail == kTailScan + 1) {
+      for (auto j = neighbors.sortedPrefix; j < ids.size(); ++j) {
+        if (neighbors.indices[j] != kNoIndex) {
+          fUnsortedIds[srcIndex].insert(ids[j]);
+        }
+      }
+    } else if (tail > kTailScan + 1) {
+      fUnsortedIds[srcIndex].insert(dest);
+    }
+  } else {
+    neighbors.indices[k] = destIndex;
+  }
+  if (fReverseIndex) {
+    auto &in = fPredecessors[destIndex];
+    fReversePositions[srcIndex][k] = in.indices.size();
+    in.indices.push_back(srcIndex);
+    in.positions.push_back(k);
+  }
+}
+
+std::size_t AdjacencyListGraph::find_in_tail(std::size_t index,
+                                             nodeId_t dest) const {
+  const auto &neighbors = fAdjacencyList[index];
+  if (tail_indexed(neighbors) && !fUnsortedIds[index].contains(dest)) {
+    return kNoIndex;
+  }
+  for (auto k = neighbors.sortedPrefix; k < neighbors.ids.size(); ++k) {
+    if (neighbors.ids[k] == dest && neighbors.indices[k] != kNoIndex) {
+      return k;
+    }
+  }
+  return kNoIndex;
+}
+
+void AdjacencyListGraph::drop_edge(std::size_t srcIndex, std::size_t k) {
+  auto &neighbors = fAdjacencyList[srcIndex];
+  if (k >= neighbors.sortedPrefix && tail_indexed(neighbors)) {
+    fUnsortedIds[srcIndex].erase(neighbors.ids[k]);
+  }
+  // Left in place so no other edge moves. The next read drops it.
+  neighbors.indices[k] = kNoIndex;
+  neighbors.state = kUnsorted;
+}
+
+void AdjacencyListGraph::drop_reverse_edge(std::size_t destIndex,
+                                           std::size_t k) {
+  auto &in = fPredecessors[destIndex];
+  const auto last = in.indices.size() - 1;
+  if (k != last) {
+    in.indices[k] = in.indices[last];
+    in.positions[k] = in.positions[last];
+    fReversePositions[in.indices[k]][in.positions[k]] = k;
+  }
+  in.indices.pop_back();
+  in.positions.pop_back();
+}
+
 void AdjacencyListGraph::remove_node(nodeId_t node) {
-  auto it = fAdjacencyList.find(node);
-  if (it == fAdjacencyList.end()) {
+  auto it = fIndex.find(node);
+  if (it == fIndex.end()) {
     return;
   }
-  fAdjacencyList.erase(node);
-  for (auto &[_, edgeSet] : fAdjacencyList) {
-    edgeSet.erase(node);
+  const auto index = it->second;
+  fIndex.erase(it);
+  fSortedIds.erase(node);
+  fFreeIndices.push_back(index);
+  if (fReverseIndex) {
+    // Self-loops go with the node's own lists
+    const auto &in = fPredecessors[index];
+    for (std::size_t j = 0; j < in.indices.size(); ++j) {
+      if (in.indices[j] != index) {
+        drop_edge(in.indices[j], in.positions[j]);
+      }
+    }
+    const auto &out = fAdjacencyList[index];
+    for (std::size_t k = 0; k < out.indices.size(); ++k) {
+      const auto dest = out.indices[k];
+      if (dest != kNoIndex && dest != index) {
+        drop_reverse_edge(dest, fReversePositions[index][k]);
+      }
+    }
+    fPredecessors[index] = {};
+    fReversePositions[index] = {};
+  } else {
+    // Dropped edges hold kNoIndex, so only the live edge to node matches
+    for (std::size_t src = 0; src < fAdjacencyList.size(); ++src) {
+      const auto &indices = fAdjacencyList[src].indices;
+      auto edge = std::find(indices.begin(), indices.end(), index);
+      if (edge != indices.end()) {
+        drop_edge(src, static_cast<std::size_t>(edge - indices.begin()));
+      }
+    }
   }
+  fAdjacencyList[index] = {};
+  fUnsortedIds[index] = {};
 }
 
-auto checked_node_find(AdjacencyListGraph::AdjacencyList_t &l, nodeId_t node) {
-  auto it = l.find(node);
-  if (it == std::end(l)) {
-    throw new InvalidNodeIdError("Non-existent node: " + std::to_string(node));
+void AdjacencyListGraph::remove_nodes(std::span<const nodeId_t> nodes) {
+  if (fReverseIndex) {
+    for (auto node : nodes) {
+      remove_node(node);
+    }
+    return;
+  }
+  std::vector<char> removed(fIds.size(), 0);
+  bool any = false;
+  for (auto node : nodes) {
+    auto it = fIndex.find(node);
+    if (it == fIndex.end()) {
+      continue;
+    }
+    removed[it->second] = 1;
+    fAdjacencyList[it->second] = {};
+    fUnsortedIds[it->second] = {};
+    fFreeIndices.push_back(it->second);
+    fIndex.erase(it);
+    fSortedIds.erase(node);
+    any = true;
+  }
+  if (!any) {
+    return;
+  }
+  // One pass drops the edges into every removed node, and those dropped
+  // before, keeping the order of the rest
+  for (std::size_t src = 0; src < fAdjacencyList.size(); ++src) {
+    auto &neighbors = fAdjacencyList[src];
+    auto &ids = neighbors.ids;
+    auto &indices = neighbors.indices;
+    std::size_t kept = 0, keptSorted = 0;
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+      if (indices[i] != kNoIndex && !removed[indices[i]]) {
+        keptSorted += i < neighbors.sortedPrefix;
+        ids[kept] = ids[i];
+        indices[kept] = indices[i];
+        ++kept;
+      } else if (indices[i] != kNoIndex && i >= neighbors.sortedPrefix) {
+        fUnsortedIds[src].erase(ids[i]);
+      }
+    }
+    ids.resize(kept);
+    indices.resize(kept);
+    neighbors.sortedPrefix = keptSorted;
+    neighbors.state = keptSorted == kept ? kSorted : kUnsorted;
+    if (!tail_indexed(neighbors)) {
+      fUnsortedIds[src].clear();
+    }
   }
-  return it;
 }
+
 void AdjacencyListGraph::add_edge(nodeId_t src, nodeId_t dest) {
-  auto itSrc = checked_node_find(fAdjacencyList, src);
-  checked_node_find(fAdjacencyList, dest);
+  auto srcIndex = checked_find(src);
+  auto destIndex = checked_find(dest);
+  insert_edge(srcIndex, dest, destIndex);
+}
 
-  itSrc->second.insert(dest);
+void AdjacencyListGraph::add_edges(std::span<const Edge> edges) {
+  // Sorted, each source's edges are consecutive and in neighbor order
+  std::vector<Edge> sorted(edges.begin(), edges.end());
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  // Resolve every endpoint before changing anything
+  std::vector<std::size_t> srcIndices(sorted.size());
+  std::vector<std::size_t> destIndices(sorted.size());
+  for (std::size_t k = 0; k < sorted.size(); ++k) {
+    srcIndices[k] = k > 0 && sorted[k].first == sorted[k - 1].first
+                        ? srcIndices[k - 1]
+                        : checked_find(sorted[k].first);
+    destIndices[k] = checked_find(sorted[k].second);
+  }
+  for (std::size_t k = 0; k < sorted.size(); ++k) {
+    insert_edge(srcIndices[k], sorted[k].second, destIndices[k]);
+  }
 }
 
-std::vector<nodeId_t> bfs(const Graph &g) {
-  std::queue<nodeId_t> workQueue;
-  std::unordered_set<nodeId_t> visited;
+namespace {
+// Call fn(i) for each set bit i of words, in increasing order
+template <typename F>
+void for_each_bit(std::span<const std::uint64_t> words, F fn) {
+  for (std::size_t w = 0; w < words.size(); ++w) {
+    for (auto word = words[w]; word != 0; word &= word - 1) {
+      fn(w * 64 + static_cast<std::size_t>(std::countr_zero(word)));
+    }
+  }
+}
+
+// Plain word loops, which compilers vectorize
+void or_into(std::uint64_t *dst, const std::uint64_t *src, std::size_t n) {
+  for (std::size_t w = 0; w < n; ++w) {
+    dst[w] |= src[w];
+  }
+}
+
+bool covers(const std::uint64_t *a, const std::uint64_t *b,
+            const std::uint64_t *set, std::size_t n) {
+  std::uint64_t missing = 0;
+  for (std::size_t w = 0; w < n; ++w) {
+    missing |= set[w] & ~(a[w] | b[w]);
+  }
+  return missing == 0;
+}
+
+void check_matrix_node_id(nodeId_t node) {
+  if (node > AdjacencyMatrixGraph::kMaxNodeId) {
+    throw InvalidNodeIdError("Node id " + std::to_string(node) +
+                             " too large for AdjacencyMatrixGraph");
+  }
+}
+} // namespace
+
+AdjacencyMatrixGraph::AdjacencyMatrixGraph(std::size_t capacity) {
+  if (capacity > 0) {
+    check_matrix_node_id(capacity - 1);
+    grow(capacity);
+  }
+}
+
+void AdjacencyMatrixGraph::grow(std::size_t capacity) {
+  const std::size_t words = (capacity + 63) / 64;
+  std::vector<std::uint64_t> bits(words * 64 * words, 0);
+  for (std::size_t row = 0; row < fCapacity; ++row) {
+    std::copy_n(fBits.begin() + static_cast<std::ptrdiff_t>(row * fWords),
+                fWords,
+                bits.begin() + static_cast<std::ptrdiff_t>(row * words));
+  }
+  fBits = std::move(bits);
+  fPresent.resize(words, 0);
+  fWords = words;
+  fCapacity = words * 64;
+}
+
+void AdjacencyMatrixGraph::add_node(nodeId_t node) {
+  check_matrix_node_id(node);
+  if (node >= fCapacity) {
+    grow(std::clamp(2 * fCapacity, node + 1, kMaxNodeId + 1));
+  }
+  auto &word = fPresent[node / 64];
+  const std::uint64_t bit = std::uint64_t{1} << (node % 64);
+  if (!(word & bit)) {
+    word |= bit;
+    ++fNumNodes;
+  }
+}
+
+void AdjacencyMatrixGraph::remove_node(nodeId_t node) {
+  if (!contains(node)) {
+    return;
+  }
+  std::fill_n(fBits.begin() + static_cast<std::ptrdiff_t>(node * fWords),
+              fWords, 0);
+  const std::uint64_t keep = ~(std::uint64_t{1} << (node % 64));
+  for (std::size_t row = 0; row < fCapacity; ++row) {
+    fBits[row * fWords + node / 64] &= keep;
+  }
+  fPresent[node / 64] &= keep;
+  --fNumNodes;
+}
+
+void AdjacencyMatrixGraph::add_edge(nodeId_t src, nodeId_t dest) {
+  for (auto node : {src, dest}) {
+    if (!contains(node)) {
+      throw InvalidNodeIdError("Non-existent node: " + std::to_string(node));
+    }
+  }
+  fBits[src * fWords + dest / 64] |= std::uint64_t{1} << (dest % 64);
+}
+
+bool AdjacencyMatrixGraph::isAdjacent(nodeId_t src, nodeId_t dest) const {
+  return contains(src) && dest < fCapacity &&
+         ((fBits[src * fWords + dest / 64] >> (dest % 64)) & 1);
+}
+
+std::span<const std::uint64_t>
+AdjacencyMatrixGraph::neighborBits(nodeId_t node) const {
+  if (!contains(node)) {
+    return {};
+  }
+  return {fBits.data() + node * fWords, fWords};
+}
+
+std::size_t AdjacencyMatrixGraph::degree(nodeId_t node) const {
+  std::size_t res = 0;
+  for (auto word : neighborBits(node)) {
+    res += static_cast<std::size_t>(std::popcount(word));
+  }
+  return res;
+}
 
+std::vector<nodeId_t> AdjacencyMatrixGraph::getNeighbors(nodeId_t node) const {
   std::vector<nodeId_t> res;
+  res.reserve(degree(node));
+  for_each_bit(neighborBits(node),
+               [&](std::size_t dest) { res.push_back(dest); });
+  return res;
+}
 
-  auto startNode = g.getNodes()[0];
-  workQueue.push(startNode);
-  visited.insert(startNode);
-  while (!workQueue.empty()) {
-    auto node = workQueue.front();
-    workQueue.pop();
-    res.push_back(node);
-    auto neighbors = g.getNeighbors(node);
-    for (auto neighbor : neighbors) {
-      auto [_, isUnvisited] = visited.insert(neighbor);
-      if (isUnvisited) {
-        workQueue.push(neighbor);
+void AdjacencyMatrixGraph::visitNeighbors(nodeId_t node,
+                                          NeighborVisitor visit) const {
+  // Whole words are decoded into a buffer that is passed on once half full
+  constexpr std::size_t kBatch = 64;
+  nodeId_t batch[2 * kBatch];
+  std::size_t count = 0;
+  auto row = neighborBits(node);
+  for (std::size_t w = 0; w < row.size(); ++w) {
+    for (auto word = row[w]; word != 0; word &= word - 1) {
+      batch[count++] =
+          w * 64 + static_cast<std::size_t>(std::countr_zero(word));
+    }
+    if (count >= kBatch) {
+      visit(std::span<const nodeId_t>(batch, count),
+            std::span<const std::size_t>(batch, count));
+      count = 0;
+    }
+  }
+  if (count > 0) {
+    visit(std::span<const nodeId_t>(batch, count),
+          std::span<const std::size_t>(batch, count));
+  }
+}
+
+std::size_t AdjacencyMatrixGraph::denseIndex(nodeId_t node) const {
+  if (!contains(node)) {
+    throw InvalidNodeIdError("Non-existent node: " + std::to_string(node));
+  }
+  return node;
+}
+
+std::vector<nodeId_t> AdjacencyMatrixGraph::getNodes() const {
+  std::vector<nodeId_t> res;
+  res.reserve(fNumNodes);
+  for_each_bit(fPresent, [&](std::size_t node) { res.push_back(node); });
+  return res;
+}
+
+std::optional<nodeId_t> AdjacencyMatrixGraph::firstNode() const {
+  for (std::size_t w = 0; w < fPresent.size(); ++w) {
+    if (fPresent[w] != 0) {
+      return w * 64 + static_cast<std::size_t>(std::countr_zero(fPresent[w]));
+    }
+  }
+  return std::nullopt;
+}
+
+std::vector<std::size_t> AdjacencyMatrixGraph::bfsLevels(nodeId_t root) const {
+  if (!contains(root)) {
+    throw InvalidNodeIdError("Non-existent node: " + std::to_string(root));
+  }
+  std::vector<std::size_t> levels(fCapacity, kUnreached);
+  std::vector<std::uint64_t> frontier(fWords, 0), next(fWords),
+      visited(fWords, 0);
+  frontier[root / 64] = visited[root / 64] = std::uint64_t{1} << (root % 64);
+  levels[root] = 0;
+  // How many rows to OR between checks that next already holds every node
+  // left to visit, which dense graphs reach early
+  constexpr std::size_t kCoverCheck = 16;
+  for (std::size_t depth = 1;; ++depth) {
+    std::fill(next.begin(), next.end(), 0);
+    std::size_t rows = 0;
+    bool covered = false;
+    for (std::size_t w = 0; w < fWords && !covered; ++w) {
+      for (auto word = frontier[w]; word != 0 && !covered; word &= word - 1) {
+        const std::size_t src =
+            w * 64 + static_cast<std::size_t>(std::countr_zero(word));
+        or_into(next.data(), fBits.data() + src * fWords, fWords);
+        covered = ++rows % kCoverCheck == 0 &&
+                  covers(next.data(), visited.data(), fPresent.data(), fWords);
       }
     }
+    std::uint64_t any = 0;
+    for (std::size_t w = 0; w < fWords; ++w) {
+      next[w] &= ~visited[w];
+      visited[w] |= next[w];
+      any |= next[w];
+    }
+    if (any == 0) {
+      break;
+    }
+    for_each_bit(next, [&](std::size_t node) { levels[node] = depth; });
+    std::swap(frontier, next);
+  }
+  return levels;
+}
+
+namespace {
+// Visited sets for traversals that don't take one. They live as long as the
+// thread, so repeated traversals neither allocate nor clear them, and keep
+// the size of the largest graph until release_scratch_visited.
+thread_local VisitedSet scratchSets[2];
+
+VisitedSet &scratch_visited(std::size_t which = 0) {
+  return scratchSets[which];
+}
+
+// Where traversals without a root start, if g has nodes
+bool first_node(const Graph &g, nodeId_t &node) {
+  auto first = g.firstNode();
+  if (!first) {
+    return false;
+  }
+  node = *first;
+  return true;
+}
+
+// A node and its dense index
+using IndexedNode = std::pair<nodeId_t, std::size_t>;
+} // namespace
+
+void release_scratch_visited() {
+  for (auto &set : scratchSets) {
+    set = VisitedSet();
+  }
+}
+
+std::vector<nodeId_t> bfs(const Graph &g) {
+  nodeId_t root;
+  return first_node(g, root) ? bfs(g, root, scratch_visited())
+                             : std::vector<nodeId_t>{};
+}
+
+std::vector<nodeId_t> bfs(const Graph &g, nodeId_t root, VisitedSet &visited) {
+  visited.reset(g.denseIndexBound());
+  visited.insert(g.denseIndex(root));
+  // Nodes are output in the order they are queued, so res is the queue
+  std::vector<nodeId_t> res{root};
+  for (std::size_t head = 0; head < res.size(); ++head) {
+    g.forEachNeighborWithIndex(res[head],
+                               [&](nodeId_t neighbor, std::size_t index) {
+                                 if (visited.insert(index)) {
+                                   res.push_back(neighbor);
+                                 }
+                               });
   }
   return res;
 }
 
 std::vector<nodeId_t> dfsPreorder(const Graph &g) {
-  std::stack<nodeId_t> workStack;
-  std::unordered_set<nodeId_t> visited;
+  nodeId_t root;
+  return first_node(g, root) ? dfsPreorder(g, root, scratch_visited())
+                             : std::vector<nodeId_t>{};
+}
+
+std::vector<nodeId_t> dfsPreorder(const Graph &g, nodeId_t root,
+                                  VisitedSet &visited) {
+  visited.reset(g.denseIndexBound());
+  std::vector<IndexedNode> workStack{{root, g.denseIndex(root)}};
   std::vector<nodeId_t> res;
 
-  auto startNode = g.getNodes()[0];
-  workStack.push(startNode);
   while (!workStack.empty()) {
-    auto node = workStack.top();
-    workStack.pop();
-    auto [_, isUnvisited] = visited.insert(node);
-    if (isUnvisited) {
+    auto [node, index] = workStack.back();
+    workStack.pop_back();
+    if (visited.insert(index)) {
       res.push_back(node);
-      auto neighbors = g.getNeighbors(node);
-      for (auto neighbor : neighbors) {
-        workStack.push(neighbor);
-      }
+      g.forEachNeighborWithIndex(
+          node, [&](nodeId_t neighbor, std::size_t neighborIndex) {
+            workStack.emplace_back(neighbor, neighborIndex);
+          });
     }
   }
   return res;
 }
 
 void dfsPostorderWorker(const Graph &g, std::vector<nodeId_t> &res,
-                        std::unordered_set<nodeId_t> &visited, nodeId_t node) {
-  auto [_, isUnvisited] = visited.insert(node);
-  if (!isUnvisited) {
+                        VisitedSet &visited, nodeId_t node,
+                        std::size_t index) {
+  if (!visited.insert(index)) {
     return;
   }
-  auto neighbors = g.getNeighbors(node);
-  for (auto neighbor : neighbors) {
-    if (!visited.contains(neighbor)) {
-      dfsPostorderWorker(g, res, visited, neighbor);
-    }
-  }
+  g.forEachNeighborWithIndex(
+      node, [&](nodeId_t neighbor, std::size_t neighborIndex) {
+        if (!visited.contains(neighborIndex)) {
+          dfsPostorderWorker(g, res, visited, neighbor, neighborIndex);
+        }
+      });
   res.push_back(node);
 }
 
 std::vector<nodeId_t> dfsPostorderRecursive(const Graph &g) {
-  std::unordered_set<nodeId_t> visited;
   std::vector<nodeId_t> res;
-
-  auto startNode = g.getNodes()[0];
-  dfsPostorderWorker(g, res, visited, startNode);
+  nodeId_t startNode;
+  if (!first_node(g, startNode)) {
+    return res;
+  }
+  auto &visited = scratch_visited();
+  visited.reset(g.denseIndexBound());
+  dfsPostorderWorker(g, res, visited, startNode, g.denseIndex(startNode));
   return res;
 }
 
 // Note: Topological sort is just reverse postorder
 std::vector<nodeId_t> dfsPostorderIterative(const Graph &g) {
-  // Visited set for when we first visit a node
-  std::unordered_set<nodeId_t> visited;
-  // Pairs {nodeId, isSecondVisit}. isSecondVisit == true means
+  nodeId_t root;
+  return first_node(g, root) ? dfsPostorderIterative(g, root, scratch_visited())
+                             : std::vector<nodeId_t>{};
+}
+
+std::vector<nodeId_t> dfsPostorderIterative(const Graph &g, nodeId_t root,
+                                            VisitedSet &visited) {
+  visited.reset(g.denseIndexBound());
+  // Entries {node, isSecondVisit}. isSecondVisit == true means
   // we're seeing this the second time and ready to store to result
   // to mimic postorder
-  std::stack<std::pair<nodeId_t, bool>> workStack;
+  std::vector<std::pair<IndexedNode, bool>> workStack;
   std::vector<nodeId_t> res;
+  // Reused for every node so reversing neighbors doesn't allocate
+  std::vector<IndexedNode> neighbors;
 
-  auto startNode = g.getNodes()[0];
-  workStack.emplace(startNode, false);
+  workStack.push_back({{root, g.denseIndex(root)}, false});
   while (!workStack.empty()) {
-    auto node = workStack.top();
-    auto nodeId = node.first;
-    workStack.pop();
-    if (node.second) {
-      res.push_back(nodeId);
-    } else if (!visited.contains(nodeId)) {
-      visited.insert(nodeId);
-      workStack.emplace(nodeId, true);
-      auto neighbors = g.getNeighbors(nodeId);
+    auto [node, isSecondVisit] = workStack.back();
+    workStack.pop_back();
+    if (isSecondVisit) {
+      res.push_back(node.first);
+    } else if (visited.insert(node.second)) {
+      workStack.push_back({node, true});
+      neighbors.clear();
+      g.forEachNeighborWithIndex(
+          node.first, [&](nodeId_t neighbor, std::size_t index) {
+            neighbors.emplace_back(neighbor, index);
+          });
       // Reverse to match recursive neighbor visitation order
       for (auto neighborIt = neighbors.rbegin(); neighborIt != neighbors.rend();
            ++neighborIt) {
-        workStack.emplace(*neighborIt, false);
+        workStack.push_back({*neighborIt, false});
       }
     }
   }
@@ -207,39 +778,56 @@ std::vector<nodeId_t> dfsPostorderIterative(const Graph &g) {
 }
 
 std::tuple<bool, nodeId_t, nodeId_t> detectCyclesDfs(const Graph &g) {
-  std::stack<nodeId_t> workStack;
-  std::unordered_set<nodeId_t> visited;
-  std::unordered_set<nodeId_t> recursiveStack;
+  constexpr auto kNone = std::numeric_limits<nodeId_t>::max();
+  auto &visited = scratch_visited(0);
+  auto &recursiveStack = scratch_visited(1);
+  visited.reset(g.denseIndexBound());
+  recursiveStack.reset(g.denseIndexBound());
+  std::vector<IndexedNode> workStack;
 
-  auto startNode = g.getNodes()[0];
-  workStack.push(startNode);
-  while (!workStack.empty()) {
-    // Look at next element
-    auto node = workStack.top();
-    workStack.pop();
-    if (recursiveStack.contains(node)) {
-      // We've recursed on this node and are now returning from recursion
-      recursiveStack.erase(node);
-    } else {
-      // If unvisited, recurse on this node. I.e. push neighbors and
-      // check for back edges
-      auto [_, isUnvisited] = visited.insert(node);
-      if (isUnvisited) {
-        // "Recurse" on node
-        recursiveStack.insert(node);
-        workStack.push(node);
-        auto neighbors = g.getNeighbors(node);
-        for (auto neighbor : neighbors) {
-          if (recursiveStack.contains(neighbor)) {
-            return {true, node, neighbor};
+  bool found = false;
+  nodeId_t backEdgeDest = 0;
+  // Each node not yet visited starts another search, so cycles that can't
+  // be reached from the first node are found too
+  for (auto startNode : g.getNodes()) {
+    const auto startIndex = g.denseIndex(startNode);
+    if (visited.contains(startIndex)) {
+      continue;
+    }
+    workStack.emplace_back(startNode, startIndex);
+    while (!workStack.empty()) {
+      // Look at next element
+      auto [node, index] = workStack.back();
+      workStack.pop_back();
+      if (recursiveStack.contains(index)) {
+        // We've recursed on this node and are now returning from recursion
+        recursiveStack.erase(index);
+      } else {
+        // If unvisited, recurse on this node. I.e. push neighbors and
+        // check for back edges
+        if (visited.insert(index)) {
+          // "Recurse" on node
+          recursiveStack.insert(index);
+          workStack.emplace_back(node, index);
+          g.forEachNeighborWithIndex(
+              node, [&](nodeId_t neighbor, std::size_t neighborIndex) {
+                if (found) {
+                  return;
+                }
+                if (recursiveStack.contains(neighborIndex)) {
+                  found = true;
+                  backEdgeDest = neighbor;
+                }
+                workStack.emplace_back(neighbor, neighborIndex);
+              });
+          if (found) {
+            return {true, node, backEdgeDest};
           }
-          workStack.push(neighbor);
         }
       }
     }
   }
-  return {false, std::numeric_limits<nodeId_t>::max(),
-          std::numeric_limits<nodeId_t>::max()};
+  return {false, kNone, kNone};
 }
 
 /**
@@ -256,113 +844,113 @@ std::tuple<bool, nodeId_t, nodeId_t> detectCyclesDfs(const Graph &g) {
  */
 std::vector<nodeId_t> bfs2(const Graph &g) {
   std::vector<nodeId_t> res;
-  std::unordered_set<nodeId_t> visited;
-  auto nodes = g.getNodes();
-  if (nodes.size() == 0) {
+  nodeId_t root;
+  if (!first_node(g, root)) {
     return res;
   }
-  auto root = nodes[0];
+  auto &visited = scratch_visited();
+  visited.reset(g.denseIndexBound());
   std::queue<nodeId_t> workqueue;
   workqueue.push(root);
-  visited.insert(root);
+  visited.insert(g.denseIndex(root));
   while (!workqueue.empty()) {
     // Visit first node in queue
     auto node = workqueue.front();
     workqueue.pop();
     res.push_back(node);
     // Enqueue adjacent nodes
-    for (auto neighbor : g.getNeighbors(node)) {
-      if (visited.count(neighbor) == 0) {
+    g.forEachNeighborWithIndex(node, [&](nodeId_t neighbor, std::size_t index) {
+      // Don't enqueue this node again
+      if (visited.insert(index)) {
         workqueue.push(neighbor);
-        // Don't enqueue this node again
-        visited.insert(neighbor);
       }
-    }
+    });
   }
   return res;
 }
 
 std::vector<nodeId_t> dfsPreorder2(const Graph &g) {
   std::vector<nodeId_t> res;
-  std::unordered_set<nodeId_t> visited;
-  std::stack<nodeId_t> workstack;
-  auto nodes = g.getNodes();
-  if (nodes.empty()) {
+  nodeId_t root;
+  if (!first_node(g, root)) {
     return res;
   }
-  auto root = nodes[0];
+  auto &visited = scratch_visited();
+  visited.reset(g.denseIndexBound());
+  std::stack<nodeId_t> workstack;
   workstack.push(root);
-  visited.insert(root);
+  visited.insert(g.denseIndex(root));
   while (!workstack.empty()) {
     auto node = workstack.top();
     res.push_back(node);
     workstack.pop();
-    for (auto neighbor : g.getNeighbors(node)) {
-      if (visited.count(neighbor) == 0) {
+    g.forEachNeighborWithIndex(node, [&](nodeId_t neighbor, std::size_t index) {
+      if (visited.insert(index)) {
         workstack.push(neighbor);
-        visited.insert(neighbor);
       }
-    }
+    });
   }
   return res;
 }
 
 void dfsPostorderRecursiveWorker2(const Graph &g, nodeId_t node,
                                   std::vector<nodeId_t> &res,
-                                  std::unordered_set<nodeId_t> &visited) {
-  for (auto neighbor : g.getNeighbors(node)) {
-    if (visited.count(neighbor) == 0) {
-      visited.insert(neighbor);
+                                  VisitedSet &visited) {
+  g.forEachNeighborWithIndex(node, [&](nodeId_t neighbor, std::size_t index) {
+    if (visited.insert(index)) {
       dfsPostorderRecursiveWorker2(g, neighbor, res, visited);
     }
-  }
+  });
   // Finally insert current node
   res.push_back(node);
 }
 
 std::vector<nodeId_t> dfsPostorderRecursive2(const Graph &g) {
   std::vector<nodeId_t> res;
-  std::unordered_set<nodeId_t> visited;
-  auto nodes = g.getNodes();
-  if (nodes.empty()) {
+  nodeId_t node;
+  if (!first_node(g, node)) {
     return res;
   }
-  auto node = nodes[0];
-  visited.insert(node);
+  auto &visited = scratch_visited();
+  visited.reset(g.denseIndexBound());
+  visited.insert(g.denseIndex(node));
   dfsPostorderRecursiveWorker2(g, node, res, visited);
   return res;
 }
 
 std::vector<nodeId_t> dfsPostorderIterative2(const Graph &g) {
   std::vector<nodeId_t> res;
-  std::unordered_set<nodeId_t> visited;
-  std::stack<nodeId_t> workstack;
-  auto nodes = g.getNodes();
-  if (nodes.empty()) {
+  // Pairs {nodeId, expanded}. Every neighbor is visited once a node has been
+  // expanded, so the next time it is on top it is finished.
+  std::stack<std::pair<nodeId_t, bool>> workstack;
+  std::vector<IndexedNode> neighbors;
+  nodeId_t node;
+  if (!first_node(g, node)) {
     return res;
   }
-  auto node = nodes[0];
-  workstack.push(node);
-  visited.insert(node);
+  auto &visited = scratch_visited();
+  visited.reset(g.denseIndexBound());
+  workstack.emplace(node, false);
+  visited.insert(g.denseIndex(node));
   while (!workstack.empty()) {
-    auto node = workstack.top();
-    bool should_pop = true;
-    auto neighbors = g.getNeighbors(node);
+    auto &[node, expanded] = workstack.top();
+    if (expanded) {
+      res.push_back(node);
+      workstack.pop();
+      continue;
+    }
+    expanded = true;
+    neighbors.clear();
+    g.forEachNeighborWithIndex(node, [&](nodeId_t neighbor, std::size_t index) {
+      neighbors.emplace_back(neighbor, index);
+    });
 
     // Reverse order to match recursive implementation for ease of verification
     for (auto it = neighbors.rbegin(); it != neighbors.rend(); ++it) {
-      auto neighbor = *it;
-      if (visited.count(neighbor) == 0) {
-        workstack.push(neighbor);
-        visited.insert(neighbor);
-        should_pop = false;
+      if (visited.insert(it->second)) {
+        workstack.emplace(it->first, false);
       }
     }
-
-    if (should_pop) {
-      res.push_back(node);
-      workstack.pop();
-    }
   }
   return res;
 }
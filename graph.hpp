@@ -1,35 +1,250 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <set>
+#include <span>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace ry {
 
 using nodeId_t = std::size_t;
 
+// Directed edge {src, dest}
+using Edge = std::pair<nodeId_t, nodeId_t>;
+
+// BFS depth of nodes that can't be reached
+inline constexpr std::size_t kUnreached =
+    std::numeric_limits<std::size_t>::max();
+
+/**
+ * @brief Non-owning reference to a callable taking a batch of neighbors as
+ * (std::span<const nodeId_t> ids, std::span<const std::size_t> indices),
+ * where indices holds the dense index of each id. Graphs hand their neighbors
+ * to one through a single virtual call, in as few batches as their storage
+ * allows, so visiting neighbors neither allocates nor makes a virtual call per
+ * edge.
+ *
+ */
+class NeighborVisitor {
+public:
+  template <typename F>
+    requires(!std::is_same_v<std::remove_cv_t<F>, NeighborVisitor>)
+  NeighborVisitor(F &visit)
+      : fVisit(const_cast<void *>(
+            static_cast<const void *>(std::addressof(visit)))),
+        fCall([](void *visit, std::span<const nodeId_t> ids,
+                 std::span<const std::size_t> indices) {
+          (*static_cast<F *>(visit))(ids, indices);
+        }) {}
+
+  void operator()(std::span<const nodeId_t> ids,
+                  std::span<const std::size_t> indices) const {
+    fCall(fVisit, ids, indices);
+  }
+
+private:
+  void *fVisit;
+  void (*fCall)(void *, std::span<const nodeId_t>,
+                std::span<const std::size_t>);
+};
+
+/**
+ * @brief Visited flags over dense node indices that clear in O(1). Each
+ * index holds the epoch it was last visited in, and reset starts a new epoch,
+ * so one set can serve back-to-back traversals without being cleared.
+ *
+ */
+class VisitedSet {
+public:
+  /**
+   * @brief Forget every visit and cover indices below bound. Call before each
+   * traversal.
+   *
+   */
+  void reset(std::size_t bound) {
+    if (fStamps.size() < bound) {
+      fStamps.resize(bound, 0);
+    }
+    // Stamps are only rewritten when the epoch wraps around
+    if (++fEpoch == 0) {
+      std::fill(fStamps.begin(), fStamps.end(), 0);
+      fEpoch = 1;
+    }
+  }
+  bool contains(std::size_t index) const {
+    return fStamps[index] == fEpoch;
+  }
+  /**
+   * @brief Mark index visited, returning whether it was unvisited
+   *
+   */
+  bool insert(std::size_t index) {
+    if (fStamps[index] == fEpoch) {
+      return false;
+    }
+    fStamps[index] = fEpoch;
+    return true;
+  }
+  void erase(std::size_t index) {
+    fStamps[index] = 0;
+  }
+
+private:
+  std::vector<std::uint32_t> fStamps;
+  std::uint32_t fEpoch = 0;
+};
+
 class Graph {
 public:
   explicit Graph() {}
 
   virtual bool isAdjacent(nodeId_t src, nodeId_t dest) const = 0;
-  virtual std::vector<nodeId_t> getNeighbors(nodeId_t node) const = 0;
+  /**
+   * @brief Sorted neighbors of node, in a new vector. Traversals should use
+   * forEachNeighbor, which doesn't allocate.
+   *
+   */
+  virtual std::vector<nodeId_t> getNeighbors(nodeId_t node) const;
+  /**
+   * @brief Pass the neighbors of node to visit in increasing id order, in one
+   * or more batches. Unknown nodes have no neighbors. The graph must not
+   * change while visit runs.
+   *
+   */
+  virtual void visitNeighbors(nodeId_t node, NeighborVisitor visit) const = 0;
   virtual void add_node(nodeId_t node) = 0;
   virtual void remove_node(nodeId_t node) = 0;
   virtual void add_edge(nodeId_t src, nodeId_t dest) = 0;
   virtual std::vector<nodeId_t> getNodes() const = 0;
+  /**
+   * @brief Smallest node id, or nothing if the graph is empty. The default
+   * copies getNodes(), so graphs override it with a cheaper lookup.
+   *
+   */
+  virtual std::optional<nodeId_t> firstNode() const;
+
+  /**
+   * @brief Dense index of node, below denseIndexBound(), for per-node arrays
+   * such as VisitedSet. Indices are fixed until the graph changes, and those
+   * of removed nodes may be reused. Throws InvalidNodeIdError if node is not
+   * in the graph.
+   *
+   */
+  virtual std::size_t denseIndex(nodeId_t node) const = 0;
+  virtual std::size_t denseIndexBound() const = 0;
+
+  /**
+   * @brief Call visit(neighbor) for each neighbor of node in increasing id
+   * order, without allocating
+   *
+   */
+  template <typename F> void forEachNeighbor(nodeId_t node, F &&visit) const {
+    auto visitBatch = [&visit](std::span<const nodeId_t> ids,
+                               std::span<const std::size_t>) {
+      for (auto neighbor : ids) {
+        visit(neighbor);
+      }
+    };
+    visitNeighbors(node, NeighborVisitor(visitBatch));
+  }
+
+  /**
+   * @brief Call visit(neighbor, denseIndex(neighbor)) for each neighbor of
+   * node in increasing id order, without allocating or looking indices up
+   *
+   */
+  template <typename F>
+  void forEachNeighborWithIndex(nodeId_t node, F &&visit) const {
+    auto visitBatch = [&visit](std::span<const nodeId_t> ids,
+                               std::span<const std::size_t> indices) {
+      for (std::size_t k = 0; k < ids.size(); ++k) {
+        visit(ids[k], indices[k]);
+      }
+    };
+    visitNeighbors(node, NeighborVisitor(visitBatch));
+  }
 };
 
+/**
+ * @brief Directed graph stored as a packed bit matrix: bit dest of row src is
+ * set when there is an edge from src to dest. Node ids index the matrix
+ * directly, so they must be small: the matrix takes capacity()^2 / 8 bytes,
+ * where capacity() is above the largest id. isAdjacent is a single bit test,
+ * and neighbors and BFS frontiers are processed 64 nodes per word.
+ */
 class AdjacencyMatrixGraph : public Graph {
 public:
   explicit AdjacencyMatrixGraph() {}
+  /**
+   * @brief Empty graph with room for ids below capacity without regrowing
+   *
+   */
+  explicit AdjacencyMatrixGraph(std::size_t capacity);
 
   virtual bool isAdjacent(nodeId_t src, nodeId_t dest) const override;
   virtual std::vector<nodeId_t> getNeighbors(nodeId_t node) const override;
+  virtual void visitNeighbors(nodeId_t node,
+                              NeighborVisitor visit) const override;
   virtual void add_node(nodeId_t node) override;
   virtual void remove_node(nodeId_t node) override;
   virtual void add_edge(nodeId_t src, nodeId_t dest) override;
+  virtual std::vector<nodeId_t> getNodes() const override;
+  virtual std::optional<nodeId_t> firstNode() const override;
+  // Ids are their own indices
+  virtual std::size_t denseIndex(nodeId_t node) const override;
+  virtual std::size_t denseIndexBound() const override {
+    return fCapacity;
+  }
+
+  // Largest id accepted, which bounds the matrix at 128 GiB
+  static constexpr nodeId_t kMaxNodeId = (nodeId_t{1} << 20) - 1;
+
+  std::size_t capacity() const {
+    return fCapacity;
+  }
+  std::size_t numNodes() const {
+    return fNumNodes;
+  }
+  bool contains(nodeId_t node) const {
+    return node < fCapacity && ((fPresent[node / 64] >> (node % 64)) & 1);
+  }
+  std::size_t degree(nodeId_t node) const;
+
+  /**
+   * @brief Row of node: bit dest % 64 of word dest / 64 is set for each
+   * neighbor dest. Empty if node is not in the graph.
+   *
+   */
+  std::span<const std::uint64_t> neighborBits(nodeId_t node) const;
+
+  /**
+   * @brief BFS depth of every id below capacity() from root, or kUnreached.
+   * Each level ORs the rows of the frontier into the next frontier a word
+   * at a time.
+   *
+   */
+  std::vector<std::size_t> bfsLevels(nodeId_t root) const;
+
+private:
+  void grow(std::size_t capacity);
+
+  std::size_t fCapacity = 0;
+  // Words per row, fCapacity / 64
+  std::size_t fWords = 0;
+  std::size_t fNumNodes = 0;
+  // fCapacity rows of fWords words
+  std::vector<std::uint64_t> fBits;
+  // Bit per id that is a node
+  std::vector<std::uint64_t> fPresent;
 };
 
 struct InvalidNodeIdError {
@@ -41,24 +256,135 @@ struct InvalidNodeIdError {
 private:
   std::string fMessage = nullptr;
 };
+/**
+ * @brief Graph of sorted out-neighbor lists over dense node indices.
+ *
+ * Edges are appended, which is O(1) when they arrive in increasing order and
+ * O(log out-degree) otherwise. The first read of a list after out-of-order
+ * appends sorts them in, so reads see sorted lists without allocating.
+ * Concurrent reads are safe; reads concurrent with changes are not.
+ *
+ * Built with reverseIndex, it also keeps the in-edges of each node, which
+ * costs two indices per edge and makes predecessor queries and node removal
+ * O(in-degree + out-degree). Without it both look in every node's list.
+ *
+ */
 class AdjacencyListGraph : public Graph {
 public:
-  explicit AdjacencyListGraph() {}
+  explicit AdjacencyListGraph(bool reverseIndex = false)
+      : fReverseIndex(reverseIndex) {}
 
   virtual bool isAdjacent(nodeId_t src, nodeId_t dest) const override;
   virtual std::vector<nodeId_t> getNeighbors(nodeId_t node) const override;
+  virtual void visitNeighbors(nodeId_t node,
+                              NeighborVisitor visit) const override;
   virtual void add_node(nodeId_t node) override;
   virtual void remove_node(nodeId_t node) override;
   virtual void add_edge(nodeId_t src, nodeId_t dest) override;
   virtual std::vector<nodeId_t> getNodes() const override;
+  virtual std::optional<nodeId_t> firstNode() const override {
+    if (fSortedIds.empty()) {
+      return std::nullopt;
+    }
+    return *fSortedIds.begin();
+  }
+  virtual std::size_t denseIndex(nodeId_t node) const override;
+  virtual std::size_t denseIndexBound() const override {
+    return fIds.size();
+  }
+  bool contains(nodeId_t node) const {
+    return fIndex.contains(node);
+  }
+  bool hasReverseIndex() const {
+    return fReverseIndex;
+  }
+
+  /**
+   * @brief Nodes with an edge to node, in increasing id order
+   *
+   */
+  std::vector<nodeId_t> getPredecessors(nodeId_t node) const;
 
-  using AdjacencyList_t =
-      std::unordered_map<nodeId_t, std::unordered_set<nodeId_t>>;
+  /**
+   * @brief Add many edges at once. Each source is hashed once, and the
+   * batch is sorted so that it appends to lists in order. Throws
+   * InvalidNodeIdError, adding none of them, if an endpoint doesn't exist.
+   *
+   */
+  void add_edges(std::span<const Edge> edges);
+
+  /**
+   * @brief Remove many nodes at once. Without a reverse index this is one
+   * pass over all edges rather than a search of every list per node. Absent
+   * nodes are ignored.
+   *
+   */
+  void remove_nodes(std::span<const nodeId_t> nodes);
 
 private:
-  // Maps a given node id, src to the list of adjacent node ids, dst[i]
-  // such that there is an edge from src to dst[i] for each i
-  AdjacencyList_t fAdjacencyList;
+  // Dense index of node, or kNoIndex
+  std::size_t find(nodeId_t node) const;
+  std::size_t checked_find(nodeId_t node) const;
+  static constexpr std::size_t kNoIndex = ~std::size_t{0};
+
+  // Nodes are numbered densely so that edges and traversals work on indices
+  // rather than hashing ids. Maps each node id to its index.
+  std::unordered_map<nodeId_t, std::size_t> fIndex;
+  // Id of each index. Indices of removed nodes wait in fFreeIndices.
+  std::vector<nodeId_t> fIds;
+  std::vector<std::size_t> fFreeIndices;
+  // Out-neighbors of a node as parallel lists of ids and their indices. The
+  // first sortedPrefix are sorted by id. Once more than kTailScan follow them,
+  // appended out of order, their ids are also in fUnsortedIds so that adding
+  // an edge twice is caught without a scan. Removed edges keep their id with
+  // index kNoIndex until the list is next read.
+  struct Neighbors {
+    std::vector<nodeId_t> ids;
+    std::vector<std::size_t> indices;
+    std::size_t sortedPrefix = 0;
+    // kSorted once sortedPrefix covers the list and nothing was removed.
+    // Readers go through std::atomic_ref so that only one of them sorts it.
+    std::uint8_t state = kSorted;
+  };
+  static constexpr std::uint8_t kSorted = 0;
+  static constexpr std::uint8_t kUnsorted = 1;
+  static constexpr std::uint8_t kSorting = 2;
+  static constexpr std::size_t kTailScan = 32;
+  static bool tail_indexed(const Neighbors &neighbors) {
+    return neighbors.ids.size() - neighbors.sortedPrefix > kTailScan;
+  }
+  // Position of a live edge to dest after the sorted prefix, or kNoIndex
+  std::size_t find_in_tail(std::size_t index, nodeId_t dest) const;
+  // The list of index, sorted first if needed
+  const Neighbors &sorted_neighbors(std::size_t index) const;
+  void sort_neighbors(std::size_t index) const;
+  // Add src -> dest unless it is there already
+  void insert_edge(std::size_t srcIndex, nodeId_t dest, std::size_t destIndex);
+  // Remove the edge at position k of the list of src in O(1)
+  void drop_edge(std::size_t srcIndex, std::size_t k);
+  // Remove the entry at position k of the Predecessors of dest in O(1)
+  void drop_reverse_edge(std::size_t destIndex, std::size_t k);
+
+  // Maps a given node index, src to the adjacent nodes, dst[i] such that
+  // there is an edge from src to dst[i] for each i. Mutable because reads
+  // finish sorting the lists, so both can be handed out as is.
+  mutable std::vector<Neighbors> fAdjacencyList;
+  // Ids in the long unsorted tails of fAdjacencyList, kept apart so that
+  // scanning the lists stays compact
+  mutable std::vector<std::unordered_set<nodeId_t>> fUnsortedIds;
+  // Node ids in increasing order, so getNodes doesn't sort
+  std::set<nodeId_t> fSortedIds;
+  // In-edges of each index if fReverseIndex, in no particular order: their
+  // sources and where each sits in its source's Neighbors. Mutable because
+  // sorting a list moves its edges.
+  struct Predecessors {
+    std::vector<std::size_t> indices;
+    std::vector<std::size_t> positions;
+  };
+  bool fReverseIndex;
+  mutable std::vector<Predecessors> fPredecessors;
+  // Where each edge of fAdjacencyList sits in its dest's Predecessors
+  mutable std::vector<std::vector<std::size_t>> fReversePositions;
 };
 
 class NodeAndEdgeGraph : public Graph {
@@ -67,18 +393,40 @@ public:
 
   virtual bool isAdjacent(nodeId_t src, nodeId_t dest) const override;
   virtual std::vector<nodeId_t> getNeighbors(nodeId_t node) const override;
+  virtual void visitNeighbors(nodeId_t node,
+                              NeighborVisitor visit) const override;
   virtual void add_node(nodeId_t node) override;
   virtual void remove_node(nodeId_t node) override;
   virtual void add_edge(nodeId_t src, nodeId_t dest) override;
+  virtual std::size_t denseIndex(nodeId_t node) const override;
+  virtual std::size_t denseIndexBound() const override;
 };
 
 // Various visitation methods that all return a vector of
-// node IDs in the order they were visited
+// node IDs in the order they were visited. They start from the smallest node
+// id, and keep visited sets in a VisitedSet per thread that later traversals
+// reuse.
 std::vector<nodeId_t> bfs(const Graph &g);
 std::vector<nodeId_t> dfsPreorder(const Graph &g);
 std::vector<nodeId_t> dfsPostorderRecursive(const Graph &g);
 std::vector<nodeId_t> dfsPostorderIterative(const Graph &g);
 
+/**
+ * @brief Free the calling thread's visited sets. They only grow, holding 4
+ * bytes per node of the largest graph traversed, so threads that are done
+ * with a large graph can give the memory back.
+ *
+ */
+void release_scratch_visited();
+
+// The same from root, with a caller's visited set. Repeated queries then cost
+// only what they visit.
+std::vector<nodeId_t> bfs(const Graph &g, nodeId_t root, VisitedSet &visited);
+std::vector<nodeId_t> dfsPreorder(const Graph &g, nodeId_t root,
+                                  VisitedSet &visited);
+std::vector<nodeId_t> dfsPostorderIterative(const Graph &g, nodeId_t root,
+                                            VisitedSet &visited);
+
 std::vector<nodeId_t> bfs2(const Graph &g);
 std::vector<nodeId_t> dfsPreorder2(const Graph &g);
 std::vector<nodeId_t> dfsPostorderRecursive2(const Graph &g);
@@ -87,7 +435,9 @@ std::vector<nodeId_t> dfsPostorderIterative2(const Graph &g);
 /**
  * @brief Detects if g contains a cycle. First tuple element
  * is true if a cycle is found and false otherwise. If true
- * there was a back edge fround from tuple[1] to tuple[2]
+ * there was a back edge fround from tuple[1] to tuple[2].
+ * Searches start from every node, so the whole graph is checked. To check
+ * each edge as it is added, use DagGraph instead.
  *
  * @param g
  * @return std::tuple<bool, nodeId_t, nodeId_t>
@@ -0,0 +1,213 @@
+#include "graph_bfs.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+
+namespace ry {
+namespace {
+// Frontier nodes per task in top-down steps
+constexpr std::size_t kFrontierChunk = 1024;
+// Nodes per task in bottom-up steps, a whole number of bitmap words
+constexpr std::size_t kNodeChunk = 64 * 64;
+
+std::uint64_t bit_of(std::size_t i) {
+  return std::uint64_t{1} << (i % 64);
+}
+
+bool has_bit(const std::vector<std::uint64_t> &bits, std::size_t i) {
+  return (bits[i / 64] & bit_of(i)) != 0;
+}
+
+// Atomically set bit i, returning whether this call set it
+bool claim(std::vector<std::uint64_t> &bits, std::size_t i) {
+  std::atomic_ref<std::uint64_t> word(bits[i / 64]);
+  if ((word.load(std::memory_order_relaxed) & bit_of(i)) != 0) {
+    return false;
+  }
+  return (word.fetch_or(bit_of(i), std::memory_order_relaxed) & bit_of(i)) ==
+         0;
+}
+
+// State of one search, with per-thread buffers and counters
+class Search {
+public:
+  Search(const CsrGraph &graph, const CsrGraph &transpose)
+      : fGraph(graph), fTranspose(transpose), fPool(default_thread_pool()),
+        fN(graph.numNodes()), fWords((fN + 63) / 64),
+        fLevels(fN, kUnreached), fVisited(fWords, 0), fFrontierBits(fWords),
+        fNextBits(fWords), fLocal(fPool.size()), fEdges(fPool.size()),
+        fCounts(fPool.size()) {}
+
+  std::vector<std::size_t> run(nodeIndex_t root, BfsDirection direction);
+
+private:
+  void top_down(std::size_t depth);
+  void bottom_up(std::size_t depth);
+  void to_bits();
+  void to_queue();
+  // Frontier size and out-edges, summed over threads
+  std::pair<std::size_t, std::size_t> totals();
+
+  const CsrGraph &fGraph;
+  const CsrGraph &fTranspose;
+  // Held for the whole search, so the per-thread buffers fit every loop
+  ThreadPool::Lease fPool;
+  const std::size_t fN;
+  const std::size_t fWords;
+  std::vector<std::size_t> fLevels;
+  std::vector<std::uint64_t> fVisited;
+  // The frontier is a queue in top-down steps and a bitmap in bottom-up ones
+  std::vector<nodeIndex_t> fFrontier;
+  std::vector<std::uint64_t> fFrontierBits;
+  std::vector<std::uint64_t> fNextBits;
+  std::vector<std::vector<nodeIndex_t>> fLocal;
+  std::vector<std::size_t> fEdges;
+  std::vector<std::size_t> fCounts;
+};
+
+std::vector<std::size_t> Search::run(nodeIndex_t root,
+                                     BfsDirection direction) {
+  fLevels[root] = 0;
+  fVisited[root / 64] |= bit_of(root);
+  fFrontier.assign(1, root);
+  bool bottomUp = false;
+  std::size_t frontierSize = 1;
+  std::size_t frontierEdges = fGraph.degree(root);
+  // Out-edges of unvisited nodes
+  std::size_t unexplored = fGraph.numEdges() - frontierEdges;
+  for (std::size_t depth = 1; frontierSize > 0; ++depth) {
+    bool wantBottomUp = direction == BfsDirection::BottomUp;
+    if (direction == BfsDirection::Auto) {
+      wantBottomUp =
+          bottomUp ? static_cast<double>(frontierSize) * kBfsBeta >=
+                         static_cast<double>(fN)
+                   : static_cast<double>(frontierEdges) * kBfsAlpha >
+                         static_cast<double>(unexplored);
+    }
+    if (wantBottomUp && !bottomUp) {
+      to_bits();
+    } else if (!wantBottomUp && bottomUp) {
+      to_queue();
+    }
+    bottomUp = wantBottomUp;
+    if (bottomUp) {
+      bottom_up(depth);
+    } else {
+      top_down(depth);
+    }
+    std::tie(frontierSize, frontierEdges) = totals();
+    unexplored -= frontierEdges;
+  }
+  return std::move(fLevels);
+}
+
+void Search::top_down(std::size_t depth) {
+  const std::size_t chunks = (fFrontier.size() + kFrontierChunk - 1) /
+                             kFrontierChunk;
+  fPool.parallel_for(chunks, [&](std::size_t c, std::size_t worker) {
+    auto &local = fLocal[worker];
+    const std::size_t end =
+        std::min(fFrontier.size(), (c + 1) * kFrontierChunk);
+    std::size_t edges = 0;
+    for (std::size_t f = c * kFrontierChunk; f < end; ++f) {
+      for (auto v : fGraph.neighbors(fFrontier[f])) {
+        if (claim(fVisited, v)) {
+          fLevels[v] = depth;
+          local.push_back(v);
+          edges += fGraph.degree(v);
+        }
+      }
+    }
+    fEdges[worker] += edges;
+  });
+  fFrontier.clear();
+  for (auto &local : fLocal) {
+    fFrontier.insert(fFrontier.end(), local.begin(), local.end());
+    local.clear();
+  }
+  fCounts[0] = fFrontier.size();
+}
+
+void Search::bottom_up(std::size_t depth) {
+  const std::size_t chunks = (fN + kNodeChunk - 1) / kNodeChunk;
+  fPool.parallel_for(chunks, [&](std::size_t c, std::size_t worker) {
+    const std::size_t begin = c * kNodeChunk;
+    const std::size_t end = std::min(fN, begin + kNodeChunk);
+    std::fill(fNextBits.begin() + static_cast<std::ptrdiff_t>(begin / 64),
+              fNextBits.begin() + static_cast<std::ptrdiff_t>((end + 63) / 64),
+              0);
+    std::size_t count = 0, edges = 0;
+    for (std::size_t v = begin; v < end; ++v) {
+      if (fLevels[v] != kUnreached) {
+        continue;
+      }
+      for (auto u : fTranspose.neighbors(static_cast<nodeIndex_t>(v))) {
+        if (has_bit(fFrontierBits, u)) {
+          fLevels[v] = depth;
+          fVisited[v / 64] |= bit_of(v);
+          fNextBits[v / 64] |= bit_of(v);
+          ++count;
+          edges += fGraph.degree(static_cast<nodeIndex_t>(v));
+          break;
+        }
+      }
+    }
+    fCounts[worker] += count;
+    fEdges[worker] += edges;
+  });
+  std::swap(fFrontierBits, fNextBits);
+}
+
+void Search::to_bits() {
+  std::fill(fFrontierBits.begin(), fFrontierBits.end(), 0);
+  for (auto v : fFrontier) {
+    fFrontierBits[v / 64] |= bit_of(v);
+  }
+}
+
+void Search::to_queue() {
+  fFrontier.clear();
+  for (std::size_t w = 0; w < fWords; ++w) {
+    for (auto word = fFrontierBits[w]; word != 0; word &= word - 1) {
+      fFrontier.push_back(static_cast<nodeIndex_t>(
+          w * 64 + static_cast<std::size_t>(std::countr_zero(word))));
+    }
+  }
+}
+
+std::pair<std::size_t, std::size_t> Search::totals() {
+  std::size_t count = 0, edges = 0;
+  for (std::size_t worker = 0; worker < fCounts.size(); ++worker) {
+    count += std::exchange(fCounts[worker], 0);
+    edges += std::exchange(fEdges[worker], 0);
+  }
+  return {count, edges};
+}
+} // namespace
+
+std::vector<std::size_t> parallelBfsLevels(const CsrGraph &graph,
+                                           const CsrGraph &transpose,
+                                           nodeId_t root,
+                                           BfsDirection direction) {
+  if (transpose.numNodes() != graph.numNodes() ||
+      transpose.numEdges() != graph.numEdges()) {
+    throw std::runtime_error(
+        "Transpose has " + std::to_string(transpose.numNodes()) +
+        " nodes and " + std::to_string(transpose.numEdges()) +
+        " edges but the graph has " + std::to_string(graph.numNodes()) +
+        " and " + std::to_string(graph.numEdges()));
+  }
+  return Search(graph, transpose).run(graph.indexOf(root), direction);
+}
+
+std::vector<std::size_t> parallelBfsLevels(const CsrGraph &graph,
+                                           nodeId_t root) {
+  return parallelBfsLevels(graph, graph.transpose(), root);
+}
+} // namespace ry
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "graph_csr.hpp"
+
+/**
+ * Direction-optimizing parallel BFS (Beamer, Asanovic and Patterson, 2012).
+ *
+ * A top-down step scans the out-edges of the frontier and claims unvisited
+ * nodes with an atomic OR on a visited bitmap, each thread appending what it
+ * claims to its own buffer. A bottom-up step instead scans the in-edges of
+ * every unvisited node and stops at the first parent in the frontier, which
+ * checks far fewer edges once the frontier holds a large part of the graph.
+ * Each thread owns whole words of the bitmaps there, so it needs no atomics.
+ *
+ * Steps switch to bottom-up when the frontier's out-edges exceed
+ * 1 / kBfsAlpha of the edges still to explore, and back to top-down when the
+ * frontier drops below 1 / kBfsBeta of the nodes. On low-diameter graphs the
+ * few large middle levels then run bottom-up.
+ */
+namespace ry {
+
+inline constexpr double kBfsAlpha = 15;
+inline constexpr double kBfsBeta = 18;
+
+enum class BfsDirection { Auto, TopDown, BottomUp };
+
+/**
+ * @brief BFS depth from root of every node of graph, by dense index, or
+ * kUnreached. The levels are those of bfs.
+ *
+ * @param graph
+ * @param transpose - graph.transpose(), or graph itself if it is symmetric
+ * @param root - Node id
+ * @param direction - Auto, or a fixed direction for every step
+ * @return std::vector<std::size_t>
+ */
+std::vector<std::size_t>
+parallelBfsLevels(const CsrGraph &graph, const CsrGraph &transpose,
+                  nodeId_t root, BfsDirection direction = BfsDirection::Auto);
+
+/**
+ * @brief parallelBfsLevels, building the transpose first. Reuse one
+ * transpose for several roots instead.
+ *
+ */
+std::vector<std::size_t> parallelBfsLevels(const CsrGraph &graph,
+                                           nodeId_t root);
+} // namespace ry
@@ -0,0 +1,242 @@
+#include "graph_components.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace ry {
+namespace {
+// Nodes per task
+constexpr std::size_t kNodeChunk = 1 << 14;
+// Nodes sampled to find the largest component
+constexpr std::size_t kGiantSamples = 1024;
+
+std::size_t num_chunks(std::size_t n) {
+  return (n + kNodeChunk - 1) / kNodeChunk;
+}
+
+// Call fn(i) for each i of chunk c of [0, n)
+template <typename F>
+void for_each_in_chunk(std::size_t c, std::size_t n, F fn) {
+  const std::size_t end = std::min(n, (c + 1) * kNodeChunk);
+  for (std::size_t i = c * kNodeChunk; i < end; ++i) {
+    fn(static_cast<nodeIndex_t>(i));
+  }
+}
+
+class UnionFind {
+public:
+  explicit UnionFind(std::size_t n) : fParent(n) {
+    default_thread_pool().parallel_for(
+        num_chunks(n), [&](std::size_t c, std::size_t) {
+          for_each_in_chunk(c, n, [&](nodeIndex_t i) { fParent[i] = i; });
+        });
+  }
+
+  nodeIndex_t find(nodeIndex_t x) {
+    for (;;) {
+      const auto parent = load(x);
+      if (parent == x) {
+        return x;
+      }
+      const auto grandparent = load(parent);
+      if (grandparent == parent) {
+        return parent;
+      }
+      // Only roots are ever relinked and nodes only gain ancestors, so
+      // pointing a non-root at any ancestor is safe whatever races it
+      std::atomic_ref<nodeIndex_t>(fParent[x]).store(
+          grandparent, std::memory_order_relaxed);
+      x = grandparent;
+    }
+  }
+
+  void unite(nodeIndex_t a, nodeIndex_t b) {
+    for (;;) {
+      a = find(a);
+      b = find(b);
+      if (a == b) {
+        return;
+      }
+      if (a < b) {
+        std::swap(a, b);
+      }
+      // Fails if another thread linked a meanwhile; then retry from the top
+      nodeIndex_t expected = a;
+      if (std::atomic_ref<nodeIndex_t>(fParent[a]).compare_exchange_strong(
+              expected, b, std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+
+  // Point every node at its root
+  void compress() {
+    const std::size_t n = fParent.size();
+    default_thread_pool().parallel_for(
+        num_chunks(n), [&](std::size_t c, std::size_t) {
+          for_each_in_chunk(c, n, [&](nodeIndex_t i) {
+            std::atomic_ref<nodeIndex_t>(fParent[i]).store(
+                find(i), std::memory_order_relaxed);
+          });
+        });
+  }
+
+  // Root shared by most of a sample of nodes, after compress
+  nodeIndex_t most_frequent_root() const {
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<std::size_t> pick(0, fParent.size() - 1);
+    std::unordered_map<nodeIndex_t, std::size_t> counts;
+    for (std::size_t s = 0; s < kGiantSamples; ++s) {
+      ++counts[fParent[pick(gen)]];
+    }
+    return std::max_element(counts.begin(), counts.end(),
+                            [](const auto &a, const auto &b) {
+                              return a.second < b.second;
+                            })
+        ->first;
+  }
+
+  /**
+   * @brief Number the components in order of their roots, after compress.
+   * Indices not in present, if given, are left out.
+   *
+   */
+  Components labels(const std::vector<char> &present) const {
+    const std::size_t n = fParent.size();
+    const std::size_t chunks = num_chunks(n);
+    auto isRoot = [&](nodeIndex_t i) {
+      return fParent[i] == i && (present.empty() || present[i]);
+    };
+    // Roots per chunk, then their running total
+    std::vector<std::size_t> firstLabel(chunks + 1, 0);
+    auto &pool = default_thread_pool();
+    pool.parallel_for(chunks, [&](std::size_t c, std::size_t) {
+      std::size_t roots = 0;
+      for_each_in_chunk(c, n, [&](nodeIndex_t i) { roots += isRoot(i); });
+      firstLabel[c + 1] = roots;
+    });
+    for (std::size_t c = 0; c < chunks; ++c) {
+      firstLabel[c + 1] += firstLabel[c];
+    }
+
+    Components res{std::vector<nodeIndex_t>(n, kNoComponent),
+                   firstLabel[chunks]};
+    pool.parallel_for(chunks, [&](std::size_t c, std::size_t) {
+      auto label = static_cast<nodeIndex_t>(firstLabel[c]);
+      for_each_in_chunk(c, n, [&](nodeIndex_t i) {
+        if (isRoot(i)) {
+          res.labels[i] = label++;
+        }
+      });
+    });
+    // Roots come first in their component, so their labels are all set
+    pool.parallel_for(chunks, [&](std::size_t c, std::size_t) {
+      for_each_in_chunk(c, n, [&](nodeIndex_t i) {
+        if (fParent[i] != i && (present.empty() || present[i])) {
+          res.labels[i] = res.labels[fParent[i]];
+        }
+      });
+    });
+    return res;
+  }
+
+private:
+  nodeIndex_t load(nodeIndex_t x) const {
+    return std::atomic_ref<const nodeIndex_t>(fParent[x]).load(
+        std::memory_order_relaxed);
+  }
+
+  std::vector<nodeIndex_t> fParent;
+};
+
+// Afforest over graph. Without a transpose every edge is linked.
+Components afforest(const CsrGraph &graph, const CsrGraph *transpose) {
+  const std::size_t n = graph.numNodes();
+  const std::size_t chunks = num_chunks(n);
+  auto &pool = default_thread_pool();
+  UnionFind forest(n);
+  for (std::size_t round = 0; round < kCcSampleRounds; ++round) {
+    pool.parallel_for(chunks, [&](std::size_t c, std::size_t) {
+      for_each_in_chunk(c, n, [&](nodeIndex_t u) {
+        auto neighbors = graph.neighbors(u);
+        if (round < neighbors.size()) {
+          forest.unite(u, neighbors[round]);
+        }
+      });
+    });
+  }
+  forest.compress();
+
+  // No root is kNoComponent, so without a transpose nothing is skipped
+  nodeIndex_t giant = kNoComponent;
+  if (transpose != nullptr && n > 0) {
+    giant = forest.most_frequent_root();
+  }
+  const bool symmetric = transpose == &graph;
+  pool.parallel_for(chunks, [&](std::size_t c, std::size_t) {
+    for_each_in_chunk(c, n, [&](nodeIndex_t u) {
+      if (forest.find(u) == giant) {
+        return;
+      }
+      auto neighbors = graph.neighbors(u);
+      for (std::size_t k = kCcSampleRounds; k < neighbors.size(); ++k) {
+        forest.unite(u, neighbors[k]);
+      }
+      if (transpose != nullptr && !symmetric) {
+        for (auto v : transpose->neighbors(u)) {
+          forest.unite(u, v);
+        }
+      }
+    });
+  });
+  forest.compress();
+  return forest.labels({});
+}
+} // namespace
+
+Components connectedComponents(const CsrGraph &graph,
+                               const CsrGraph &transpose) {
+  if (transpose.numNodes() != graph.numNodes() ||
+      transpose.numEdges() != graph.numEdges()) {
+    throw std::runtime_error(
+        "Transpose has " + std::to_string(transpose.numNodes()) +
+        " nodes and " + std::to_string(transpose.numEdges()) +
+        " edges but the graph has " + std::to_string(graph.numNodes()) +
+        " and " + std::to_string(graph.numEdges()));
+  }
+  return afforest(graph, &transpose);
+}
+
+Components connectedComponents(const CsrGraph &graph) {
+  return afforest(graph, nullptr);
+}
+
+Components connectedComponents(const Graph &graph) {
+  const std::size_t n = graph.denseIndexBound();
+  if (n >= kNoComponent) {
+    throw std::runtime_error("Graph has " + std::to_string(n) +
+                             " dense indices, more than components can label");
+  }
+  const auto nodes = graph.getNodes();
+  std::vector<char> present(n, 0);
+  UnionFind forest(n);
+  default_thread_pool().parallel_for(
+      num_chunks(nodes.size()), [&](std::size_t c, std::size_t) {
+        for_each_in_chunk(c, nodes.size(), [&](nodeIndex_t k) {
+          const auto u = static_cast<nodeIndex_t>(graph.denseIndex(nodes[k]));
+          present[u] = 1;
+          graph.forEachNeighborWithIndex(
+              nodes[k], [&](nodeId_t, std::size_t v) {
+                forest.unite(u, static_cast<nodeIndex_t>(v));
+              });
+        });
+      });
+  forest.compress();
+  return forest.labels(present);
+}
+} // namespace ry
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "graph_csr.hpp"
+
+/**
+ * Parallel weakly connected components with a lock-free union-find, in the
+ * style of Afforest (Sutton, Ben-Nun and Barak, 2018).
+ *
+ * Every node starts as its own tree. Linking two trees swings the root with
+ * the larger index under the other one with a compare-and-swap, and finds
+ * halve their path as they go, so threads link edges with no locks. Each root
+ * is therefore the smallest index of its component.
+ *
+ * Links start with the first kCcSampleRounds neighbors of every node, which
+ * on most graphs already joins the bulk of the nodes into one component. Given
+ * a transpose, the remaining edges of the nodes in that largest component are
+ * then skipped: any edge into or out of the rest of the graph is also the
+ * in- or out-edge of a node outside it.
+ */
+namespace ry {
+
+inline constexpr std::size_t kCcSampleRounds = 2;
+
+// Label of a dense index with no node
+inline constexpr nodeIndex_t kNoComponent = ~nodeIndex_t{0};
+
+struct Components {
+  // Component of each dense index, numbered from 0 in order of their
+  // smallest index
+  std::vector<nodeIndex_t> labels;
+  std::size_t count = 0;
+};
+
+/**
+ * @brief Weakly connected components of graph, by dense index
+ *
+ * @param graph
+ * @param transpose - graph.transpose(), or graph itself if it is symmetric
+ * @return Components
+ */
+Components connectedComponents(const CsrGraph &graph,
+                               const CsrGraph &transpose);
+
+/**
+ * @brief connectedComponents without a transpose, which links every edge.
+ * Pass a symmetric graph as its own transpose instead.
+ *
+ */
+Components connectedComponents(const CsrGraph &graph);
+
+/**
+ * @brief Weakly connected components of any graph, by graph.denseIndex.
+ * Indices with no node are labelled kNoComponent.
+ *
+ */
+Components connectedComponents(const Graph &graph);
+} // namespace ry
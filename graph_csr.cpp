@@ -0,0 +1,357 @@
+#include "graph_csr.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace ry {
+namespace {
+// Items per task when building in parallel
+constexpr std::size_t kBuildChunk = std::size_t{1} << 16;
+
+// body(begin, end) over chunks of [0, count), in parallel when there are
+// several
+template <typename F> void for_each_chunk(std::size_t count, F body) {
+  const std::size_t chunks = (count + kBuildChunk - 1) / kBuildChunk;
+  if (chunks <= 1) {
+    if (count > 0) {
+      body(std::size_t{0}, count);
+    }
+    return;
+  }
+  default_thread_pool().parallel_for(chunks, [&](std::size_t c, std::size_t) {
+    body(c * kBuildChunk, std::min(count, (c + 1) * kBuildChunk));
+  });
+}
+
+Edge endpoints(const Edge &edge) {
+  return edge;
+}
+
+Edge endpoints(const WeightedEdge &edge) {
+  return {edge.src, edge.dest};
+}
+
+nodeIndex_t checked_num_nodes(std::size_t n) {
+  // The top index is reserved for "no node"
+  if (n >= std::numeric_limits<nodeIndex_t>::max()) {
+    throw std::length_error("Graph too large for 32-bit node indices");
+  }
+  return static_cast<nodeIndex_t>(n);
+}
+
+// Sorted, distinct ids of all edge endpoints and extra nodes. Ids that are
+// dense enough are found with a flag per id rather than a sort.
+template <typename E>
+std::vector<nodeId_t> collect_node_ids(std::span<const E> edges,
+                                       std::span<const nodeId_t> nodes) {
+  nodeId_t maxId = 0;
+  for (const auto &edge : edges) {
+    auto [src, dest] = endpoints(edge);
+    maxId = std::max({maxId, src, dest});
+  }
+  for (auto node : nodes) {
+    maxId = std::max(maxId, node);
+  }
+  const std::size_t mentions = 2 * edges.size() + nodes.size();
+  std::vector<nodeId_t> res;
+  if (maxId / 4 < mentions) {
+    std::vector<char> present(maxId + 1, 0);
+    for (const auto &edge : edges) {
+      auto [src, dest] = endpoints(edge);
+      present[src] = 1;
+      present[dest] = 1;
+    }
+    for (auto node : nodes) {
+      present[node] = 1;
+    }
+    for (nodeId_t id = 0; id <= maxId; ++id) {
+      if (present[id]) {
+        res.push_back(id);
+      }
+    }
+    return res;
+  }
+  res.reserve(mentions);
+  for (const auto &edge : edges) {
+    auto [src, dest] = endpoints(edge);
+    res.push_back(src);
+    res.push_back(dest);
+  }
+  res.insert(res.end(), nodes.begin(), nodes.end());
+  std::sort(res.begin(), res.end());
+  res.erase(std::unique(res.begin(), res.end()), res.end());
+  return res;
+}
+
+using WeightedTarget = std::pair<nodeIndex_t, weight_t>;
+
+// Sort the count targets and weights of one list by target and then weight,
+// keep the lightest edge to each target at the front and return how many
+// are kept
+std::size_t sort_and_dedupe_weighted(nodeIndex_t *targets, weight_t *weights,
+                                     std::size_t count,
+                                     std::vector<WeightedTarget> &scratch) {
+  scratch.resize(count);
+  for (std::size_t k = 0; k < count; ++k) {
+    scratch[k] = {targets[k], weights[k]};
+  }
+  std::sort(scratch.begin(), scratch.end());
+  std::size_t kept = 0;
+  for (std::size_t k = 0; k < count; ++k) {
+    if (k == 0 || scratch[k].first != scratch[k - 1].first) {
+      targets[kept] = scratch[k].first;
+      weights[kept++] = scratch[k].second;
+    }
+  }
+  return kept;
+}
+
+// Sort each neighbor list and drop repeats, compacting targets and weights,
+// if any, in place
+void sort_and_dedupe(std::vector<std::size_t> &offsets,
+                     std::vector<nodeIndex_t> &targets,
+                     std::vector<weight_t> &weights) {
+  const std::size_t n = offsets.size() - 1;
+  const bool weighted = !weights.empty();
+  std::vector<std::size_t> kept(n);
+  for_each_chunk(n, [&](std::size_t begin, std::size_t end) {
+    std::vector<WeightedTarget> scratch;
+    for (std::size_t i = begin; i < end; ++i) {
+      auto first = targets.begin() + static_cast<std::ptrdiff_t>(offsets[i]);
+      auto last =
+          targets.begin() + static_cast<std::ptrdiff_t>(offsets[i + 1]);
+      if (weighted) {
+        kept[i] = sort_and_dedupe_weighted(
+            targets.data() + offsets[i], weights.data() + offsets[i],
+            offsets[i + 1] - offsets[i], scratch);
+        continue;
+      }
+      if (!std::is_sorted(first, last)) {
+        std::sort(first, last);
+      }
+      kept[i] = static_cast<std::size_t>(std::unique(first, last) - first);
+    }
+  });
+  bool repeats = false;
+  for (std::size_t i = 0; i < n && !repeats; ++i) {
+    repeats = kept[i] != offsets[i + 1] - offsets[i];
+  }
+  if (!repeats) {
+    return;
+  }
+  // Lists only move down, so copying in order never overwrites unread data
+  std::size_t dst = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const std::size_t src = offsets[i];
+    std::copy_n(targets.begin() + static_cast<std::ptrdiff_t>(src), kept[i],
+                targets.begin() + static_cast<std::ptrdiff_t>(dst));
+    if (weighted) {
+      std::copy_n(weights.begin() + static_cast<std::ptrdiff_t>(src), kept[i],
+                  weights.begin() + static_cast<std::ptrdiff_t>(dst));
+    }
+    offsets[i] = dst;
+    dst += kept[i];
+  }
+  offsets[n] = dst;
+  targets.resize(dst);
+  if (weighted) {
+    weights.resize(dst);
+  }
+}
+} // namespace
+
+CsrGraph::CsrGraph(const Graph &g) : fNodeIds(g.getNodes()) {
+  std::sort(fNodeIds.begin(), fNodeIds.end());
+  const std::size_t n = checked_num_nodes(fNodeIds.size());
+  fIdentity = n == 0 || fNodeIds.back() == n - 1;
+  fOffsets.assign(n + 1, 0);
+  for (std::size_t i = 0; i < n; ++i) {
+    g.forEachNeighbor(fNodeIds[i], [&](nodeId_t neighbor) {
+      fTargets.push_back(indexOf(neighbor));
+    });
+    fOffsets[i + 1] = fTargets.size();
+  }
+  sort_and_dedupe(fOffsets, fTargets, fWeights);
+}
+
+CsrGraph::CsrGraph(std::span<const Edge> edges,
+                   std::span<const nodeId_t> nodes)
+    : fNodeIds(collect_node_ids(edges, nodes)) {
+  build(edges);
+}
+
+CsrGraph::CsrGraph(std::span<const WeightedEdge> edges,
+                   std::span<const nodeId_t> nodes)
+    : fNodeIds(collect_node_ids(edges, nodes)), fWeighted(true) {
+  for (const auto &edge : edges) {
+    // Also false for NaN
+    if (!(edge.weight >= 0)) {
+      throw std::runtime_error("Edge from " + std::to_string(edge.src) +
+                               " to " + std::to_string(edge.dest) +
+                               " has invalid weight " +
+                               std::to_string(edge.weight));
+    }
+  }
+  build(edges);
+}
+
+template <typename E> void CsrGraph::build(std::span<const E> edges) {
+  const std::size_t n = checked_num_nodes(fNodeIds.size());
+  fIdentity = n == 0 || fNodeIds.back() == n - 1;
+  const std::size_t m = edges.size();
+
+  std::vector<nodeIndex_t> srcs(m);
+  fTargets.resize(m);
+  for_each_chunk(m, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t e = begin; e < end; ++e) {
+      auto [src, dest] = endpoints(edges[e]);
+      srcs[e] = find(src);
+      fTargets[e] = find(dest);
+    }
+  });
+
+  // Counting sort of the edges by source
+  fOffsets.assign(n + 1, 0);
+  for (auto src : srcs) {
+    ++fOffsets[src + 1];
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    fOffsets[i + 1] += fOffsets[i];
+  }
+  std::vector<std::size_t> next(fOffsets.begin(), fOffsets.end() - 1);
+  std::vector<nodeIndex_t> targets(m);
+  if constexpr (std::is_same_v<E, WeightedEdge>) {
+    fWeights.resize(m);
+    for (std::size_t e = 0; e < m; ++e) {
+      fWeights[next[srcs[e]]] = edges[e].weight;
+      targets[next[srcs[e]]++] = fTargets[e];
+    }
+  } else {
+    for (std::size_t e = 0; e < m; ++e) {
+      targets[next[srcs[e]]++] = fTargets[e];
+    }
+  }
+  fTargets = std::move(targets);
+  sort_and_dedupe(fOffsets, fTargets, fWeights);
+}
+
+CsrGraph CsrGraph::transpose() const {
+  const std::size_t n = numNodes();
+  CsrGraph res;
+  res.fNodeIds = fNodeIds;
+  res.fIdentity = fIdentity;
+  res.fWeighted = fWeighted;
+  res.fOffsets.assign(n + 1, 0);
+  res.fTargets.resize(fTargets.size());
+  res.fWeights.resize(fWeights.size());
+  for (auto dest : fTargets) {
+    ++res.fOffsets[dest + 1];
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    res.fOffsets[i + 1] += res.fOffsets[i];
+  }
+  std::vector<std::size_t> next(res.fOffsets.begin(), res.fOffsets.end() - 1);
+  // Visiting sources in order keeps each new list sorted
+  for (std::size_t src = 0; src < n; ++src) {
+    for (std::size_t e = fOffsets[src]; e < fOffsets[src + 1]; ++e) {
+      const auto dest = fTargets[e];
+      if (fWeighted) {
+        res.fWeights[next[dest]] = fWeights[e];
+      }
+      res.fTargets[next[dest]++] = static_cast<nodeIndex_t>(src);
+    }
+  }
+  return res;
+}
+
+nodeIndex_t CsrGraph::find(nodeId_t node) const {
+  if (fIdentity) {
+    return node < fNodeIds.size() ? static_cast<nodeIndex_t>(node) : kNoIndex;
+  }
+  auto it = std::lower_bound(fNodeIds.begin(), fNodeIds.end(), node);
+  if (it == fNodeIds.end() || *it != node) {
+    return kNoIndex;
+  }
+  return static_cast<nodeIndex_t>(it - fNodeIds.begin());
+}
+
+nodeIndex_t CsrGraph::indexOf(nodeId_t node) const {
+  auto index = find(node);
+  if (index == kNoIndex) {
+    throw InvalidNodeIdError("Non-existent node: " + std::to_string(node));
+  }
+  return index;
+}
+
+bool CsrGraph::isAdjacent(nodeId_t src, nodeId_t dest) const {
+  auto srcIndex = find(src), destIndex = find(dest);
+  if (srcIndex == kNoIndex || destIndex == kNoIndex) {
+    return false;
+  }
+  auto list = neighbors(srcIndex);
+  return std::binary_search(list.begin(), list.end(), destIndex);
+}
+
+std::vector<nodeId_t> CsrGraph::getNeighbors(nodeId_t node) const {
+  auto index = find(node);
+  if (index == kNoIndex) {
+    return {};
+  }
+  // Indices are in id order, so the ids come out sorted
+  std::vector<nodeId_t> res;
+  res.reserve(degree(index));
+  for (auto neighbor : neighbors(index)) {
+    res.push_back(fNodeIds[neighbor]);
+  }
+  return res;
+}
+
+void CsrGraph::visitNeighbors(nodeId_t node, NeighborVisitor visit) const {
+  auto index = find(node);
+  if (index == kNoIndex) {
+    return;
+  }
+  // Translate indices to ids through small buffers on the stack. When ids
+  // are their own indices one buffer serves as both.
+  constexpr std::size_t kBatch = 64;
+  nodeId_t ids[kBatch];
+  std::size_t indices[kBatch];
+  auto list = neighbors(index);
+  for (std::size_t begin = 0; begin < list.size(); begin += kBatch) {
+    const std::size_t count = std::min(kBatch, list.size() - begin);
+    for (std::size_t k = 0; k < count; ++k) {
+      indices[k] = list[begin + k];
+    }
+    if (fIdentity) {
+      visit(std::span<const nodeId_t>(indices, count),
+            std::span<const std::size_t>(indices, count));
+      continue;
+    }
+    for (std::size_t k = 0; k < count; ++k) {
+      ids[k] = fNodeIds[indices[k]];
+    }
+    visit(std::span<const nodeId_t>(ids, count),
+          std::span<const std::size_t>(indices, count));
+  }
+}
+
+std::vector<nodeId_t> CsrGraph::getNodes() const {
+  return fNodeIds;
+}
+
+void CsrGraph::add_node(nodeId_t) {
+  throw std::logic_error("CsrGraph is immutable");
+}
+
+void CsrGraph::remove_node(nodeId_t) {
+  throw std::logic_error("CsrGraph is immutable");
+}
+
+void CsrGraph::add_edge(nodeId_t, nodeId_t) {
+  throw std::logic_error("CsrGraph is immutable");
+}
+} // namespace ry
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "graph.hpp"
+
+/**
+ * Immutable compressed sparse row (CSR) graph. Node ids are compacted to
+ * dense indices 0..N-1 in increasing id order, and the out-neighbors of
+ * index i are the sorted range targets[offsets[i]..offsets[i + 1]). Each
+ * edge costs one 32-bit index, against a hash node per edge in
+ * AdjacencyListGraph, and a traversal reads neighbor lists contiguously.
+ */
+namespace ry {
+
+// Dense node index of a CsrGraph. 32 bits halve the edge array.
+using nodeIndex_t = std::uint32_t;
+
+// Edge weight. 32 bits keep the weight array as small as the target array.
+using weight_t = float;
+
+struct WeightedEdge {
+  nodeId_t src;
+  nodeId_t dest;
+  weight_t weight;
+};
+
+class CsrGraph : public Graph {
+public:
+  explicit CsrGraph() = default;
+
+  /**
+   * @brief Snapshot of the nodes and edges of g
+   *
+   * @param g
+   */
+  explicit CsrGraph(const Graph &g);
+
+  /**
+   * @brief Graph with the given edges. Its nodes are the edge endpoints plus
+   * any extra nodes; repeated edges are kept once.
+   *
+   * @param edges
+   * @param nodes - Extra nodes, which may be isolated
+   */
+  explicit CsrGraph(std::span<const Edge> edges,
+                    std::span<const nodeId_t> nodes = {});
+
+  /**
+   * @brief Weighted graph with the given edges. Of repeated edges the
+   * lightest is kept. Throws std::runtime_error for a negative or NaN weight.
+   *
+   * @param edges
+   * @param nodes - Extra nodes, which may be isolated
+   */
+  explicit CsrGraph(std::span<const WeightedEdge> edges,
+                    std::span<const nodeId_t> nodes = {});
+
+  virtual bool isAdjacent(nodeId_t src, nodeId_t dest) const override;
+  virtual std::vector<nodeId_t> getNeighbors(nodeId_t node) const override;
+  virtual void visitNeighbors(nodeId_t node,
+                              NeighborVisitor visit) const override;
+  virtual std::vector<nodeId_t> getNodes() const override;
+  virtual std::optional<nodeId_t> firstNode() const override {
+    if (fNodeIds.empty()) {
+      return std::nullopt;
+    }
+    return fNodeIds.front();
+  }
+  virtual std::size_t denseIndex(nodeId_t node) const override {
+    return indexOf(node);
+  }
+  virtual std::size_t denseIndexBound() const override {
+    return numNodes();
+  }
+
+  // The graph is immutable: these throw std::logic_error
+  virtual void add_node(nodeId_t node) override;
+  virtual void remove_node(nodeId_t node) override;
+  virtual void add_edge(nodeId_t src, nodeId_t dest) override;
+
+  std::size_t numNodes() const {
+    return fOffsets.size() - 1;
+  }
+  std::size_t numEdges() const {
+    return fTargets.size();
+  }
+  bool contains(nodeId_t node) const {
+    return find(node) != kNoIndex;
+  }
+
+  /**
+   * @brief Dense index of node. Throws InvalidNodeIdError if node is not in
+   * the graph.
+   *
+   */
+  nodeIndex_t indexOf(nodeId_t node) const;
+  nodeId_t nodeId(nodeIndex_t index) const {
+    return fNodeIds[index];
+  }
+
+  /**
+   * @brief Sorted dense indices of the out-neighbors of index
+   *
+   */
+  std::span<const nodeIndex_t> neighbors(nodeIndex_t index) const {
+    return {fTargets.data() + fOffsets[index],
+            fTargets.data() + fOffsets[index + 1]};
+  }
+  std::size_t degree(nodeIndex_t index) const {
+    return fOffsets[index + 1] - fOffsets[index];
+  }
+  std::span<const std::size_t> offsets() const {
+    return fOffsets;
+  }
+  std::span<const nodeIndex_t> targets() const {
+    return fTargets;
+  }
+
+  /**
+   * @brief Whether edges have weights. Edges of unweighted graphs weigh 1.
+   *
+   */
+  bool weighted() const {
+    return fWeighted;
+  }
+  /**
+   * @brief Weights of the out-edges of index, parallel to neighbors(index).
+   * Empty if the graph is unweighted.
+   *
+   */
+  std::span<const weight_t> weights(nodeIndex_t index) const {
+    if (!fWeighted) {
+      return {};
+    }
+    return {fWeights.data() + fOffsets[index],
+            fWeights.data() + fOffsets[index + 1]};
+  }
+  std::span<const weight_t> weights() const {
+    return fWeights;
+  }
+
+  /**
+   * @brief The graph with every edge reversed, on the same nodes and indices,
+   * with the same weights
+   *
+   */
+  CsrGraph transpose() const;
+
+  std::size_t memoryBytes() const {
+    return fNodeIds.size() * sizeof(nodeId_t) +
+           fOffsets.size() * sizeof(std::size_t) +
+           fTargets.size() * sizeof(nodeIndex_t) +
+           fWeights.size() * sizeof(weight_t);
+  }
+
+private:
+  static constexpr nodeIndex_t kNoIndex = ~nodeIndex_t{0};
+  nodeIndex_t find(nodeId_t node) const;
+  // Fill offsets, targets and, for WeightedEdge, weights from edges
+  template <typename E> void build(std::span<const E> edges);
+
+  // Sorted node ids; fNodeIds[i] is the id of index i
+  std::vector<nodeId_t> fNodeIds;
+  // Ids are exactly 0..N-1, so an id is its own index
+  bool fIdentity = true;
+  std::vector<std::size_t> fOffsets{0};
+  std::vector<nodeIndex_t> fTargets;
+  // Weight of each edge, parallel to fTargets, if fWeighted
+  bool fWeighted = false;
+  std::vector<weight_t> fWeights;
+};
+} // namespace ry
@@ -0,0 +1,164 @@
+#include "graph_dag.hpp"
+#include <algorithm>
+
+namespace ry {
+void DagGraph::add_node(nodeId_t node) {
+  fGraph.add_node(node);
+  const auto index = fGraph.denseIndex(node);
+  if (index >= fIds.size()) {
+    fIds.resize(index + 1);
+    fOrder.resize(index + 1, kNoOrder);
+    fPredecessors.resize(index + 1);
+    fParents.resize(index + 1);
+  }
+  if (fOrder[index] == kNoOrder) {
+    // New nodes have no edges, so the end of the order suits them
+    fIds[index] = node;
+    fOrder[index] = fNextOrder++;
+  }
+}
+
+void DagGraph::remove_node(nodeId_t node) {
+  if (!fGraph.contains(node)) {
+    return;
+  }
+  const auto index = fGraph.denseIndex(node);
+  fGraph.forEachNeighborWithIndex(node, [&](nodeId_t, std::size_t successor) {
+    auto &predecessors = fPredecessors[successor];
+    auto it = std::find(predecessors.begin(), predecessors.end(), index);
+    *it = predecessors.back();
+    predecessors.pop_back();
+  });
+  fPredecessors[index].clear();
+  fOrder[index] = kNoOrder;
+  fGraph.remove_node(node);
+}
+
+void DagGraph::add_edge(nodeId_t src, nodeId_t dest) {
+  if (!insert_edge(src, dest)) {
+    throw CycleError("Edge from " + std::to_string(src) + " to " +
+                         std::to_string(dest) + " closes a cycle",
+                     fCycle);
+  }
+}
+
+bool DagGraph::try_add_edge(nodeId_t src, nodeId_t dest) {
+  return insert_edge(src, dest);
+}
+
+bool DagGraph::insert_edge(nodeId_t src, nodeId_t dest) {
+  const auto srcIndex = fGraph.denseIndex(src);
+  const auto destIndex = fGraph.denseIndex(dest);
+  if (fGraph.isAdjacent(src, dest)) {
+    return true;
+  }
+  if (srcIndex == destIndex) {
+    fCycle.assign(1, src);
+    return false;
+  }
+  if (fOrder[destIndex] < fOrder[srcIndex]) {
+    fVisited.reset(fIds.size());
+    if (!search_forward(destIndex, srcIndex)) {
+      // Follow the search tree back from src to dest
+      fCycle.clear();
+      for (auto index = srcIndex; index != destIndex; index = fParents[index]) {
+        fCycle.push_back(fIds[index]);
+      }
+      fCycle.push_back(dest);
+      std::reverse(fCycle.begin(), fCycle.end());
+      return false;
+    }
+    search_backward(srcIndex, destIndex);
+    reorder();
+  }
+  fGraph.add_edge(src, dest);
+  fPredecessors[destIndex].push_back(srcIndex);
+  return true;
+}
+
+bool DagGraph::search_forward(std::size_t dest, std::size_t src) {
+  // Nodes after src in the order can't reach it
+  const auto bound = fOrder[src];
+  bool reached = false;
+  fForward.clear();
+  fStack.assign(1, dest);
+  fVisited.insert(dest);
+  while (!fStack.empty() && !reached) {
+    const auto u = fStack.back();
+    fStack.pop_back();
+    fForward.push_back(u);
+    fGraph.forEachNeighborWithIndex(fIds[u], [&](nodeId_t, std::size_t v) {
+      if (reached) {
+        return;
+      }
+      if (v == src) {
+        reached = true;
+        fParents[v] = u;
+      } else if (fOrder[v] < bound && fVisited.insert(v)) {
+        fParents[v] = u;
+        fStack.push_back(v);
+      }
+    });
+  }
+  return !reached;
+}
+
+void DagGraph::search_backward(std::size_t src, std::size_t dest) {
+  // Nodes before dest in the order can't be reached from it. The forward
+  // search didn't reach src, so the two searches visit disjoint nodes and
+  // can share fVisited.
+  const auto bound = fOrder[dest];
+  fBackward.clear();
+  fStack.assign(1, src);
+  fVisited.insert(src);
+  while (!fStack.empty()) {
+    const auto u = fStack.back();
+    fStack.pop_back();
+    fBackward.push_back(u);
+    for (auto v : fPredecessors[u]) {
+      if (fOrder[v] > bound && fVisited.insert(v)) {
+        fStack.push_back(v);
+      }
+    }
+  }
+}
+
+void DagGraph::reorder() {
+  auto byOrder = [this](std::size_t a, std::size_t b) {
+    return fOrder[a] < fOrder[b];
+  };
+  std::sort(fForward.begin(), fForward.end(), byOrder);
+  std::sort(fBackward.begin(), fBackward.end(), byOrder);
+  fPositions.clear();
+  for (const auto *nodes : {&fBackward, &fForward}) {
+    for (auto u : *nodes) {
+      fPositions.push_back(fOrder[u]);
+    }
+  }
+  std::sort(fPositions.begin(), fPositions.end());
+  // The nodes reaching src take the first positions, keeping their relative
+  // order, and those reached from dest the rest
+  std::size_t k = 0;
+  for (const auto *nodes : {&fBackward, &fForward}) {
+    for (auto u : *nodes) {
+      fOrder[u] = fPositions[k++];
+    }
+  }
+}
+
+std::vector<nodeId_t> DagGraph::topologicalOrder() const {
+  std::vector<std::pair<std::size_t, nodeId_t>> ordered;
+  for (std::size_t index = 0; index < fIds.size(); ++index) {
+    if (fOrder[index] != kNoOrder) {
+      ordered.emplace_back(fOrder[index], fIds[index]);
+    }
+  }
+  std::sort(ordered.begin(), ordered.end());
+  std::vector<nodeId_t> res;
+  res.reserve(ordered.size());
+  for (auto [_, node] : ordered) {
+    res.push_back(node);
+  }
+  return res;
+}
+} // namespace ry
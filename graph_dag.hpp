@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "graph.hpp"
+
+/**
+ * Directed acyclic graph that keeps a topological order as edges are added,
+ * with the algorithm of Pearce and Kelly (2006).
+ *
+ * Each node holds a position in the order, and every edge goes from a lower
+ * position to a higher one. An edge src -> dest that already agrees costs
+ * nothing more. Otherwise only the nodes positioned between dest and src can
+ * be affected: a forward search from dest and a backward one from src, both
+ * kept inside that window, either reach each other, which means the edge
+ * closes a cycle, or find the nodes to move. Those swap among their own
+ * positions, the ones reaching src first. The work depends on the affected
+ * region, not on the size of the graph.
+ */
+namespace ry {
+
+/**
+ * @brief Thrown by DagGraph::add_edge for an edge that would close a cycle
+ *
+ */
+struct CycleError {
+  CycleError(std::string message, std::vector<nodeId_t> cycle)
+      : fMessage(std::move(message)), fCycle(std::move(cycle)) {}
+  std::string what() const {
+    return fMessage;
+  }
+  /**
+   * @brief Nodes of the cycle, from dest of the rejected edge along existing
+   * edges to its src
+   *
+   */
+  const std::vector<nodeId_t> &cycle() const {
+    return fCycle;
+  }
+
+private:
+  std::string fMessage;
+  std::vector<nodeId_t> fCycle;
+};
+
+class DagGraph : public Graph {
+public:
+  explicit DagGraph() {}
+
+  virtual bool isAdjacent(nodeId_t src, nodeId_t dest) const override {
+    return fGraph.isAdjacent(src, dest);
+  }
+  virtual std::vector<nodeId_t> getNeighbors(nodeId_t node) const override {
+    return fGraph.getNeighbors(node);
+  }
+  virtual void visitNeighbors(nodeId_t node,
+                              NeighborVisitor visit) const override {
+    fGraph.visitNeighbors(node, visit);
+  }
+  virtual std::vector<nodeId_t> getNodes() const override {
+    return fGraph.getNodes();
+  }
+  virtual std::optional<nodeId_t> firstNode() const override {
+    return fGraph.firstNode();
+  }
+  virtual std::size_t denseIndex(nodeId_t node) const override {
+    return fGraph.denseIndex(node);
+  }
+  virtual std::size_t denseIndexBound() const override {
+    return fGraph.denseIndexBound();
+  }
+  virtual void add_node(nodeId_t node) override;
+  virtual void remove_node(nodeId_t node) override;
+
+  /**
+   * @brief Add an edge, keeping the order. Throws CycleError, leaving the
+   * graph unchanged, if dest already reaches src.
+   *
+   */
+  virtual void add_edge(nodeId_t src, nodeId_t dest) override;
+
+  /**
+   * @brief add_edge that returns false instead of throwing for an edge that
+   * would close a cycle
+   *
+   */
+  bool try_add_edge(nodeId_t src, nodeId_t dest);
+
+  /**
+   * @brief All nodes, each before every node it has an edge to
+   *
+   */
+  std::vector<nodeId_t> topologicalOrder() const;
+
+private:
+  // Insert src -> dest, or leave the graph unchanged and store the cycle it
+  // would close in fCycle and return false
+  bool insert_edge(nodeId_t src, nodeId_t dest);
+  // Nodes of the window reached forward from dest, or false if src is one
+  bool search_forward(std::size_t dest, std::size_t src);
+  void search_backward(std::size_t src, std::size_t dest);
+  void reorder();
+
+  static constexpr std::size_t kNoOrder = ~std::size_t{0};
+
+  AdjacencyListGraph fGraph;
+  // By dense index: id, position in the order, or kNoOrder for removed
+  // nodes, and in-neighbors
+  std::vector<nodeId_t> fIds;
+  std::vector<std::size_t> fOrder;
+  std::vector<std::vector<std::size_t>> fPredecessors;
+  std::size_t fNextOrder = 0;
+
+  // Search state, reused by every insertion
+  VisitedSet fVisited;
+  std::vector<std::size_t> fStack;
+  std::vector<std::size_t> fParents;
+  std::vector<std::size_t> fForward;
+  std::vector<std::size_t> fBackward;
+  std::vector<std::size_t> fPositions;
+  std::vector<nodeId_t> fCycle;
+};
+} // namespace ry
@@ -0,0 +1,461 @@
+#include "graph_bfs.hpp"
+#include "graph_components.hpp"
+#include "graph_paths.hpp"
+#include "graph_csr.hpp"
+#include "graph_reference.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Graph benchmark harness. Generates R-MAT or uniform random graphs, builds
+ * them as CsrGraph, and times algorithms on them; reports median/p95 time,
+ * millions of traversed edges per second (MTEPS) and speedup over the first
+ * algorithm after warmup runs; checks every result against a serial
+ * reference; and optionally writes CSV to compare versions. Run with --help
+ * for the options.
+ */
+
+namespace {
+struct Options {
+  // Graphs have 2^scale nodes
+  std::vector<std::size_t> scales{16, 18};
+  std::size_t edgeFactor = 16;
+  std::vector<std::string> graphs{"rmat"};
+  bool directed = false;
+  std::vector<std::string> algorithms{"bfs", "serial-bfs", "parallel-bfs"};
+  std::vector<std::size_t> threads;
+  std::size_t warmup = 1;
+  std::size_t reps = 5;
+  unsigned seed = 1;
+  std::string csvPath;
+  std::string label;
+};
+
+struct Result {
+  std::string graph;
+  std::size_t nodes, edges;
+  std::string algorithm;
+  std::size_t threads;
+  std::size_t reps;
+  double minSeconds, medianSeconds, p95Seconds;
+  // Edges the algorithm traverses / median time
+  double mteps;
+  // Median time of the first algorithm for the same case over this one's
+  double speedup;
+  bool passed;
+};
+
+void print_usage(const char *argv0) {
+  std::cerr
+      << "Usage " << argv0 << " [options]\n"
+      << "  --scales 16,18          Graphs have 2^scale nodes\n"
+      << "  --edge-factor N         Edges per node (default 16)\n"
+      << "  --graphs rmat,uniform   Generators (default rmat)\n"
+      << "  --directed              Keep edges one way; by default every\n"
+      << "                          edge is added in both directions\n"
+      << "  --algorithms a,b,...    bfs (ry::bfs through the Graph\n"
+      << "                          interface), serial-bfs, parallel-bfs,\n"
+      << "                          top-down, bottom-up, serial-components\n"
+      << "                          (BFS from every unlabelled node),\n"
+      << "                          components, dijkstra, delta-stepping\n"
+      << "                          (on the graph with weights in [0, 1)).\n"
+      << "                          Speedups are relative to the first.\n"
+      << "  --threads 1,2,4         Thread counts (default: current)\n"
+      << "  --warmup N              Untimed runs per case (default 1)\n"
+      << "  --reps N                Timed runs per case (default 5)\n"
+      << "  --seed N                Generator seed (default 1)\n"
+      << "  --csv FILE              Also write results to FILE\n"
+      << "  --label TEXT            Version label recorded in the CSV\n";
+}
+
+std::vector<std::string> split(const std::string &list, char sep) {
+  std::vector<std::string> res;
+  std::istringstream iss(list);
+  std::string item;
+  while (std::getline(iss, item, sep)) {
+    if (!item.empty()) {
+      res.push_back(item);
+    }
+  }
+  return res;
+}
+
+std::optional<Options> parse_options(int argc, char *argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--directed") {
+      opts.directed = true;
+      continue;
+    }
+    if (arg == "--help" || i + 1 == argc) {
+      return std::nullopt;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--scales") {
+      opts.scales.clear();
+      for (const auto &scale : split(value, ',')) {
+        opts.scales.push_back(std::stoull(scale));
+      }
+    } else if (arg == "--edge-factor") {
+      opts.edgeFactor = std::stoull(value);
+    } else if (arg == "--graphs") {
+      opts.graphs = split(value, ',');
+      for (const auto &graph : opts.graphs) {
+        if (graph != "rmat" && graph != "uniform") {
+          throw std::runtime_error("Unknown graph " + graph);
+        }
+      }
+    } else if (arg == "--algorithms") {
+      opts.algorithms = split(value, ',');
+      for (const auto &name : opts.algorithms) {
+        const bool known = name == "bfs" || name == "serial-bfs" ||
+                           name == "parallel-bfs" || name == "top-down" ||
+                           name == "bottom-up" ||
+                           name == "serial-components" ||
+                           name == "components" || name == "dijkstra" ||
+                           name == "delta-stepping";
+        if (!known) {
+          throw std::runtime_error("Unknown algorithm " + name);
+        }
+      }
+    } else if (arg == "--threads") {
+      opts.threads.clear();
+      for (const auto &threads : split(value, ',')) {
+        opts.threads.push_back(std::stoull(threads));
+      }
+    } else if (arg == "--warmup") {
+      opts.warmup = std::stoull(value);
+    } else if (arg == "--reps") {
+      opts.reps = std::max<std::size_t>(1, std::stoull(value));
+    } else if (arg == "--seed") {
+      opts.seed = static_cast<unsigned>(std::stoul(value));
+    } else if (arg == "--csv") {
+      opts.csvPath = value;
+    } else if (arg == "--label") {
+      opts.label = value;
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (opts.threads.empty()) {
+    opts.threads.push_back(ry::get_num_threads());
+  }
+  return opts;
+}
+
+// R-MAT edges (Chakrabarti, Zhan and Faloutsos) with the Graph500
+// probabilities, or uniform ones, over 2^scale nodes. Node labels are
+// shuffled so that degree doesn't follow the id.
+std::vector<ry::Edge> generate_edges(const std::string &kind,
+                                     std::size_t scale, std::size_t count,
+                                     std::mt19937_64 &gen) {
+  const ry::nodeId_t n = ry::nodeId_t{1} << scale;
+  std::vector<ry::Edge> res(count);
+  if (kind == "uniform") {
+    std::uniform_int_distribution<ry::nodeId_t> id(0, n - 1);
+    for (auto &edge : res) {
+      edge = {id(gen), id(gen)};
+    }
+    return res;
+  }
+  std::uniform_real_distribution<double> coin(0, 1);
+  std::vector<ry::nodeId_t> label(n);
+  for (ry::nodeId_t node = 0; node < n; ++node) {
+    label[node] = node;
+  }
+  std::shuffle(label.begin(), label.end(), gen);
+  for (auto &edge : res) {
+    ry::nodeId_t src = 0, dest = 0;
+    for (std::size_t level = 0; level < scale; ++level) {
+      const double r = coin(gen);
+      src = 2 * src + (r >= 0.57 + 0.19);
+      dest = 2 * dest + (r >= 0.57 && r < 0.57 + 0.19) + (r >= 0.95);
+    }
+    edge = {label[src], label[dest]};
+  }
+  return res;
+}
+
+// A generated graph and the serial reference results for it
+struct Case {
+  std::string graph;
+  std::shared_ptr<const ry::CsrGraph> g;
+  std::shared_ptr<const ry::CsrGraph> transpose;
+  // Id 0 is relabelled to be a node with edges, so ry::bfs starts there too
+  ry::nodeId_t root = 0;
+  std::vector<std::size_t> levels;
+  // Out-edges of the nodes reachable from root
+  std::size_t reachedEdges = 0;
+  // Weakly connected component labels, if a components algorithm runs
+  std::vector<ry::nodeIndex_t> components;
+  // The graph with random weights and Dijkstra's distances from root, if a
+  // shortest path algorithm runs
+  std::shared_ptr<const ry::CsrGraph> weighted;
+  std::vector<double> distances;
+};
+
+bool is_shortest_path(const std::string &name) {
+  return name == "dijkstra" || name == "delta-stepping";
+}
+
+Case make_case(const Options &opts, const std::string &kind,
+               std::size_t scale) {
+  std::mt19937_64 gen(opts.seed * 1000003ull + scale);
+  const ry::nodeId_t n = ry::nodeId_t{1} << scale;
+  auto edges = generate_edges(kind, scale, n * opts.edgeFactor, gen);
+  // Swap the labels of 0 and the source of the first edge
+  const ry::nodeId_t start = edges.empty() ? 0 : edges.front().first;
+  for (auto &[src, dest] : edges) {
+    for (auto *node : {&src, &dest}) {
+      *node = *node == start ? 0 : *node == 0 ? start : *node;
+    }
+  }
+  if (!opts.directed) {
+    const std::size_t count = edges.size();
+    for (std::size_t e = 0; e < count; ++e) {
+      edges.emplace_back(edges[e].second, edges[e].first);
+    }
+  }
+  std::vector<ry::nodeId_t> nodes(n);
+  for (ry::nodeId_t node = 0; node < n; ++node) {
+    nodes[node] = node;
+  }
+
+  Case res;
+  res.graph = kind + (opts.directed ? "-directed" : "");
+  res.g = std::make_shared<const ry::CsrGraph>(edges, nodes);
+  res.transpose = opts.directed
+                      ? std::make_shared<const ry::CsrGraph>(
+                            res.g->transpose())
+                      : res.g;
+  res.levels = ry::reference::bfs_levels(*res.g, res.root);
+  for (std::size_t i = 0; i < res.levels.size(); ++i) {
+    if (res.levels[i] != ry::kUnreached) {
+      res.reachedEdges += res.g->degree(static_cast<ry::nodeIndex_t>(i));
+    }
+  }
+  for (const auto &name : opts.algorithms) {
+    if (name.ends_with("components") && res.components.empty()) {
+      res.components = ry::reference::components(*res.g, *res.transpose);
+    }
+    if (is_shortest_path(name) && !res.weighted) {
+      // Weights in [0, 1) as in Graph500 SSSP, the same both ways along an
+      // undirected edge
+      std::uniform_real_distribution<ry::weight_t> weight(0, 1);
+      const std::size_t generated =
+          opts.directed ? edges.size() : edges.size() / 2;
+      std::vector<ry::WeightedEdge> weighted(edges.size());
+      for (std::size_t e = 0; e < edges.size(); ++e) {
+        const auto w =
+            e < generated ? weight(gen) : weighted[e - generated].weight;
+        weighted[e] = {edges[e].first, edges[e].second, w};
+      }
+      res.weighted = std::make_shared<const ry::CsrGraph>(weighted, nodes);
+      res.distances = ry::dijkstra(*res.weighted, res.root);
+    }
+  }
+  return res;
+}
+
+// An algorithm set up to run on one case. run is timed; check is not.
+struct PreparedAlgorithm {
+  std::function<void()> run;
+  std::function<bool()> check;
+  std::size_t edges;
+};
+
+PreparedAlgorithm prepare_algorithm(const std::string &name, const Case &c) {
+  const auto &g = *c.g;
+  if (name == "bfs") {
+    auto order = std::make_shared<std::vector<ry::nodeId_t>>();
+    return {[&g, order] { *order = ry::bfs(g); },
+            [&c, order] {
+              // Every reachable node once, in order of level
+              std::size_t reached = 0, previous = 0;
+              for (auto level : c.levels) {
+                reached += level != ry::kUnreached;
+              }
+              bool ordered = order->size() == reached;
+              for (auto node : *order) {
+                const auto level = c.levels[c.g->indexOf(node)];
+                ordered = ordered && level != ry::kUnreached &&
+                          level >= previous;
+                previous = level;
+              }
+              return ordered;
+            },
+            c.reachedEdges};
+  }
+  if (is_shortest_path(name)) {
+    auto distances = std::make_shared<std::vector<double>>();
+    auto check = [&c, distances] { return *distances == c.distances; };
+    if (name == "dijkstra") {
+      return {[&c, distances] {
+                *distances = ry::dijkstra(*c.weighted, c.root);
+              },
+              check, c.reachedEdges};
+    }
+    return {[&c, distances] {
+              *distances = ry::deltaStepping(*c.weighted, c.root);
+            },
+            check, c.reachedEdges};
+  }
+  if (name.ends_with("components")) {
+    auto labels = std::make_shared<std::vector<ry::nodeIndex_t>>();
+    auto check = [&c, labels] { return *labels == c.components; };
+    if (name == "serial-components") {
+      return {[&c, labels] {
+                *labels = ry::reference::components(*c.g, *c.transpose);
+              },
+              check, g.numEdges()};
+    }
+    return {[&c, labels] {
+              *labels = ry::connectedComponents(*c.g, *c.transpose).labels;
+            },
+            check, g.numEdges()};
+  }
+  auto levels = std::make_shared<std::vector<std::size_t>>();
+  auto check = [&c, levels] { return *levels == c.levels; };
+  if (name == "serial-bfs") {
+    return {[&c, levels] { *levels = ry::reference::bfs_levels(*c.g, c.root); },
+            check, c.reachedEdges};
+  }
+  const auto direction = name == "top-down"    ? ry::BfsDirection::TopDown
+                         : name == "bottom-up" ? ry::BfsDirection::BottomUp
+                                               : ry::BfsDirection::Auto;
+  return {[&c, levels, direction] {
+            *levels =
+                ry::parallelBfsLevels(*c.g, *c.transpose, c.root, direction);
+          },
+          check, c.reachedEdges};
+}
+
+Result run_algorithm(const Options &opts, const Case &c,
+                     const std::string &name, std::size_t threads) {
+  auto algorithm = prepare_algorithm(name, c);
+  for (std::size_t rep = 0; rep < opts.warmup; ++rep) {
+    algorithm.run();
+  }
+  std::vector<double> seconds;
+  for (std::size_t rep = 0; rep < opts.reps; ++rep) {
+    auto start = std::chrono::steady_clock::now();
+    algorithm.run();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    seconds.push_back(elapsed.count());
+  }
+  std::sort(seconds.begin(), seconds.end());
+  // Nearest-rank percentiles
+  auto percentile = [&seconds](double p) {
+    auto rank = static_cast<std::size_t>(std::ceil(p * seconds.size()));
+    return seconds[std::clamp<std::size_t>(rank, 1, seconds.size()) - 1];
+  };
+
+  Result res{c.graph, c.g->numNodes(), c.g->numEdges(), name, threads,
+             opts.reps};
+  res.minSeconds = seconds.front();
+  res.medianSeconds = percentile(0.5);
+  res.p95Seconds = percentile(0.95);
+  res.mteps = static_cast<double>(algorithm.edges) / res.medianSeconds / 1e6;
+  res.speedup = 1;
+  res.passed = algorithm.check();
+  return res;
+}
+
+void print_header() {
+  std::cout << std::left << std::setw(16) << "graph" << std::right
+            << std::setw(10) << "nodes" << std::setw(11) << "edges" << "  "
+            << std::left << std::setw(18) << "algorithm" << std::right
+            << std::setw(8) << "threads" << std::setw(11) << "median_ms"
+            << std::setw(11) << "p95_ms" << std::setw(9) << "MTEPS"
+            << std::setw(9) << "speedup" << "  check\n";
+}
+
+void print_result(const Result &r) {
+  std::cout << std::left << std::setw(16) << r.graph << std::right
+            << std::setw(10) << r.nodes << std::setw(11) << r.edges << "  "
+            << std::left << std::setw(18) << r.algorithm << std::right
+            << std::setw(8) << r.threads << std::fixed << std::setprecision(3)
+            << std::setw(11) << r.medianSeconds * 1e3 << std::setw(11)
+            << r.p95Seconds * 1e3 << std::setprecision(1) << std::setw(9)
+            << r.mteps << std::setprecision(2) << std::setw(9) << r.speedup
+            << std::defaultfloat << "  " << (r.passed ? "ok" : "FAIL")
+            << std::endl;
+}
+
+void write_csv(const std::string &path, const Options &opts,
+               const std::vector<Result> &results) {
+  std::ofstream out(path);
+  out << "label,graph,nodes,edges,algorithm,threads,reps,min_s,median_s,"
+         "p95_s,mteps,speedup,passed\n";
+  out << std::setprecision(9);
+  for (const auto &r : results) {
+    out << opts.label << "," << r.graph << "," << r.nodes << "," << r.edges
+        << "," << r.algorithm << "," << r.threads << "," << r.reps << ","
+        << r.minSeconds << "," << r.medianSeconds << "," << r.p95Seconds
+        << "," << r.mteps << "," << r.speedup << ","
+        << (r.passed ? "true" : "false") << "\n";
+  }
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::optional<Options> opts;
+  try {
+    opts = parse_options(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+  }
+  if (!opts) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::cout << "edge factor " << opts->edgeFactor << ", warmup "
+            << opts->warmup << ", reps " << opts->reps << "\n";
+  print_header();
+  std::vector<Result> results;
+  try {
+    for (const auto &kind : opts->graphs) {
+      for (auto scale : opts->scales) {
+        const auto c = make_case(*opts, kind, scale);
+        for (auto threads : opts->threads) {
+          ry::set_num_threads(threads);
+          std::optional<double> baseline;
+          for (const auto &name : opts->algorithms) {
+            auto res = run_algorithm(*opts, c, name, threads);
+            if (!baseline) {
+              baseline = res.medianSeconds;
+            }
+            res.speedup = *baseline / res.medianSeconds;
+            print_result(res);
+            results.push_back(res);
+          }
+        }
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  if (!opts->csvPath.empty()) {
+    write_csv(opts->csvPath, *opts, results);
+  }
+  const bool allPassed = std::all_of(results.begin(), results.end(),
+                                     [](const Result &r) { return r.passed; });
+  return allPassed ? 0 : 2;
+}
@@ -0,0 +1,241 @@
+#include "graph_paths.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace ry {
+namespace {
+// Frontier nodes per task in delta-stepping
+constexpr std::size_t kFrontierChunk = 256;
+
+// Call fn(neighbor, weight) for each out-edge of u
+template <typename F>
+void for_each_edge(const CsrGraph &graph, nodeIndex_t u, F fn) {
+  auto targets = graph.neighbors(u);
+  auto weights = graph.weights(u);
+  if (weights.empty()) {
+    for (auto v : targets) {
+      fn(v, 1.0);
+    }
+    return;
+  }
+  for (std::size_t k = 0; k < targets.size(); ++k) {
+    fn(targets[k], static_cast<double>(weights[k]));
+  }
+}
+
+// Atomically lower slot to value, returning whether this call lowered it
+bool lower(double &slot, double value) {
+  std::atomic_ref<double> distance(slot);
+  double current = distance.load(std::memory_order_relaxed);
+  while (value < current) {
+    if (distance.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Largest weight over average degree, a bucket about one edge of a typical
+// node wide
+double default_delta(const CsrGraph &graph) {
+  if (!graph.weighted() || graph.numEdges() == 0) {
+    return 1;
+  }
+  const auto weights = graph.weights();
+  const double maxWeight = *std::max_element(weights.begin(), weights.end());
+  const double degree = static_cast<double>(graph.numEdges()) /
+                        static_cast<double>(graph.numNodes());
+  const double delta = maxWeight / std::max(1.0, degree);
+  return delta > 0 ? delta : 1;
+}
+} // namespace
+
+void RadixHeap::clear() {
+  for (auto &bucket : fBuckets) {
+    bucket.clear();
+  }
+  fLast = 0;
+  fSize = 0;
+}
+
+RadixHeap::Entry RadixHeap::pop() {
+  if (fBuckets[0].empty()) {
+    std::size_t i = 1;
+    while (fBuckets[i].empty()) {
+      ++i;
+    }
+    auto &source = fBuckets[i];
+    fLast = std::min_element(source.begin(), source.end(),
+                             [](const Entry &a, const Entry &b) {
+                               return a.distance < b.distance;
+                             })
+                ->distance;
+    // Every entry now differs from fLast in a lower bit than i
+    for (const auto &entry : source) {
+      fBuckets[bucket(entry.distance)].push_back(entry);
+    }
+    source.clear();
+  }
+  const auto res = fBuckets[0].back();
+  fBuckets[0].pop_back();
+  --fSize;
+  return res;
+}
+
+std::vector<double> dijkstra(const CsrGraph &graph, nodeId_t source) {
+  std::vector<double> res(graph.numNodes(), kNoPath);
+  RadixHeap heap;
+  const auto root = graph.indexOf(source);
+  res[root] = 0;
+  heap.push(0, root);
+  while (!heap.empty()) {
+    const auto [distance, u] = heap.pop();
+    if (distance > res[u]) {
+      continue;
+    }
+    for_each_edge(graph, u, [&](nodeIndex_t v, double weight) {
+      if (distance + weight < res[v]) {
+        res[v] = distance + weight;
+        heap.push(res[v], v);
+      }
+    });
+  }
+  return res;
+}
+
+std::vector<double> deltaStepping(const CsrGraph &graph, nodeId_t source,
+                                  double delta) {
+  if (!(delta >= 0)) {
+    throw std::runtime_error("Invalid delta " + std::to_string(delta));
+  }
+  if (delta == 0) {
+    delta = default_delta(graph);
+  }
+  std::vector<double> res(graph.numNodes(), kNoPath);
+  const auto root = graph.indexOf(source);
+  res[root] = 0;
+  // Leased so that the pool keeps the size bins was made for
+  ThreadPool::Lease pool(default_thread_pool());
+  // bins[worker][b] holds nodes the worker lowered into bucket b
+  std::vector<std::vector<std::vector<nodeIndex_t>>> bins(pool.size());
+  std::vector<nodeIndex_t> frontier{root};
+  std::size_t bucket = 0;
+  while (!frontier.empty()) {
+    const double bucketStart = delta * static_cast<double>(bucket);
+    const std::size_t chunks =
+        (frontier.size() + kFrontierChunk - 1) / kFrontierChunk;
+    pool.parallel_for(chunks, [&](std::size_t c, std::size_t worker) {
+      auto &local = bins[worker];
+      const std::size_t end =
+          std::min(frontier.size(), (c + 1) * kFrontierChunk);
+      for (std::size_t f = c * kFrontierChunk; f < end; ++f) {
+        const auto u = frontier[f];
+        const double distance =
+            std::atomic_ref<double>(res[u]).load(std::memory_order_relaxed);
+        // Nodes lowered into an earlier bucket since they were filed here
+        // have been relaxed already
+        if (distance < bucketStart) {
+          continue;
+        }
+        for_each_edge(graph, u, [&](nodeIndex_t v, double weight) {
+          const double candidate = distance + weight;
+          if (lower(res[v], candidate)) {
+            // Clamped in case rounding puts a node at the start of this
+            // bucket into the previous one
+            const auto b = std::max(
+                bucket, static_cast<std::size_t>(candidate / delta));
+            if (b >= local.size()) {
+              local.resize(b + 1);
+            }
+            local[b].push_back(v);
+          }
+        });
+      }
+    });
+
+    // Relaxing never lowers a node below the current bucket, so the next
+    // nonempty bucket is this one or later
+    std::size_t next = SIZE_MAX;
+    for (const auto &local : bins) {
+      for (std::size_t b = bucket; b < std::min(next, local.size()); ++b) {
+        if (!local[b].empty()) {
+          next = b;
+          break;
+        }
+      }
+    }
+    frontier.clear();
+    if (next == SIZE_MAX) {
+      break;
+    }
+    for (auto &local : bins) {
+      if (next < local.size()) {
+        frontier.insert(frontier.end(), local[next].begin(),
+                        local[next].end());
+        local[next].clear();
+      }
+    }
+    bucket = next;
+  }
+  return res;
+}
+
+ShortestPathQuery::ShortestPathQuery(const CsrGraph &graph)
+    : fGraph(graph), fDistances(graph.numNodes()),
+      fParents(graph.numNodes()) {}
+
+bool ShortestPathQuery::search(nodeIndex_t source, nodeIndex_t target) {
+  fReached.reset(fGraph.numNodes());
+  fHeap.clear();
+  fReached.insert(source);
+  fDistances[source] = 0;
+  fParents[source] = source;
+  fHeap.push(0, source);
+  while (!fHeap.empty()) {
+    const auto [distance, u] = fHeap.pop();
+    if (distance > fDistances[u]) {
+      continue;
+    }
+    if (u == target) {
+      return true;
+    }
+    for_each_edge(fGraph, u, [&](nodeIndex_t v, double weight) {
+      if (fReached.insert(v) || distance + weight < fDistances[v]) {
+        fDistances[v] = distance + weight;
+        fParents[v] = u;
+        fHeap.push(fDistances[v], v);
+      }
+    });
+  }
+  return false;
+}
+
+double ShortestPathQuery::distance(nodeId_t source, nodeId_t target) {
+  const auto targetIndex = fGraph.indexOf(target);
+  return search(fGraph.indexOf(source), targetIndex)
+             ? fDistances[targetIndex]
+             : kNoPath;
+}
+
+std::vector<nodeId_t> ShortestPathQuery::path(nodeId_t source,
+                                              nodeId_t target) {
+  const auto sourceIndex = fGraph.indexOf(source);
+  auto index = fGraph.indexOf(target);
+  std::vector<nodeId_t> res;
+  if (!search(sourceIndex, index)) {
+    return res;
+  }
+  res.push_back(fGraph.nodeId(index));
+  while (index != sourceIndex) {
+    index = fParents[index];
+    res.push_back(fGraph.nodeId(index));
+  }
+  std::reverse(res.begin(), res.end());
+  return res;
+}
+} // namespace ry
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "graph_csr.hpp"
+
+/**
+ * Single-source shortest paths over weighted CsrGraphs, where the edges of
+ * unweighted graphs weigh 1.
+ *
+ * Dijkstra's algorithm keeps its queue in a RadixHeap. Nodes are pushed again
+ * when their distance drops instead of being moved, and stale entries are
+ * skipped when popped.
+ *
+ * Delta-stepping (Meyer and Sanders, 2003) settles nodes in buckets of
+ * distance width delta, relaxing the edges of a whole bucket in parallel.
+ * Distances drop with an atomic compare-and-swap, and each thread files the
+ * nodes it improves in its own buckets, as in the GAP benchmark suite.
+ * Small deltas approach Dijkstra's order and large ones Bellman-Ford's
+ * parallelism.
+ */
+namespace ry {
+
+// Distance of nodes that can't be reached
+inline constexpr double kNoPath = std::numeric_limits<double>::infinity();
+
+/**
+ * @brief Monotone priority queue of (distance, node) entries, which only
+ * accepts distances no smaller than the last one popped, as in Dijkstra's
+ * algorithm (Ahuja, Mehlhorn, Orlin and Tarjan, 1990).
+ *
+ * Non-negative doubles order like their bit patterns, so entries are filed
+ * by the highest bit where their pattern differs from the last popped one.
+ * Pops take from bucket 0 and, when it is empty, refile the next nonempty
+ * bucket around its minimum. Each entry moves down at most 64 buckets, and
+ * every move appends to a plain vector rather than sifting through a heap.
+ */
+class RadixHeap {
+public:
+  struct Entry {
+    double distance;
+    nodeIndex_t node;
+  };
+
+  bool empty() const {
+    return fSize == 0;
+  }
+  void clear();
+  void push(double distance, nodeIndex_t node) {
+    fBuckets[bucket(distance)].push_back({distance, node});
+    ++fSize;
+  }
+  Entry pop();
+
+private:
+  static std::uint64_t bits(double distance) {
+    return std::bit_cast<std::uint64_t>(distance);
+  }
+  std::size_t bucket(double distance) const {
+    return static_cast<std::size_t>(
+        std::bit_width(bits(distance) ^ bits(fLast)));
+  }
+
+  std::vector<Entry> fBuckets[65];
+  double fLast = 0;
+  std::size_t fSize = 0;
+};
+
+/**
+ * @brief Distance from source of every node of graph, by dense index, or
+ * kNoPath
+ *
+ * @param graph
+ * @param source - Node id
+ * @return std::vector<double>
+ */
+std::vector<double> dijkstra(const CsrGraph &graph, nodeId_t source);
+
+/**
+ * @brief The distances of dijkstra, computed in parallel
+ *
+ * @param graph
+ * @param source - Node id
+ * @param delta - Bucket width, or 0 to pick one from the average degree and
+ * the largest weight
+ * @return std::vector<double>
+ */
+std::vector<double> deltaStepping(const CsrGraph &graph, nodeId_t source,
+                                  double delta = 0);
+
+/**
+ * @brief Point-to-point shortest path queries on one graph. Each query runs
+ * Dijkstra only until the target is settled. The search state is kept
+ * between queries and its visited set clears in O(1), so a query costs what
+ * it explores rather than the size of the graph.
+ *
+ */
+class ShortestPathQuery {
+public:
+  explicit ShortestPathQuery(const CsrGraph &graph);
+
+  /**
+   * @brief Length of a shortest path from source to target, or kNoPath.
+   * Throws InvalidNodeIdError for unknown nodes.
+   *
+   */
+  double distance(nodeId_t source, nodeId_t target);
+
+  /**
+   * @brief Node ids of a shortest path from source to target, including
+   * both, or an empty vector if there is none
+   *
+   */
+  std::vector<nodeId_t> path(nodeId_t source, nodeId_t target);
+
+private:
+  // Search from source until target is settled, returning whether it was
+  // reached
+  bool search(nodeIndex_t source, nodeIndex_t target);
+
+  const CsrGraph &fGraph;
+  // Distance and parent of each index, valid for those in fReached
+  std::vector<double> fDistances;
+  std::vector<nodeIndex_t> fParents;
+  VisitedSet fReached;
+  RadixHeap fHeap;
+};
+} // namespace ry
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "graph_components.hpp"
+#include "graph_csr.hpp"
+
+/**
+ * Graph generators and plain serial algorithms that the tests and the graph
+ * benchmark check the parallel algorithms against. They favour being
+ * obviously right over being fast.
+ */
+namespace ry::reference {
+
+/**
+ * @brief m random edges over ids below n, which may repeat or be loops.
+ * Acyclic edges only go from smaller to larger ids.
+ *
+ */
+inline std::vector<Edge> random_edges(nodeId_t n, std::size_t m, unsigned seed,
+                                      bool acyclic = false) {
+  std::mt19937_64 gen(seed);
+  std::uniform_int_distribution<nodeId_t> id(0, n - 1);
+  std::vector<Edge> res;
+  res.reserve(m);
+  while (res.size() < m) {
+    auto src = id(gen);
+    auto dest = id(gen);
+    if (acyclic && src >= dest) {
+      continue;
+    }
+    res.emplace_back(src, dest);
+  }
+  return res;
+}
+
+/**
+ * @brief random_edges plus a 300-node path from n that node 0 leads into, so
+ * BFS has both wide and narrow levels, and the isolated nodes n + 1000 and
+ * n + 1001. Symmetric graphs have every edge both ways.
+ *
+ */
+inline CsrGraph random_graph(std::size_t n, std::size_t m, bool symmetric,
+                             unsigned seed) {
+  auto edges = random_edges(n, m, seed);
+  for (nodeId_t node = 0; node < 300; ++node) {
+    edges.emplace_back(node + n, node + n + 1);
+  }
+  edges.emplace_back(0, n);
+  if (symmetric) {
+    for (std::size_t e = 0, count = edges.size(); e < count; ++e) {
+      edges.emplace_back(edges[e].second, edges[e].first);
+    }
+  }
+  std::vector<nodeId_t> isolated{n + 1000, n + 1001};
+  return CsrGraph(edges, isolated);
+}
+
+/**
+ * @brief random_edges with integer weights in [0, 100], so every order of
+ * summing them agrees, and the isolated nodes n + 1000 and n + 1001
+ *
+ */
+inline CsrGraph random_weighted_graph(std::size_t n, std::size_t m,
+                                      unsigned seed) {
+  // Weights come from their own stream, not the one that drew the ids
+  std::mt19937_64 gen(~seed);
+  std::uniform_int_distribution<int> weight(0, 100);
+  std::vector<WeightedEdge> edges;
+  for (auto [src, dest] : random_edges(n, m, seed)) {
+    edges.push_back({src, dest, static_cast<weight_t>(weight(gen))});
+  }
+  std::vector<nodeId_t> isolated{n + 1000, n + 1001};
+  return CsrGraph(edges, isolated);
+}
+
+/**
+ * @brief BFS level of each dense index from root, by a queue BFS.
+ * Unreachable indices are kUnreached.
+ *
+ */
+inline std::vector<std::size_t> bfs_levels(const CsrGraph &g, nodeId_t root) {
+  std::vector<std::size_t> res(g.numNodes(), kUnreached);
+  std::vector<nodeIndex_t> work{g.indexOf(root)};
+  res[work.front()] = 0;
+  for (std::size_t head = 0; head < work.size(); ++head) {
+    const auto u = work[head];
+    for (auto v : g.neighbors(u)) {
+      if (res[v] == kUnreached) {
+        res[v] = res[u] + 1;
+        work.push_back(v);
+      }
+    }
+  }
+  return res;
+}
+
+/**
+ * @brief Weakly connected component labels, numbered in order of their
+ * smallest index, by BFS over out- and in-edges from each node not yet
+ * labelled
+ *
+ */
+inline std::vector<nodeIndex_t> components(const CsrGraph &g,
+                                           const CsrGraph &transpose) {
+  std::vector<nodeIndex_t> res(g.numNodes(), kNoComponent);
+  std::vector<nodeIndex_t> work;
+  nodeIndex_t count = 0;
+  for (nodeIndex_t root = 0; root < g.numNodes(); ++root) {
+    if (res[root] != kNoComponent) {
+      continue;
+    }
+    res[root] = count;
+    work.assign(1, root);
+    for (std::size_t head = 0; head < work.size(); ++head) {
+      const auto u = work[head];
+      for (const auto *graph : {&g, &transpose}) {
+        for (auto v : graph->neighbors(u)) {
+          if (res[v] == kNoComponent) {
+            res[v] = count;
+            work.push_back(v);
+          }
+        }
+      }
+    }
+    ++count;
+  }
+  return res;
+}
+
+} // namespace ry::reference
@@ -0,0 +1,151 @@
+#include "graph_scc.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace ry {
+namespace {
+// Nodes per task
+constexpr std::size_t kNodeChunk = 1 << 14;
+// Level nodes per task
+constexpr std::size_t kLevelChunk = 1024;
+
+std::size_t num_chunks(std::size_t n, std::size_t chunk) {
+  return (n + chunk - 1) / chunk;
+}
+} // namespace
+
+Components stronglyConnectedComponents(const CsrGraph &graph) {
+  const std::size_t n = graph.numNodes();
+  const auto offsets = graph.offsets();
+  const auto targets = graph.targets();
+  Components res{std::vector<nodeIndex_t>(n, kNoComponent), 0};
+  // Discovery time and lowest discovery time reachable through the DFS tree
+  // and one more edge. A node is on Tarjan's stack while it has a time and
+  // no label.
+  std::vector<nodeIndex_t> time(n, kNoComponent), low(n);
+  std::vector<nodeIndex_t> stack;
+  // DFS frames {node, next edge}
+  std::vector<std::pair<nodeIndex_t, std::size_t>> frames;
+  nodeIndex_t clock = 0;
+  auto discover = [&](nodeIndex_t u) {
+    time[u] = low[u] = clock++;
+    stack.push_back(u);
+    frames.emplace_back(u, offsets[u]);
+  };
+
+  for (nodeIndex_t root = 0; root < n; ++root) {
+    if (time[root] != kNoComponent) {
+      continue;
+    }
+    discover(root);
+    while (!frames.empty()) {
+      auto &[u, next] = frames.back();
+      if (next < offsets[u + 1]) {
+        const auto v = targets[next++];
+        if (time[v] == kNoComponent) {
+          // Invalidates u and next
+          discover(v);
+        } else if (res.labels[v] == kNoComponent) {
+          low[u] = std::min(low[u], time[v]);
+        }
+        continue;
+      }
+      const auto done = u;
+      frames.pop_back();
+      if (low[done] == time[done]) {
+        // done is the first node of its component, and the rest are above it
+        const auto label = static_cast<nodeIndex_t>(res.count++);
+        nodeIndex_t member;
+        do {
+          member = stack.back();
+          stack.pop_back();
+          res.labels[member] = label;
+        } while (member != done);
+      }
+      if (!frames.empty()) {
+        auto &parent = frames.back().first;
+        low[parent] = std::min(low[parent], low[done]);
+      }
+    }
+  }
+  return res;
+}
+
+Components stronglyConnectedComponents(const Graph &graph) {
+  // Tarjan resumes each node's edges where it left them, which needs the
+  // random access of a CSR snapshot
+  const CsrGraph csr(graph);
+  const auto components = stronglyConnectedComponents(csr);
+  Components res{
+      std::vector<nodeIndex_t>(graph.denseIndexBound(), kNoComponent),
+      components.count};
+  for (nodeIndex_t i = 0; i < csr.numNodes(); ++i) {
+    res.labels[graph.denseIndex(csr.nodeId(i))] = components.labels[i];
+  }
+  return res;
+}
+
+TopologicalLevels topologicalLevels(const CsrGraph &graph) {
+  const std::size_t n = graph.numNodes();
+  // Leased so that the pool keeps the size local is made for
+  ThreadPool::Lease pool(default_thread_pool());
+  // In-degrees, then the in-edges from levels not yet relaxed
+  std::vector<nodeIndex_t> remaining(n, 0);
+  pool.parallel_for(
+      num_chunks(n, kNodeChunk), [&](std::size_t c, std::size_t) {
+        const std::size_t end = std::min(n, (c + 1) * kNodeChunk);
+        for (std::size_t u = c * kNodeChunk; u < end; ++u) {
+          for (auto v : graph.neighbors(static_cast<nodeIndex_t>(u))) {
+            std::atomic_ref<nodeIndex_t>(remaining[v]).fetch_add(
+                1, std::memory_order_relaxed);
+          }
+        }
+      });
+
+  TopologicalLevels res;
+  res.order.reserve(n);
+  for (nodeIndex_t u = 0; u < n; ++u) {
+    if (remaining[u] == 0) {
+      res.order.push_back(u);
+    }
+  }
+  std::vector<std::vector<nodeIndex_t>> local(pool.size());
+  while (res.order.size() > res.offsets.back()) {
+    const std::size_t begin = res.offsets.back();
+    const std::size_t size = res.order.size() - begin;
+    res.offsets.push_back(res.order.size());
+    pool.parallel_for(
+        num_chunks(size, kLevelChunk), [&](std::size_t c, std::size_t worker) {
+          const std::size_t end =
+              begin + std::min(size, (c + 1) * kLevelChunk);
+          for (std::size_t f = begin + c * kLevelChunk; f < end; ++f) {
+            for (auto v : graph.neighbors(res.order[f])) {
+              // The last in-edge to be relaxed releases v
+              if (std::atomic_ref<nodeIndex_t>(remaining[v]).fetch_sub(
+                      1, std::memory_order_relaxed) == 1) {
+                local[worker].push_back(v);
+              }
+            }
+          }
+        });
+    const std::size_t next = res.order.size();
+    for (auto &nodes : local) {
+      res.order.insert(res.order.end(), nodes.begin(), nodes.end());
+      nodes.clear();
+    }
+    // Sorted so the levels don't depend on how threads shared the work
+    std::sort(res.order.begin() + static_cast<std::ptrdiff_t>(next),
+              res.order.end());
+  }
+  if (res.order.size() < n) {
+    throw std::runtime_error(
+        "Graph has a cycle: " + std::to_string(n - res.order.size()) +
+        " nodes are on or after one");
+  }
+  return res;
+}
+} // namespace ry
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "graph_components.hpp"
+#include "graph_csr.hpp"
+
+/**
+ * Orderings of directed graphs that hold at any depth: neither function
+ * recurses, so long dependency chains don't overflow the stack.
+ *
+ * Strongly connected components come from Tarjan's algorithm with an explicit
+ * stack of (node, next edge) frames. Topological levels come from Kahn's
+ * algorithm run a level at a time: the edges out of a level are relaxed in
+ * parallel, and a node joins the next level when an atomic decrement takes
+ * its remaining in-degree to 0.
+ */
+namespace ry {
+
+/**
+ * @brief Strongly connected components of graph, by dense index. They are
+ * numbered in the order Tarjan's algorithm completes them, so every edge
+ * between two components goes from the higher label to the lower.
+ *
+ */
+Components stronglyConnectedComponents(const CsrGraph &graph);
+
+/**
+ * @brief stronglyConnectedComponents of any graph, by graph.denseIndex.
+ * Indices with no node are labelled kNoComponent.
+ *
+ */
+Components stronglyConnectedComponents(const Graph &graph);
+
+struct TopologicalLevels {
+  // Dense indices level by level, each level in increasing order. This is
+  // also a topological order.
+  std::vector<nodeIndex_t> order;
+  // Level k is order[offsets[k], offsets[k + 1])
+  std::vector<std::size_t> offsets{0};
+
+  std::size_t numLevels() const {
+    return offsets.size() - 1;
+  }
+  /**
+   * @brief Nodes whose predecessors are all in earlier levels, which can be
+   * processed in parallel once those are done
+   *
+   */
+  std::span<const nodeIndex_t> level(std::size_t k) const {
+    return {order.data() + offsets[k], order.data() + offsets[k + 1]};
+  }
+};
+
+/**
+ * @brief Nodes of graph grouped by the length of the longest path reaching
+ * them. Level 0 holds the nodes without in-edges. Throws std::runtime_error
+ * if graph has a cycle. Snapshot other graphs with CsrGraph(g) first.
+ *
+ */
+TopologicalLevels topologicalLevels(const CsrGraph &graph);
+} // namespace ry
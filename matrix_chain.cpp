@@ -0,0 +1,58 @@
+#include "matrix_chain.hpp"
+
+#include <sstream>
+
+ChainOrder matrix_chain_order(const std::vector<std::size_t> &dims,
+                              const ChainCostModel &model) {
+  if (dims.size() < 2) {
+    throw std::runtime_error("A chain needs at least one matrix");
+  }
+  const std::size_t n = dims.size() - 1;
+  ChainOrder res;
+  res.n = n;
+  res.splits.assign(n * n, 0);
+  // costs[i + j * n] is the cheapest cost of computing A_i..A_j
+  std::vector<double> costs(n * n, 0.0);
+
+  for (std::size_t len = 1; len < n; ++len) {
+    for (std::size_t i = 0; i + len < n; ++i) {
+      const std::size_t j = i + len;
+      double best = std::numeric_limits<double>::max();
+      std::size_t bestSplit = i;
+      for (std::size_t k = i; k < j; ++k) {
+        const double cost = costs[i + k * n] + costs[(k + 1) + j * n] +
+                            model.cost(dims[i], dims[k + 1], dims[j + 1]);
+        if (cost < best) {
+          best = cost;
+          bestSplit = k;
+        }
+      }
+      costs[i + j * n] = best;
+      res.splits[i + j * n] = bestSplit;
+    }
+  }
+  res.cost = costs[(n - 1) * n];
+  return res;
+}
+
+namespace {
+void chain_order_to_string_worker(const ChainOrder &order, std::size_t i,
+                                  std::size_t j, std::ostringstream &oss) {
+  if (i == j) {
+    oss << "A" << i;
+    return;
+  }
+  oss << "(";
+  chain_order_to_string_worker(order, i, order.split(i, j), oss);
+  chain_order_to_string_worker(order, order.split(i, j) + 1, j, oss);
+  oss << ")";
+}
+} // namespace
+
+std::string chain_order_to_string(const ChainOrder &order) {
+  std::ostringstream oss;
+  if (order.n > 0) {
+    chain_order_to_string_worker(order, 0, order.n - 1, oss);
+  }
+  return oss.str();
+}
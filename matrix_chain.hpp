@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "matrix_ops.hpp"
+
+/**
+ * Matrix chain products A0 * A1 * ... * An-1 evaluated in the order found by
+ * the classic O(n^3) dynamic program (see matrixChainBottomUp in
+ * leetcode.cpp), with intermediates drawn from a reusable buffer pool.
+ */
+
+/**
+ * @brief Cost of an (m x k) * (k x n) product used to pick the evaluation
+ * order. The default counts scalar multiplies; calibrate_chain_cost_model
+ * builds one from measured gemm throughput instead, which accounts for skinny
+ * products running well below peak.
+ *
+ */
+struct ChainCostModel {
+  std::function<double(std::size_t m, std::size_t k, std::size_t n)> cost =
+      [](std::size_t m, std::size_t k, std::size_t n) {
+        return static_cast<double>(m) * static_cast<double>(k) *
+               static_cast<double>(n);
+      };
+};
+
+/**
+ * @brief Optimal parenthesization of a chain. Matrix i is dims[i] x
+ * dims[i + 1]; split(i, j) is the k such that A_i..A_j is best computed as
+ * (A_i..A_k) * (A_k+1..A_j).
+ *
+ */
+struct ChainOrder {
+  double cost = 0;
+  std::size_t n = 0;
+  std::vector<std::size_t> splits;
+
+  std::size_t split(std::size_t i, std::size_t j) const {
+    return splits[i + j * n];
+  }
+};
+
+/**
+ * @brief Bottom-up dynamic program over chain windows of growing length
+ *
+ * @param dims - n + 1 dimensions for a chain of n matrices
+ * @param model
+ * @return ChainOrder
+ */
+ChainOrder matrix_chain_order(const std::vector<std::size_t> &dims,
+                              const ChainCostModel &model = {});
+
+/**
+ * @brief Render the order as nested parentheses, e.g. ((A0(A1A2))A3)
+ *
+ */
+std::string chain_order_to_string(const ChainOrder &order);
+
+/**
+ * @brief Reusable column-major buffers for intermediate results. acquire hands
+ * out the smallest free buffer that is large enough and only allocates when
+ * none is, so repeated chains of similar shapes stop allocating after the
+ * first one.
+ *
+ * @tparam T
+ */
+template <typename T> class MatrixBufferPool {
+public:
+  MatrixView<T> acquire(std::size_t nrows, std::size_t ncols,
+                        std::size_t &slot) {
+    const std::size_t n = std::max<std::size_t>(nrows * ncols, 1);
+    slot = fSlots.size();
+    for (std::size_t i = 0; i < fSlots.size(); ++i) {
+      const bool fits = !fSlots[i].inUse && fSlots[i].capacity >= n;
+      if (fits && (slot == fSlots.size() ||
+                   fSlots[i].capacity < fSlots[slot].capacity)) {
+        slot = i;
+      }
+    }
+    if (slot == fSlots.size()) {
+      fSlots.push_back({ry::detail::make_aligned_buffer<T>(n), n, false});
+      ++fAllocations;
+    }
+    fSlots[slot].inUse = true;
+    return {fSlots[slot].data.get(), nrows, ncols};
+  }
+
+  void release(std::size_t slot) {
+    fSlots.at(slot).inUse = false;
+  }
+
+  /**
+   * @brief Number of buffers allocated over the pool's lifetime
+   *
+   */
+  std::size_t allocations() const {
+    return fAllocations;
+  }
+
+private:
+  struct Slot {
+    ry::detail::aligned_buffer_t<T> data;
+    std::size_t capacity;
+    bool inUse;
+  };
+  std::vector<Slot> fSlots;
+  std::size_t fAllocations = 0;
+};
+
+namespace matrix_chain_detail {
+template <typename T> struct Evaluator {
+  static constexpr std::size_t kNoSlot =
+      std::numeric_limits<std::size_t>::max();
+
+  struct Operand {
+    MatrixView<const T> view;
+    std::size_t slot;
+  };
+
+  // Product of matrices i..j. Writes into dst if given, else into a pool
+  // buffer that the caller must release.
+  Operand eval(std::size_t i, std::size_t j, MatrixView<T> *dst) {
+    if (i == j) {
+      return {fMats[i], kNoSlot};
+    }
+    const std::size_t k = fOrder.split(i, j);
+    Operand lhs = eval(i, k, nullptr);
+    Operand rhs = eval(k + 1, j, nullptr);
+    std::size_t slot = kNoSlot;
+    MatrixView<T> out = dst ? *dst
+                            : fPool.acquire(lhs.view.nrows(),
+                                            rhs.view.ncols(), slot);
+    matrix_multiply_add(T{1}, lhs.view, rhs.view, T{0}, out);
+    for (auto used : {lhs.slot, rhs.slot}) {
+      if (used != kNoSlot) {
+        fPool.release(used);
+      }
+    }
+    return {out, slot};
+  }
+
+  std::span<const MatrixView<const T>> fMats;
+  const ChainOrder &fOrder;
+  MatrixBufferPool<T> &fPool;
+};
+} // namespace matrix_chain_detail
+
+/**
+ * @brief Multiply a chain of matrices or views in the cheapest order under
+ * model. Intermediates live in pool (a private pool if nullptr) and the final
+ * product is written straight into the result.
+ *
+ * @tparam T
+ * @param mats
+ * @param model
+ * @param pool
+ * @return Matrix<T>
+ */
+template <typename T>
+Matrix<T> multiply_chain(std::span<const MatrixView<const T>> mats,
+                         const ChainCostModel &model = {},
+                         MatrixBufferPool<T> *pool = nullptr) {
+  if (mats.empty()) {
+    throw std::runtime_error("Cannot multiply an empty chain");
+  }
+  std::vector<std::size_t> dims{mats[0].nrows()};
+  for (std::size_t i = 0; i < mats.size(); ++i) {
+    if (mats[i].nrows() != dims.back()) {
+      throw std::runtime_error(
+          "Inner dimension size mismatch at chain position " +
+          std::to_string(i) + ": " +
+          print_size(mats[i - 1].nrows(), mats[i - 1].ncols()) + " * " +
+          print_size(mats[i].nrows(), mats[i].ncols()));
+    }
+    dims.push_back(mats[i].ncols());
+  }
+
+  if (mats.size() == 1) {
+    return Matrix<T>(mats[0]);
+  }
+
+  auto order = matrix_chain_order(dims, model);
+  MatrixBufferPool<T> localPool;
+  matrix_chain_detail::Evaluator<T> evaluator{mats, order,
+                                              pool ? *pool : localPool};
+  Matrix<T> res(dims.front(), dims.back(), uninitialized);
+  auto out = res.view();
+  evaluator.eval(0, mats.size() - 1, &out);
+  return res;
+}
+
+template <typename T>
+Matrix<T> multiply_chain(std::span<const Matrix<T>> mats,
+                         const ChainCostModel &model = {},
+                         MatrixBufferPool<T> *pool = nullptr) {
+  std::vector<MatrixView<const T>> views(mats.begin(), mats.end());
+  return multiply_chain(std::span<const MatrixView<const T>>(views), model,
+                        pool);
+}
+
+/**
+ * @brief Cost model from measured gemm throughput. Times products for every
+ * combination of sizes in grid and estimates the cost of an arbitrary shape as
+ * its multiply count divided by the throughput measured at the nearest grid
+ * point (in log scale). Takes on the order of 100ms with the default grid.
+ *
+ * @tparam T
+ * @param grid - Sizes sampled for each of m, k and n
+ * @return ChainCostModel
+ */
+template <typename T>
+ChainCostModel calibrate_chain_cost_model(std::vector<std::size_t> grid = {
+                                              8, 32, 128, 512}) {
+  const std::size_t g = grid.size();
+  auto rates = std::make_shared<std::vector<double>>(g * g * g);
+  for (std::size_t im = 0; im < g; ++im) {
+    for (std::size_t ik = 0; ik < g; ++ik) {
+      for (std::size_t in = 0; in < g; ++in) {
+        Matrix<T> a(grid[im], grid[ik]), b(grid[ik], grid[in]),
+            c(grid[im], grid[in]);
+        const double flops = static_cast<double>(grid[im]) *
+                             static_cast<double>(grid[ik]) *
+                             static_cast<double>(grid[in]);
+        // Best of a few runs, at least one of which is warm
+        double best = std::numeric_limits<double>::max();
+        for (int rep = 0; rep < 3; ++rep) {
+          auto start = std::chrono::steady_clock::now();
+          matrix_multiply_add(T{1}, a, b, T{0}, c);
+          std::chrono::duration<double> elapsed =
+              std::chrono::steady_clock::now() - start;
+          best = std::min(best, elapsed.count());
+        }
+        (*rates)[im + g * (ik + g * in)] = flops / std::max(best, 1e-9);
+      }
+    }
+  }
+
+  ChainCostModel model;
+  model.cost = [grid = std::move(grid), rates](std::size_t m, std::size_t k,
+                                                std::size_t n) {
+    auto nearest = [&grid](std::size_t x) {
+      std::size_t best = 0;
+      for (std::size_t i = 1; i < grid.size(); ++i) {
+        if (std::abs(std::log2(static_cast<double>(x) / grid[i])) <
+            std::abs(std::log2(static_cast<double>(x) / grid[best]))) {
+          best = i;
+        }
+      }
+      return best;
+    };
+    const std::size_t g = grid.size();
+    const double rate =
+        (*rates)[nearest(m) + g * (nearest(k) + g * nearest(n))];
+    return static_cast<double>(m) * static_cast<double>(k) *
+           static_cast<double>(n) / rate;
+  };
+  return model;
+}
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+#include "matrix_ops.hpp"
+
+/**
+ * Lazy matrix expressions
+ *
+ * A + B, A - B, s * A and A * B build lightweight expression objects instead
+ * of temporaries. Evaluating an expression into a destination
+ *
+ *   - computes every element-wise term (sums, differences, scalings of
+ *     matrices and views) in one fused pass over the destination, then
+ *   - accumulates every product straight into the destination with
+ *     matrix_multiply_add, i.e. ry::gemm with beta = 1.
+ *
+ * So D = 2*A*B + C - E makes one pass for C - E and one gemm call, and no
+ * temporaries. Scalars on either side of a product are folded into gemm's
+ * alpha. Only products whose operands are themselves sums or products are
+ * materialized.
+ *
+ * Expressions refer to their operands through views: the operands must
+ * outlive the evaluation, so store results with evaluate() rather than
+ * keeping expressions around.
+ */
+
+/**
+ * @brief Tag base class for expression nodes
+ *
+ */
+struct MatrixExprBase {};
+
+template <typename E>
+concept matrix_expr_node = std::is_base_of_v<MatrixExprBase, E>;
+
+template <typename E>
+concept matrix_expression = matrix_like<E> || matrix_expr_node<E>;
+
+namespace matrix_expr_detail {
+template <typename T> const T *last_element(MatrixView<const T> v) {
+  return v.data() + (v.nrows() - 1) * v.row_stride() +
+         (v.ncols() - 1) * v.col_stride();
+}
+} // namespace matrix_expr_detail
+
+/**
+ * @brief Conservative overlap test on the address ranges spanned by two views
+ *
+ */
+template <typename T>
+bool overlaps(MatrixView<const T> x, MatrixView<const T> y) {
+  if (x.numel() == 0 || y.numel() == 0) {
+    return false;
+  }
+  std::less_equal<const T *> le;
+  return le(x.data(), matrix_expr_detail::last_element(y)) &&
+         le(y.data(), matrix_expr_detail::last_element(x));
+}
+
+template <typename T>
+bool same_layout(MatrixView<const T> x, MatrixView<const T> y) {
+  return x.data() == y.data() && x.nrows() == y.nrows() &&
+         x.ncols() == y.ncols() && x.row_stride() == y.row_stride() &&
+         x.col_stride() == y.col_stride();
+}
+
+/**
+ * @brief Leaf node wrapping a read-only view
+ *
+ * @tparam T
+ */
+template <typename T> struct MatrixLeafExpr : MatrixExprBase {
+  using value_type = T;
+  static constexpr bool has_elementwise = true;
+
+  explicit MatrixLeafExpr(MatrixView<const T> view) : fView(view) {}
+
+  std::size_t nrows() const {
+    return fView.nrows();
+  }
+  std::size_t ncols() const {
+    return fView.ncols();
+  }
+  T elem(std::size_t row, std::size_t col) const {
+    return fView(row, col);
+  }
+  template <typename F> void for_each_product(T, F &&) const {}
+
+  /**
+   * @brief True if writing dst element by element while reading this
+   * expression at the same position could read an already overwritten value
+   *
+   */
+  bool unsafe_alias(MatrixView<const T> dst) const {
+    return overlaps(fView, dst) && !same_layout(fView, dst);
+  }
+
+  MatrixView<const T> fView;
+};
+
+/**
+ * @brief alpha * expr
+ *
+ */
+template <typename E> struct MatrixScaledExpr : MatrixExprBase {
+  using value_type = typename E::value_type;
+  using T = value_type;
+  static constexpr bool has_elementwise = E::has_elementwise;
+
+  MatrixScaledExpr(T alpha, E expr) : fAlpha(alpha), fExpr(std::move(expr)) {}
+
+  std::size_t nrows() const {
+    return fExpr.nrows();
+  }
+  std::size_t ncols() const {
+    return fExpr.ncols();
+  }
+  T elem(std::size_t row, std::size_t col) const {
+    return fAlpha * fExpr.elem(row, col);
+  }
+  template <typename F> void for_each_product(T scale, F &&f) const {
+    fExpr.for_each_product(scale * fAlpha, f);
+  }
+  bool unsafe_alias(MatrixView<const T> dst) const {
+    return fExpr.unsafe_alias(dst);
+  }
+
+  T fAlpha;
+  E fExpr;
+};
+
+/**
+ * @brief lhs + sign * rhs with sign = +1 or -1
+ *
+ */
+template <typename L, typename R> struct MatrixSumExpr : MatrixExprBase {
+  using value_type = typename L::value_type;
+  using T = value_type;
+  static constexpr bool has_elementwise =
+      L::has_elementwise || R::has_elementwise;
+  static_assert(std::is_same_v<T, typename R::value_type>,
+                "Operands must have the same element type");
+
+  MatrixSumExpr(L lhs, R rhs, T sign)
+      : fLhs(std::move(lhs)), fRhs(std::move(rhs)), fSign(sign) {
+    if (fLhs.nrows() != fRhs.nrows() || fLhs.ncols() != fRhs.ncols()) {
+      throw std::runtime_error("Size mismatch: " +
+                               print_size(fLhs.nrows(), fLhs.ncols()) +
+                               (sign == T{1} ? " + " : " - ") +
+                               print_size(fRhs.nrows(), fRhs.ncols()));
+    }
+  }
+
+  std::size_t nrows() const {
+    return fLhs.nrows();
+  }
+  std::size_t ncols() const {
+    return fLhs.ncols();
+  }
+  T elem(std::size_t row, std::size_t col) const {
+    return fLhs.elem(row, col) + fSign * fRhs.elem(row, col);
+  }
+  template <typename F> void for_each_product(T scale, F &&f) const {
+    fLhs.for_each_product(scale, f);
+    fRhs.for_each_product(scale * fSign, f);
+  }
+  bool unsafe_alias(MatrixView<const T> dst) const {
+    return fLhs.unsafe_alias(dst) || fRhs.unsafe_alias(dst);
+  }
+
+  L fLhs;
+  R fRhs;
+  T fSign;
+};
+
+/**
+ * @brief alpha * a * b. Contributes nothing element-wise; evaluation routes
+ * it to gemm. Operands that were not plain views are owned by the node.
+ *
+ * @tparam T
+ */
+template <typename T> struct MatrixProductExpr : MatrixExprBase {
+  using value_type = T;
+  static constexpr bool has_elementwise = false;
+
+  MatrixProductExpr(T alpha, MatrixView<const T> a, MatrixView<const T> b,
+                    std::shared_ptr<const Matrix<T>> ownedA = nullptr,
+                    std::shared_ptr<const Matrix<T>> ownedB = nullptr)
+      : fAlpha(alpha), fA(a), fB(b), fOwnedA(std::move(ownedA)),
+        fOwnedB(std::move(ownedB)) {
+    if (a.ncols() != b.nrows()) {
+      throw std::runtime_error(
+          "Inner dimension size mismatch: " + print_size(a.nrows(), a.ncols()) +
+          " * " + print_size(b.nrows(), b.ncols()));
+    }
+  }
+
+  std::size_t nrows() const {
+    return fA.nrows();
+  }
+  std::size_t ncols() const {
+    return fB.ncols();
+  }
+  T elem(std::size_t, std::size_t) const {
+    return T{0};
+  }
+  template <typename F> void for_each_product(T scale, F &&f) const {
+    f(scale * fAlpha, fA, fB);
+  }
+  // gemm cannot write to memory it is reading at all
+  bool unsafe_alias(MatrixView<const T> dst) const {
+    return overlaps(fA, dst) || overlaps(fB, dst);
+  }
+
+  T fAlpha;
+  MatrixView<const T> fA;
+  MatrixView<const T> fB;
+  std::shared_ptr<const Matrix<T>> fOwnedA;
+  std::shared_ptr<const Matrix<T>> fOwnedB;
+};
+
+/**
+ * @brief Wrap matrices and views as leaves, pass expression nodes through
+ *
+ */
+template <matrix_expression E> auto to_matrix_expr(const E &e) {
+  if constexpr (matrix_expr_node<E>) {
+    return e;
+  } else {
+    return MatrixLeafExpr<matrix_value_t<E>>(as_view(e));
+  }
+}
+
+template <matrix_expression E>
+using matrix_expr_t = decltype(to_matrix_expr(std::declval<const E &>()));
+
+template <matrix_expression E>
+using matrix_expr_value_t = typename matrix_expr_t<E>::value_type;
+
+namespace matrix_expr_detail {
+// A product operand: a view, its scale, and storage if it had to be evaluated
+template <typename T> struct ProductOperand {
+  T scale;
+  MatrixView<const T> view;
+  std::shared_ptr<const Matrix<T>> owned;
+};
+
+template <typename T> struct is_leaf : std::false_type {};
+template <typename T> struct is_leaf<MatrixLeafExpr<T>> : std::true_type {};
+
+template <typename T> struct is_scaled_leaf : std::false_type {};
+template <typename T>
+struct is_scaled_leaf<MatrixScaledExpr<MatrixLeafExpr<T>>> : std::true_type {};
+
+template <typename E> Matrix<typename E::value_type> evaluate_node(const E &e);
+
+template <typename E>
+ProductOperand<typename E::value_type> product_operand(const E &e) {
+  using T = typename E::value_type;
+  if constexpr (is_leaf<E>::value) {
+    return {T{1}, e.fView, nullptr};
+  } else if constexpr (is_scaled_leaf<E>::value) {
+    return {e.fAlpha, e.fExpr.fView, nullptr};
+  } else {
+    auto owned = std::make_shared<const Matrix<T>>(evaluate_node(e));
+    return {T{1}, owned->view(), owned};
+  }
+}
+} // namespace matrix_expr_detail
+
+/**
+ * @brief dst = beta * dst + expr, the core of every evaluation
+ *
+ * @tparam E - Expression node
+ */
+template <typename E>
+void evaluate_into(MatrixView<typename E::value_type> dst, const E &expr,
+                   typename E::value_type beta) {
+  using T = typename E::value_type;
+  if (dst.nrows() != expr.nrows() || dst.ncols() != expr.ncols()) {
+    throw std::runtime_error("Cannot assign a " +
+                             print_size(expr.nrows(), expr.ncols()) +
+                             " expression to a " +
+                             print_size(dst.nrows(), dst.ncols()) + " matrix");
+  }
+  if (expr.unsafe_alias(dst)) {
+    // Evaluate into a temporary and then fold that into dst
+    Matrix<T> tmp(dst.nrows(), dst.ncols(), uninitialized);
+    evaluate_into(tmp.view(), expr, T{0});
+    evaluate_into(dst, MatrixLeafExpr<T>(tmp.view()), beta);
+    return;
+  }
+
+  // With no element-wise terms the first product applies beta itself and the
+  // fused pass is skipped entirely
+  if constexpr (E::has_elementwise) {
+    for (std::size_t col = 0; col < dst.ncols(); ++col) {
+      for (std::size_t row = 0; row < dst.nrows(); ++row) {
+        T &out = dst(row, col);
+        out = (beta == T{0} ? T{0} : beta * out) + expr.elem(row, col);
+      }
+    }
+    beta = T{1};
+  }
+  expr.for_each_product(T{1}, [&dst, &beta](T alpha, MatrixView<const T> a,
+                                           MatrixView<const T> b) {
+    matrix_multiply_add(alpha, a, b, beta, dst);
+    beta = T{1};
+  });
+}
+
+namespace matrix_expr_detail {
+template <typename E> Matrix<typename E::value_type> evaluate_node(const E &e) {
+  Matrix<typename E::value_type> res(e.nrows(), e.ncols(), uninitialized);
+  evaluate_into(res.view(), e, typename E::value_type{0});
+  return res;
+}
+} // namespace matrix_expr_detail
+
+/**
+ * @brief Evaluate an expression into a new matrix
+ *
+ */
+template <matrix_expression E> auto evaluate(const E &e) {
+  return matrix_expr_detail::evaluate_node(to_matrix_expr(e));
+}
+
+/**
+ * @brief dst = e
+ *
+ */
+template <matrix_expression E>
+void assign(MatrixView<matrix_expr_value_t<E>> dst, const E &e) {
+  evaluate_into(dst, to_matrix_expr(e), matrix_expr_value_t<E>{0});
+}
+
+/**
+ * @brief dst += e. With e = alpha * A * B this is a single in-place gemm.
+ *
+ */
+template <matrix_expression E>
+void add_assign(MatrixView<matrix_expr_value_t<E>> dst, const E &e) {
+  evaluate_into(dst, to_matrix_expr(e), matrix_expr_value_t<E>{1});
+}
+
+template <typename T, matrix_expression E>
+Matrix<T> &operator+=(Matrix<T> &dst, const E &e) {
+  add_assign(dst.view(), e);
+  return dst;
+}
+
+template <typename T, matrix_expression E>
+Matrix<T> &operator-=(Matrix<T> &dst, const E &e) {
+  add_assign(dst.view(), matrix_expr_value_t<E>{-1} * e);
+  return dst;
+}
+
+template <matrix_expression L, matrix_expression R>
+auto operator+(const L &lhs, const R &rhs) {
+  using T = matrix_expr_value_t<L>;
+  return MatrixSumExpr<matrix_expr_t<L>, matrix_expr_t<R>>(
+      to_matrix_expr(lhs), to_matrix_expr(rhs), T{1});
+}
+
+template <matrix_expression L, matrix_expression R>
+auto operator-(const L &lhs, const R &rhs) {
+  using T = matrix_expr_value_t<L>;
+  return MatrixSumExpr<matrix_expr_t<L>, matrix_expr_t<R>>(
+      to_matrix_expr(lhs), to_matrix_expr(rhs), T{-1});
+}
+
+template <typename S, matrix_expression E>
+  requires std::is_arithmetic_v<S>
+auto operator*(S alpha, const E &e) {
+  using T = matrix_expr_value_t<E>;
+  return MatrixScaledExpr<matrix_expr_t<E>>(static_cast<T>(alpha),
+                                            to_matrix_expr(e));
+}
+
+template <typename S, matrix_expression E>
+  requires std::is_arithmetic_v<S>
+auto operator*(const E &e, S alpha) {
+  return alpha * e;
+}
+
+template <matrix_expression E> auto operator-(const E &e) {
+  return matrix_expr_value_t<E>{-1} * e;
+}
+
+template <matrix_expression L, matrix_expression R>
+auto operator*(const L &lhs, const R &rhs) {
+  using T = matrix_expr_value_t<L>;
+  static_assert(std::is_same_v<T, matrix_expr_value_t<R>>,
+                "Operands must have the same element type");
+  auto a = matrix_expr_detail::product_operand(to_matrix_expr(lhs));
+  auto b = matrix_expr_detail::product_operand(to_matrix_expr(rhs));
+  return MatrixProductExpr<T>(a.scale * b.scale, a.view, b.view,
+                              std::move(a.owned), std::move(b.owned));
+}
@@ -0,0 +1,573 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix_ops.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Dense LU and Cholesky factorizations and triangular solves, arranged so
+ * that nearly all of their flops are matrix products through ry::gemm.
+ *
+ * The factorizations are blocked and right-looking: each step factors a panel
+ * of block columns, solves for the block row beside it and then subtracts one
+ * large product from the trailing matrix. Panels are factored recursively
+ * (halving their columns), so even the panel work is mostly gemm. Trailing
+ * updates and triangular solves are split into column blocks across
+ * default_thread_pool(); gemms called from inside those blocks run serially.
+ *
+ * Everything works in place on views of any layout:
+ *   LU        a = P * L * U, with the unit lower triangle of L below the
+ *             diagonal and U on and above it
+ *   Cholesky  a = L * L^T, with L in the lower triangle; the strict upper
+ *             triangle is neither read nor written
+ */
+
+/**
+ * @brief Default panel width of the blocked factorizations
+ *
+ */
+inline constexpr std::size_t kFactorBlock = 128;
+
+/**
+ * @brief Which side of the unknown the triangular matrix multiplies
+ *
+ */
+enum class SolveSide {
+  Left, // op(a) * x = alpha * b
+  Right // x * op(a) = alpha * b
+};
+
+/**
+ * @brief Triangle of a triangular matrix that is read
+ *
+ */
+enum class Triangle { Lower, Upper };
+
+/**
+ * @brief Whether the diagonal is read or taken to be all ones
+ *
+ */
+enum class Diagonal { NonUnit, Unit };
+
+namespace matrix_factor_detail {
+// Triangular solves and factorizations this small are done with plain loops
+inline constexpr std::size_t kRecursionBase = 16;
+// LU panels this narrow are factored a column at a time
+inline constexpr std::size_t kLuPanelBase = 8;
+
+// y += alpha * x for strided vectors, with a unit stride loop the compiler
+// can vectorize
+template <typename T>
+void axpy(std::size_t n, T alpha, const T *x, std::size_t incx, T *y,
+          std::size_t incy) {
+  if (incx == 1 && incy == 1) {
+    for (std::size_t i = 0; i < n; ++i) {
+      y[i] += alpha * x[i];
+    }
+  } else {
+    for (std::size_t i = 0; i < n; ++i) {
+      y[i * incy] += alpha * x[i * incx];
+    }
+  }
+}
+
+template <typename T>
+void scale(std::size_t n, T alpha, T *x, std::size_t incx) {
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i * incx] *= alpha;
+  }
+}
+
+// body(col, ncols) for consecutive blocks of [0, ncols) at most width wide,
+// across default_thread_pool() if the total number of multiply-adds, work,
+// is worth it
+template <typename F>
+void for_each_column_block(std::size_t ncols, std::size_t width, double work,
+                           F body) {
+  const std::size_t count = (ncols + width - 1) / width;
+  auto run = [&](std::size_t block, std::size_t) {
+    const std::size_t col = block * width;
+    body(col, std::min(width, ncols - col));
+  };
+  auto &pool = ry::default_thread_pool();
+  if (count > 1 && pool.size() > 1 && work >= ry::kGemmParallelThreshold) {
+    pool.parallel_for(count, run);
+  } else {
+    for (std::size_t block = 0; block < count; ++block) {
+      run(block, 0);
+    }
+  }
+}
+
+// b = a^-1 * b for a small triangular a. Column-major b is solved a column
+// at a time with columns of a; row-major b a whole row at a time, so the inner
+// loops are contiguous either way.
+template <typename T>
+void solve_unblocked(Triangle uplo, Diagonal diag, MatrixView<const T> a,
+                     MatrixView<T> b) {
+  const std::size_t m = a.nrows(), n = b.ncols();
+  const std::size_t rsa = a.row_stride(), rsb = b.row_stride();
+  const std::size_t csb = b.col_stride();
+  const bool lower = uplo == Triangle::Lower;
+  const bool byRows = csb == 1 && rsb != 1;
+  for (std::size_t step = 0; step < m; ++step) {
+    const std::size_t l = lower ? step : m - 1 - step;
+    // Rows below l for lower a, above l for upper a
+    const std::size_t first = lower ? l + 1 : 0;
+    const std::size_t count = lower ? m - l - 1 : l;
+    const T *column = &a(0, l) + first * rsa;
+    if (byRows) {
+      if (diag == Diagonal::NonUnit) {
+        scale(n, T{1} / a(l, l), &b(l, 0), csb);
+      }
+      for (std::size_t i = 0; i < count; ++i) {
+        axpy(n, -column[i * rsa], &b(l, 0), csb, &b(first + i, 0), csb);
+      }
+    } else {
+      for (std::size_t j = 0; j < n; ++j) {
+        if (diag == Diagonal::NonUnit) {
+          b(l, j) /= a(l, l);
+        }
+        axpy(count, -b(l, j), column, rsa, &b(first, j), rsb);
+      }
+    }
+  }
+}
+
+// b = a^-1 * b, splitting a in half so the off-diagonal block is a gemm
+template <typename T>
+void solve_recursive(Triangle uplo, Diagonal diag, MatrixView<const T> a,
+                     MatrixView<T> b) {
+  const std::size_t m = a.nrows();
+  if (m <= kRecursionBase) {
+    solve_unblocked(uplo, diag, a, b);
+    return;
+  }
+  const std::size_t m1 = m / 2, m2 = m - m1;
+  auto b1 = b.rows(0, m1);
+  auto b2 = b.rows(m1, m2);
+  if (uplo == Triangle::Lower) {
+    solve_recursive(uplo, diag, a.submatrix(0, 0, m1, m1), b1);
+    matrix_multiply_add(T{-1}, a.submatrix(m1, 0, m2, m1), b1, T{1}, b2);
+    solve_recursive(uplo, diag, a.submatrix(m1, m1, m2, m2), b2);
+  } else {
+    solve_recursive(uplo, diag, a.submatrix(m1, m1, m2, m2), b2);
+    matrix_multiply_add(T{-1}, a.submatrix(0, m1, m1, m2), b2, T{1}, b1);
+    solve_recursive(uplo, diag, a.submatrix(0, 0, m1, m1), b1);
+  }
+}
+
+// b = a^-1 * b with the columns of b split across threads
+template <typename T>
+void solve_left(Triangle uplo, Diagonal diag, MatrixView<const T> a,
+                MatrixView<T> b) {
+  const double work = static_cast<double>(a.nrows()) * a.nrows() * b.ncols();
+  for_each_column_block(b.ncols(), kFactorBlock, work,
+                        [&](std::size_t col, std::size_t ncols) {
+                          solve_recursive(uplo, diag, a, b.columns(col, ncols));
+                        });
+}
+
+// Swap rows i and pivots[i] of a for i in [begin, end), in order
+template <typename T>
+void swap_rows(MatrixView<T> a, const std::vector<std::size_t> &pivots,
+               std::size_t begin, std::size_t end) {
+  for (std::size_t i = begin; i < end; ++i) {
+    if (pivots[i] != i) {
+      for (std::size_t col = 0; col < a.ncols(); ++col) {
+        std::swap(a(i, col), a(pivots[i], col));
+      }
+    }
+  }
+}
+
+// LU of the m x n panel a with partial pivoting, recursing on halves of its
+// columns. Row i of a is row offset + i of the panel being factored, and
+// pivots[offset + i] is set to the panel row swapped with it.
+template <typename T>
+void lu_recursive(MatrixView<T> a, std::vector<std::size_t> &pivots,
+                  std::size_t offset) {
+  const std::size_t m = a.nrows(), n = a.ncols();
+  const std::size_t mn = std::min(m, n);
+  if (mn == 0) {
+    return;
+  }
+  if (n <= kLuPanelBase) {
+    const std::size_t rs = a.row_stride();
+    for (std::size_t j = 0; j < mn; ++j) {
+      std::size_t pivot = j;
+      for (std::size_t i = j + 1; i < m; ++i) {
+        if (std::abs(a(i, j)) > std::abs(a(pivot, j))) {
+          pivot = i;
+        }
+      }
+      pivots[offset + j] = offset + pivot;
+      if (pivot != j) {
+        for (std::size_t col = 0; col < n; ++col) {
+          std::swap(a(j, col), a(pivot, col));
+        }
+      }
+      // A zero column is left as is; lu_solve reports the singular U
+      if (a(j, j) != T{0}) {
+        scale(m - j - 1, T{1} / a(j, j), &a(j, j) + rs, rs);
+      }
+      for (std::size_t col = j + 1; col < n; ++col) {
+        axpy(m - j - 1, -a(j, col), &a(j, j) + rs, rs, &a(j, col) + rs, rs);
+      }
+    }
+    return;
+  }
+  const std::size_t n1 = std::max<std::size_t>(mn / 2, 1), n2 = n - n1;
+  auto left = a.columns(0, n1);
+  auto right = a.columns(n1, n2);
+  lu_recursive(left, pivots, offset);
+  auto local = [offset](std::size_t row) { return row - offset; };
+  for (std::size_t i = 0; i < n1; ++i) {
+    if (pivots[offset + i] != offset + i) {
+      for (std::size_t col = 0; col < n2; ++col) {
+        std::swap(right(i, col), right(local(pivots[offset + i]), col));
+      }
+    }
+  }
+  auto a12 = right.rows(0, n1);
+  solve_recursive<T>(Triangle::Lower, Diagonal::Unit, left.rows(0, n1), a12);
+  auto a22 = right.rows(n1, m - n1);
+  matrix_multiply_add(T{-1}, left.rows(n1, m - n1), a12, T{1}, a22);
+  lu_recursive(a22, pivots, offset + n1);
+  for (std::size_t i = n1; i < mn; ++i) {
+    if (pivots[offset + i] != offset + i) {
+      for (std::size_t col = 0; col < n1; ++col) {
+        std::swap(left(i, col), left(local(pivots[offset + i]), col));
+      }
+    }
+  }
+}
+
+// c -= a * a^T on and below the diagonal of c, leaving the strict upper
+// triangle alone. Column blocks of c are independent, so they run across
+// threads; each diagonal block is computed in full into scratch.
+template <typename T>
+void lower_rank_update(MatrixView<const T> a, MatrixView<T> c,
+                       std::size_t width) {
+  const std::size_t n = c.nrows(), k = a.ncols();
+  const double work = static_cast<double>(n) * n * k / 2;
+  for_each_column_block(n, width, work, [&](std::size_t col,
+                                            std::size_t ncols) {
+    auto aBlock = a.rows(col, ncols);
+    Matrix<T> diagonal(ncols, ncols, uninitialized);
+    matrix_multiply_add(T{1}, aBlock, aBlock.transpose(), T{0},
+                        diagonal.view());
+    for (std::size_t j = 0; j < ncols; ++j) {
+      for (std::size_t i = j; i < ncols; ++i) {
+        c(col + i, col + j) -= diagonal(i, j);
+      }
+    }
+    const std::size_t below = n - col - ncols;
+    if (below > 0) {
+      matrix_multiply_add(T{-1}, a.rows(col + ncols, below),
+                          aBlock.transpose(), T{1},
+                          c.submatrix(col + ncols, col, below, ncols));
+    }
+  });
+}
+
+// Cholesky factor of a small or diagonal block, recursing on halves
+template <typename T>
+void cholesky_recursive(MatrixView<T> a, std::size_t offset) {
+  const std::size_t n = a.nrows();
+  if (n <= kRecursionBase) {
+    for (std::size_t j = 0; j < n; ++j) {
+      T d = a(j, j);
+      for (std::size_t l = 0; l < j; ++l) {
+        d -= a(j, l) * a(j, l);
+      }
+      if (!(d > T{0})) {
+        throw std::runtime_error("Matrix is not positive definite: pivot " +
+                                 std::to_string(offset + j) + " is " +
+                                 std::to_string(d));
+      }
+      d = std::sqrt(d);
+      a(j, j) = d;
+      for (std::size_t i = j + 1; i < n; ++i) {
+        T sum = a(i, j);
+        for (std::size_t l = 0; l < j; ++l) {
+          sum -= a(i, l) * a(j, l);
+        }
+        a(i, j) = sum / d;
+      }
+    }
+    return;
+  }
+  const std::size_t n1 = n / 2, n2 = n - n1;
+  auto a11 = a.submatrix(0, 0, n1, n1);
+  auto a21 = a.submatrix(n1, 0, n2, n1);
+  auto a22 = a.submatrix(n1, n1, n2, n2);
+  cholesky_recursive(a11, offset);
+  // a21 = a21 * L11^-T, i.e. L11 * a21^T = a21^T
+  solve_recursive<T>(Triangle::Lower, Diagonal::NonUnit, a11,
+                     a21.transpose());
+  lower_rank_update<T>(a21, a22, n2);
+  cholesky_recursive(a22, offset + n1);
+}
+
+template <typename T> void check_square(MatrixView<T> a, const char *what) {
+  if (a.nrows() != a.ncols()) {
+    throw std::runtime_error(std::string(what) +
+                             " needs a square matrix, not " +
+                             print_size(a.nrows(), a.ncols()));
+  }
+}
+} // namespace matrix_factor_detail
+
+/**
+ * @brief Solve op(a) * x = alpha * b (SolveSide::Left) or
+ * x * op(a) = alpha * b (SolveSide::Right) for x, overwriting b. Only the
+ * uplo triangle of the square matrix a is read, without its diagonal for
+ * Diagonal::Unit.
+ *
+ * @tparam T
+ */
+template <typename T>
+void triangular_solve(SolveSide side, Triangle uplo, MatrixOp op,
+                      Diagonal diag, T alpha,
+                      std::type_identity_t<MatrixView<const T>> a,
+                      std::type_identity_t<MatrixView<T>> b) {
+  matrix_factor_detail::check_square(a, "Triangular solve");
+  const std::size_t inner = side == SolveSide::Left ? b.nrows() : b.ncols();
+  if (a.nrows() != inner) {
+    throw std::runtime_error("Size mismatch: triangular " +
+                             print_size(a.nrows(), a.ncols()) + " with " +
+                             print_size(b.nrows(), b.ncols()));
+  }
+  if (alpha != T{1}) {
+    for (std::size_t col = 0; col < b.ncols(); ++col) {
+      for (std::size_t row = 0; row < b.nrows(); ++row) {
+        b(row, col) *= alpha;
+      }
+    }
+  }
+  // x * op(a) = b is op(a)^T * x^T = b^T, and a transposed triangle is the
+  // opposite one
+  if (side == SolveSide::Right) {
+    b = b.transpose();
+    op = op == MatrixOp::None ? MatrixOp::Transpose : MatrixOp::None;
+  }
+  if (op == MatrixOp::Transpose) {
+    a = a.transpose();
+    uplo = uplo == Triangle::Lower ? Triangle::Upper : Triangle::Lower;
+  }
+  matrix_factor_detail::solve_left(uplo, diag, a, b);
+}
+
+/**
+ * @brief Factor a = P * L * U in place with partial pivoting: a is left
+ * holding L below its diagonal and U on and above it. a may be rectangular.
+ * Singular matrices are factored too, leaving zeros on the diagonal of U.
+ *
+ * @tparam T
+ * @param a
+ * @param block - Panel width; at least a's columns gives the unblocked
+ * algorithm
+ * @return std::vector<std::size_t> - Row i of a was swapped with row
+ * pivots[i], for i in increasing order
+ */
+template <typename T>
+std::vector<std::size_t> lu_factor_in_place(MatrixView<T> a,
+                                            std::size_t block = kFactorBlock) {
+  using namespace matrix_factor_detail;
+  const std::size_t m = a.nrows(), n = a.ncols(), mn = std::min(m, n);
+  block = std::max<std::size_t>(block, 1);
+  std::vector<std::size_t> pivots(mn), panelPivots;
+  for (std::size_t j0 = 0; j0 < mn; j0 += block) {
+    const std::size_t jb = std::min(block, mn - j0);
+    auto panel = a.submatrix(j0, j0, m - j0, jb);
+    panelPivots.assign(jb, 0);
+    lu_recursive(panel, panelPivots, 0);
+    for (std::size_t i = 0; i < jb; ++i) {
+      pivots[j0 + i] = panelPivots[i] + j0;
+    }
+    swap_rows(a.columns(0, j0), pivots, j0, j0 + jb);
+
+    // Swap and solve for the block row right of the panel, then update the
+    // trailing matrix
+    const std::size_t rest = n - j0 - jb;
+    if (rest == 0) {
+      continue;
+    }
+    auto right = a.columns(j0 + jb, rest);
+    auto l11 = MatrixView<const T>(panel.rows(0, jb));
+    for_each_column_block(rest, kFactorBlock,
+                          static_cast<double>(jb) * jb * rest,
+                          [&](std::size_t col, std::size_t ncols) {
+                            auto columns = right.columns(col, ncols);
+                            swap_rows(columns, pivots, j0, j0 + jb);
+                            solve_recursive(Triangle::Lower, Diagonal::Unit,
+                                            l11, columns.rows(j0, jb));
+                          });
+    if (j0 + jb < m) {
+      matrix_multiply_add(T{-1}, panel.rows(jb, m - j0 - jb),
+                          right.rows(j0, jb), T{1},
+                          right.rows(j0 + jb, m - j0 - jb));
+    }
+  }
+  return pivots;
+}
+
+/**
+ * @brief An LU factorization from lu_factor
+ *
+ * @tparam T
+ */
+template <typename T> struct LuFactorization {
+  // L below the diagonal, U on and above it
+  Matrix<T> lu;
+  // Row i was swapped with row pivots[i], for i in increasing order
+  std::vector<std::size_t> pivots;
+};
+
+/**
+ * @brief LU factorization of a copy of a matrix or view
+ *
+ * @tparam M
+ * @return LuFactorization<matrix_value_t<M>>
+ */
+template <matrix_like M>
+auto lu_factor(const M &a, std::size_t block = kFactorBlock) {
+  using T = matrix_value_t<M>;
+  LuFactorization<T> res{Matrix<T>(as_view(a)), {}};
+  res.pivots = lu_factor_in_place(res.lu.view(), block);
+  return res;
+}
+
+/**
+ * @brief Solve a * x = b given the factorization of a square a, overwriting b
+ * with x. Throws std::runtime_error if a is singular.
+ *
+ * @tparam T
+ */
+template <typename T>
+void lu_solve_in_place(const LuFactorization<T> &factors,
+                       std::type_identity_t<MatrixView<T>> b) {
+  auto lu = as_view(factors.lu);
+  matrix_factor_detail::check_square(lu, "LU solve");
+  for (std::size_t i = 0; i < lu.nrows(); ++i) {
+    if (lu(i, i) == T{0}) {
+      throw std::runtime_error("Matrix is singular: U(" + std::to_string(i) +
+                               ", " + std::to_string(i) + ") is 0");
+    }
+  }
+  if (b.nrows() != lu.nrows()) {
+    throw std::runtime_error("Size mismatch: solving " +
+                             print_size(lu.nrows(), lu.ncols()) + " with " +
+                             print_size(b.nrows(), b.ncols()));
+  }
+  matrix_factor_detail::swap_rows(b, factors.pivots, 0, factors.pivots.size());
+  triangular_solve(SolveSide::Left, Triangle::Lower, MatrixOp::None,
+                   Diagonal::Unit, T{1}, lu, b);
+  triangular_solve(SolveSide::Left, Triangle::Upper, MatrixOp::None,
+                   Diagonal::NonUnit, T{1}, lu, b);
+}
+
+/**
+ * @brief Solution x of a * x = b given the factorization of a
+ *
+ * @tparam T
+ * @tparam M
+ * @return Matrix<T>
+ */
+template <typename T, matrix_like M>
+Matrix<T> lu_solve(const LuFactorization<T> &factors, const M &b) {
+  Matrix<T> x(as_view(b));
+  lu_solve_in_place(factors, x.view());
+  return x;
+}
+
+/**
+ * @brief Factor the symmetric positive definite a = L * L^T in place, reading
+ * and writing only the lower triangle. Throws std::runtime_error if a is not
+ * positive definite, leaving a partly factored.
+ *
+ * @tparam T
+ * @param a
+ * @param block - Panel width
+ */
+template <typename T>
+void cholesky_factor_in_place(MatrixView<T> a,
+                              std::size_t block = kFactorBlock) {
+  using namespace matrix_factor_detail;
+  check_square(a, "Cholesky");
+  const std::size_t n = a.nrows();
+  block = std::max<std::size_t>(block, 1);
+  for (std::size_t j0 = 0; j0 < n; j0 += block) {
+    const std::size_t jb = std::min(block, n - j0);
+    auto a11 = a.submatrix(j0, j0, jb, jb);
+    cholesky_recursive(a11, j0);
+    const std::size_t rest = n - j0 - jb;
+    if (rest == 0) {
+      break;
+    }
+    auto a21 = a.submatrix(j0 + jb, j0, rest, jb);
+    triangular_solve(SolveSide::Right, Triangle::Lower, MatrixOp::Transpose,
+                     Diagonal::NonUnit, T{1}, a11, a21);
+    lower_rank_update<T>(a21, a.submatrix(j0 + jb, j0 + jb, rest, rest),
+                         block);
+  }
+}
+
+/**
+ * @brief Cholesky factor L of a copy of a matrix or view, with zeros above the
+ * diagonal
+ *
+ * @tparam M
+ * @return Matrix<matrix_value_t<M>>
+ */
+template <matrix_like M>
+auto cholesky_factor(const M &a, std::size_t block = kFactorBlock) {
+  using T = matrix_value_t<M>;
+  Matrix<T> l(as_view(a));
+  cholesky_factor_in_place(l.view(), block);
+  for (std::size_t col = 1; col < l.ncols(); ++col) {
+    for (std::size_t row = 0; row < col; ++row) {
+      l(row, col) = T{0};
+    }
+  }
+  return l;
+}
+
+/**
+ * @brief Solve a * x = b given the Cholesky factor L of a, overwriting b with
+ * x
+ *
+ * @tparam T
+ */
+template <typename T>
+void cholesky_solve_in_place(std::type_identity_t<MatrixView<const T>> l,
+                             std::type_identity_t<MatrixView<T>> b) {
+  triangular_solve(SolveSide::Left, Triangle::Lower, MatrixOp::None,
+                   Diagonal::NonUnit, T{1}, l, b);
+  triangular_solve(SolveSide::Left, Triangle::Lower, MatrixOp::Transpose,
+                   Diagonal::NonUnit, T{1}, l, b);
+}
+
+/**
+ * @brief Solution x of a * x = b given the Cholesky factor L of a
+ *
+ * @tparam ML
+ * @tparam MB
+ * @return Matrix<matrix_value_t<MB>>
+ */
+template <matrix_like ML, matrix_like MB>
+auto cholesky_solve(const ML &l, const MB &b) {
+  using T = matrix_value_t<MB>;
+  Matrix<T> x(as_view(b));
+  cholesky_solve_in_place<T>(as_view(l), x.view());
+  return x;
+}
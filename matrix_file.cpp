@@ -0,0 +1,218 @@
+#include "matrix_file.hpp"
+
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr std::array<char, 8> kMagic{'R', 'Y', 'M', 'A', 'T', 'R', 'I', 'X'};
+constexpr std::uint32_t kVersion = 1;
+
+struct Header {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t dtype;
+  std::uint32_t layout;
+  std::uint32_t elementSize;
+  std::uint64_t nrows;
+  std::uint64_t ncols;
+  std::uint64_t dataOffset;
+  std::array<std::uint8_t, 16> reserved;
+};
+static_assert(sizeof(Header) == 64, "Header must match the file format");
+
+void check_byte_order() {
+  if constexpr (std::endian::native != std::endian::little) {
+    throw std::runtime_error("Matrix files are only supported on "
+                             "little-endian machines");
+  }
+}
+
+// File descriptor closed on scope exit
+struct FileDescriptor {
+  int fd;
+  ~FileDescriptor() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+};
+
+[[noreturn]] void throw_errno(const std::string &what,
+                              const std::filesystem::path &path) {
+  throw std::system_error(errno, std::generic_category(),
+                          what + " " + path.string());
+}
+
+// Bytes of a file holding its header and nrows x ncols elements from
+// dataOffset, or nothing if huge dimensions would wrap that count
+std::optional<std::size_t> file_bytes(std::uint64_t nrows, std::uint64_t ncols,
+                                      std::size_t elementSize,
+                                      std::uint64_t dataOffset) {
+  constexpr auto kMaxSize = std::numeric_limits<std::size_t>::max();
+  if (nrows > kMaxSize || ncols > kMaxSize || dataOffset > kMaxSize ||
+      (ncols != 0 && elementSize != 0 &&
+       nrows > (kMaxSize - dataOffset) / elementSize / ncols)) {
+    return std::nullopt;
+  }
+  return dataOffset + nrows * ncols * elementSize;
+}
+} // namespace
+
+std::string matrix_dtype_name(MatrixDtype dtype) {
+  switch (dtype) {
+  case MatrixDtype::Float32:
+    return "float32";
+  case MatrixDtype::Float64:
+    return "float64";
+  case MatrixDtype::Int8:
+    return "int8";
+  case MatrixDtype::Int16:
+    return "int16";
+  case MatrixDtype::Int32:
+    return "int32";
+  case MatrixDtype::Int64:
+    return "int64";
+  }
+  return "unknown";
+}
+
+std::size_t matrix_dtype_size(MatrixDtype dtype) {
+  switch (dtype) {
+  case MatrixDtype::Int8:
+    return 1;
+  case MatrixDtype::Int16:
+    return 2;
+  case MatrixDtype::Float32:
+  case MatrixDtype::Int32:
+    return 4;
+  case MatrixDtype::Float64:
+  case MatrixDtype::Int64:
+    return 8;
+  }
+  return 0;
+}
+
+MatrixFileInfo read_matrix_file_info(const std::filesystem::path &path) {
+  return ry::read_matrix_file_info(ry::MappedFile(path), path);
+}
+
+namespace ry {
+MappedFile::MappedFile(const std::filesystem::path &path, Mode mode)
+    : fPath(path) {
+  const bool writable = mode == Mode::ReadWrite;
+  FileDescriptor file{::open(path.c_str(), writable ? O_RDWR : O_RDONLY)};
+  if (file.fd < 0) {
+    throw_errno("Cannot open", path);
+  }
+  struct stat st {};
+  if (::fstat(file.fd, &st) != 0) {
+    throw_errno("Cannot stat", path);
+  }
+  fSize = static_cast<std::size_t>(st.st_size);
+  if (fSize == 0) {
+    return;
+  }
+  void *addr =
+      ::mmap(nullptr, fSize, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+             MAP_SHARED, file.fd, 0);
+  if (addr == MAP_FAILED) {
+    fSize = 0;
+    throw_errno("Cannot map", path);
+  }
+  fData = static_cast<std::byte *>(addr);
+}
+
+MatrixFileInfo read_matrix_file_info(const MappedFile &file,
+                                     const std::filesystem::path &path) {
+  check_byte_order();
+  Header header{};
+  if (file.size() >= sizeof(header)) {
+    std::memcpy(&header, file.data(), sizeof(header));
+  }
+  if (file.size() < sizeof(header) || header.magic != kMagic) {
+    throw std::runtime_error(path.string() + " is not a matrix file");
+  }
+  if (header.version != kVersion) {
+    throw std::runtime_error(path.string() + " has unsupported version " +
+                             std::to_string(header.version));
+  }
+  const auto dtype = static_cast<MatrixDtype>(header.dtype);
+  const std::size_t elementSize = matrix_dtype_size(dtype);
+  if (elementSize == 0 || elementSize != header.elementSize ||
+      header.layout > static_cast<std::uint32_t>(MatrixLayout::RowMajor) ||
+      header.dataOffset < sizeof(Header) ||
+      header.dataOffset % kMatrixFileAlignment != 0) {
+    throw std::runtime_error(path.string() + " has a corrupt header");
+  }
+  const auto bytes = file_bytes(header.nrows, header.ncols, elementSize,
+                                header.dataOffset);
+  if (!bytes) {
+    throw std::runtime_error(path.string() + " has a corrupt header: " +
+                             print_size(header.nrows, header.ncols) +
+                             " elements overflow");
+  }
+  if (file.size() < *bytes) {
+    throw std::runtime_error(path.string() + " is truncated: expected " +
+                             print_size(header.nrows, header.ncols) + " " +
+                             matrix_dtype_name(dtype) + " elements");
+  }
+  return {dtype, static_cast<MatrixLayout>(header.layout), header.nrows,
+          header.ncols, header.dataOffset};
+}
+
+MappedFile::~MappedFile() {
+  if (fData != nullptr) {
+    ::munmap(fData, fSize);
+  }
+}
+
+void MappedFile::sync() const {
+  if (fData != nullptr && ::msync(fData, fSize, MS_SYNC) != 0) {
+    throw_errno("Cannot sync", fPath);
+  }
+}
+
+MappedFile create_matrix_file(const std::filesystem::path &path,
+                              const MatrixFileInfo &info) {
+  check_byte_order();
+  const std::size_t elementSize = matrix_dtype_size(info.dtype);
+  const auto bytes =
+      file_bytes(info.nrows, info.ncols, elementSize, sizeof(Header));
+  if (!bytes) {
+    throw std::runtime_error("Cannot create " + path.string() + ": " +
+                             print_size(info.nrows, info.ncols) + " " +
+                             matrix_dtype_name(info.dtype) +
+                             " elements overflow");
+  }
+  Header header{kMagic,
+                kVersion,
+                static_cast<std::uint32_t>(info.dtype),
+                static_cast<std::uint32_t>(info.layout),
+                static_cast<std::uint32_t>(elementSize),
+                info.nrows,
+                info.ncols,
+                sizeof(Header),
+                {}};
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.write(reinterpret_cast<const char *>(&header), sizeof(header))) {
+      throw std::runtime_error("Cannot write " + path.string());
+    }
+  }
+  // Extending the file leaves a hole that reads as zeros
+  std::filesystem::resize_file(path, *bytes);
+  return MappedFile(path, MappedFile::Mode::ReadWrite);
+}
+} // namespace ry
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "matrix_ops.hpp"
+
+/**
+ * Binary on-disk matrices, mapped into memory with mmap so loading one is
+ * zero-copy: pages are read on first touch and the matrix API works on the
+ * mapping directly.
+ *
+ * A file is a 64-byte little-endian header followed by the elements:
+ *
+ *   offset  size  field
+ *        0     8  magic "RYMATRIX"
+ *        8     4  format version (1)
+ *       12     4  element type (MatrixDtype)
+ *       16     4  layout (MatrixLayout)
+ *       20     4  bytes per element
+ *       24     8  rows
+ *       32     8  columns
+ *       40     8  offset of the first element (64)
+ *       48    16  reserved, zero
+ *
+ * Data starts on a cache line so mapped columns are as aligned as a Matrix's.
+ * Readers reject files whose data offset isn't a multiple of
+ * kMatrixFileAlignment.
+ */
+
+inline constexpr std::size_t kMatrixFileAlignment = 64;
+
+/**
+ * @brief Element type stored in a matrix file
+ *
+ */
+enum class MatrixDtype : std::uint32_t {
+  Float32 = 1,
+  Float64 = 2,
+  Int8 = 3,
+  Int16 = 4,
+  Int32 = 5,
+  Int64 = 6,
+};
+
+namespace matrix_file_detail {
+template <typename T> constexpr MatrixDtype dtype_of() {
+  using U = std::remove_const_t<T>;
+  if constexpr (std::is_same_v<U, float>) {
+    return MatrixDtype::Float32;
+  } else if constexpr (std::is_same_v<U, double>) {
+    return MatrixDtype::Float64;
+  } else if constexpr (std::is_same_v<U, std::int8_t>) {
+    return MatrixDtype::Int8;
+  } else if constexpr (std::is_same_v<U, std::int16_t>) {
+    return MatrixDtype::Int16;
+  } else if constexpr (std::is_same_v<U, std::int32_t>) {
+    return MatrixDtype::Int32;
+  } else {
+    static_assert(std::is_same_v<U, std::int64_t>,
+                  "No matrix file element type for T");
+    return MatrixDtype::Int64;
+  }
+}
+} // namespace matrix_file_detail
+
+template <typename T>
+inline constexpr MatrixDtype matrix_dtype_v =
+    matrix_file_detail::dtype_of<T>();
+
+std::string matrix_dtype_name(MatrixDtype dtype);
+std::size_t matrix_dtype_size(MatrixDtype dtype);
+
+/**
+ * @brief Contents of a matrix file header
+ *
+ */
+struct MatrixFileInfo {
+  MatrixDtype dtype = MatrixDtype::Float64;
+  MatrixLayout layout = MatrixLayout::ColumnMajor;
+  std::size_t nrows = 0;
+  std::size_t ncols = 0;
+  std::size_t dataOffset = 64;
+};
+
+/**
+ * @brief Read and validate the header of the matrix file at path. Throws
+ * std::runtime_error if it isn't one or is shorter than its header says.
+ *
+ */
+MatrixFileInfo read_matrix_file_info(const std::filesystem::path &path);
+
+namespace ry {
+/**
+ * @brief A whole file mapped into memory, unmapped on destruction. Writes to
+ * a ReadWrite mapping go to the file.
+ *
+ */
+class MappedFile {
+public:
+  enum class Mode { ReadOnly, ReadWrite };
+
+  MappedFile() = default;
+  explicit MappedFile(const std::filesystem::path &path,
+                      Mode mode = Mode::ReadOnly);
+  MappedFile(MappedFile &&other) noexcept
+      : fPath(std::move(other.fPath)),
+        fData(std::exchange(other.fData, nullptr)),
+        fSize(std::exchange(other.fSize, 0)) {}
+  MappedFile &operator=(MappedFile &&other) noexcept {
+    std::swap(fPath, other.fPath);
+    std::swap(fData, other.fData);
+    std::swap(fSize, other.fSize);
+    return *this;
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  std::byte *data() const {
+    return fData;
+  }
+  std::size_t size() const {
+    return fSize;
+  }
+
+  /**
+   * @brief Write modified pages back to the file now rather than whenever the
+   * kernel gets to them. Throws std::system_error if writing fails.
+   *
+   */
+  void sync() const;
+
+private:
+  // For error messages
+  std::filesystem::path fPath;
+  std::byte *fData = nullptr;
+  std::size_t fSize = 0;
+};
+
+/**
+ * @brief Validate the header of a mapped matrix file, read from the mapping
+ * itself so that what is checked is what gets used. path names the file in
+ * errors.
+ *
+ */
+MatrixFileInfo read_matrix_file_info(const MappedFile &file,
+                                     const std::filesystem::path &path);
+
+/**
+ * @brief Write the header for info to path, size the file to hold the data and
+ * map it for writing. The elements start out zero. Throws std::runtime_error
+ * if the file size would overflow.
+ *
+ */
+MappedFile create_matrix_file(const std::filesystem::path &path,
+                              const MatrixFileInfo &info);
+} // namespace ry
+
+/**
+ * @brief Matrix backed by a mapped file. MappedMatrix<const T> is read-only.
+ * Converts to a view, so it works anywhere a Matrix does.
+ *
+ * @tparam T
+ */
+template <typename T> class MappedMatrix {
+public:
+  using value_type = T;
+
+  /**
+   * @brief Matrix described by info in file. Throws std::runtime_error if
+   * file is too small to hold it.
+   *
+   */
+  MappedMatrix(ry::MappedFile file, const MatrixFileInfo &info)
+      : fFile(std::move(file)), fLayout(info.layout),
+        fView(checked_data(fFile, info), info.nrows, info.ncols,
+              info.layout) {}
+
+  std::size_t nrows() const {
+    return fView.nrows();
+  }
+  std::size_t ncols() const {
+    return fView.ncols();
+  }
+  std::size_t numel() const {
+    return fView.numel();
+  }
+  MatrixLayout layout() const {
+    return fLayout;
+  }
+  T &operator()(std::size_t row, std::size_t col) const {
+    return fView(row, col);
+  }
+
+  MatrixView<T> view() const {
+    return fView;
+  }
+  operator MatrixView<T>() const {
+    return fView;
+  }
+  operator MatrixView<const T>() const
+    requires(!std::is_const_v<T>)
+  {
+    return fView;
+  }
+
+  void sync() const {
+    fFile.sync();
+  }
+
+private:
+  static T *checked_data(const ry::MappedFile &file,
+                         const MatrixFileInfo &info) {
+    const std::size_t size = file.size();
+    if (info.dataOffset > size ||
+        (info.ncols != 0 &&
+         info.nrows > (size - info.dataOffset) / sizeof(T) / info.ncols)) {
+      throw std::runtime_error("Mapped file of " + std::to_string(size) +
+                               " bytes is too small for a " +
+                               print_size(info.nrows, info.ncols) +
+                               " matrix");
+    }
+    return reinterpret_cast<T *>(file.data() + info.dataOffset);
+  }
+
+  ry::MappedFile fFile;
+  MatrixLayout fLayout;
+  MatrixView<T> fView;
+};
+
+template <typename T>
+MatrixView<const std::remove_const_t<T>> as_view(const MappedMatrix<T> &m) {
+  return m.view();
+}
+
+/**
+ * @brief Map the matrix file at path without reading it. Throws
+ * std::runtime_error if its elements aren't T.
+ *
+ * @tparam T
+ */
+template <typename T>
+MappedMatrix<const T> map_matrix_file(const std::filesystem::path &path) {
+  // The header comes from the mapping, so the file can't change in between
+  ry::MappedFile file(path);
+  auto info = ry::read_matrix_file_info(file, path);
+  if (info.dtype != matrix_dtype_v<T>) {
+    throw std::runtime_error(path.string() + " holds " +
+                             matrix_dtype_name(info.dtype) + ", not " +
+                             matrix_dtype_name(matrix_dtype_v<T>));
+  }
+  return {std::move(file), info};
+}
+
+/**
+ * @brief Create a zero nrows x ncols matrix file at path, mapped for writing
+ *
+ * @tparam T
+ */
+template <typename T>
+MappedMatrix<T>
+create_matrix_file(const std::filesystem::path &path, std::size_t nrows,
+                   std::size_t ncols,
+                   MatrixLayout layout = MatrixLayout::ColumnMajor) {
+  MatrixFileInfo info{matrix_dtype_v<T>, layout, nrows, ncols};
+  return {ry::create_matrix_file(path, info), info};
+}
+
+/**
+ * @brief Write a matrix or view to path in the given layout
+ *
+ * @tparam M
+ */
+template <matrix_like M>
+void save_matrix_file(const std::filesystem::path &path, const M &matrix,
+                      MatrixLayout layout = MatrixLayout::ColumnMajor) {
+  auto src = as_view(matrix);
+  auto dst = create_matrix_file<matrix_value_t<M>>(path, src.nrows(),
+                                                   src.ncols(), layout);
+  matrix_copy(src, dst.view());
+  dst.sync();
+}
+
+/**
+ * @brief Default memory budget for the tile buffers of an out-of-core multiply
+ *
+ */
+inline constexpr std::size_t kOutOfCoreMemoryBudget = std::size_t{256} << 20;
+
+namespace matrix_file_detail {
+struct Tiles {
+  std::size_t m, n, k;
+};
+
+// Square c tiles with a and b tiles half as deep: the operands are reread
+// once per tile of c in the other dimension, so the c tile gets most of the
+// budget
+inline Tiles out_of_core_tiles(std::size_t m, std::size_t n, std::size_t k,
+                               std::size_t budgetElements) {
+  const auto side = std::max<std::size_t>(
+      1, static_cast<std::size_t>(std::sqrt(budgetElements / 2.0)));
+  Tiles res{std::min(m, side), std::min(n, side), 1};
+  const std::size_t left =
+      budgetElements > res.m * res.n ? budgetElements - res.m * res.n : 0;
+  res.k = std::clamp<std::size_t>(left / std::max<std::size_t>(
+                                             1, res.m + res.n),
+                                  1, std::max<std::size_t>(k, 1));
+  return res;
+}
+} // namespace matrix_file_detail
+
+/**
+ * @brief c = alpha * a * b + beta * c for operands too large for memory,
+ * typically mapped files. Tiles of a, b and c are copied into buffers of at
+ * most memoryBudget bytes in total and multiplied there, so only those buffers
+ * and the pages currently being streamed need to be resident. Each tile of c
+ * is read (unless beta is 0) and written once.
+ *
+ * @tparam T
+ */
+template <typename T>
+void matrix_multiply_add_out_of_core(
+    T alpha, std::type_identity_t<MatrixView<const T>> a,
+    std::type_identity_t<MatrixView<const T>> b, T beta,
+    std::type_identity_t<MatrixView<T>> c,
+    std::size_t memoryBudget = kOutOfCoreMemoryBudget) {
+  if (a.ncols() != b.nrows() || a.nrows() != c.nrows() ||
+      b.ncols() != c.ncols()) {
+    throw std::runtime_error(
+        "Size mismatch: " + print_size(a.nrows(), a.ncols()) + " * " +
+        print_size(b.nrows(), b.ncols()) + " -> " +
+        print_size(c.nrows(), c.ncols()));
+  }
+  const std::size_t m = c.nrows(), n = c.ncols(), k = a.ncols();
+  if (m == 0 || n == 0) {
+    return;
+  }
+  auto tiles =
+      matrix_file_detail::out_of_core_tiles(m, n, k, memoryBudget / sizeof(T));
+  auto aBuf = ry::detail::make_aligned_buffer<T>(tiles.m * tiles.k);
+  auto bBuf = ry::detail::make_aligned_buffer<T>(tiles.k * tiles.n);
+  auto cBuf = ry::detail::make_aligned_buffer<T>(tiles.m * tiles.n);
+  for (std::size_t j0 = 0; j0 < n; j0 += tiles.n) {
+    const std::size_t ncur = std::min(tiles.n, n - j0);
+    for (std::size_t i0 = 0; i0 < m; i0 += tiles.m) {
+      const std::size_t mcur = std::min(tiles.m, m - i0);
+      MatrixView<T> cTile(cBuf.get(), mcur, ncur);
+      if (beta != T{0}) {
+        matrix_copy<T>(c.submatrix(i0, j0, mcur, ncur), cTile);
+      }
+      T tileBeta = beta;
+      std::size_t l0 = 0;
+      do {
+        const std::size_t kcur = std::min(tiles.k, k - l0);
+        MatrixView<T> aTile(aBuf.get(), mcur, kcur);
+        MatrixView<T> bTile(bBuf.get(), kcur, ncur);
+        matrix_copy<T>(a.submatrix(i0, l0, mcur, kcur), aTile);
+        matrix_copy<T>(b.submatrix(l0, j0, kcur, ncur), bTile);
+        matrix_multiply_add<T>(alpha, aTile, bTile, tileBeta, cTile);
+        tileBeta = T{1};
+        l0 += kcur;
+      } while (l0 < k);
+      matrix_copy<T>(cTile, c.submatrix(i0, j0, mcur, ncur));
+    }
+  }
+}
+
+/**
+ * @brief a * b written to a new column-major matrix file at path, computed
+ * out of core so neither the operands nor the result need fit in memory
+ *
+ * @return MappedMatrix<matrix_value_t<MA>>
+ */
+template <matrix_like MA, matrix_like MB>
+auto matrix_multiply_out_of_core(
+    const MA &a, const MB &b, const std::filesystem::path &path,
+    std::size_t memoryBudget = kOutOfCoreMemoryBudget) {
+  using T = matrix_value_t<MA>;
+  static_assert(std::is_same_v<T, matrix_value_t<MB>>,
+                "Operands must have the same element type");
+  auto av = as_view(a);
+  auto bv = as_view(b);
+  if (av.ncols() != bv.nrows()) {
+    throw std::runtime_error(
+        "Inner dimension size mismatch: " + print_size(av.nrows(), av.ncols()) +
+        " * " + print_size(bv.nrows(), bv.ncols()));
+  }
+  auto c = create_matrix_file<T>(path, av.nrows(), bv.ncols());
+  matrix_multiply_add_out_of_core(T{1}, av, bv, T{0}, c.view(), memoryBudget);
+  c.sync();
+  return c;
+}
@@ -1,27 +1,806 @@
+#include "matrix_factor.hpp"
+#include "matrix_file.hpp"
 #include "matrix_ops.hpp"
+#include "matrix_quantized.hpp"
+#include "matrix_sparse.hpp"
+#include "matrix_strassen.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
-int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    std::cerr << "Usage " << argv[0] << " num_rows\n";
-    return 1;
+/**
+ * GEMM benchmark harness. Sweeps sizes, aspect ratios, element types, kernel
+ * variants, thread counts and the density of a; reports median/p95 time,
+ * GFLOPS, the footprint of a and speedup over the first kernel after warmup
+ * runs; checks every result against matrix_multiply_naive; and optionally
+ * writes CSV/JSON to compare versions. Operands can also be loaded from, or
+ * saved to, matrix files (see matrix_file.hpp). Square a can also be
+ * factored, to compare LU and Cholesky rates with the products they are built
+ * on. Run with --help for the options.
+ */
+
+namespace {
+struct Options {
+  std::vector<std::size_t> sizes{128, 256, 512, 1024};
+  // m, k and n as multiples of each size
+  std::vector<std::array<double, 3>> aspects{{1, 1, 1}};
+  std::vector<std::string> types{"double", "float"};
+  // Fraction of the entries of a that are nonzero
+  std::vector<double> densities{1};
+  std::vector<std::string> kernels;
+  std::vector<std::size_t> threads;
+  std::size_t warmup = 1;
+  std::size_t reps = 5;
+  // Products with more multiply-adds than this are checked at sampled entries
+  // rather than in full, since the naive kernel is so slow
+  double fullCheckLimit = 256.0 * 256.0 * 256.0;
+  std::string csvPath;
+  std::string jsonPath;
+  std::string label;
+  // Operands mapped from matrix files instead of generated
+  std::string aFile;
+  std::string bFile;
+  // Generated operands are also saved to matrix files starting with this
+  std::string savePrefix;
+  // Tile buffer budget of the out-of-core kernel
+  std::size_t memoryBudget = kOutOfCoreMemoryBudget;
+  // Factorizations of square a run after the kernels
+  std::vector<std::string> factorizations;
+};
+
+struct Result {
+  std::string type;
+  std::string kernel;
+  std::size_t m, k, n;
+  std::size_t threads;
+  double density;
+  std::size_t reps;
+  double minSeconds, medianSeconds, p95Seconds;
+  // 2 * m * k * n / median time, whatever the format of a, so rates compare
+  // directly. Factorizations count their own flops: 2/3 n^3 for LU and 1/3
+  // n^3 for Cholesky.
+  double gflops;
+  // Bytes of a in the kernel's format
+  std::size_t aBytes;
+  // Median time of the first kernel for the same case over this one's
+  double speedup;
+  double maxRelError;
+  bool passed;
+};
+
+void print_usage(const char *argv0) {
+  std::cerr
+      << "Usage " << argv0 << " [options]\n"
+      << "  --sizes 128,256,...     Base sizes\n"
+      << "  --aspects 1x1x1,4x1x.25 m x k x n as multiples of each size\n"
+      << "  --types double,float    Element types\n"
+      << "  --densities 1,.01       Fraction of nonzeros in a (default 1)\n"
+      << "  --kernels a,b,...       blocked, naive, strassen,\n"
+      << "                          cache-oblivious, scalar, sse4.2, avx2,\n"
+      << "                          avx512, csr, csc, out-of-core, int8,\n"
+      << "                          int16 (default: every gemm ISA the CPU\n"
+      << "                          supports).\n"
+      << "                          Speedups are relative to the first.\n"
+      << "  --threads 1,2,4         Thread counts (default: current)\n"
+      << "  --warmup N              Untimed runs per case (default 1)\n"
+      << "  --reps N                Timed runs per case (default 5)\n"
+      << "  --csv FILE, --json FILE Also write results to FILE\n"
+      << "  --label TEXT            Version label recorded in CSV/JSON\n"
+      << "  --a-file F --b-file F   Map a and b from matrix files; replaces\n"
+      << "                          --sizes, --aspects, --types, --densities\n"
+      << "  --save-operands PREFIX  Save generated a and b as matrix files\n"
+      << "                          named PREFIX{a,b}-type-rowsxcols-density\n"
+      << "  --memory-budget MIB     Tile buffers for out-of-core (256)\n"
+      << "  --factorizations a,...  Also factor square a with lu, cholesky\n"
+      << "                          (of a * a^T + m * I), lu-naive or\n"
+      << "                          cholesky-naive\n";
+}
+
+std::vector<std::string> split(const std::string &list, char sep) {
+  std::vector<std::string> res;
+  std::istringstream iss(list);
+  std::string item;
+  while (std::getline(iss, item, sep)) {
+    if (!item.empty()) {
+      res.push_back(item);
+    }
+  }
+  return res;
+}
+
+std::optional<Options> parse_options(int argc, char *argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--help" || i + 1 == argc) {
+      return std::nullopt;
+    }
+    const std::string value = argv[++i];
+    if (arg == "--sizes") {
+      opts.sizes.clear();
+      for (const auto &size : split(value, ',')) {
+        opts.sizes.push_back(std::stoull(size));
+      }
+    } else if (arg == "--aspects") {
+      opts.aspects.clear();
+      for (const auto &aspect : split(value, ',')) {
+        auto ratios = split(aspect, 'x');
+        if (ratios.size() != 3) {
+          throw std::runtime_error("Aspect " + aspect + " is not m x k x n");
+        }
+        opts.aspects.push_back({std::stod(ratios[0]), std::stod(ratios[1]),
+                                std::stod(ratios[2])});
+      }
+    } else if (arg == "--types") {
+      opts.types = split(value, ',');
+    } else if (arg == "--densities") {
+      opts.densities.clear();
+      for (const auto &density : split(value, ',')) {
+        opts.densities.push_back(std::stod(density));
+      }
+    } else if (arg == "--kernels") {
+      opts.kernels = split(value, ',');
+      for (const auto &kernel : opts.kernels) {
+        const bool known =
+            kernel == "blocked" || kernel == "naive" || kernel == "strassen" ||
+            kernel == "cache-oblivious" || kernel == "scalar" ||
+            kernel == "sse4.2" || kernel == "avx2" || kernel == "avx512" ||
+            kernel == "csr" || kernel == "csc" || kernel == "out-of-core" ||
+            kernel == "int8" || kernel == "int16";
+        if (!known) {
+          throw std::runtime_error("Unknown kernel " + kernel);
+        }
+      }
+    } else if (arg == "--threads") {
+      opts.threads.clear();
+      for (const auto &threads : split(value, ',')) {
+        opts.threads.push_back(std::stoull(threads));
+      }
+    } else if (arg == "--warmup") {
+      opts.warmup = std::stoull(value);
+    } else if (arg == "--reps") {
+      opts.reps = std::max<std::size_t>(1, std::stoull(value));
+    } else if (arg == "--csv") {
+      opts.csvPath = value;
+    } else if (arg == "--json") {
+      opts.jsonPath = value;
+    } else if (arg == "--label") {
+      opts.label = value;
+    } else if (arg == "--a-file") {
+      opts.aFile = value;
+    } else if (arg == "--b-file") {
+      opts.bFile = value;
+    } else if (arg == "--save-operands") {
+      opts.savePrefix = value;
+    } else if (arg == "--memory-budget") {
+      opts.memoryBudget = std::stoull(value) << 20;
+    } else if (arg == "--factorizations") {
+      opts.factorizations = split(value, ',');
+      for (const auto &name : opts.factorizations) {
+        if (name != "lu" && name != "cholesky" && name != "lu-naive" &&
+            name != "cholesky-naive") {
+          throw std::runtime_error("Unknown factorization " + name);
+        }
+      }
+    } else {
+      return std::nullopt;
+    }
+  }
+  if (opts.aFile.empty() != opts.bFile.empty()) {
+    throw std::runtime_error("--a-file and --b-file go together");
+  }
+  if (opts.kernels.empty()) {
+    for (auto isa : {ry::GemmIsa::Scalar, ry::GemmIsa::Sse42,
+                     ry::GemmIsa::Avx2, ry::GemmIsa::Avx512}) {
+      if (ry::gemm_isa_supported(isa)) {
+        opts.kernels.push_back(ry::gemm_isa_name(isa));
+      }
+    }
+  }
+  if (opts.threads.empty()) {
+    opts.threads.push_back(ry::get_num_threads());
+  }
+  return opts;
+}
+
+// Multiplies by a fixed a, converted to the kernel's format up front so the
+// conversion isn't timed
+template <typename T> struct PreparedKernel {
+  // c = a * b
+  std::function<void(MatrixView<const T> b, MatrixView<T> c)> run;
+  std::size_t aBytes;
+  // Largest acceptable max_relative_error; 0 for the rounding error bound
+  double tolerance = 0;
+};
+
+// Symmetric quantization of m onto [-levels, levels]
+template <typename T>
+QuantParams symmetric_quant_params(MatrixView<const T> m, double levels) {
+  double maxAbs = 0;
+  for (std::size_t col = 0; col < m.ncols(); ++col) {
+    for (std::size_t row = 0; row < m.nrows(); ++row) {
+      maxAbs = std::max(maxAbs, std::abs(static_cast<double>(m(row, col))));
+    }
+  }
+  return {maxAbs == 0 ? 1.0f : static_cast<float>(maxAbs / levels), 0};
+}
+
+// The named variant for a, or nullopt if it can't run here
+template <typename T>
+std::optional<PreparedKernel<T>> prepare_kernel(const Options &opts,
+                                                const std::string &name,
+                                                MatrixView<const T> matrixA) {
+  auto dense = [a = matrixA](auto &&multiply) {
+    return PreparedKernel<T>{
+        [a, multiply](auto b, auto c) { multiply(a, b, c); },
+        a.numel() * sizeof(T)};
+  };
+  if (name == "csr" || name == "csc") {
+    // Column vectors take the SpMV path
+    auto sparse = [](auto a) {
+      return PreparedKernel<T>{
+          [a](MatrixView<const T> b, MatrixView<T> c) {
+            if (b.ncols() == 1 && b.row_stride() == 1 && c.row_stride() == 1) {
+              spmv(T{1}, *a, std::span<const T>(b.data(), b.nrows()), T{0},
+                   std::span<T>(c.data(), c.nrows()));
+            } else {
+              spmm(T{1}, *a, b, T{0}, c);
+            }
+          },
+          a->memory_bytes()};
+    };
+    if (name == "csr") {
+      return sparse(std::make_shared<const CsrMatrix<T>>(
+          CsrMatrix<T>::from_dense(matrixA)));
+    }
+    return sparse(std::make_shared<const CscMatrix<T>>(
+        CscMatrix<T>::from_dense(matrixA)));
+  }
+  if (name == "int8" || name == "int16") {
+    // b is quantized inside the timed run, as a layer's input would be. int16
+    // levels are limited so that k products can't overflow the accumulator.
+    auto quantized = [&matrixA](auto q, double levels, double tolerance) {
+      using Q = decltype(q);
+      const auto qa = symmetric_quant_params(matrixA, levels);
+      auto a = std::make_shared<const Matrix<Q>>(quantize<Q>(matrixA, qa));
+      return PreparedKernel<T>{
+          [a, qa, levels](MatrixView<const T> b, MatrixView<T> c) {
+            const auto qb = symmetric_quant_params(b, levels);
+            quantized_matrix_multiply<T>(*a, qa, quantize<Q>(b, qb), qb, c);
+          },
+          a->numel() * sizeof(Q), tolerance};
+    };
+    if (name == "int8") {
+      return quantized(std::int8_t{}, 127, 0.05);
+    }
+    const double k = std::max<double>(1, static_cast<double>(matrixA.ncols()));
+    return quantized(std::int16_t{},
+                     std::floor(std::min(32767.0, std::sqrt(2147483647.0 / k))),
+                     1e-3);
+  }
+  if (name == "blocked") {
+    return dense([](auto a, auto b, auto c) {
+      matrix_multiply_add(T{1}, a, b, T{0}, c);
+    });
+  }
+  if (name == "strassen" || name == "cache-oblivious") {
+    RecursiveMultiplyOptions opts;
+    opts.strassen = name == "strassen";
+    return dense([opts](auto a, auto b, auto c) {
+      matrix_multiply_add_recursive(T{1}, a, b, T{0}, c, opts);
+    });
+  }
+  if (name == "out-of-core") {
+    return dense([budget = opts.memoryBudget](auto a, auto b, auto c) {
+      matrix_multiply_add_out_of_core(T{1}, a, b, T{0}, c, budget);
+    });
+  }
+  if (name == "naive") {
+    return dense([](auto a, auto b, auto c) {
+      auto res = matrix_multiply_naive(a.to_vector(), a.nrows(), a.ncols(),
+                                       b.to_vector(), b.nrows(), b.ncols());
+      std::copy(res.begin(), res.end(), c.data());
+    });
+  }
+  for (auto isa : {ry::GemmIsa::Scalar, ry::GemmIsa::Sse42, ry::GemmIsa::Avx2,
+                   ry::GemmIsa::Avx512}) {
+    if (name != ry::gemm_isa_name(isa)) {
+      continue;
+    }
+    if (!ry::gemm_isa_supported(isa)) {
+      return std::nullopt;
+    }
+    auto kernel = ry::gemm_kernel_for_isa<T>(isa);
+    return dense([kernel](auto a, auto b, auto c) {
+      auto blocking = ry::default_gemm_blocking(kernel);
+      auto &pool = ry::default_thread_pool();
+      if (pool.size() > 1) {
+        ry::gemm_parallel(c.nrows(), c.ncols(), a.ncols(), T{1}, a.data(),
+                          a.row_stride(), a.col_stride(), b.data(),
+                          b.row_stride(), b.col_stride(), T{0}, c.data(),
+                          c.row_stride(), c.col_stride(), kernel, blocking,
+                          pool);
+      } else {
+        ry::gemm(c.nrows(), c.ncols(), a.ncols(), T{1}, a.data(),
+                 a.row_stride(), a.col_stride(), b.data(), b.row_stride(),
+                 b.col_stride(), T{0}, c.data(), c.row_stride(),
+                 c.col_stride(), kernel, blocking);
+      }
+    });
+  }
+  throw std::runtime_error("Unknown kernel " + name);
+}
+
+// Entries are nonzero with probability density
+template <typename T>
+Matrix<T> random_matrix(std::size_t nrows, std::size_t ncols,
+                        std::mt19937 &gen, double density = 1) {
+  std::uniform_real_distribution<double> dist(-1, 1);
+  std::bernoulli_distribution nonzero(density);
+  Matrix<T> res(nrows, ncols, uninitialized);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = density >= 1 || nonzero(gen) ? static_cast<T>(dist(gen))
+                                                 : T{0};
+  }
+  return res;
+}
+
+// Largest error of c relative to sum_l |a(i, l) * b(l, j)|, the scale of the
+// rounding error any summation order can make. Compares every entry with
+// matrix_multiply_naive for small products and a random sample otherwise.
+template <typename T>
+double max_relative_error(MatrixView<const T> a, MatrixView<const T> b,
+                          const Matrix<T> &c, double fullCheckLimit,
+                          std::mt19937 &gen) {
+  const std::size_t m = a.nrows(), k = a.ncols(), n = b.ncols();
+  auto error_at = [&](std::size_t i, std::size_t j, double expected) {
+    double scale = 0;
+    for (std::size_t l = 0; l < k; ++l) {
+      scale += std::abs(static_cast<double>(a(i, l)) * b(l, j));
+    }
+    const double err = std::abs(static_cast<double>(c(i, j)) - expected);
+    return scale == 0 ? err : err / scale;
+  };
+
+  double maxError = 0;
+  if (static_cast<double>(m) * k * n <= fullCheckLimit) {
+    auto expected =
+        matrix_multiply_naive(a.to_vector(), m, k, b.to_vector(), k, n);
+    for (std::size_t j = 0; j < n; ++j) {
+      for (std::size_t i = 0; i < m; ++i) {
+        maxError = std::max(maxError, error_at(i, j, expected[i + j * m]));
+      }
+    }
+    return maxError;
+  }
+  std::uniform_int_distribution<std::size_t> row(0, m - 1), col(0, n - 1);
+  for (int sample = 0; sample < 256; ++sample) {
+    const std::size_t i = row(gen), j = col(gen);
+    // The naive kernel's sum for a single entry, accumulated in T
+    T expected{0};
+    for (std::size_t l = 0; l < k; ++l) {
+      expected += a(i, l) * b(l, j);
+    }
+    maxError = std::max(maxError, error_at(i, j, expected));
+  }
+  return maxError;
+}
+
+template <typename T>
+std::optional<Result> run_case(const Options &opts, const std::string &type,
+                               const std::string &kernelName,
+                               MatrixView<const T> a, MatrixView<const T> b,
+                               std::size_t threads, double density) {
+  const std::size_t m = a.nrows(), k = a.ncols(), n = b.ncols();
+  std::mt19937 gen(static_cast<unsigned>(m * 31 + k * 17 + n));
+  Matrix<T> c(m, n);
+  auto kernel = prepare_kernel<T>(opts, kernelName, a);
+  if (!kernel) {
+    return std::nullopt;
+  }
+
+  for (std::size_t rep = 0; rep < opts.warmup; ++rep) {
+    kernel->run(b, c);
+  }
+  std::vector<double> seconds;
+  for (std::size_t rep = 0; rep < opts.reps; ++rep) {
+    auto start = std::chrono::steady_clock::now();
+    kernel->run(b, c);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    seconds.push_back(elapsed.count());
+  }
+  std::sort(seconds.begin(), seconds.end());
+  // Nearest-rank percentiles
+  auto percentile = [&seconds](double p) {
+    auto rank = static_cast<std::size_t>(std::ceil(p * seconds.size()));
+    return seconds[std::clamp<std::size_t>(rank, 1, seconds.size()) - 1];
+  };
+
+  Result res{type, kernelName, m, k, n, threads, density, opts.reps};
+  res.minSeconds = seconds.front();
+  res.medianSeconds = percentile(0.5);
+  res.p95Seconds = percentile(0.95);
+  res.gflops = 2.0 * m * k * n / res.medianSeconds / 1e9;
+  res.aBytes = kernel->aBytes;
+  res.speedup = 1;
+  res.maxRelError = max_relative_error(a, b, c, opts.fullCheckLimit, gen);
+  // Generous enough for Strassen's weaker error bound
+  const double tolerance =
+      kernel->tolerance > 0
+          ? kernel->tolerance
+          : 64.0 * std::sqrt(static_cast<double>(k)) *
+                std::numeric_limits<T>::epsilon();
+  res.passed = res.maxRelError <= tolerance;
+  return res;
+}
+
+// Textbook LU with partial pivoting, one element at a time
+template <typename T>
+std::vector<std::size_t> lu_factor_naive(MatrixView<T> a) {
+  const std::size_t n = a.nrows();
+  std::vector<std::size_t> pivots(n);
+  for (std::size_t j = 0; j < n; ++j) {
+    std::size_t pivot = j;
+    for (std::size_t i = j + 1; i < n; ++i) {
+      if (std::abs(a(i, j)) > std::abs(a(pivot, j))) {
+        pivot = i;
+      }
+    }
+    pivots[j] = pivot;
+    for (std::size_t col = 0; col < n; ++col) {
+      std::swap(a(j, col), a(pivot, col));
+    }
+    for (std::size_t i = j + 1; i < n; ++i) {
+      a(i, j) /= a(j, j);
+      for (std::size_t col = j + 1; col < n; ++col) {
+        a(i, col) -= a(i, j) * a(j, col);
+      }
+    }
+  }
+  return pivots;
+}
+
+// Textbook Cholesky of the lower triangle, one element at a time
+template <typename T> void cholesky_factor_naive(MatrixView<T> a) {
+  const std::size_t n = a.nrows();
+  for (std::size_t j = 0; j < n; ++j) {
+    for (std::size_t l = 0; l < j; ++l) {
+      a(j, j) -= a(j, l) * a(j, l);
+    }
+    a(j, j) = std::sqrt(a(j, j));
+    for (std::size_t i = j + 1; i < n; ++i) {
+      for (std::size_t l = 0; l < j; ++l) {
+        a(i, j) -= a(i, l) * a(j, l);
+      }
+      a(i, j) /= a(j, j);
+    }
+  }
+}
+
+// Factor square a (or a * a^T + m * I for Cholesky, which needs a positive
+// definite matrix), checked by the backward error of a solve with rhs:
+// |a * x - rhs| / (|a| |x| + |rhs|) in the infinity norm
+template <typename T>
+Result run_factorization(const Options &opts, const std::string &type,
+                         const std::string &name, MatrixView<const T> a,
+                         MatrixView<const T> rhs, std::size_t threads,
+                         double density) {
+  const std::size_t n = a.nrows();
+  const bool cholesky = name.starts_with("cholesky");
+  const bool naive = name.ends_with("-naive");
+  Matrix<T> input(a);
+  if (cholesky) {
+    input = matrix_multiply(a, a.transpose());
+    for (std::size_t k = 0; k < n; ++k) {
+      input(k, k) += static_cast<T>(n);
+    }
   }
-  std::size_t n = std::stoll(argv[1]);
-  std::vector<double> a(n * n);
-  for (size_t k = 0; k < a.size(); ++k) {
-    a[k] = k;
+
+  Matrix<T> work(n, n, uninitialized);
+  std::vector<std::size_t> pivots;
+  auto factor = [&] {
+    if (cholesky) {
+      naive ? cholesky_factor_naive(work.view())
+            : cholesky_factor_in_place(work.view());
+    } else {
+      pivots = naive ? lu_factor_naive(work.view())
+                     : lu_factor_in_place(work.view());
+    }
+  };
+  std::vector<double> seconds;
+  for (std::size_t rep = 0; rep < opts.warmup + opts.reps; ++rep) {
+    matrix_copy<T>(input, work.view());
+    auto start = std::chrono::steady_clock::now();
+    factor();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    if (rep >= opts.warmup) {
+      seconds.push_back(elapsed.count());
+    }
   }
+  std::sort(seconds.begin(), seconds.end());
+  auto percentile = [&seconds](double p) {
+    auto rank = static_cast<std::size_t>(std::ceil(p * seconds.size()));
+    return seconds[std::clamp<std::size_t>(rank, 1, seconds.size()) - 1];
+  };
 
-  auto start = std::chrono::steady_clock::now();
-  auto res = matrix_multiply(a, n, n, a, n, n);
-  auto end = std::chrono::steady_clock::now();
+  Result res{type, name, n, n, n, threads, density, opts.reps};
+  res.minSeconds = seconds.front();
+  res.medianSeconds = percentile(0.5);
+  res.p95Seconds = percentile(0.95);
+  const double flops = (cholesky ? 1.0 : 2.0) / 3.0 * n * n * n;
+  res.gflops = flops / res.medianSeconds / 1e9;
+  res.aBytes = n * n * sizeof(T);
+  res.speedup = 1;
 
-  std::cout << "Elapsed time for size (" << n << "," << n << "): "
-            << std::chrono::duration_cast<std::chrono::microseconds>(end -
-                                                                     start)
-            << ".\n";
+  Matrix<T> x(rhs);
+  if (cholesky) {
+    cholesky_solve_in_place<T>(work, x.view());
+  } else {
+    lu_solve_in_place(LuFactorization<T>{std::move(work), pivots}, x.view());
+  }
+  auto residual = matrix_multiply(input, x);
+  double residualNorm = 0, aNorm = 0, xNorm = 0, rhsNorm = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    double rowSum = 0;
+    for (std::size_t j = 0; j < n; ++j) {
+      rowSum += std::abs(static_cast<double>(input(i, j)));
+    }
+    aNorm = std::max(aNorm, rowSum);
+    const double diff = static_cast<double>(residual(i, 0)) - rhs(i, 0);
+    residualNorm = std::max(residualNorm, std::abs(diff));
+    xNorm = std::max(xNorm, std::abs(static_cast<double>(x(i, 0))));
+    rhsNorm = std::max(rhsNorm, std::abs(static_cast<double>(rhs(i, 0))));
+  }
+  const double scale = aNorm * xNorm + rhsNorm;
+  res.maxRelError = scale == 0 ? residualNorm : residualNorm / scale;
+  res.passed = res.maxRelError <= 64.0 * std::sqrt(static_cast<double>(n)) *
+                                      std::numeric_limits<T>::epsilon();
+  return res;
+}
 
-  return res[12] == 0;
+void print_header() {
+  std::cout << std::left << std::setw(7) << "type" << std::setw(16)
+            << "kernel" << std::right << std::setw(6) << "m" << std::setw(6)
+            << "k" << std::setw(6) << "n" << std::setw(8) << "threads"
+            << std::setw(9) << "density" << std::setw(11) << "median_ms"
+            << std::setw(11) << "p95_ms" << std::setw(9) << "GFLOPS"
+            << std::setw(10) << "a_KiB" << std::setw(9) << "speedup"
+            << std::setw(10) << "rel_err" << "  check\n";
+}
+
+void print_result(const Result &r) {
+  std::cout << std::left << std::setw(7) << r.type << std::setw(16)
+            << r.kernel << std::right << std::setw(6) << r.m << std::setw(6)
+            << r.k << std::setw(6) << r.n << std::setw(8) << r.threads
+            << std::setw(9) << r.density << std::fixed << std::setprecision(3)
+            << std::setw(11) << r.medianSeconds * 1e3 << std::setw(11)
+            << r.p95Seconds * 1e3 << std::setprecision(2) << std::setw(9)
+            << r.gflops << std::setprecision(1) << std::setw(10)
+            << r.aBytes / 1024.0 << std::setprecision(2) << std::setw(9)
+            << r.speedup << std::scientific << std::setprecision(1)
+            << std::setw(10) << r.maxRelError << std::defaultfloat << "  "
+            << (r.passed ? "ok" : "FAIL") << std::endl;
+}
+
+void write_csv(const std::string &path, const Options &opts,
+               const std::vector<Result> &results) {
+  std::ofstream out(path);
+  out << "label,isa,type,kernel,m,k,n,threads,density,reps,min_s,median_s,"
+         "p95_s,gflops,a_bytes,speedup,max_rel_error,passed\n";
+  out << std::setprecision(9);
+  for (const auto &r : results) {
+    out << opts.label << "," << ry::gemm_isa_name(ry::active_gemm_isa())
+        << "," << r.type << "," << r.kernel << "," << r.m << "," << r.k << ","
+        << r.n << "," << r.threads << "," << r.density << "," << r.reps << ","
+        << r.minSeconds << "," << r.medianSeconds << "," << r.p95Seconds
+        << "," << r.gflops << "," << r.aBytes << "," << r.speedup << ","
+        << r.maxRelError << "," << (r.passed ? "true" : "false") << "\n";
+  }
+}
+
+std::string json_escape(const std::string &text) {
+  std::string res;
+  for (char ch : text) {
+    if (ch == '"' || ch == '\\') {
+      res += '\\';
+    }
+    res += ch;
+  }
+  return res;
+}
+
+void write_json(const std::string &path, const Options &opts,
+                const std::vector<Result> &results) {
+  std::ofstream out(path);
+  out << std::setprecision(9);
+  out << "{\n  \"label\": \"" << json_escape(opts.label) << "\",\n"
+      << "  \"isa\": \"" << ry::gemm_isa_name(ry::active_gemm_isa())
+      << "\",\n"
+      << "  \"hardware_concurrency\": " << std::thread::hardware_concurrency()
+      << ",\n  \"warmup\": " << opts.warmup << ",\n  \"results\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto &r = results[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"type\": \"" << r.type
+        << "\", \"kernel\": \"" << r.kernel << "\", \"m\": " << r.m
+        << ", \"k\": " << r.k << ", \"n\": " << r.n
+        << ", \"threads\": " << r.threads << ", \"density\": " << r.density
+        << ", \"reps\": " << r.reps
+        << ", \"min_s\": " << r.minSeconds
+        << ", \"median_s\": " << r.medianSeconds
+        << ", \"p95_s\": " << r.p95Seconds << ", \"gflops\": " << r.gflops
+        << ", \"a_bytes\": " << r.aBytes << ", \"speedup\": " << r.speedup
+        << ", \"max_rel_error\": " << r.maxRelError
+        << ", \"passed\": " << (r.passed ? "true" : "false") << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+// Every kernel on one pair of operands, with speedups over the first, then
+// every factorization of a if it is square
+template <typename T>
+void run_kernels(const Options &opts, const std::string &type,
+                 MatrixView<const T> a, MatrixView<const T> b,
+                 std::size_t threads, double density,
+                 std::vector<Result> &results) {
+  std::optional<double> baseline;
+  for (const auto &kernel : opts.kernels) {
+    auto res = run_case<T>(opts, type, kernel, a, b, threads, density);
+    if (!res) {
+      std::cerr << "Skipping " << kernel << ": not supported here\n";
+      continue;
+    }
+    if (!baseline) {
+      baseline = res->medianSeconds;
+    }
+    res->speedup = *baseline / res->medianSeconds;
+    print_result(*res);
+    results.push_back(*res);
+  }
+
+  if (a.nrows() != a.ncols()) {
+    return;
+  }
+  // Speedups are over the first LU or the first Cholesky
+  double factorBaselines[2] = {};
+  for (const auto &name : opts.factorizations) {
+    auto res = run_factorization<T>(opts, type, name, a, b.columns(0, 1),
+                                    threads, density);
+    double &baseline = factorBaselines[name.starts_with("cholesky")];
+    if (baseline == 0) {
+      baseline = res.medianSeconds;
+    }
+    res.speedup = baseline / res.medianSeconds;
+    print_result(res);
+    results.push_back(res);
+  }
+}
+
+template <typename T>
+void run_generated(const Options &opts, const std::string &type,
+                   std::size_t m, std::size_t k, std::size_t n,
+                   std::size_t threads, std::vector<Result> &results) {
+  for (auto density : opts.densities) {
+    std::mt19937 gen(static_cast<unsigned>(m * 31 + k * 17 + n));
+    auto a = random_matrix<T>(m, k, gen, density);
+    auto b = random_matrix<T>(k, n, gen);
+    if (!opts.savePrefix.empty()) {
+      auto name = [&](const char *operand, const Matrix<T> &matrix) {
+        std::ostringstream oss;
+        oss << opts.savePrefix << operand << "-" << type << "-"
+            << matrix.nrows() << "x" << matrix.ncols() << "-" << density
+            << ".rym";
+        return oss.str();
+      };
+      save_matrix_file(name("a", a), a);
+      save_matrix_file(name("b", b), b);
+    }
+    run_kernels<T>(opts, type, a, b, threads, density, results);
+  }
+}
+
+// Operands mapped from files are used in place, never copied into memory
+template <typename T>
+void run_files(const Options &opts, const std::string &type,
+               std::vector<Result> &results) {
+  auto a = map_matrix_file<T>(opts.aFile);
+  auto b = map_matrix_file<T>(opts.bFile);
+  std::size_t nonzeros = 0;
+  for (std::size_t col = 0; col < a.ncols(); ++col) {
+    for (std::size_t row = 0; row < a.nrows(); ++row) {
+      nonzeros += a(row, col) != T{0};
+    }
+  }
+  const double density =
+      a.numel() == 0 ? 1 : static_cast<double>(nonzeros) / a.numel();
+  for (auto threads : opts.threads) {
+    ry::set_num_threads(threads);
+    run_kernels<T>(opts, type, as_view(a), as_view(b), threads, density,
+                   results);
+  }
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::optional<Options> opts;
+  try {
+    opts = parse_options(argc, argv);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+  }
+  if (!opts) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::cout << "gemm ISA " << ry::gemm_isa_name(ry::active_gemm_isa())
+            << ", warmup " << opts->warmup << ", reps " << opts->reps << "\n";
+  print_header();
+  std::vector<Result> results;
+  try {
+    if (!opts->aFile.empty()) {
+      const auto dtype = read_matrix_file_info(opts->aFile).dtype;
+      if (dtype == MatrixDtype::Float64) {
+        run_files<double>(*opts, "double", results);
+      } else if (dtype == MatrixDtype::Float32) {
+        run_files<float>(*opts, "float", results);
+      } else {
+        std::cerr << "Unsupported element type " << matrix_dtype_name(dtype)
+                  << "\n";
+        return 1;
+      }
+    } else {
+      for (auto threads : opts->threads) {
+        ry::set_num_threads(threads);
+        for (const auto &type : opts->types) {
+          for (auto size : opts->sizes) {
+            for (const auto &aspect : opts->aspects) {
+              auto dim = [size](double ratio) {
+                return std::max<std::size_t>(
+                    1, static_cast<std::size_t>(std::llround(size * ratio)));
+              };
+              const std::size_t m = dim(aspect[0]), k = dim(aspect[1]),
+                                n = dim(aspect[2]);
+              if (type == "double") {
+                run_generated<double>(*opts, type, m, k, n, threads, results);
+              } else if (type == "float") {
+                run_generated<float>(*opts, type, m, k, n, threads, results);
+              } else {
+                std::cerr << "Unknown type " << type << "\n";
+                return 1;
+              }
+            }
+          }
+        }
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  if (!opts->csvPath.empty()) {
+    write_csv(opts->csvPath, *opts, results);
+  }
+  if (!opts->jsonPath.empty()) {
+    write_json(opts->jsonPath, *opts, results);
+  }
+  const bool allPassed = std::all_of(results.begin(), results.end(),
+                                     [](const Result &r) { return r.passed; });
+  return allPassed ? 0 : 2;
 }
@@ -1,11 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "gemm.hpp"
+#include "transpose.hpp"
+
 /**
  * @brief Print the size of a matrix in a nice way
  *
@@ -15,6 +23,417 @@
  */
 std::string print_size(std::size_t nrows, std::size_t ncols);
 
+/**
+ * @brief Extent of a Matrix whose size is only known at runtime
+ *
+ */
+inline constexpr std::size_t dynamic_size = std::dynamic_extent;
+
+/**
+ * @brief Order of the elements of a contiguous matrix in memory
+ *
+ */
+enum class MatrixLayout : std::uint32_t { ColumnMajor = 0, RowMajor = 1 };
+
+/**
+ * @brief Matrix with R rows and C columns. The default is heap-allocated with
+ * runtime dimensions; fixed sizes (see matrix_small.hpp) live inline.
+ *
+ */
+template <typename T, std::size_t R = dynamic_size,
+          std::size_t C = dynamic_size>
+class Matrix;
+
+template <typename T> class MatrixView;
+
+/**
+ * @brief dst = src for views of the same size in any layouts. Views whose
+ * unit strides cross (one column-major, the other row-major) go through the
+ * blocked ry::transpose.
+ *
+ */
+template <typename T>
+void matrix_copy(MatrixView<const T> src, MatrixView<T> dst);
+
+/**
+ * @brief Non-owning, strided view of an nrows x ncols matrix. Element (i, j)
+ * lives at data()[i * row_stride() + j * col_stride()], so sub-matrices,
+ * column ranges and transposes of a matrix are views of the same memory
+ * without copying. Use MatrixView<const T> for read-only views.
+ *
+ * @tparam T
+ */
+template <typename T> class MatrixView {
+public:
+  using value_type = T;
+
+  MatrixView() = default;
+  MatrixView(T *data, std::size_t nrows, std::size_t ncols,
+             std::size_t rowStride, std::size_t colStride)
+      : fData(data), fNrows(nrows), fNcols(ncols), fRowStride(rowStride),
+        fColStride(colStride) {}
+
+  /**
+   * @brief View of contiguous column-major data
+   *
+   */
+  MatrixView(T *data, std::size_t nrows, std::size_t ncols)
+      : MatrixView(data, nrows, ncols, 1, nrows) {}
+
+  /**
+   * @brief View of contiguous data in either layout
+   *
+   */
+  MatrixView(T *data, std::size_t nrows, std::size_t ncols,
+             MatrixLayout layout)
+      : MatrixView(data, nrows, ncols,
+                   layout == MatrixLayout::RowMajor ? ncols : 1,
+                   layout == MatrixLayout::RowMajor ? 1 : nrows) {}
+
+  // Allow MatrixView<T> -> MatrixView<const T>
+  operator MatrixView<const T>() const {
+    return {fData, fNrows, fNcols, fRowStride, fColStride};
+  }
+
+  T *data() const {
+    return fData;
+  }
+  std::size_t nrows() const {
+    return fNrows;
+  }
+  std::size_t ncols() const {
+    return fNcols;
+  }
+  std::size_t numel() const {
+    return fNrows * fNcols;
+  }
+  std::size_t row_stride() const {
+    return fRowStride;
+  }
+  std::size_t col_stride() const {
+    return fColStride;
+  }
+
+  T &operator()(std::size_t row, std::size_t col) const {
+    return fData[row * fRowStride + col * fColStride];
+  }
+
+  /**
+   * @brief View of the nrows x ncols block starting at (row, col)
+   *
+   */
+  MatrixView submatrix(std::size_t row, std::size_t col, std::size_t nrows,
+                       std::size_t ncols) const {
+    if (row + nrows > fNrows || col + ncols > fNcols) {
+      throw std::out_of_range("Submatrix " + print_size(nrows, ncols) +
+                              " at (" + std::to_string(row) + ", " +
+                              std::to_string(col) + ") exceeds " +
+                              print_size(fNrows, fNcols));
+    }
+    return {fData + row * fRowStride + col * fColStride, nrows, ncols,
+            fRowStride, fColStride};
+  }
+
+  MatrixView columns(std::size_t col, std::size_t ncols) const {
+    return submatrix(0, col, fNrows, ncols);
+  }
+
+  MatrixView rows(std::size_t row, std::size_t nrows) const {
+    return submatrix(row, 0, nrows, fNcols);
+  }
+
+  MatrixView transpose() const {
+    return {fData, fNcols, fNrows, fColStride, fRowStride};
+  }
+
+  /**
+   * @brief Copy the viewed elements out in column-major order
+   *
+   */
+  std::vector<std::remove_const_t<T>> to_vector() const {
+    using U = std::remove_const_t<T>;
+    std::vector<U> res(numel());
+    matrix_copy<U>(*this, MatrixView<U>(res.data(), fNrows, fNcols));
+    return res;
+  }
+
+private:
+  T *fData = nullptr;
+  std::size_t fNrows = 0;
+  std::size_t fNcols = 0;
+  std::size_t fRowStride = 1;
+  std::size_t fColStride = 0;
+};
+
+/**
+ * @brief Tag to construct a Matrix without initializing its elements, e.g. so
+ * the threads computing it are the first to touch its pages
+ *
+ */
+struct uninitialized_t {
+  explicit uninitialized_t() = default;
+};
+inline constexpr uninitialized_t uninitialized{};
+
+/**
+ * @brief Owning column-major matrix. Storage comes from ry::aligned_alloc so
+ * columns start on a cache line and vector loads never split one.
+ *
+ * @tparam T
+ */
+template <typename T> class Matrix<T, dynamic_size, dynamic_size> {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Matrix storage is raw memory from ry::aligned_alloc");
+
+public:
+  using value_type = T;
+  static constexpr std::size_t alignment = 64;
+
+  Matrix() = default;
+
+  Matrix(std::size_t nrows, std::size_t ncols, uninitialized_t)
+      : fNrows(nrows), fNcols(ncols), fData(allocate(nrows * ncols)) {}
+
+  Matrix(std::size_t nrows, std::size_t ncols)
+      : Matrix(nrows, ncols, uninitialized) {
+    std::fill(fData, fData + numel(), T{0});
+  }
+
+  /**
+   * @brief Matrix holding a copy of column-major data
+   *
+   */
+  Matrix(std::size_t nrows, std::size_t ncols, const std::vector<T> &data)
+      : Matrix(nrows, ncols, uninitialized) {
+    if (data.size() != numel()) {
+      throw std::runtime_error("Expected " + std::to_string(numel()) +
+                               " elements for a " + print_size(nrows, ncols) +
+                               " matrix but got " +
+                               std::to_string(data.size()));
+    }
+    std::copy(data.begin(), data.end(), fData);
+  }
+
+  /**
+   * @brief Matrix holding a copy of the elements of a view
+   *
+   */
+  explicit Matrix(MatrixView<const T> other)
+      : Matrix(other.nrows(), other.ncols(), uninitialized) {
+    matrix_copy(other, view());
+  }
+
+  Matrix(const Matrix &other) : Matrix(other.view()) {}
+  Matrix(Matrix &&other) noexcept
+      : fNrows(std::exchange(other.fNrows, 0)),
+        fNcols(std::exchange(other.fNcols, 0)),
+        fData(std::exchange(other.fData, nullptr)) {}
+  Matrix &operator=(const Matrix &other) {
+    if (this != &other) {
+      *this = Matrix(other);
+    }
+    return *this;
+  }
+  Matrix &operator=(Matrix &&other) noexcept {
+    std::swap(fNrows, other.fNrows);
+    std::swap(fNcols, other.fNcols);
+    std::swap(fData, other.fData);
+    return *this;
+  }
+  ~Matrix() {
+    ry::aligned_free(fData);
+  }
+
+  std::size_t nrows() const {
+    return fNrows;
+  }
+  std::size_t ncols() const {
+    return fNcols;
+  }
+  std::size_t numel() const {
+    return fNrows * fNcols;
+  }
+  T *data() {
+    return fData;
+  }
+  const T *data() const {
+    return fData;
+  }
+
+  T &operator()(std::size_t row, std::size_t col) {
+    return fData[row + col * fNrows];
+  }
+  const T &operator()(std::size_t row, std::size_t col) const {
+    return fData[row + col * fNrows];
+  }
+
+  MatrixView<T> view() {
+    return {fData, fNrows, fNcols};
+  }
+  MatrixView<const T> view() const {
+    return {fData, fNrows, fNcols};
+  }
+  operator MatrixView<T>() {
+    return view();
+  }
+  operator MatrixView<const T>() const {
+    return view();
+  }
+
+  std::vector<T> to_vector() const {
+    return std::vector<T>(fData, fData + numel());
+  }
+
+  /**
+   * @brief Reinterpret the column-major data as nrows x ncols
+   *
+   */
+  void reshape(std::size_t nrows, std::size_t ncols) {
+    if (nrows * ncols != numel()) {
+      throw std::runtime_error("Cannot reshape " + print_size(fNrows, fNcols) +
+                               " to " + print_size(nrows, ncols));
+    }
+    fNrows = nrows;
+    fNcols = ncols;
+  }
+
+private:
+  static T *allocate(std::size_t n) {
+    if (n == 0) {
+      return nullptr;
+    }
+    T *res = ry::aligned_alloc<T>(alignment, n * sizeof(T));
+    if (res == nullptr) {
+      throw std::bad_alloc();
+    }
+    return res;
+  }
+
+  std::size_t fNrows = 0;
+  std::size_t fNcols = 0;
+  T *fData = nullptr;
+};
+
+/**
+ * @brief Read-only view of a Matrix or MatrixView. Used to write one function
+ * template accepting either.
+ *
+ */
+template <typename T> MatrixView<const T> as_view(const Matrix<T> &m) {
+  return m.view();
+}
+template <typename T> MatrixView<const T> as_view(MatrixView<T> v) {
+  return v;
+}
+
+template <typename M>
+concept matrix_like = requires(const M &m) { as_view(m); };
+
+template <matrix_like M>
+using matrix_value_t = std::remove_const_t<
+    typename decltype(as_view(std::declval<const M &>()))::value_type>;
+
+template <typename T>
+void matrix_copy(MatrixView<const T> src, MatrixView<T> dst) {
+  if (src.nrows() != dst.nrows() || src.ncols() != dst.ncols()) {
+    throw std::runtime_error("Size mismatch: cannot copy " +
+                             print_size(src.nrows(), src.ncols()) + " to " +
+                             print_size(dst.nrows(), dst.ncols()));
+  }
+  const std::size_t m = src.nrows(), n = src.ncols();
+  if (src.row_stride() == 1 && dst.col_stride() == 1) {
+    // Column-major to row-major: dst is the column-major n x m transpose
+    ry::transpose(m, n, src.data(), src.col_stride(), dst.data(),
+                  dst.row_stride());
+  } else if (src.col_stride() == 1 && dst.row_stride() == 1) {
+    ry::transpose(n, m, src.data(), src.row_stride(), dst.data(),
+                  dst.col_stride());
+  } else if (src.col_stride() == 1 && dst.col_stride() == 1) {
+    for (std::size_t row = 0; row < m; ++row) {
+      std::copy(src.data() + row * src.row_stride(),
+                src.data() + row * src.row_stride() + n,
+                dst.data() + row * dst.row_stride());
+    }
+  } else {
+    for (std::size_t col = 0; col < n; ++col) {
+      for (std::size_t row = 0; row < m; ++row) {
+        dst(row, col) = src(row, col);
+      }
+    }
+  }
+}
+
+/**
+ * @brief The transpose of a matrix or view as a new column-major Matrix
+ *
+ * @tparam M
+ * @param matrix
+ * @return Matrix<matrix_value_t<M>>
+ */
+template <matrix_like M> auto matrix_transpose(const M &matrix) {
+  using T = matrix_value_t<M>;
+  auto view = as_view(matrix);
+  Matrix<T> res(view.ncols(), view.nrows(), uninitialized);
+  matrix_copy(view.transpose(), res.view());
+  return res;
+}
+
+/**
+ * @brief Transpose a Matrix in place, rectangular or not
+ *
+ * @tparam T
+ * @param matrix
+ */
+template <typename T> void transpose_in_place(Matrix<T> &matrix) {
+  ry::transpose_in_place(matrix.nrows(), matrix.ncols(), matrix.data());
+  matrix.reshape(matrix.ncols(), matrix.nrows());
+}
+
+/**
+ * @brief Transpose a square view in place
+ *
+ * @tparam T
+ * @param view
+ */
+template <typename T> void transpose_in_place(MatrixView<T> view) {
+  const std::size_t n = view.nrows();
+  if (view.ncols() != n) {
+    throw std::runtime_error("In-place transpose of a view needs it square, "
+                             "not " +
+                             print_size(view.nrows(), view.ncols()));
+  }
+  if (view.row_stride() == 1 || view.col_stride() == 1) {
+    // A row-major view is the column-major transpose, which transposes the
+    // same way
+    ry::transpose_in_place(n, view.data(),
+                           std::max(view.row_stride(), view.col_stride()));
+    return;
+  }
+  for (std::size_t col = 0; col < n; ++col) {
+    for (std::size_t row = col + 1; row < n; ++row) {
+      std::swap(view(row, col), view(col, row));
+    }
+  }
+}
+
+/**
+ * @brief Copy a matrix or view out as contiguous data in the given layout
+ *
+ * @tparam M
+ * @param matrix
+ * @param layout
+ * @return std::vector<matrix_value_t<M>>
+ */
+template <matrix_like M>
+auto to_layout(const M &matrix, MatrixLayout layout) {
+  using T = matrix_value_t<M>;
+  auto view = as_view(matrix);
+  std::vector<T> res(view.numel());
+  matrix_copy(view, MatrixView<T>(res.data(), view.nrows(), view.ncols(),
+                                  layout));
+  return res;
+}
+
 /**
  * @brief Naive implementation of matrix multiplication for column-major
  * matrices
@@ -29,9 +448,10 @@ std::string print_size(std::size_t nrows, std::size_t ncols);
  * @return std::vector<T>
  */
 template <typename T>
-std::vector<T> matrix_multiply(const std::vector<T> &a, std::size_t anrows,
-                               std::size_t ancols, const std::vector<T> &b,
-                               std::size_t bnrows, std::size_t bncols) {
+std::vector<T> matrix_multiply_naive(const std::vector<T> &a,
+                                     std::size_t anrows, std::size_t ancols,
+                                     const std::vector<T> &b,
+                                     std::size_t bnrows, std::size_t bncols) {
   std::size_t outNrows = anrows, outNcols = bncols, innerDim = ancols;
   std::vector<T> res(outNrows * outNcols);
   if (ancols != bnrows) {
@@ -53,6 +473,154 @@ std::vector<T> matrix_multiply(const std::vector<T> &a, std::size_t anrows,
   return res;
 }
 
+/**
+ * @brief Matrix multiplication for column-major matrices. Uses the packed,
+ * cache-blocked ry::gemm engine.
+ *
+ * @tparam T
+ * @param a
+ * @param anrows
+ * @param ancols
+ * @param b
+ * @param bnrows
+ * @param bncols
+ * @return std::vector<T>
+ */
+template <typename T>
+std::vector<T> matrix_multiply(const std::vector<T> &a, std::size_t anrows,
+                               std::size_t ancols, const std::vector<T> &b,
+                               std::size_t bnrows, std::size_t bncols) {
+  if (ancols != bnrows) {
+    throw std::runtime_error(
+        "Inner dimension size mismatch: " + print_size(anrows, ancols) + " * " +
+        print_size(bnrows, bncols));
+  }
+  std::vector<T> res(anrows * bncols);
+  ry::gemm(anrows, bncols, ancols, T{1}, a.data(), 1, anrows, b.data(), 1,
+           bnrows, T{0}, res.data(), 1, anrows);
+  return res;
+}
+
+/**
+ * @brief c = alpha * a * b + beta * c for matrices or views of any layout.
+ * T is deduced from alpha and beta only so Matrix arguments convert to views.
+ *
+ * @tparam T
+ * @param alpha
+ * @param a
+ * @param b
+ * @param beta
+ * @param c
+ */
+template <typename T>
+void matrix_multiply_add(T alpha,
+                         std::type_identity_t<MatrixView<const T>> a,
+                         std::type_identity_t<MatrixView<const T>> b, T beta,
+                         std::type_identity_t<MatrixView<T>> c) {
+  if (a.ncols() != b.nrows() || a.nrows() != c.nrows() ||
+      b.ncols() != c.ncols()) {
+    throw std::runtime_error(
+        "Size mismatch: " + print_size(a.nrows(), a.ncols()) + " * " +
+        print_size(b.nrows(), b.ncols()) + " -> " +
+        print_size(c.nrows(), c.ncols()));
+  }
+  ry::gemm(a.nrows(), b.ncols(), a.ncols(), alpha, a.data(), a.row_stride(),
+           a.col_stride(), b.data(), b.row_stride(), b.col_stride(), beta,
+           c.data(), c.row_stride(), c.col_stride());
+}
+
+/**
+ * @brief Multiply two matrices or strided views without copying them
+ *
+ * @tparam MA
+ * @tparam MB
+ * @param a
+ * @param b
+ * @return Matrix<matrix_value_t<MA>>
+ */
+template <matrix_like MA, matrix_like MB>
+auto matrix_multiply(const MA &a, const MB &b) {
+  using T = matrix_value_t<MA>;
+  static_assert(std::is_same_v<T, matrix_value_t<MB>>,
+                "Operands must have the same element type");
+  auto av = as_view(a);
+  auto bv = as_view(b);
+  if (av.ncols() != bv.nrows()) {
+    throw std::runtime_error(
+        "Inner dimension size mismatch: " + print_size(av.nrows(), av.ncols()) +
+        " * " + print_size(bv.nrows(), bv.ncols()));
+  }
+  // gemm overwrites c when beta == 0, so skip initializing it
+  Matrix<T> c(av.nrows(), bv.ncols(), uninitialized);
+  matrix_multiply_add(T{1}, av, bv, T{0}, c.view());
+  return c;
+}
+
+/**
+ * @brief Operation applied to an operand of matrix_multiply. Transposes are
+ * views with the strides swapped, so the operand is never copied.
+ *
+ */
+enum class MatrixOp { None, Transpose };
+
+template <typename T> MatrixView<T> apply_op(MatrixView<T> view, MatrixOp op) {
+  return op == MatrixOp::Transpose ? view.transpose() : view;
+}
+
+/**
+ * @brief c = alpha * op(a) * op(b) + beta * c
+ *
+ * @tparam T
+ */
+template <typename T>
+void matrix_multiply_add(T alpha,
+                         std::type_identity_t<MatrixView<const T>> a,
+                         MatrixOp opA,
+                         std::type_identity_t<MatrixView<const T>> b,
+                         MatrixOp opB, T beta,
+                         std::type_identity_t<MatrixView<T>> c) {
+  matrix_multiply_add(alpha, apply_op(a, opA), apply_op(b, opB), beta, c);
+}
+
+/**
+ * @brief op(a) * op(b)
+ *
+ * @tparam MA
+ * @tparam MB
+ * @return Matrix<matrix_value_t<MA>>
+ */
+template <matrix_like MA, matrix_like MB>
+auto matrix_multiply(const MA &a, MatrixOp opA, const MB &b, MatrixOp opB) {
+  return matrix_multiply(apply_op(as_view(a), opA), apply_op(as_view(b), opB));
+}
+
+/**
+ * @brief Matrix multiplication of contiguous data in either layout. The
+ * operands are used in place and the result is written in cLayout.
+ *
+ * @tparam T
+ * @return std::vector<T>
+ */
+template <typename T>
+std::vector<T> matrix_multiply(const std::vector<T> &a, std::size_t anrows,
+                               std::size_t ancols, MatrixLayout aLayout,
+                               const std::vector<T> &b, std::size_t bnrows,
+                               std::size_t bncols, MatrixLayout bLayout,
+                               MatrixLayout cLayout =
+                                   MatrixLayout::ColumnMajor) {
+  if (a.size() != anrows * ancols || b.size() != bnrows * bncols) {
+    throw std::runtime_error("Data does not match sizes " +
+                             print_size(anrows, ancols) + " * " +
+                             print_size(bnrows, bncols));
+  }
+  std::vector<T> res(anrows * bncols);
+  matrix_multiply_add(T{1},
+                      MatrixView<const T>(a.data(), anrows, ancols, aLayout),
+                      MatrixView<const T>(b.data(), bnrows, bncols, bLayout),
+                      T{0}, MatrixView<T>(res.data(), anrows, bncols, cLayout));
+  return res;
+}
+
 /**
  * @brief Render the column-major data in matrix as an nrows x ncols matrix
  *
@@ -75,3 +643,24 @@ auto matrix_to_string(T &&matrix, std::size_t nrows, std::size_t ncols) {
   std::string res = ress.str();
   return res;
 }
+
+/**
+ * @brief Render a matrix or strided view for display. Use write_matrix_text
+ * (matrix_text.hpp) to export large matrices.
+ *
+ * @tparam M
+ * @param matrix
+ * @return std::string
+ */
+template <matrix_like M> std::string matrix_to_string(const M &matrix) {
+  auto view = as_view(matrix);
+  std::stringstream ress;
+  for (std::size_t row = 0; row < view.nrows(); ++row) {
+    ress << "\t";
+    for (std::size_t col = 0; col < view.ncols(); ++col) {
+      ress << view(row, col) << "\t";
+    }
+    ress << "\n";
+  }
+  return ress.str();
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "matrix_ops.hpp"
+#include "qgemm.hpp"
+
+/**
+ * Quantized matrix multiplication. A quantized matrix stores integers q
+ * standing for the real values scale * (q - zeroPoint). Products of int8,
+ * uint8 or int16 matrices are accumulated exactly in int32 by ry::qgemm and
+ * then converted to the output type:
+ *
+ *   int32          the accumulator, sum_l (a - za) * (b - zb)
+ *   float, double  the real product, sa * sb times the accumulator
+ *   8/16-bit ints  the product requantized with the output's parameters,
+ *                  rounded and saturated
+ *
+ * Zero points are not subtracted before multiplying, which would no longer
+ * fit in the packed int16 format, but corrected for afterwards:
+ *   sum (a - za)(b - zb) = sum ab - zb * rowsum(a) - za * colsum(b) + k za zb
+ */
+
+/**
+ * @brief Affine quantization parameters: q stands for scale * (q - zeroPoint)
+ *
+ */
+struct QuantParams {
+  float scale = 1;
+  std::int32_t zeroPoint = 0;
+};
+
+/**
+ * @brief Parameters mapping [minValue, maxValue] onto the range of Q. The range
+ * is widened to include 0 so that 0 is exact.
+ *
+ * @tparam Q
+ */
+template <typename Q>
+QuantParams choose_quant_params(float minValue, float maxValue) {
+  static_assert(std::is_integral_v<Q>, "Quantized types are integers");
+  minValue = std::min(minValue, 0.0f);
+  maxValue = std::max(maxValue, 0.0f);
+  const float qmin = std::numeric_limits<Q>::min();
+  const float qmax = std::numeric_limits<Q>::max();
+  if (maxValue == minValue) {
+    return {};
+  }
+  const float scale = (maxValue - minValue) / (qmax - qmin);
+  const float zero =
+      std::clamp(std::round(qmin - minValue / scale), qmin, qmax);
+  return {scale, static_cast<std::int32_t>(zero)};
+}
+
+namespace matrix_quantized_detail {
+// round(value) + zeroPoint saturated to Q
+template <typename Q> Q saturate(float value, std::int32_t zeroPoint) {
+  const float q = std::nearbyint(value) + static_cast<float>(zeroPoint);
+  return static_cast<Q>(
+      std::clamp(q, static_cast<float>(std::numeric_limits<Q>::min()),
+                 static_cast<float>(std::numeric_limits<Q>::max())));
+}
+
+// Sums of the rows (rows == true) or columns of m, as the kernel sees them
+template <typename T>
+std::vector<std::int32_t> sums(MatrixView<const T> m, bool rows) {
+  std::vector<std::int32_t> res(rows ? m.nrows() : m.ncols(), 0);
+  for (std::size_t col = 0; col < m.ncols(); ++col) {
+    for (std::size_t row = 0; row < m.nrows(); ++row) {
+      res[rows ? row : col] += m(row, col);
+    }
+  }
+  return res;
+}
+} // namespace matrix_quantized_detail
+
+/**
+ * @brief Quantize a real matrix or view
+ *
+ * @tparam Q
+ * @tparam M
+ * @return Matrix<Q>
+ */
+template <typename Q, matrix_like M>
+Matrix<Q> quantize(const M &matrix, QuantParams params) {
+  auto view = as_view(matrix);
+  Matrix<Q> res(view.nrows(), view.ncols(), uninitialized);
+  const float inv = 1.0f / params.scale;
+  for (std::size_t col = 0; col < view.ncols(); ++col) {
+    for (std::size_t row = 0; row < view.nrows(); ++row) {
+      res(row, col) = matrix_quantized_detail::saturate<Q>(
+          static_cast<float>(view(row, col)) * inv, params.zeroPoint);
+    }
+  }
+  return res;
+}
+
+/**
+ * @brief The real values a quantized matrix or view stands for
+ *
+ * @tparam T
+ * @tparam M
+ * @return Matrix<T>
+ */
+template <typename T, matrix_like M>
+Matrix<T> dequantize(const M &matrix, QuantParams params) {
+  auto view = as_view(matrix);
+  Matrix<T> res(view.nrows(), view.ncols(), uninitialized);
+  for (std::size_t col = 0; col < view.ncols(); ++col) {
+    for (std::size_t row = 0; row < view.nrows(); ++row) {
+      res(row, col) = static_cast<T>(params.scale) *
+                      static_cast<T>(view(row, col) - params.zeroPoint);
+    }
+  }
+  return res;
+}
+
+/**
+ * @brief c = a * b for quantized a and b, converted to Out as described at the
+ * top of this file. qc is only used when Out is an 8- or 16-bit integer.
+ *
+ * The output is split into tiles as in ry::gemm_parallel. Each tile is
+ * accumulated into an int32 buffer, then converted straight into c, so the
+ * full int32 product never exists.
+ *
+ * @tparam Out
+ * @tparam MA
+ * @tparam MB
+ */
+template <typename Out, matrix_like MA, matrix_like MB>
+void quantized_matrix_multiply(const MA &a, QuantParams qa, const MB &b,
+                               QuantParams qb, MatrixView<Out> c,
+                               QuantParams qc = {}) {
+  using TA = matrix_value_t<MA>;
+  using TB = matrix_value_t<MB>;
+  static_assert(ry::qgemm_operand<TA> && ry::qgemm_operand<TB>,
+                "Quantized operands must be int8, uint8 or int16");
+  auto av = as_view(a);
+  auto bv = as_view(b);
+  if (av.ncols() != bv.nrows() || av.nrows() != c.nrows() ||
+      bv.ncols() != c.ncols()) {
+    throw std::runtime_error(
+        "Size mismatch: " + print_size(av.nrows(), av.ncols()) + " * " +
+        print_size(bv.nrows(), bv.ncols()) + " -> " +
+        print_size(c.nrows(), c.ncols()));
+  }
+  const std::size_t m = c.nrows(), n = c.ncols(), k = av.ncols();
+  if (m == 0 || n == 0) {
+    return;
+  }
+  std::vector<std::int32_t> rowSumsA, colSumsB;
+  if (qb.zeroPoint != 0) {
+    rowSumsA = matrix_quantized_detail::sums(av, true);
+  }
+  if (qa.zeroPoint != 0) {
+    colSumsB = matrix_quantized_detail::sums(bv, false);
+  }
+  const std::int32_t offset =
+      static_cast<std::int32_t>(k) * qa.zeroPoint * qb.zeroPoint;
+  const float realScale = qa.scale * qb.scale;
+  const float requantScale = realScale / qc.scale;
+
+  auto kernel = ry::default_qgemm_kernel();
+  auto blocking = ry::default_qgemm_blocking(kernel);
+  auto &pool = ry::default_thread_pool();
+  const double work = static_cast<double>(m) * static_cast<double>(n) *
+                      static_cast<double>(k);
+  const bool parallel =
+      pool.size() > 1 && work >= ry::kGemmParallelThreshold;
+  const auto tiling = ry::gemm_output_tiling(m, n, kernel.mr, kernel.nr,
+                                             parallel ? pool.size() : 1);
+  // Bound the int32 buffer, which would otherwise be all of c on one thread
+  const std::size_t tileM = std::min(tiling.first, 4 * blocking.mc);
+  const std::size_t tileN =
+      std::min(tiling.second, ry::detail::round_up(512, kernel.nr));
+  const std::size_t tilesM = (m + tileM - 1) / tileM;
+  const std::size_t tilesN = (n + tileN - 1) / tileN;
+  auto run_tile = [&](std::size_t tile, std::size_t) {
+    const std::size_t i0 = (tile % tilesM) * tileM;
+    const std::size_t j0 = (tile / tilesM) * tileN;
+    const std::size_t mcur = std::min(tileM, m - i0);
+    const std::size_t ncur = std::min(tileN, n - j0);
+    auto acc = ry::detail::make_aligned_buffer<std::int32_t>(mcur * ncur);
+    ry::qgemm(mcur, ncur, k, av.data() + i0 * av.row_stride(),
+              av.row_stride(), av.col_stride(),
+              bv.data() + j0 * bv.col_stride(), bv.row_stride(),
+              bv.col_stride(), acc.get(), 1, mcur, kernel, blocking);
+    for (std::size_t j = 0; j < ncur; ++j) {
+      for (std::size_t i = 0; i < mcur; ++i) {
+        std::int32_t val = acc[i + j * mcur] + offset;
+        if (!rowSumsA.empty()) {
+          val -= qb.zeroPoint * rowSumsA[i0 + i];
+        }
+        if (!colSumsB.empty()) {
+          val -= qa.zeroPoint * colSumsB[j0 + j];
+        }
+        Out &out = c(i0 + i, j0 + j);
+        if constexpr (std::is_same_v<Out, std::int32_t>) {
+          out = val;
+        } else if constexpr (std::is_floating_point_v<Out>) {
+          out = static_cast<Out>(realScale) * static_cast<Out>(val);
+        } else {
+          out = matrix_quantized_detail::saturate<Out>(
+              static_cast<float>(val) * requantScale, qc.zeroPoint);
+        }
+      }
+    }
+  };
+  if (parallel) {
+    pool.parallel_for(tilesM * tilesN, run_tile);
+  } else {
+    for (std::size_t tile = 0; tile < tilesM * tilesN; ++tile) {
+      run_tile(tile, 0);
+    }
+  }
+}
+
+/**
+ * @brief a * b for quantized a and b as a new Matrix<Out>
+ *
+ * @tparam Out
+ * @tparam MA
+ * @tparam MB
+ * @return Matrix<Out>
+ */
+template <typename Out, matrix_like MA, matrix_like MB>
+Matrix<Out> quantized_matrix_multiply(const MA &a, QuantParams qa,
+                                      const MB &b, QuantParams qb,
+                                      QuantParams qc = {}) {
+  auto av = as_view(a);
+  auto bv = as_view(b);
+  if (av.ncols() != bv.nrows()) {
+    throw std::runtime_error(
+        "Inner dimension size mismatch: " + print_size(av.nrows(), av.ncols()) +
+        " * " + print_size(bv.nrows(), bv.ncols()));
+  }
+  Matrix<Out> c(av.nrows(), bv.ncols(), uninitialized);
+  quantized_matrix_multiply<Out>(av, qa, bv, qb, c.view(), qc);
+  return c;
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "matrix_ops.hpp"
+
+/**
+ * Small matrices with compile-time dimensions. Multiplying a few 3x3 to 8x8
+ * matrices through the dynamic Matrix pays for size checks, a heap-allocated
+ * result and runtime loop bounds, all of which outweigh the arithmetic. Here
+ * storage is inline and every product is unrolled at compile time.
+ *
+ * For many products of the same shape, MatrixBatch stores a whole batch
+ * interleaved so that batched_matrix_multiply vectorizes across matrices.
+ */
+
+/**
+ * @brief R x C column-major matrix stored inline. Value-initialized to zero,
+ * usable in constant expressions.
+ *
+ * @tparam T
+ * @tparam R
+ * @tparam C
+ */
+template <typename T, std::size_t R, std::size_t C> class Matrix {
+  static_assert(R != dynamic_size && C != dynamic_size,
+                "Use Matrix<T> for runtime sizes");
+
+public:
+  using value_type = T;
+
+  constexpr Matrix() = default;
+
+  /**
+   * @brief Matrix holding column-major data
+   *
+   */
+  constexpr explicit Matrix(const std::array<T, R * C> &data) : fData(data) {}
+
+  static constexpr Matrix identity() {
+    Matrix res;
+    for (std::size_t k = 0; k < std::min(R, C); ++k) {
+      res(k, k) = T{1};
+    }
+    return res;
+  }
+
+  static constexpr std::size_t nrows() {
+    return R;
+  }
+  static constexpr std::size_t ncols() {
+    return C;
+  }
+  static constexpr std::size_t numel() {
+    return R * C;
+  }
+  constexpr T *data() {
+    return fData.data();
+  }
+  constexpr const T *data() const {
+    return fData.data();
+  }
+
+  constexpr T &operator()(std::size_t row, std::size_t col) {
+    return fData[row + col * R];
+  }
+  constexpr const T &operator()(std::size_t row, std::size_t col) const {
+    return fData[row + col * R];
+  }
+
+  /**
+   * @brief Views for use with the dynamic Matrix API
+   *
+   */
+  MatrixView<T> view() {
+    return {data(), R, C};
+  }
+  MatrixView<const T> view() const {
+    return {data(), R, C};
+  }
+
+  constexpr Matrix<T, C, R> transpose() const {
+    Matrix<T, C, R> res;
+    for (std::size_t col = 0; col < C; ++col) {
+      for (std::size_t row = 0; row < R; ++row) {
+        res(col, row) = (*this)(row, col);
+      }
+    }
+    return res;
+  }
+
+  constexpr bool operator==(const Matrix &other) const = default;
+
+private:
+  std::array<T, R * C> fData{};
+};
+
+namespace matrix_small_detail {
+// Entry (I, J) of a * b for column-major R x K and K x C operands, with the
+// sum over K written out
+template <typename T, std::size_t R, std::size_t K, std::size_t C,
+          std::size_t I, std::size_t J, std::size_t... L>
+constexpr T dot(const T *a, const T *b, std::index_sequence<L...>) {
+  if constexpr (K == 0) {
+    return T{0};
+  } else {
+    return ((a[I + L * R] * b[L + J * K]) + ...);
+  }
+}
+
+template <typename T, std::size_t R, std::size_t K, std::size_t C,
+          std::size_t... Idx>
+constexpr void multiply(const T *a, const T *b, T *c,
+                        std::index_sequence<Idx...>) {
+  ((c[Idx] = dot<T, R, K, C, Idx % R, Idx / R>(
+        a, b, std::make_index_sequence<K>{})),
+   ...);
+}
+} // namespace matrix_small_detail
+
+/**
+ * @brief a * b fully unrolled: one expression per entry of the result with no
+ * loops, size checks or allocation
+ *
+ * @return Matrix<T, R, C>
+ */
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+  requires(R != dynamic_size && K != dynamic_size && C != dynamic_size)
+constexpr Matrix<T, R, C> matrix_multiply(const Matrix<T, R, K> &a,
+                                          const Matrix<T, K, C> &b) {
+  Matrix<T, R, C> c;
+  matrix_small_detail::multiply<T, R, K, C>(a.data(), b.data(), c.data(),
+                                            std::make_index_sequence<R * C>{});
+  return c;
+}
+
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+  requires(R != dynamic_size && K != dynamic_size && C != dynamic_size)
+constexpr Matrix<T, R, C> operator*(const Matrix<T, R, K> &a,
+                                    const Matrix<T, K, C> &b) {
+  return matrix_multiply(a, b);
+}
+
+/**
+ * @brief count R x C matrices stored interleaved: entry (row, col) of every
+ * matrix is contiguous, so element k of matrix i lives at
+ * data()[k * stride() + i]. Loops over the batch then have unit stride and
+ * vectorize, where one matrix at a time is too small to.
+ *
+ * @tparam T
+ * @tparam R
+ * @tparam C
+ */
+template <typename T, std::size_t R, std::size_t C> class MatrixBatch {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "MatrixBatch storage is raw memory from ry::aligned_alloc");
+
+public:
+  // Matrices per cache line of an entry's run
+  static constexpr std::size_t group_size = 64 / sizeof(T);
+  static_assert(64 % sizeof(T) == 0, "Elements must tile a cache line");
+
+  explicit MatrixBatch(std::size_t count)
+      : fCount(count),
+        // Start each entry's run on a cache line
+        fStride(ry::detail::round_up(count, group_size)),
+        fData(ry::detail::make_aligned_buffer<T>(fStride * R * C)) {
+    std::fill(fData.get(), fData.get() + fStride * R * C, T{0});
+  }
+
+  std::size_t count() const {
+    return fCount;
+  }
+  std::size_t stride() const {
+    return fStride;
+  }
+  T *data() {
+    return fData.get();
+  }
+  const T *data() const {
+    return fData.get();
+  }
+
+  T &operator()(std::size_t index, std::size_t row, std::size_t col) {
+    return fData[(row + col * R) * fStride + index];
+  }
+  const T &operator()(std::size_t index, std::size_t row,
+                      std::size_t col) const {
+    return fData[(row + col * R) * fStride + index];
+  }
+
+  Matrix<T, R, C> get(std::size_t index) const {
+    check_index(index);
+    Matrix<T, R, C> res;
+    for (std::size_t k = 0; k < R * C; ++k) {
+      res.data()[k] = fData[k * fStride + index];
+    }
+    return res;
+  }
+
+  void set(std::size_t index, const Matrix<T, R, C> &m) {
+    check_index(index);
+    for (std::size_t k = 0; k < R * C; ++k) {
+      fData[k * fStride + index] = m.data()[k];
+    }
+  }
+
+private:
+  void check_index(std::size_t index) const {
+    if (index >= fCount) {
+      throw std::out_of_range("Index " + std::to_string(index) +
+                              " out of range for batch of " +
+                              std::to_string(fCount));
+    }
+  }
+
+  std::size_t fCount;
+  std::size_t fStride;
+  ry::detail::aligned_buffer_t<T> fData;
+};
+
+/**
+ * @brief c[i] = a[i] * b[i] for every matrix in the batches. Each entry's run
+ * is a sequence of cache lines holding that entry for a group of consecutive
+ * matrices. The product is computed a group at a time with whole lines as
+ * GCC/Clang vector values, so every multiply-add is a full-width vector op.
+ *
+ * @tparam T
+ * @tparam R
+ * @tparam K
+ * @tparam C
+ */
+template <typename T, std::size_t R, std::size_t K, std::size_t C>
+void batched_matrix_multiply(const MatrixBatch<T, R, K> &a,
+                             const MatrixBatch<T, K, C> &b,
+                             MatrixBatch<T, R, C> &c) {
+  const std::size_t count = c.count();
+  if (a.count() != count || b.count() != count) {
+    throw std::runtime_error(
+        "Batch size mismatch: " + std::to_string(a.count()) + " * " +
+        std::to_string(b.count()) + " -> " + std::to_string(count));
+  }
+#if defined(__GNUC__)
+  constexpr std::size_t kGroup = MatrixBatch<T, R, C>::group_size;
+  typedef T lane_t __attribute__((vector_size(kGroup * sizeof(T))));
+  // Strides are whole lines, so the padding at the end of each run is ours to
+  // compute on
+  for (std::size_t i0 = 0; i0 < count; i0 += kGroup) {
+    lane_t la[R * K], lb[K * C];
+    for (std::size_t k = 0; k < R * K; ++k) {
+      std::memcpy(&la[k], a.data() + k * a.stride() + i0, sizeof(lane_t));
+    }
+    for (std::size_t k = 0; k < K * C; ++k) {
+      std::memcpy(&lb[k], b.data() + k * b.stride() + i0, sizeof(lane_t));
+    }
+    for (std::size_t col = 0; col < C; ++col) {
+      for (std::size_t row = 0; row < R; ++row) {
+        lane_t acc = {};
+        for (std::size_t l = 0; l < K; ++l) {
+          acc += la[row + l * R] * lb[l + col * K];
+        }
+        std::memcpy(c.data() + (row + col * R) * c.stride() + i0, &acc,
+                    sizeof(lane_t));
+      }
+    }
+  }
+#else
+  for (std::size_t i = 0; i < count; ++i) {
+    c.set(i, a.get(i) * b.get(i));
+  }
+#endif
+}
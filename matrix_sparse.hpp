@@ -0,0 +1,516 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "matrix_ops.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Compressed sparse row (CSR) and column (CSC) matrices with multithreaded
+ * sparse * dense (SpMM) and sparse * vector (SpMV) kernels. Both formats store
+ * only the nonzeros, so a matrix with density d takes about
+ * d * (sizeof(T) + 4) / sizeof(T) of the dense footprint.
+ */
+
+// 32-bit indices halve the index overhead; from_dense checks they suffice
+using sparse_index_t = std::uint32_t;
+
+namespace sparse_detail {
+// Storage shared by CSR and CSC: for each of the outer rows (CSR) or columns
+// (CSC), ptr[o]..ptr[o + 1] index the inner indices and values of its
+// nonzeros
+template <typename T> struct Compressed {
+  std::size_t nrows = 0;
+  std::size_t ncols = 0;
+  std::vector<sparse_index_t> ptr{0};
+  std::vector<sparse_index_t> idx;
+  std::vector<T> values;
+
+  std::size_t memory_bytes() const {
+    return ptr.size() * sizeof(sparse_index_t) +
+           idx.size() * sizeof(sparse_index_t) + values.size() * sizeof(T);
+  }
+
+  void validate(std::size_t outer, std::size_t inner) const {
+    if (ptr.size() != outer + 1 || ptr.front() != 0 ||
+        ptr.back() != idx.size() || idx.size() != values.size()) {
+      throw std::runtime_error("Inconsistent compressed sparse arrays for a " +
+                               print_size(nrows, ncols) + " matrix");
+    }
+    for (std::size_t o = 0; o < outer; ++o) {
+      if (ptr[o] > ptr[o + 1]) {
+        throw std::runtime_error("Sparse offsets must be nondecreasing");
+      }
+    }
+    for (auto i : idx) {
+      if (i >= inner) {
+        throw std::out_of_range("Sparse index " + std::to_string(i) +
+                                " out of range for a " +
+                                print_size(nrows, ncols) + " matrix");
+      }
+    }
+  }
+};
+
+inline sparse_index_t checked_index(std::size_t i) {
+  if (i > std::numeric_limits<sparse_index_t>::max()) {
+    throw std::length_error("Sparse matrix too large for 32-bit indices");
+  }
+  return static_cast<sparse_index_t>(i);
+}
+
+// Swap the roles of outer and inner: CSR <-> CSC of the same matrix, or a
+// transpose in the same format
+template <typename T>
+Compressed<T> transpose_compressed(const Compressed<T> &src, std::size_t outer,
+                                   std::size_t inner) {
+  Compressed<T> res;
+  res.nrows = src.nrows;
+  res.ncols = src.ncols;
+  res.ptr.assign(inner + 1, 0);
+  res.idx.resize(src.idx.size());
+  res.values.resize(src.values.size());
+  for (auto i : src.idx) {
+    ++res.ptr[i + 1];
+  }
+  for (std::size_t i = 0; i < inner; ++i) {
+    res.ptr[i + 1] += res.ptr[i];
+  }
+  std::vector<sparse_index_t> next(res.ptr.begin(), res.ptr.end() - 1);
+  // Visiting outer indices in order keeps each new list sorted
+  for (std::size_t o = 0; o < outer; ++o) {
+    for (auto p = src.ptr[o]; p < src.ptr[o + 1]; ++p) {
+      const auto dst = next[src.idx[p]]++;
+      res.idx[dst] = static_cast<sparse_index_t>(o);
+      res.values[dst] = src.values[p];
+    }
+  }
+  return res;
+}
+
+// Split [0, outer) into ranges of about equal nonzero counts, several per
+// thread so uneven rows balance out
+inline std::vector<std::size_t>
+balanced_ranges(std::span<const sparse_index_t> ptr, std::size_t parts) {
+  const std::size_t outer = ptr.size() - 1;
+  const std::size_t nnz = ptr.back();
+  std::vector<std::size_t> bounds{0};
+  for (std::size_t part = 1; part < parts; ++part) {
+    const auto target = static_cast<sparse_index_t>(nnz * part / parts);
+    auto it = std::lower_bound(ptr.begin(), ptr.end(), target);
+    auto o = static_cast<std::size_t>(it - ptr.begin());
+    if (o > bounds.back() && o < outer) {
+      bounds.push_back(o);
+    }
+  }
+  bounds.push_back(outer);
+  return bounds;
+}
+
+// Multiply-adds below which kernels stay on the calling thread
+inline constexpr double kSparseParallelThreshold = 32768;
+
+// body(begin, end) over ranges of [0, outer) covering the work about equally,
+// on default_thread_pool() when there is enough work
+template <typename F>
+void parallel_ranges(std::span<const sparse_index_t> ptr, double work,
+                     F &&body) {
+  auto &pool = ry::default_thread_pool();
+  if (pool.size() == 1 || work < kSparseParallelThreshold) {
+    body(std::size_t{0}, ptr.size() - 1);
+    return;
+  }
+  auto bounds = balanced_ranges(ptr, 4 * pool.size());
+  pool.parallel_for(bounds.size() - 1, [&](std::size_t range, std::size_t) {
+    body(bounds[range], bounds[range + 1]);
+  });
+}
+
+template <typename T> void scale(T beta, T *y, std::size_t n) {
+  // beta == 0 must not read y, which may be uninitialized
+  if (beta == T{0}) {
+    std::fill(y, y + n, T{0});
+  } else if (beta != T{1}) {
+    for (std::size_t i = 0; i < n; ++i) {
+      y[i] *= beta;
+    }
+  }
+}
+
+template <typename T>
+Compressed<T> compress_dense_columns(MatrixView<const T> dense) {
+  Compressed<T> res;
+  res.nrows = dense.nrows();
+  res.ncols = dense.ncols();
+  res.ptr.reserve(dense.ncols() + 1);
+  for (std::size_t col = 0; col < dense.ncols(); ++col) {
+    for (std::size_t row = 0; row < dense.nrows(); ++row) {
+      if (dense(row, col) != T{0}) {
+        res.idx.push_back(checked_index(row));
+        res.values.push_back(dense(row, col));
+      }
+    }
+    res.ptr.push_back(checked_index(res.idx.size()));
+  }
+  return res;
+}
+
+template <typename T>
+Matrix<T> expand(const Compressed<T> &src, bool rowMajor) {
+  Matrix<T> res(src.nrows, src.ncols);
+  const std::size_t outer = rowMajor ? src.nrows : src.ncols;
+  for (std::size_t o = 0; o < outer; ++o) {
+    for (auto p = src.ptr[o]; p < src.ptr[o + 1]; ++p) {
+      if (rowMajor) {
+        res(o, src.idx[p]) = src.values[p];
+      } else {
+        res(src.idx[p], o) = src.values[p];
+      }
+    }
+  }
+  return res;
+}
+} // namespace sparse_detail
+
+template <typename T> class CscMatrix;
+
+/**
+ * @brief Compressed sparse row matrix: the nonzeros of row i are
+ * values()[row_ptr()[i]..row_ptr()[i + 1]] in columns col_idx()[...], sorted
+ * by column.
+ *
+ * @tparam T
+ */
+template <typename T> class CsrMatrix {
+public:
+  using value_type = T;
+
+  CsrMatrix() = default;
+
+  /**
+   * @brief Matrix from CSR arrays, which are checked for consistency
+   *
+   */
+  CsrMatrix(std::size_t nrows, std::size_t ncols,
+            std::vector<sparse_index_t> rowPtr,
+            std::vector<sparse_index_t> colIdx, std::vector<T> values)
+      : fData{nrows, ncols, std::move(rowPtr), std::move(colIdx),
+              std::move(values)} {
+    fData.validate(nrows, ncols);
+  }
+
+  /**
+   * @brief Nonzeros of a dense matrix or view, e.g. existing column-major
+   * data wrapped as MatrixView<const T>(data, nrows, ncols)
+   *
+   */
+  static CsrMatrix from_dense(MatrixView<const T> dense) {
+    return CsrMatrix(sparse_detail::transpose_compressed(
+        sparse_detail::compress_dense_columns(dense), dense.ncols(),
+        dense.nrows()));
+  }
+
+  CscMatrix<T> to_csc() const;
+
+  Matrix<T> to_dense() const {
+    return sparse_detail::expand(fData, true);
+  }
+
+  std::size_t nrows() const {
+    return fData.nrows;
+  }
+  std::size_t ncols() const {
+    return fData.ncols;
+  }
+  std::size_t nnz() const {
+    return fData.values.size();
+  }
+  std::span<const sparse_index_t> row_ptr() const {
+    return fData.ptr;
+  }
+  std::span<const sparse_index_t> col_idx() const {
+    return fData.idx;
+  }
+  std::span<const T> values() const {
+    return fData.values;
+  }
+
+  /**
+   * @brief Bytes of index and value storage
+   *
+   */
+  std::size_t memory_bytes() const {
+    return fData.memory_bytes();
+  }
+
+private:
+  template <typename> friend class CscMatrix;
+  explicit CsrMatrix(sparse_detail::Compressed<T> data)
+      : fData(std::move(data)) {}
+
+  sparse_detail::Compressed<T> fData;
+};
+
+/**
+ * @brief Compressed sparse column matrix: the nonzeros of column j are
+ * values()[col_ptr()[j]..col_ptr()[j + 1]] in rows row_idx()[...], sorted by
+ * row.
+ *
+ * @tparam T
+ */
+template <typename T> class CscMatrix {
+public:
+  using value_type = T;
+
+  CscMatrix() = default;
+
+  /**
+   * @brief Matrix from CSC arrays, which are checked for consistency
+   *
+   */
+  CscMatrix(std::size_t nrows, std::size_t ncols,
+            std::vector<sparse_index_t> colPtr,
+            std::vector<sparse_index_t> rowIdx, std::vector<T> values)
+      : fData{nrows, ncols, std::move(colPtr), std::move(rowIdx),
+              std::move(values)} {
+    fData.validate(ncols, nrows);
+  }
+
+  /**
+   * @brief Nonzeros of a dense matrix or view, e.g. existing column-major
+   * data wrapped as MatrixView<const T>(data, nrows, ncols)
+   *
+   */
+  static CscMatrix from_dense(MatrixView<const T> dense) {
+    return CscMatrix(sparse_detail::compress_dense_columns(dense));
+  }
+
+  CsrMatrix<T> to_csr() const {
+    return CsrMatrix<T>(
+        sparse_detail::transpose_compressed(fData, ncols(), nrows()));
+  }
+
+  Matrix<T> to_dense() const {
+    return sparse_detail::expand(fData, false);
+  }
+
+  std::size_t nrows() const {
+    return fData.nrows;
+  }
+  std::size_t ncols() const {
+    return fData.ncols;
+  }
+  std::size_t nnz() const {
+    return fData.values.size();
+  }
+  std::span<const sparse_index_t> col_ptr() const {
+    return fData.ptr;
+  }
+  std::span<const sparse_index_t> row_idx() const {
+    return fData.idx;
+  }
+  std::span<const T> values() const {
+    return fData.values;
+  }
+
+  /**
+   * @brief Bytes of index and value storage
+   *
+   */
+  std::size_t memory_bytes() const {
+    return fData.memory_bytes();
+  }
+
+private:
+  template <typename> friend class CsrMatrix;
+  explicit CscMatrix(sparse_detail::Compressed<T> data)
+      : fData(std::move(data)) {}
+
+  sparse_detail::Compressed<T> fData;
+};
+
+template <typename T> CscMatrix<T> CsrMatrix<T>::to_csc() const {
+  return CscMatrix<T>(
+      sparse_detail::transpose_compressed(fData, nrows(), ncols()));
+}
+
+namespace sparse_detail {
+inline void check_spmv(std::size_t nrows, std::size_t ncols, std::size_t xn,
+                       std::size_t yn) {
+  if (xn != ncols || yn != nrows) {
+    throw std::runtime_error("Size mismatch: " + print_size(nrows, ncols) +
+                             " * " + print_size(xn, 1) + " -> " +
+                             print_size(yn, 1));
+  }
+}
+
+template <typename T>
+void check_spmm(std::size_t nrows, std::size_t ncols, MatrixView<const T> b,
+                MatrixView<T> c) {
+  if (b.nrows() != ncols || c.nrows() != nrows || c.ncols() != b.ncols()) {
+    throw std::runtime_error("Size mismatch: " + print_size(nrows, ncols) +
+                             " * " + print_size(b.nrows(), b.ncols()) +
+                             " -> " + print_size(c.nrows(), c.ncols()));
+  }
+}
+} // namespace sparse_detail
+
+/**
+ * @brief y = alpha * a * x + beta * y. Rows are split among threads by
+ * nonzero count.
+ *
+ */
+template <typename T>
+void spmv(T alpha, const CsrMatrix<T> &a, std::span<const T> x, T beta,
+          std::span<T> y) {
+  sparse_detail::check_spmv(a.nrows(), a.ncols(), x.size(), y.size());
+  auto ptr = a.row_ptr();
+  auto idx = a.col_idx();
+  auto vals = a.values();
+  sparse_detail::parallel_ranges(
+      ptr, static_cast<double>(a.nnz()), [&](std::size_t r0, std::size_t r1) {
+        for (std::size_t row = r0; row < r1; ++row) {
+          T sum{0};
+          for (auto p = ptr[row]; p < ptr[row + 1]; ++p) {
+            sum += vals[p] * x[idx[p]];
+          }
+          y[row] = beta == T{0} ? alpha * sum : alpha * sum + beta * y[row];
+        }
+      });
+}
+
+/**
+ * @brief y = alpha * a * x + beta * y. Columns scatter into all of y, so this
+ * runs on the calling thread; prefer CSR for SpMV.
+ *
+ */
+template <typename T>
+void spmv(T alpha, const CscMatrix<T> &a, std::span<const T> x, T beta,
+          std::span<T> y) {
+  sparse_detail::check_spmv(a.nrows(), a.ncols(), x.size(), y.size());
+  auto ptr = a.col_ptr();
+  auto idx = a.row_idx();
+  auto vals = a.values();
+  sparse_detail::scale(beta, y.data(), y.size());
+  for (std::size_t col = 0; col < a.ncols(); ++col) {
+    const T xj = alpha * x[col];
+    for (auto p = ptr[col]; p < ptr[col + 1]; ++p) {
+      y[idx[p]] += vals[p] * xj;
+    }
+  }
+}
+
+/**
+ * @brief c = alpha * a * b + beta * c for dense b and c of any layout. Rows
+ * of c are split among threads by nonzero count.
+ *
+ */
+template <typename T>
+void spmm(T alpha, const CsrMatrix<T> &a,
+          std::type_identity_t<MatrixView<const T>> b, T beta,
+          std::type_identity_t<MatrixView<T>> c) {
+  sparse_detail::check_spmm(a.nrows(), a.ncols(), b, c);
+  auto ptr = a.row_ptr();
+  auto idx = a.col_idx();
+  auto vals = a.values();
+  sparse_detail::parallel_ranges(
+      ptr, static_cast<double>(a.nnz()) * b.ncols(),
+      [&](std::size_t r0, std::size_t r1) {
+        // One column of c at a time keeps b's column in cache while the
+        // rows of a reuse it
+        for (std::size_t col = 0; col < b.ncols(); ++col) {
+          for (std::size_t row = r0; row < r1; ++row) {
+            T sum{0};
+            for (auto p = ptr[row]; p < ptr[row + 1]; ++p) {
+              sum += vals[p] * b(idx[p], col);
+            }
+            c(row, col) = beta == T{0} ? alpha * sum
+                                       : alpha * sum + beta * c(row, col);
+          }
+        }
+      });
+}
+
+/**
+ * @brief c = alpha * a * b + beta * c for dense b and c of any layout. Each
+ * column of c is the columns of a scaled by a column of b, so columns of c are
+ * split among threads.
+ *
+ */
+template <typename T>
+void spmm(T alpha, const CscMatrix<T> &a,
+          std::type_identity_t<MatrixView<const T>> b, T beta,
+          std::type_identity_t<MatrixView<T>> c) {
+  sparse_detail::check_spmm(a.nrows(), a.ncols(), b, c);
+  auto ptr = a.col_ptr();
+  auto idx = a.row_idx();
+  auto vals = a.values();
+  auto columns = [&](std::size_t j0, std::size_t j1) {
+    for (std::size_t col = j0; col < j1; ++col) {
+      auto ccol = c.columns(col, 1);
+      for (std::size_t row = 0; row < c.nrows(); ++row) {
+        ccol(row, 0) = beta == T{0} ? T{0} : beta * ccol(row, 0);
+      }
+      for (std::size_t k = 0; k < a.ncols(); ++k) {
+        const T bkj = alpha * b(k, col);
+        if (bkj == T{0}) {
+          continue;
+        }
+        for (auto p = ptr[k]; p < ptr[k + 1]; ++p) {
+          ccol(idx[p], 0) += vals[p] * bkj;
+        }
+      }
+    }
+  };
+  auto &pool = ry::default_thread_pool();
+  const double work = static_cast<double>(a.nnz()) * b.ncols();
+  if (pool.size() == 1 || b.ncols() == 1 ||
+      work < sparse_detail::kSparseParallelThreshold) {
+    columns(0, b.ncols());
+    return;
+  }
+  pool.parallel_for(b.ncols(), [&](std::size_t col, std::size_t) {
+    columns(col, col + 1);
+  });
+}
+
+/**
+ * @brief Dense product of a sparse matrix and a dense matrix or view
+ *
+ */
+template <typename S, matrix_like MB>
+  requires(std::is_same_v<S, CsrMatrix<matrix_value_t<MB>>> ||
+           std::is_same_v<S, CscMatrix<matrix_value_t<MB>>>)
+Matrix<matrix_value_t<MB>> matrix_multiply(const S &a, const MB &b) {
+  using T = matrix_value_t<MB>;
+  auto bv = as_view(b);
+  Matrix<T> c(a.nrows(), bv.ncols(), uninitialized);
+  spmm(T{1}, a, bv, T{0}, c.view());
+  return c;
+}
+
+/**
+ * @brief Product of a sparse matrix and a dense vector
+ *
+ */
+template <typename T>
+std::vector<T> matrix_multiply(const CsrMatrix<T> &a,
+                               const std::vector<T> &x) {
+  std::vector<T> y(a.nrows());
+  spmv(T{1}, a, std::span<const T>(x), T{0}, std::span<T>(y));
+  return y;
+}
+template <typename T>
+std::vector<T> matrix_multiply(const CscMatrix<T> &a,
+                               const std::vector<T> &x) {
+  std::vector<T> y(a.nrows());
+  spmv(T{1}, a, std::span<const T>(x), T{0}, std::span<T>(y));
+  return y;
+}
@@ -0,0 +1,76 @@
+#include "matrix_strassen.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <system_error>
+#include <vector>
+
+std::filesystem::path strassen_cache_path() {
+  if (const char *env = std::getenv("RY_STRASSEN_CACHE")) {
+    return env;
+  }
+  std::filesystem::path dir;
+  if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+    dir = xdg;
+  } else if (const char *home = std::getenv("HOME"); home && *home) {
+    dir = std::filesystem::path(home) / ".cache";
+  } else {
+    std::error_code ec;
+    dir = std::filesystem::temp_directory_path(ec);
+  }
+  return dir / "cpp-practice" / "strassen_crossover";
+}
+
+// The cache holds one "key crossover" pair per line
+std::optional<std::size_t>
+load_strassen_crossover(const std::filesystem::path &path,
+                        const std::string &key) {
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream iss(line);
+    std::string lineKey;
+    std::size_t crossover = 0;
+    if (iss >> lineKey >> crossover && lineKey == key) {
+      return crossover;
+    }
+  }
+  return std::nullopt;
+}
+
+bool store_strassen_crossover(const std::filesystem::path &path,
+                              const std::string &key, std::size_t crossover) {
+  std::vector<std::string> lines;
+  {
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+      std::istringstream iss(line);
+      std::string lineKey;
+      if (iss >> lineKey && lineKey != key) {
+        lines.push_back(line);
+      }
+    }
+  }
+  lines.push_back(key + " " + std::to_string(crossover));
+
+  std::error_code ec;
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path(), ec);
+  }
+  // Write then rename so concurrent readers never see a partial file
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::trunc);
+    for (const auto &line : lines) {
+      out << line << "\n";
+    }
+    if (!out) {
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+  return !ec;
+}
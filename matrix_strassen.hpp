@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+
+#include "matrix_ops.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Recursive matrix multiplication for large products. Strassen-Winograd
+ * replaces 8 half-size products with 7 plus 15 additions each level; shapes too
+ * far from square for that are split in half along their largest dimension
+ * instead (the cache-oblivious scheme). Either way the recursion bottoms out
+ * in ry::gemm once every dimension is below a crossover size, which is tuned
+ * on first use and cached in a file so later runs skip the tuning.
+ */
+
+/**
+ * @brief Algorithm choice for matrix_multiply
+ *
+ */
+enum class MultiplyAlgorithm {
+  Blocked,       // ry::gemm
+  Strassen,      // Strassen-Winograd, splitting unbalanced shapes
+  CacheOblivious // Split the largest dimension down to the crossover
+};
+
+struct RecursiveMultiplyOptions {
+  // Products with every dimension below this go straight to ry::gemm. 0 uses
+  // strassen_crossover<T>().
+  std::size_t crossover = 0;
+  bool strassen = true;
+};
+
+/**
+ * @brief File holding tuned crossovers. RY_STRASSEN_CACHE overrides the
+ * default of $XDG_CACHE_HOME/cpp-practice/strassen_crossover (or ~/.cache/...).
+ *
+ */
+std::filesystem::path strassen_cache_path();
+
+/**
+ * @brief Crossover stored for key in the cache file, if any
+ *
+ */
+std::optional<std::size_t>
+load_strassen_crossover(const std::filesystem::path &path,
+                        const std::string &key);
+
+/**
+ * @brief Add or replace the crossover for key in the cache file. The cache is
+ * best effort, so this returns false rather than throwing if it can't write.
+ *
+ */
+bool store_strassen_crossover(const std::filesystem::path &path,
+                              const std::string &key, std::size_t crossover);
+
+namespace strassen_detail {
+// dst = f(srcs...) elementwise, with a unit stride fast path the compiler can
+// vectorize
+template <typename T, typename F, typename... Srcs>
+void elementwise(MatrixView<T> dst, F f, const Srcs &...srcs) {
+  const bool unitStride =
+      dst.row_stride() == 1 && ((as_view(srcs).row_stride() == 1) && ...);
+  for (std::size_t col = 0; col < dst.ncols(); ++col) {
+    if (unitStride) {
+      T *out = dst.data() + col * dst.col_stride();
+      auto column = [col](const auto &src) {
+        auto view = as_view(src);
+        return view.data() + col * view.col_stride();
+      };
+      [&](const auto *...in) {
+        for (std::size_t row = 0; row < dst.nrows(); ++row) {
+          out[row] = f(in[row]...);
+        }
+      }(column(srcs)...);
+    } else {
+      for (std::size_t row = 0; row < dst.nrows(); ++row) {
+        dst(row, col) = f(as_view(srcs)(row, col)...);
+      }
+    }
+  }
+}
+
+template <typename T>
+void multiply_add(T alpha, MatrixView<const T> a, MatrixView<const T> b,
+                  T beta, MatrixView<T> c,
+                  const RecursiveMultiplyOptions &opts);
+
+// c = alpha * a * b for even sizes with one Strassen-Winograd level. Uses the
+// schedule of Boyer, Dumas, Pernet and Zhou (2009) which keeps intermediate
+// results in the quadrants of c, needing only three quarter-size temporaries.
+template <typename T>
+void strassen_winograd(T alpha, MatrixView<const T> a, MatrixView<const T> b,
+                       MatrixView<T> c, const RecursiveMultiplyOptions &opts) {
+  const std::size_t m2 = c.nrows() / 2, n2 = c.ncols() / 2, k2 = a.ncols() / 2;
+  auto a11 = a.submatrix(0, 0, m2, k2), a12 = a.submatrix(0, k2, m2, k2),
+       a21 = a.submatrix(m2, 0, m2, k2), a22 = a.submatrix(m2, k2, m2, k2);
+  auto b11 = b.submatrix(0, 0, k2, n2), b12 = b.submatrix(0, n2, k2, n2),
+       b21 = b.submatrix(k2, 0, k2, n2), b22 = b.submatrix(k2, n2, k2, n2);
+  auto c11 = c.submatrix(0, 0, m2, n2), c12 = c.submatrix(0, n2, m2, n2),
+       c21 = c.submatrix(m2, 0, m2, n2), c22 = c.submatrix(m2, n2, m2, n2);
+  Matrix<T> x(m2, k2, uninitialized), y(k2, n2, uninitialized),
+      p1(m2, n2, uninitialized);
+
+  auto product = [&](MatrixView<const T> lhs, MatrixView<const T> rhs,
+                     MatrixView<T> dst) {
+    multiply_add(alpha, lhs, rhs, T{0}, dst, opts);
+  };
+  const auto plus = [](T lhs, T rhs) { return lhs + rhs; };
+  const auto minus = [](T lhs, T rhs) { return lhs - rhs; };
+
+  elementwise(x.view(), minus, a11, a21); // S3
+  elementwise(y.view(), minus, b22, b12); // T3
+  product(x, y, c21);                     // P7
+  elementwise(x.view(), plus, a21, a22);  // S1
+  elementwise(y.view(), minus, b12, b11); // T1
+  product(x, y, c22);                     // P5
+  elementwise(x.view(), minus, x, a11);   // S2
+  elementwise(y.view(), minus, b22, y);   // T2
+  product(x, y, c12);                     // P6
+  elementwise(x.view(), minus, a12, x);   // S4
+  product(x, b22, c11);                   // P3
+  product(a11, b11, p1.view());           // P1
+  elementwise(c12, plus, p1, c12);        // U2 = P1 + P6
+  elementwise(c21, plus, c12, c21);       // U3 = U2 + P7
+  elementwise(c12, plus, c12, c22);       // U4 = U2 + P5
+  elementwise(c22, plus, c21, c22);       // U7 = U3 + P5
+  elementwise(c12, plus, c12, c11);       // U5 = U4 + P3
+  elementwise(y.view(), minus, y, b21);   // T4
+  product(a22, y, c11);                   // P4
+  elementwise(c21, minus, c21, c11);      // U6 = U3 - P4
+  product(a12, b21, c11);                 // P2
+  elementwise(c11, plus, p1, c11);        // U1 = P1 + P2
+}
+
+// c = alpha * a * b + beta * c with one Strassen-Winograd level on the even
+// part. Odd trailing rows, columns and inner index are fixed up with thin gemm
+// calls.
+template <typename T>
+void strassen_step(T alpha, MatrixView<const T> a, MatrixView<const T> b,
+                   T beta, MatrixView<T> c,
+                   const RecursiveMultiplyOptions &opts) {
+  const std::size_t m = c.nrows(), n = c.ncols(), k = a.ncols();
+  const std::size_t me = m - m % 2, ne = n - n % 2, ke = k - k % 2;
+  auto ae = a.submatrix(0, 0, me, ke);
+  auto be = b.submatrix(0, 0, ke, ne);
+  auto ce = c.submatrix(0, 0, me, ne);
+  if (beta == T{0}) {
+    strassen_winograd(alpha, ae, be, ce, opts);
+  } else {
+    // The schedule overwrites c, so accumulate through a temporary
+    Matrix<T> product(me, ne, uninitialized);
+    strassen_winograd(alpha, ae, be, product.view(), opts);
+    elementwise(ce, [beta](T lhs, T rhs) { return beta * lhs + rhs; }, ce,
+                product);
+  }
+
+  if (k != ke) {
+    matrix_multiply_add(alpha, a.submatrix(0, ke, me, 1),
+                        b.submatrix(ke, 0, 1, ne), T{1}, ce);
+  }
+  if (n != ne) {
+    matrix_multiply_add(alpha, a.rows(0, me), b.columns(ne, 1), beta,
+                        c.submatrix(0, ne, me, 1));
+  }
+  if (m != me) {
+    matrix_multiply_add(alpha, a.rows(me, 1), b, beta, c.rows(me, 1));
+  }
+}
+
+template <typename T>
+void multiply_add(T alpha, MatrixView<const T> a, MatrixView<const T> b,
+                  T beta, MatrixView<T> c,
+                  const RecursiveMultiplyOptions &opts) {
+  const std::size_t m = c.nrows(), n = c.ncols(), k = a.ncols();
+  const std::size_t largest = std::max({m, n, k});
+  const std::size_t smallest = std::min({m, n, k});
+  if (largest < opts.crossover || smallest < 2) {
+    matrix_multiply_add(alpha, a, b, beta, c);
+    return;
+  }
+  if (opts.strassen && largest <= 2 * smallest) {
+    strassen_step(alpha, a, b, beta, c, opts);
+    return;
+  }
+  // Cache-oblivious split, preferring the output dimensions so the halves
+  // are independent
+  if (m == largest) {
+    const std::size_t h = m / 2;
+    multiply_add(alpha, a.rows(0, h), b, beta, c.rows(0, h), opts);
+    multiply_add(alpha, a.rows(h, m - h), b, beta, c.rows(h, m - h), opts);
+  } else if (n == largest) {
+    const std::size_t h = n / 2;
+    multiply_add(alpha, a, b.columns(0, h), beta, c.columns(0, h), opts);
+    multiply_add(alpha, a, b.columns(h, n - h), beta, c.columns(h, n - h),
+                 opts);
+  } else {
+    const std::size_t h = k / 2;
+    multiply_add(alpha, a.columns(0, h), b.rows(0, h), beta, c, opts);
+    multiply_add(alpha, a.columns(h, k - h), b.rows(h, k - h), T{1}, c, opts);
+  }
+}
+} // namespace strassen_detail
+
+/**
+ * @brief Cache key for tuned crossovers: element type, gemm ISA and thread
+ * count, since each of those moves the crossover
+ *
+ * @tparam T
+ * @return std::string
+ */
+template <typename T> std::string strassen_cache_key() {
+  std::string type;
+  if constexpr (std::is_same_v<T, float>) {
+    type = "float";
+  } else if constexpr (std::is_same_v<T, double>) {
+    type = "double";
+  } else {
+    type = typeid(T).name();
+  }
+  return type + "-" + ry::gemm_isa_name(ry::active_gemm_isa()) + "-t" +
+         std::to_string(ry::get_num_threads());
+}
+
+/**
+ * @brief c = alpha * a * b + beta * c by recursive splitting down to ry::gemm
+ *
+ * @tparam T
+ * @param alpha
+ * @param a
+ * @param b
+ * @param beta
+ * @param c
+ * @param opts
+ */
+template <typename T>
+void matrix_multiply_add_recursive(
+    T alpha, std::type_identity_t<MatrixView<const T>> a,
+    std::type_identity_t<MatrixView<const T>> b, T beta,
+    std::type_identity_t<MatrixView<T>> c, RecursiveMultiplyOptions opts = {});
+
+/**
+ * @brief Smallest size in sizes at which one Strassen level over ry::gemm beats
+ * ry::gemm alone on square products, or twice the largest size if it never
+ * does.
+ *
+ * @tparam T
+ * @param sizes - Increasing sizes to try
+ * @return std::size_t
+ */
+template <typename T>
+std::size_t
+tune_strassen_crossover(const std::vector<std::size_t> &sizes = {128, 256, 512,
+                                                                 1024}) {
+  auto best_time = [](auto &&multiply) {
+    double best = std::numeric_limits<double>::max();
+    for (int rep = 0; rep < 2; ++rep) {
+      auto start = std::chrono::steady_clock::now();
+      multiply();
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      best = std::min(best, elapsed.count());
+    }
+    return best;
+  };
+  for (auto n : sizes) {
+    Matrix<T> a(n, n), b(n, n), c(n, n);
+    const double blocked =
+        best_time([&] { matrix_multiply_add(T{1}, a, b, T{0}, c); });
+    const double strassen = best_time([&] {
+      matrix_multiply_add_recursive(T{1}, a, b, T{0}, c,
+                                    RecursiveMultiplyOptions{n, true});
+    });
+    if (strassen < blocked) {
+      return n;
+    }
+  }
+  return sizes.empty() ? 0 : 2 * sizes.back();
+}
+
+/**
+ * @brief Crossover for the current machine. Read from strassen_cache_path() or
+ * tuned and written there on the first call for each strassen_cache_key, then
+ * kept for the process. A later set_num_threads changes the key, so the
+ * crossover follows the thread count.
+ *
+ * @tparam T
+ * @return std::size_t
+ */
+template <typename T> std::size_t strassen_crossover() {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::size_t> crossovers;
+  const auto key = strassen_cache_key<T>();
+  // Held while tuning so that concurrent callers tune once
+  std::lock_guard lock(mutex);
+  if (auto it = crossovers.find(key); it != crossovers.end()) {
+    return it->second;
+  }
+  const auto path = strassen_cache_path();
+  std::size_t crossover;
+  if (auto cached = load_strassen_crossover(path, key)) {
+    crossover = *cached;
+  } else {
+    crossover = tune_strassen_crossover<T>();
+    store_strassen_crossover(path, key, crossover);
+  }
+  crossovers.emplace(key, crossover);
+  return crossover;
+}
+
+template <typename T>
+void matrix_multiply_add_recursive(
+    T alpha, std::type_identity_t<MatrixView<const T>> a,
+    std::type_identity_t<MatrixView<const T>> b, T beta,
+    std::type_identity_t<MatrixView<T>> c, RecursiveMultiplyOptions opts) {
+  if (a.ncols() != b.nrows() || a.nrows() != c.nrows() ||
+      b.ncols() != c.ncols()) {
+    throw std::runtime_error(
+        "Size mismatch: " + print_size(a.nrows(), a.ncols()) + " * " +
+        print_size(b.nrows(), b.ncols()) + " -> " +
+        print_size(c.nrows(), c.ncols()));
+  }
+  if (opts.crossover == 0) {
+    opts.crossover = strassen_crossover<T>();
+  }
+  strassen_detail::multiply_add(alpha, a, b, beta, c, opts);
+}
+
+/**
+ * @brief Product of two matrices or views with the given algorithm
+ *
+ * @tparam MA
+ * @tparam MB
+ * @param a
+ * @param b
+ * @param algorithm
+ * @return Matrix<T>
+ */
+template <matrix_like MA, matrix_like MB>
+auto matrix_multiply(const MA &a, const MB &b, MultiplyAlgorithm algorithm) {
+  using T = matrix_value_t<MA>;
+  if (algorithm == MultiplyAlgorithm::Blocked) {
+    return matrix_multiply(a, b);
+  }
+  static_assert(std::is_same_v<T, matrix_value_t<MB>>,
+                "Operands must have the same element type");
+  auto av = as_view(a);
+  auto bv = as_view(b);
+  if (av.ncols() != bv.nrows()) {
+    throw std::runtime_error(
+        "Inner dimension size mismatch: " + print_size(av.nrows(), av.ncols()) +
+        " * " + print_size(bv.nrows(), bv.ncols()));
+  }
+  Matrix<T> c(av.nrows(), bv.ncols(), uninitialized);
+  RecursiveMultiplyOptions opts;
+  opts.strassen = algorithm == MultiplyAlgorithm::Strassen;
+  matrix_multiply_add_recursive(T{1}, av, bv, T{0}, c.view(), opts);
+  return c;
+}
@@ -0,0 +1,159 @@
+#include "matrix_text.hpp"
+
+#include <cctype>
+
+namespace {
+std::string lower(std::string_view text) {
+  std::string res(text);
+  for (char &ch : res) {
+    ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+  }
+  return res;
+}
+
+// Next line of text starting at offset, without its line end; offset moves
+// past it
+std::string_view next_line(std::string_view text, std::size_t &offset) {
+  const std::size_t eol = text.find('\n', offset);
+  const std::size_t end = eol == std::string_view::npos ? text.size() : eol;
+  auto line = text.substr(offset, end - offset);
+  offset = eol == std::string_view::npos ? text.size() : eol + 1;
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  return line;
+}
+
+std::vector<std::string> split_words(std::string_view line) {
+  std::vector<std::string> res;
+  while (true) {
+    matrix_text_detail::skip_blanks(line, ' ');
+    if (line.empty()) {
+      return res;
+    }
+    const std::size_t end = std::min(line.find_first_of(" \t"), line.size());
+    res.push_back(lower(line.substr(0, end)));
+    line.remove_prefix(end);
+  }
+}
+} // namespace
+
+TextFormat text_format_for(const std::filesystem::path &path) {
+  const auto extension = lower(path.extension().string());
+  if (extension == ".csv") {
+    return TextFormat::Csv;
+  }
+  if (extension == ".tsv") {
+    return TextFormat::Tsv;
+  }
+  if (extension == ".mtx") {
+    return TextFormat::MatrixMarket;
+  }
+  throw std::runtime_error("Unknown text matrix extension for " +
+                           path.string());
+}
+
+namespace matrix_text_detail {
+std::vector<std::string_view> split_for_parsing(std::string_view text) {
+  const std::size_t threads = ry::default_thread_pool().size();
+  const std::size_t parts =
+      text.size() >= kTextParallelBytes && threads > 1 ? 4 * threads : 1;
+  std::vector<std::string_view> res;
+  std::size_t begin = 0;
+  for (std::size_t part = 1; part <= parts && begin < text.size(); ++part) {
+    std::size_t end = text.size();
+    if (part < parts) {
+      end = std::max(begin, text.size() / parts * part);
+      const std::size_t eol = text.find('\n', end);
+      end = eol == std::string_view::npos ? text.size() : eol + 1;
+    }
+    res.push_back(text.substr(begin, end - begin));
+    begin = end;
+  }
+  return res;
+}
+
+std::size_t count_lines(std::string_view piece, bool skipComments) {
+  std::size_t count = 0;
+  for_each_line(piece, skipComments, [&count](std::string_view) { ++count; });
+  return count;
+}
+
+std::string_view first_line(std::string_view text, bool skipComments) {
+  std::size_t offset = 0;
+  while (offset < text.size()) {
+    auto line = next_line(text, offset);
+    if (line.find_first_not_of(" \t") != std::string_view::npos &&
+        !(skipComments && line.front() == '%')) {
+      return line;
+    }
+  }
+  return {};
+}
+
+std::ofstream open_output(const std::filesystem::path &path) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("Cannot open " + path.string() + " for writing");
+  }
+  return out;
+}
+
+MarketHeader parse_market_header(std::string_view text) {
+  std::size_t offset = 0;
+  const auto banner = split_words(next_line(text, offset));
+  if (banner.size() != 5 || banner[0] != "%%matrixmarket" ||
+      banner[1] != "matrix") {
+    throw std::runtime_error("Not a MatrixMarket matrix file");
+  }
+  MarketHeader header;
+  if (banner[2] != "array" && banner[2] != "coordinate") {
+    throw std::runtime_error("Unknown MatrixMarket format " + banner[2]);
+  }
+  header.coordinate = banner[2] == "coordinate";
+  header.pattern = banner[3] == "pattern";
+  if (banner[3] != "real" && banner[3] != "double" && banner[3] != "integer" &&
+      !(header.pattern && header.coordinate)) {
+    throw std::runtime_error("Unsupported MatrixMarket field " + banner[3]);
+  }
+  if (banner[4] != "general" && banner[4] != "symmetric") {
+    throw std::runtime_error("Unsupported MatrixMarket symmetry " +
+                             banner[4]);
+  }
+  header.symmetric = banner[4] == "symmetric";
+
+  std::string_view sizes;
+  while (offset < text.size() && sizes.empty()) {
+    auto line = next_line(text, offset);
+    if (line.find_first_not_of(" \t") != std::string_view::npos &&
+        line.front() != '%') {
+      sizes = line;
+    }
+  }
+  try {
+    header.nrows = parse_value<std::size_t>(sizes, ' ');
+    header.ncols = parse_value<std::size_t>(sizes, ' ');
+    if (header.coordinate) {
+      header.entries = parse_value<std::size_t>(sizes, ' ');
+    }
+    skip_blanks(sizes, ' ');
+    if (!sizes.empty()) {
+      throw std::runtime_error("unexpected \"" + std::string(sizes) + "\"");
+    }
+  } catch (const std::runtime_error &e) {
+    throw std::runtime_error(std::string("MatrixMarket size line: ") +
+                             e.what());
+  }
+  if (header.symmetric && header.nrows != header.ncols) {
+    throw std::runtime_error("Symmetric MatrixMarket matrix is " +
+                             print_size(header.nrows, header.ncols));
+  }
+  if (!header.coordinate) {
+    header.entries = header.symmetric
+                         ? header.nrows * (header.nrows + 1) / 2
+                         : header.nrows * header.ncols;
+  }
+  header.body = offset;
+  return header;
+}
+} // namespace matrix_text_detail
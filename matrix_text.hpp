@@ -0,0 +1,616 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "matrix_file.hpp"
+#include "matrix_ops.hpp"
+#include "matrix_sparse.hpp"
+#include "thread_pool.hpp"
+
+/**
+ * Text matrices for exchanging data with other tools:
+ *
+ *   Csv, Tsv      one row per line, values separated by ',' or '\t'
+ *   MatrixMarket  the NIST exchange format: "array" files list a dense matrix
+ *                 column by column, "coordinate" files list 1-based
+ *                 (row, column, value) triplets of a sparse one
+ *
+ * Numbers are written with std::to_chars, which gives the shortest text that
+ * reads back to the same value, and read with std::from_chars, so nothing
+ * goes through streams or locales. Writers format chunks of about
+ * kTextChunkBytes into reusable buffers on every thread of
+ * default_thread_pool() and write the buffers in order. Readers map the file,
+ * split it at line boundaries and parse the pieces in parallel: one pass
+ * counts the rows in each piece, so a second can parse every piece straight
+ * into its place in the result.
+ */
+
+/**
+ * @brief Text format of a matrix
+ *
+ */
+enum class TextFormat { Csv, Tsv, MatrixMarket };
+
+/**
+ * @brief Format implied by a path's extension: .csv, .tsv or .mtx. Throws
+ * std::runtime_error for anything else.
+ *
+ */
+TextFormat text_format_for(const std::filesystem::path &path);
+
+/**
+ * @brief Bytes each writer chunk formats before it is written out
+ *
+ */
+inline constexpr std::size_t kTextChunkBytes = std::size_t{1} << 20;
+
+/**
+ * @brief Text smaller than this is parsed on one thread
+ *
+ */
+inline constexpr std::size_t kTextParallelBytes = std::size_t{1} << 20;
+
+namespace matrix_text_detail {
+// Enough for any float, double or 64-bit integer
+inline constexpr std::size_t kMaxValueChars = 32;
+
+template <typename T>
+inline constexpr bool text_value =
+    std::is_arithmetic_v<T> && !std::is_same_v<T, bool>;
+
+template <typename T> char *format_value(char *first, T value) {
+  return std::to_chars(first, first + kMaxValueChars, value).ptr;
+}
+
+// Write format(begin, end, buffer) -> buffer end for the consecutive chunks
+// [k, k + chunk) of [0, count). Up to one chunk per thread is formatted at a
+// time, each into its own buffer, and the buffers are written in order.
+template <typename F>
+void write_chunks(std::ostream &out, std::size_t count, std::size_t chunk,
+                  std::size_t chunkBytes, F format) {
+  auto &pool = ry::default_thread_pool();
+  const std::size_t chunks = (count + chunk - 1) / chunk;
+  const std::size_t perRound = std::max<std::size_t>(
+      1, std::min(pool.size(), chunks));
+  std::vector<std::vector<char>> buffers(perRound);
+  std::vector<std::size_t> used(perRound);
+  for (std::size_t first = 0; first < chunks; first += perRound) {
+    const std::size_t round = std::min(perRound, chunks - first);
+    auto run = [&](std::size_t item, std::size_t) {
+      const std::size_t begin = (first + item) * chunk;
+      const std::size_t end = std::min(count, begin + chunk);
+      auto &buffer = buffers[item];
+      buffer.resize(std::max(buffer.size(), chunkBytes));
+      used[item] = format(begin, end, buffer.data()) - buffer.data();
+    };
+    if (round > 1) {
+      pool.parallel_for(round, run);
+    } else {
+      run(0, 0);
+    }
+    for (std::size_t item = 0; item < round; ++item) {
+      out.write(buffers[item].data(),
+                static_cast<std::streamsize>(used[item]));
+    }
+  }
+  if (!out) {
+    throw std::runtime_error("Error writing matrix text");
+  }
+}
+
+// Call body(i) for each piece i, across default_thread_pool() if several
+template <typename F> void for_each_piece(std::size_t pieces, F body) {
+  if (pieces > 1) {
+    ry::default_thread_pool().parallel_for(
+        pieces, [&](std::size_t piece, std::size_t) { body(piece); });
+  } else if (pieces == 1) {
+    body(0);
+  }
+}
+
+// text split at line ends into a few pieces per thread, or one piece if it
+// is smaller than kTextParallelBytes
+std::vector<std::string_view> split_for_parsing(std::string_view text);
+
+// Call line(text) for each line of piece without its line end; blank lines
+// and, if skipComments, lines starting with '%' are left out
+template <typename F>
+void for_each_line(std::string_view piece, bool skipComments, F line) {
+  while (!piece.empty()) {
+    const std::size_t eol = piece.find('\n');
+    std::string_view current = piece.substr(0, eol);
+    piece.remove_prefix(eol == std::string_view::npos ? piece.size()
+                                                      : eol + 1);
+    if (!current.empty() && current.back() == '\r') {
+      current.remove_suffix(1);
+    }
+    if (current.find_first_not_of(" \t") == std::string_view::npos ||
+        (skipComments && current.front() == '%')) {
+      continue;
+    }
+    line(current);
+  }
+}
+
+std::size_t count_lines(std::string_view piece, bool skipComments);
+
+// First line for_each_line would visit, or empty
+std::string_view first_line(std::string_view text, bool skipComments);
+
+// Skip spaces, and tabs unless they separate values, at the start of text
+inline void skip_blanks(std::string_view &text, char sep) {
+  std::size_t skip = 0;
+  while (skip < text.size() &&
+         (text[skip] == ' ' || (text[skip] == '\t' && sep != '\t'))) {
+    ++skip;
+  }
+  text.remove_prefix(skip);
+}
+
+// Parse the value at the start of text, after any blanks, and advance text
+// past it
+template <typename T> T parse_value(std::string_view &text, char sep) {
+  skip_blanks(text, sep);
+  if (!text.empty() && text.front() == '+') {
+    text.remove_prefix(1);
+  }
+  T value{};
+  auto [ptr, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{}) {
+    const auto token = text.substr(0, text.find_first_of(" \t,"));
+    throw std::runtime_error(
+        (ec == std::errc::result_out_of_range ? "Out of range value \""
+                                              : "Cannot parse \"") +
+        std::string(token) + "\"");
+  }
+  text.remove_prefix(ptr - text.data());
+  return value;
+}
+
+// Run parse(), prefixing any error with where it happened
+template <typename F>
+void with_context(const char *what, std::size_t index, F parse) {
+  try {
+    parse();
+  } catch (const std::runtime_error &e) {
+    throw std::runtime_error(std::string(what) + " " + std::to_string(index) +
+                             ": " + e.what());
+  }
+}
+
+std::ofstream open_output(const std::filesystem::path &path);
+
+// Start of each piece's lines among all of them, counted in parallel
+inline std::vector<std::size_t>
+first_lines(const std::vector<std::string_view> &pieces, bool skipComments) {
+  std::vector<std::size_t> first(pieces.size() + 1, 0);
+  for_each_piece(pieces.size(), [&](std::size_t piece) {
+    first[piece + 1] = count_lines(pieces[piece], skipComments);
+  });
+  for (std::size_t piece = 0; piece < pieces.size(); ++piece) {
+    first[piece + 1] += first[piece];
+  }
+  return first;
+}
+
+template <typename T>
+Matrix<T> parse_delimited(std::string_view text, char sep) {
+  const auto header = first_line(text, false);
+  const std::size_t ncols =
+      header.empty() ? 0 : std::count(header.begin(), header.end(), sep) + 1;
+  auto pieces = split_for_parsing(text);
+  auto firstRow = first_lines(pieces, false);
+  Matrix<T> res(firstRow.back(), ncols, uninitialized);
+  for_each_piece(pieces.size(), [&](std::size_t piece) {
+    std::size_t row = firstRow[piece];
+    for_each_line(pieces[piece], false, [&](std::string_view line) {
+      with_context("Row", row + 1, [&] {
+        for (std::size_t col = 0; col < ncols; ++col) {
+          res(row, col) = parse_value<T>(line, sep);
+          skip_blanks(line, sep);
+          const bool last = col + 1 == ncols;
+          if (last ? !line.empty() : line.empty() || line.front() != sep) {
+            throw std::runtime_error("expected " + std::to_string(ncols) +
+                                     " values");
+          }
+          if (!last) {
+            line.remove_prefix(1);
+          }
+        }
+      });
+      ++row;
+    });
+  });
+  return res;
+}
+
+// What the banner and size line of a MatrixMarket file say
+struct MarketHeader {
+  bool coordinate = false;
+  bool pattern = false;
+  bool symmetric = false;
+  std::size_t nrows = 0;
+  std::size_t ncols = 0;
+  // Entries listed in the file
+  std::size_t entries = 0;
+  // Offset of the line after the size line
+  std::size_t body = 0;
+};
+
+MarketHeader parse_market_header(std::string_view text);
+
+// An entry of a coordinate file, 0-based
+template <typename T> struct Triplet {
+  std::size_t row;
+  std::size_t col;
+  T value;
+};
+
+// Entries of a coordinate file in file order, with the mirror images of
+// symmetric off-diagonal entries after them
+template <typename T>
+std::vector<Triplet<T>> parse_coordinate(std::string_view text,
+                                         const MarketHeader &header) {
+  auto pieces = split_for_parsing(text.substr(header.body));
+  auto first = first_lines(pieces, true);
+  if (first.back() != header.entries) {
+    throw std::runtime_error("MatrixMarket file lists " +
+                             std::to_string(first.back()) + " entries, not " +
+                             std::to_string(header.entries));
+  }
+  std::vector<Triplet<T>> res(header.entries);
+  for_each_piece(pieces.size(), [&](std::size_t piece) {
+    std::size_t entry = first[piece];
+    for_each_line(pieces[piece], true, [&](std::string_view line) {
+      with_context("Entry", entry + 1, [&] {
+        const auto row = parse_value<std::size_t>(line, ' ');
+        const auto col = parse_value<std::size_t>(line, ' ');
+        const T value = header.pattern ? T{1} : parse_value<T>(line, ' ');
+        skip_blanks(line, ' ');
+        if (!line.empty()) {
+          throw std::runtime_error("unexpected \"" + std::string(line) +
+                                   "\"");
+        }
+        if (row == 0 || col == 0 || row > header.nrows ||
+            col > header.ncols) {
+          throw std::runtime_error("(" + std::to_string(row) + ", " +
+                                  std::to_string(col) + ") is outside a " +
+                                  print_size(header.nrows, header.ncols) +
+                                  " matrix");
+        }
+        res[entry] = {row - 1, col - 1, value};
+      });
+      ++entry;
+    });
+  });
+  if (header.symmetric) {
+    for (std::size_t k = 0; k < header.entries; ++k) {
+      if (res[k].row != res[k].col) {
+        res.push_back({res[k].col, res[k].row, res[k].value});
+      }
+    }
+  }
+  return res;
+}
+
+// Index of the first value of column col in a symmetric m x m array file,
+// which holds m - k values of each column k before it
+inline std::size_t symmetric_array_start(std::size_t col, std::size_t m) {
+  return col * m - col * (col - 1) / 2;
+}
+
+// Column holding the entry-th value of a symmetric m x m array file, by a
+// binary search of the column starts
+inline std::size_t symmetric_array_column(std::size_t entry, std::size_t m) {
+  std::size_t lo = 0, hi = m;
+  while (lo < hi) {
+    const std::size_t mid = lo + (hi - lo + 1) / 2;
+    if (symmetric_array_start(mid, m) <= entry) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+// Values of an array file, which lists columns in order: all of each column,
+// or for symmetric files the part on and below the diagonal
+template <typename T>
+Matrix<T> parse_array(std::string_view text, const MarketHeader &header) {
+  const std::size_t m = header.nrows;
+  auto pieces = split_for_parsing(text.substr(header.body));
+  auto first = first_lines(pieces, true);
+  if (first.back() != header.entries) {
+    throw std::runtime_error("MatrixMarket file lists " +
+                             std::to_string(first.back()) + " values, not " +
+                             std::to_string(header.entries));
+  }
+  Matrix<T> res(m, header.ncols, uninitialized);
+  for_each_piece(pieces.size(), [&](std::size_t piece) {
+    std::size_t entry = first[piece];
+    // Position of the piece's first value
+    std::size_t col = 0, row = 0;
+    if (m > 0 && header.symmetric) {
+      col = symmetric_array_column(entry, m);
+      row = entry - symmetric_array_start(col, m) + col;
+    } else if (m > 0) {
+      col = entry / m;
+      row = entry % m;
+    }
+    for_each_line(pieces[piece], true, [&](std::string_view line) {
+      with_context("Entry", entry + 1, [&] {
+        const T value = parse_value<T>(line, ' ');
+        skip_blanks(line, ' ');
+        if (!line.empty()) {
+          throw std::runtime_error("unexpected \"" + std::string(line) +
+                                   "\"");
+        }
+        res(row, col) = value;
+        if (header.symmetric) {
+          res(col, row) = value;
+        }
+      });
+      ++entry;
+      if (++row == m) {
+        ++col;
+        row = header.symmetric ? col : 0;
+      }
+    });
+  });
+  return res;
+}
+} // namespace matrix_text_detail
+
+/**
+ * @brief Write a matrix or view as text. MatrixMarket output is an "array"
+ * file, "integer" for integer T and "real" otherwise.
+ *
+ * @tparam M
+ */
+template <matrix_like M>
+void write_matrix_text(std::ostream &out, const M &matrix, TextFormat format) {
+  using namespace matrix_text_detail;
+  using T = matrix_value_t<M>;
+  static_assert(text_value<T>, "Text matrices hold numbers");
+  auto view = as_view(matrix);
+  const std::size_t m = view.nrows(), n = view.ncols();
+  if (format == TextFormat::MatrixMarket) {
+    out << "%%MatrixMarket matrix array "
+        << (std::is_integral_v<T> ? "integer" : "real") << " general\n"
+        << m << " " << n << "\n";
+    // Columns in order, one value per line
+    const std::size_t perChunk = kTextChunkBytes / (kMaxValueChars + 1);
+    write_chunks(out, m * n, perChunk, perChunk * (kMaxValueChars + 1),
+                 [&](std::size_t begin, std::size_t end, char *buffer) {
+                   for (std::size_t k = begin; k < end; ++k) {
+                     buffer = format_value(buffer, view(k % m, k / m));
+                     *buffer++ = '\n';
+                   }
+                   return buffer;
+                 });
+    return;
+  }
+  if (n == 0) {
+    return;
+  }
+  const char sep = format == TextFormat::Csv ? ',' : '\t';
+  const std::size_t rowBytes = n * (kMaxValueChars + 1);
+  const std::size_t rows = std::max<std::size_t>(1, kTextChunkBytes / rowBytes);
+  write_chunks(out, m, rows, rows * rowBytes,
+               [&](std::size_t begin, std::size_t end, char *buffer) {
+                 for (std::size_t row = begin; row < end; ++row) {
+                   for (std::size_t col = 0; col < n; ++col) {
+                     buffer = format_value(buffer, view(row, col));
+                     *buffer++ = col + 1 < n ? sep : '\n';
+                   }
+                 }
+                 return buffer;
+               });
+}
+
+/**
+ * @brief Write a matrix or view to a text file
+ *
+ * @tparam M
+ */
+template <matrix_like M>
+void write_matrix_text(const std::filesystem::path &path, const M &matrix,
+                       TextFormat format) {
+  auto out = matrix_text_detail::open_output(path);
+  write_matrix_text(out, matrix, format);
+}
+
+/**
+ * @brief Write a matrix or view to a text file in the format its extension
+ * names
+ *
+ * @tparam M
+ */
+template <matrix_like M>
+void write_matrix_text(const std::filesystem::path &path, const M &matrix) {
+  write_matrix_text(path, matrix, text_format_for(path));
+}
+
+/**
+ * @brief Write the nonzeros of a sparse matrix as a MatrixMarket "coordinate"
+ * file
+ *
+ * @tparam T
+ */
+template <typename T>
+void write_matrix_market(std::ostream &out, const CscMatrix<T> &matrix) {
+  using namespace matrix_text_detail;
+  static_assert(text_value<T>, "Text matrices hold numbers");
+  out << "%%MatrixMarket matrix coordinate "
+      << (std::is_integral_v<T> ? "integer" : "real") << " general\n"
+      << matrix.nrows() << " " << matrix.ncols() << " " << matrix.nnz()
+      << "\n";
+  const auto colPtr = matrix.col_ptr();
+  const auto rowIdx = matrix.row_idx();
+  const auto values = matrix.values();
+  const std::size_t entryBytes = 3 * kMaxValueChars;
+  const std::size_t perChunk = kTextChunkBytes / entryBytes;
+  write_chunks(
+      out, matrix.nnz(), perChunk, perChunk * entryBytes,
+      [&](std::size_t begin, std::size_t end, char *buffer) {
+        // Column of the first nonzero in the chunk
+        std::size_t col =
+            std::upper_bound(colPtr.begin(), colPtr.end(), begin) -
+            colPtr.begin() - 1;
+        for (std::size_t p = begin; p < end; ++p) {
+          while (colPtr[col + 1] <= p) {
+            ++col;
+          }
+          buffer = format_value(buffer, std::size_t{rowIdx[p]} + 1);
+          *buffer++ = ' ';
+          buffer = format_value(buffer, col + 1);
+          *buffer++ = ' ';
+          buffer = format_value(buffer, values[p]);
+          *buffer++ = '\n';
+        }
+        return buffer;
+      });
+}
+
+/**
+ * @brief Write the nonzeros of a sparse matrix to a MatrixMarket file
+ *
+ * @tparam T
+ */
+template <typename T>
+void write_matrix_market(const std::filesystem::path &path,
+                         const CscMatrix<T> &matrix) {
+  auto out = matrix_text_detail::open_output(path);
+  write_matrix_market(out, matrix);
+}
+
+/**
+ * @brief Parse a text matrix. Blank lines are ignored. Coordinate
+ * MatrixMarket files are expanded, adding up repeated entries; symmetric ones
+ * are mirrored. Throws std::runtime_error naming the row or entry that does
+ * not parse.
+ *
+ * @tparam T
+ */
+template <typename T>
+Matrix<T> parse_matrix_text(std::string_view text, TextFormat format) {
+  using namespace matrix_text_detail;
+  static_assert(text_value<T>, "Text matrices hold numbers");
+  if (format != TextFormat::MatrixMarket) {
+    return parse_delimited<T>(text, format == TextFormat::Csv ? ',' : '\t');
+  }
+  const auto header = parse_market_header(text);
+  if (!header.coordinate) {
+    return parse_array<T>(text, header);
+  }
+  Matrix<T> res(header.nrows, header.ncols);
+  for (const auto &entry : parse_coordinate<T>(text, header)) {
+    res(entry.row, entry.col) += entry.value;
+  }
+  return res;
+}
+
+/**
+ * @brief Read a text matrix file, mapped into memory rather than copied
+ *
+ * @tparam T
+ */
+template <typename T>
+Matrix<T> read_matrix_text(const std::filesystem::path &path,
+                           TextFormat format) {
+  ry::MappedFile file(path);
+  return parse_matrix_text<T>(
+      std::string_view(reinterpret_cast<const char *>(file.data()),
+                       file.size()),
+      format);
+}
+
+/**
+ * @brief Read a text matrix file in the format its extension names
+ *
+ * @tparam T
+ */
+template <typename T>
+Matrix<T> read_matrix_text(const std::filesystem::path &path) {
+  return read_matrix_text<T>(path, text_format_for(path));
+}
+
+/**
+ * @brief Parse a MatrixMarket file into a sparse matrix, without expanding a
+ * coordinate file. Repeated entries are added up.
+ *
+ * @tparam T
+ */
+template <typename T>
+CscMatrix<T> parse_matrix_market_sparse(std::string_view text) {
+  using namespace matrix_text_detail;
+  const auto header = parse_market_header(text);
+  if (!header.coordinate) {
+    return CscMatrix<T>::from_dense(parse_array<T>(text, header));
+  }
+  const auto entries = parse_coordinate<T>(text, header);
+  // Bucket by column, then sort each column by row and merge repeats
+  std::vector<sparse_index_t> colPtr(header.ncols + 1, 0);
+  for (const auto &entry : entries) {
+    ++colPtr[entry.col + 1];
+  }
+  for (std::size_t col = 0; col < header.ncols; ++col) {
+    colPtr[col + 1] += colPtr[col];
+  }
+  sparse_detail::checked_index(entries.size());
+  std::vector<std::pair<sparse_index_t, T>> sorted(entries.size());
+  auto next = colPtr;
+  for (const auto &entry : entries) {
+    sorted[next[entry.col]++] = {sparse_detail::checked_index(entry.row),
+                                 entry.value};
+  }
+  std::vector<sparse_index_t> ptr{0}, rowIdx;
+  std::vector<T> values;
+  ptr.reserve(header.ncols + 1);
+  rowIdx.reserve(entries.size());
+  values.reserve(entries.size());
+  for (std::size_t col = 0; col < header.ncols; ++col) {
+    auto first = sorted.begin() + colPtr[col];
+    auto last = sorted.begin() + colPtr[col + 1];
+    std::stable_sort(first, last, [](const auto &x, const auto &y) {
+      return x.first < y.first;
+    });
+    for (auto it = first; it != last; ++it) {
+      if (it != first && it->first == rowIdx.back()) {
+        values.back() += it->second;
+      } else {
+        rowIdx.push_back(it->first);
+        values.push_back(it->second);
+      }
+    }
+    ptr.push_back(sparse_detail::checked_index(rowIdx.size()));
+  }
+  return CscMatrix<T>(header.nrows, header.ncols, std::move(ptr),
+                      std::move(rowIdx), std::move(values));
+}
+
+/**
+ * @brief Read a MatrixMarket file into a sparse matrix
+ *
+ * @tparam T
+ */
+template <typename T>
+CscMatrix<T> read_matrix_market_sparse(const std::filesystem::path &path) {
+  ry::MappedFile file(path);
+  return parse_matrix_market_sparse<T>(std::string_view(
+      reinterpret_cast<const char *>(file.data()), file.size()));
+}
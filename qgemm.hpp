@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "gemm.hpp"
+
+/**
+ * Integer GEMM for quantized operands: C = A * B with int8, uint8 or int16 A
+ * and B and int32 C, accumulated exactly in int32.
+ *
+ * The loop structure is the same as ry::gemm. What differs is the packed
+ * format: operands are widened to int16 and consecutive pairs of k are stored
+ * together, so that one 32-bit lane of a packed A sliver holds
+ * (a[i][2p], a[i][2p + 1]) and one 32-bit word of a B sliver holds
+ * (b[2p][j], b[2p + 1][j]). The micro-kernels then use the widening
+ * multiply-add instructions (pmaddwd and its AVX2/AVX-512 forms), which
+ * multiply int16 pairs and add both products into an int32 lane, doing two
+ * steps of k per instruction. An odd k is padded with a zero.
+ *
+ * int16 inputs can overflow the int32 accumulator: keep
+ * k * max|a| * max|b| below 2^31. For int8 that allows k up to 2^17.
+ */
+namespace ry {
+
+/**
+ * @brief Signature of a micro-kernel computing
+ *   C[0:mr, 0:nr] += A_packed * B_packed
+ * over kp pairs of k, where each pair of A_packed holds 2 * mr int16 and each
+ * pair of B_packed holds 2 * nr int16
+ *
+ */
+using qgemm_micro_kernel_fn = void (*)(std::size_t kp, const std::int16_t *a,
+                                       const std::int16_t *b, std::int32_t *c,
+                                       std::size_t rsc, std::size_t csc);
+
+/**
+ * @brief An integer micro-kernel and the register tile it computes
+ *
+ */
+struct QGemmMicroKernel {
+  std::size_t mr;
+  std::size_t nr;
+  qgemm_micro_kernel_fn fn;
+  const char *name;
+};
+
+/**
+ * @brief Portable integer micro-kernel. Compilers turn the pair sum into a
+ * widening multiply-add where the target has one.
+ *
+ * @tparam MR
+ * @tparam NR
+ */
+template <std::size_t MR, std::size_t NR>
+void qgemm_micro_kernel_generic(std::size_t kp, const std::int16_t *a,
+                                const std::int16_t *b, std::int32_t *c,
+                                std::size_t rsc, std::size_t csc) {
+  std::int32_t acc[MR * NR] = {};
+  for (std::size_t p = 0; p < kp; ++p) {
+    for (std::size_t j = 0; j < NR; ++j) {
+      const std::int32_t b0 = b[2 * j], b1 = b[2 * j + 1];
+      for (std::size_t i = 0; i < MR; ++i) {
+        acc[i + j * MR] += a[2 * i] * b0 + a[2 * i + 1] * b1;
+      }
+    }
+    a += 2 * MR;
+    b += 2 * NR;
+  }
+  for (std::size_t j = 0; j < NR; ++j) {
+    for (std::size_t i = 0; i < MR; ++i) {
+      c[i * rsc + j * csc] += acc[i + j * MR];
+    }
+  }
+}
+
+/**
+ * @brief Integer micro-kernel targeting isa. The AVX-512 kernel needs
+ * AVX-512BW, and uses VNNI where available; without BW the AVX2 kernel is
+ * used. Throws std::runtime_error if the CPU does not support isa.
+ *
+ */
+QGemmMicroKernel qgemm_kernel_for_isa(GemmIsa isa);
+
+/**
+ * @brief Integer micro-kernel for active_gemm_isa()
+ *
+ */
+inline QGemmMicroKernel default_qgemm_kernel() {
+  static const QGemmMicroKernel kernel =
+      qgemm_kernel_for_isa(active_gemm_isa());
+  return kernel;
+}
+
+/**
+ * @brief Blocking for packed int16 pairs, whose blocks take as much cache as
+ * default_gemm_blocking's do for doubles
+ *
+ */
+inline GemmBlocking default_qgemm_blocking(const QGemmMicroKernel &kernel) {
+  std::size_t kc = 1024;
+  std::size_t mc = std::max(kernel.mr, 192 / kernel.mr * kernel.mr);
+  std::size_t nc = std::max(kernel.nr, 2048 / kernel.nr * kernel.nr);
+  return {mc, kc, nc};
+}
+
+namespace detail {
+/**
+ * @brief Pack an mc x kc block of A into mr-row slivers of k pairs, zero
+ * padding the last sliver and an odd last pair
+ */
+template <typename T>
+void qpack_a(std::size_t mc, std::size_t kc, const T *a, std::size_t rsa,
+             std::size_t csa, std::size_t mr, std::int16_t *dst) {
+  for (std::size_t i0 = 0; i0 < mc; i0 += mr) {
+    const std::size_t mcur = std::min(mr, mc - i0);
+    for (std::size_t p = 0; p < kc; p += 2) {
+      const T *src = a + i0 * rsa + p * csa;
+      const bool pair = p + 1 < kc;
+      std::size_t i = 0;
+      for (; i < mcur; ++i) {
+        dst[2 * i] = src[i * rsa];
+        dst[2 * i + 1] = pair ? src[i * rsa + csa] : 0;
+      }
+      for (; i < mr; ++i) {
+        dst[2 * i] = 0;
+        dst[2 * i + 1] = 0;
+      }
+      dst += 2 * mr;
+    }
+  }
+}
+
+/**
+ * @brief Pack a kc x nc block of B into nr-column slivers of k pairs, zero
+ * padding the last sliver and an odd last pair
+ */
+template <typename T>
+void qpack_b(std::size_t kc, std::size_t nc, const T *b, std::size_t rsb,
+             std::size_t csb, std::size_t nr, std::int16_t *dst) {
+  for (std::size_t j0 = 0; j0 < nc; j0 += nr) {
+    const std::size_t ncur = std::min(nr, nc - j0);
+    for (std::size_t p = 0; p < kc; p += 2) {
+      const T *src = b + p * rsb + j0 * csb;
+      const bool pair = p + 1 < kc;
+      std::size_t j = 0;
+      for (; j < ncur; ++j) {
+        dst[2 * j] = src[j * csb];
+        dst[2 * j + 1] = pair ? src[j * csb + rsb] : 0;
+      }
+      for (; j < nr; ++j) {
+        dst[2 * j] = 0;
+        dst[2 * j + 1] = 0;
+      }
+      dst += 2 * nr;
+    }
+  }
+}
+
+/**
+ * @brief Multiply a packed mc x kc block of A by a packed kc x nc panel of B
+ * into C, as gemm_macro_kernel does
+ */
+inline void qgemm_macro_kernel(std::size_t mc, std::size_t nc, std::size_t kc,
+                               const std::int16_t *packA,
+                               const std::int16_t *packB, std::int32_t *c,
+                               std::size_t rsc, std::size_t csc,
+                               const QGemmMicroKernel &kernel,
+                               std::int32_t *scratch) {
+  const std::size_t mr = kernel.mr, nr = kernel.nr;
+  const std::size_t kp = (kc + 1) / 2;
+  for (std::size_t j0 = 0; j0 < nc; j0 += nr) {
+    const std::size_t ncur = std::min(nr, nc - j0);
+    const std::int16_t *bSliver = packB + j0 * 2 * kp;
+    for (std::size_t i0 = 0; i0 < mc; i0 += mr) {
+      const std::size_t mcur = std::min(mr, mc - i0);
+      const std::int16_t *aSliver = packA + i0 * 2 * kp;
+      std::int32_t *cTile = c + i0 * rsc + j0 * csc;
+      if (mcur == mr && ncur == nr) {
+        kernel.fn(kp, aSliver, bSliver, cTile, rsc, csc);
+      } else {
+        std::fill(scratch, scratch + mr * nr, 0);
+        kernel.fn(kp, aSliver, bSliver, scratch, 1, mr);
+        for (std::size_t j = 0; j < ncur; ++j) {
+          for (std::size_t i = 0; i < mcur; ++i) {
+            cTile[i * rsc + j * csc] += scratch[i + j * mr];
+          }
+        }
+      }
+    }
+  }
+}
+} // namespace detail
+
+/**
+ * @brief Element types qgemm accepts: those that widen exactly to int16
+ *
+ */
+template <typename T>
+inline constexpr bool qgemm_operand =
+    std::is_same_v<T, std::int8_t> || std::is_same_v<T, std::uint8_t> ||
+    std::is_same_v<T, std::int16_t>;
+
+/**
+ * @brief Integer matrix multiply C = A * B for strided operands, addressed as
+ * in gemm. A and B are int8, uint8 or int16; C is overwritten.
+ *
+ * @tparam TA
+ * @tparam TB
+ */
+template <typename TA, typename TB>
+void qgemm(std::size_t m, std::size_t n, std::size_t k, const TA *a,
+           std::size_t rsa, std::size_t csa, const TB *b, std::size_t rsb,
+           std::size_t csb, std::int32_t *c, std::size_t rsc, std::size_t csc,
+           const QGemmMicroKernel &kernel, const GemmBlocking &blocking) {
+  static_assert(qgemm_operand<TA> && qgemm_operand<TB>,
+                "qgemm operands must be int8, uint8 or int16");
+  if (m == 0 || n == 0) {
+    return;
+  }
+  detail::gemm_scale_c(m, n, std::int32_t{0}, c, rsc, csc);
+  if (k == 0) {
+    return;
+  }
+
+  const std::size_t mr = kernel.mr, nr = kernel.nr;
+  const std::size_t MC =
+      detail::round_up(std::max<std::size_t>(blocking.mc, 1), mr);
+  // Even, so pairs never straddle blocks
+  const std::size_t KC =
+      detail::round_up(std::max<std::size_t>(blocking.kc, 2), 2);
+  const std::size_t NC =
+      detail::round_up(std::max<std::size_t>(blocking.nc, 1), nr);
+  const std::size_t mcMax = std::min(MC, detail::round_up(m, mr));
+  const std::size_t ncMax = std::min(NC, detail::round_up(n, nr));
+  const std::size_t kcMax = std::min(KC, detail::round_up(k, 2));
+  auto packA = detail::make_aligned_buffer<std::int16_t>(mcMax * kcMax);
+  auto packB = detail::make_aligned_buffer<std::int16_t>(kcMax * ncMax);
+  auto scratch = detail::make_aligned_buffer<std::int32_t>(mr * nr);
+
+  for (std::size_t jc = 0; jc < n; jc += NC) {
+    const std::size_t nc = std::min(NC, n - jc);
+    for (std::size_t pc = 0; pc < k; pc += KC) {
+      const std::size_t kc = std::min(KC, k - pc);
+      detail::qpack_b(kc, nc, b + pc * rsb + jc * csb, rsb, csb, nr,
+                      packB.get());
+      for (std::size_t ic = 0; ic < m; ic += MC) {
+        const std::size_t mc = std::min(MC, m - ic);
+        detail::qpack_a(mc, kc, a + ic * rsa + pc * csa, rsa, csa, mr,
+                        packA.get());
+        detail::qgemm_macro_kernel(mc, nc, kc, packA.get(), packB.get(),
+                                   c + ic * rsc + jc * csc, rsc, csc, kernel,
+                                   scratch.get());
+      }
+    }
+  }
+}
+} // namespace ry
@@ -1,6 +1,10 @@
 #include "graph.hpp"
 #include <gtest/gtest.h>
 #include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
 
 TEST(Graph, AdjacencyListConstruct) {
   ry::AdjacencyListGraph g;
@@ -136,4 +140,433 @@ TEST(Graph, AdjacencyListCycleDetection) {
 
   g.add_edge(4, 1);
   ASSERT_EQ(ry::detectCyclesDfs(g), std::make_tuple(true, 4, 1));
+
+  // Cycles the first node can't reach are found too
+  g.remove_node(1);
+  g.add_node(0);
+  g.add_edge(4, 3);
+  ASSERT_TRUE(std::get<0>(ry::detectCyclesDfs(g)));
+}
+
+TEST(Graph, AdjacencyListForEachNeighbor) {
+  ry::AdjacencyListGraph g;
+  for (ry::nodeId_t node : {5, 1, 9, 3}) {
+    g.add_node(node);
+  }
+  // Out of order and repeated
+  g.add_edge(5, 9);
+  g.add_edge(5, 1);
+  g.add_edge(5, 3);
+  g.add_edge(5, 9);
+  std::vector<ry::nodeId_t> seen;
+  g.forEachNeighbor(5,
+                    [&](ry::nodeId_t neighbor) { seen.push_back(neighbor); });
+  ASSERT_EQ(seen, std::vector<ry::nodeId_t>({1, 3, 9}));
+  ASSERT_EQ(g.getNeighbors(5), seen);
+
+  // Lists come in one batch straight from storage
+  std::size_t batches = 0;
+  auto count = [&](std::span<const ry::nodeId_t>,
+                   std::span<const std::size_t>) { ++batches; };
+  g.visitNeighbors(5, count);
+  g.visitNeighbors(1, count);
+  g.visitNeighbors(42, count);
+  ASSERT_EQ(batches, 2);
+
+  g.remove_node(3);
+  seen.clear();
+  g.forEachNeighbor(5,
+                    [&](ry::nodeId_t neighbor) { seen.push_back(neighbor); });
+  ASSERT_EQ(seen, std::vector<ry::nodeId_t>({1, 9}));
+}
+
+TEST(Graph, AdjacencyListDenseIndex) {
+  ry::AdjacencyListGraph g;
+  for (ry::nodeId_t node : {1000000, 7, 123456789}) {
+    g.add_node(node);
+  }
+  ASSERT_EQ(g.denseIndexBound(), 3);
+  ASSERT_EQ(g.denseIndex(1000000), 0);
+  ASSERT_EQ(g.denseIndex(7), 1);
+  ASSERT_EQ(g.denseIndex(123456789), 2);
+  ASSERT_THROW(g.denseIndex(8), ry::InvalidNodeIdError);
+  g.add_edge(7, 123456789);
+  g.add_edge(7, 1000000);
+
+  // Removed indices are reused by later nodes
+  g.remove_node(1000000);
+  ASSERT_THROW(g.denseIndex(1000000), ry::InvalidNodeIdError);
+  g.add_node(42);
+  ASSERT_EQ(g.denseIndex(42), 0);
+  ASSERT_EQ(g.denseIndexBound(), 3);
+  ASSERT_EQ(g.getNodes(), std::vector<ry::nodeId_t>({7, 42, 123456789}));
+  g.add_edge(7, 42);
+
+  std::vector<std::pair<ry::nodeId_t, std::size_t>> seen;
+  g.forEachNeighborWithIndex(7, [&](ry::nodeId_t neighbor, std::size_t index) {
+    seen.emplace_back(neighbor, index);
+  });
+  ASSERT_EQ(seen, (std::vector<std::pair<ry::nodeId_t, std::size_t>>(
+                      {{42, 0}, {123456789, 2}})));
+}
+
+TEST(Graph, AdjacencyListUnorderedEdges) {
+  ry::AdjacencyListGraph g;
+  for (ry::nodeId_t node = 0; node < 50; ++node) {
+    g.add_node(node);
+  }
+  // Out of order and repeated, with a removal before anything reads
+  for (ry::nodeId_t dest : {7, 3, 9, 3, 41, 0, 9, 12, 5}) {
+    g.add_edge(1, dest);
+  }
+  g.remove_node(12);
+  ASSERT_TRUE(g.isAdjacent(1, 41));
+  ASSERT_FALSE(g.isAdjacent(1, 12));
+  g.add_edge(1, 2);
+  g.add_edge(1, 49);
+  g.add_edge(1, 7);
+  const std::vector<ry::nodeId_t> neighbors{0, 2, 3, 5, 7, 9, 41, 49};
+  ASSERT_EQ(g.getNeighbors(1), neighbors);
+  g.forEachNeighborWithIndex(1, [&](ry::nodeId_t neighbor, std::size_t index) {
+    ASSERT_EQ(g.denseIndex(neighbor), index);
+  });
+
+  // The first readers of an unsorted list agree on it
+  for (ry::nodeId_t dest = 49; dest > 12; --dest) {
+    g.add_edge(2, dest);
+  }
+  // Long tails are hashed: repeats, and a node removed and added back
+  g.add_edge(2, 30);
+  g.remove_node(40);
+  g.add_node(40);
+  for (ry::nodeId_t dest = 49; dest > 12; --dest) {
+    g.add_edge(2, dest);
+  }
+  std::vector<std::vector<ry::nodeId_t>> seen(4);
+  {
+    std::vector<std::jthread> readers;
+    for (auto &res : seen) {
+      readers.emplace_back([&g, &res] { res = g.getNeighbors(2); });
+    }
+  }
+  for (const auto &res : seen) {
+    ASSERT_EQ(res.size(), 37);
+    ASSERT_TRUE(std::adjacent_find(res.begin(), res.end(),
+                                   std::greater_equal<>()) == res.end());
+  }
+}
+
+TEST(Graph, AdjacencyListPredecessors) {
+  for (bool reverseIndex : {false, true}) {
+    ry::AdjacencyListGraph g(reverseIndex);
+    ASSERT_EQ(g.hasReverseIndex(), reverseIndex);
+    for (ry::nodeId_t node : {1, 2, 3, 4}) {
+      g.add_node(node);
+    }
+    g.add_edge(3, 2);
+    g.add_edge(1, 2);
+    g.add_edge(2, 2);
+    g.add_edge(2, 4);
+    g.add_edge(1, 2);
+    ASSERT_EQ(g.getPredecessors(2), std::vector<ry::nodeId_t>({1, 2, 3}));
+    ASSERT_EQ(g.getPredecessors(1), std::vector<ry::nodeId_t>());
+    ASSERT_EQ(g.getPredecessors(9), std::vector<ry::nodeId_t>());
+
+    g.remove_node(2);
+    ASSERT_EQ(g.getNeighbors(1), std::vector<ry::nodeId_t>());
+    ASSERT_EQ(g.getPredecessors(4), std::vector<ry::nodeId_t>());
+    // Node 5 takes the index of 2, with none of its edges
+    g.add_node(5);
+    ASSERT_EQ(g.getPredecessors(5), std::vector<ry::nodeId_t>());
+    g.add_edge(5, 4);
+    ASSERT_EQ(g.getPredecessors(4), std::vector<ry::nodeId_t>({5}));
+  }
+}
+
+TEST(Graph, AdjacencyListRandomMutations) {
+  // Interleaved edits and reads against sets of edges, so that removed edges
+  // are dropped both before and after their list is sorted, and nodes come
+  // back while edges to their old index are still pending
+  constexpr ry::nodeId_t n = 40;
+  for (bool reverseIndex : {false, true}) {
+    std::mt19937_64 gen(reverseIndex);
+    std::uniform_int_distribution<ry::nodeId_t> id(0, n - 1);
+    std::uniform_int_distribution<int> op(0, 9);
+    ry::AdjacencyListGraph g(reverseIndex);
+    std::map<ry::nodeId_t, std::set<ry::nodeId_t>> reference;
+    for (int step = 0; step < 20000; ++step) {
+      const auto u = id(gen), v = id(gen);
+      switch (op(gen)) {
+      case 0:
+        g.remove_node(u);
+        reference.erase(u);
+        for (auto &[_, dests] : reference) {
+          dests.erase(u);
+        }
+        break;
+      case 1:
+        g.add_node(u);
+        reference[u];
+        break;
+      case 2:
+        ASSERT_EQ(g.isAdjacent(u, v),
+                  reference.contains(u) && reference[u].contains(v));
+        break;
+      case 3:
+        if (reference.contains(u)) {
+          ASSERT_EQ(g.getNeighbors(u),
+                    std::vector<ry::nodeId_t>(reference[u].begin(),
+                                              reference[u].end()));
+        }
+        break;
+      case 4: {
+        std::vector<ry::nodeId_t> expected;
+        for (const auto &[src, dests] : reference) {
+          if (dests.contains(u)) {
+            expected.push_back(src);
+          }
+        }
+        ASSERT_EQ(g.getPredecessors(u), expected);
+        break;
+      }
+      default:
+        if (reference.contains(u) && reference.contains(v)) {
+          g.add_edge(u, v);
+          reference[u].insert(v);
+        }
+      }
+    }
+    for (const auto &[src, dests] : reference) {
+      ASSERT_EQ(g.getNeighbors(src),
+                std::vector<ry::nodeId_t>(dests.begin(), dests.end()));
+      g.forEachNeighborWithIndex(
+          src, [&](ry::nodeId_t neighbor, std::size_t index) {
+            ASSERT_EQ(g.denseIndex(neighbor), index);
+          });
+    }
+  }
+}
+
+TEST(Graph, AdjacencyListBatched) {
+  constexpr ry::nodeId_t n = 100;
+  std::mt19937_64 gen(25);
+  std::uniform_int_distribution<ry::nodeId_t> id(0, n - 1);
+  std::vector<ry::Edge> edges;
+  for (int k = 0; k < 600; ++k) {
+    edges.emplace_back(id(gen), id(gen));
+  }
+  std::vector<ry::nodeId_t> removed;
+  for (int k = 0; k < 30; ++k) {
+    removed.push_back(id(gen));
+  }
+
+  for (bool reverseIndex : {false, true}) {
+    ry::AdjacencyListGraph batched(reverseIndex), reference;
+    for (ry::nodeId_t node = 0; node < n; ++node) {
+      batched.add_node(node);
+      reference.add_node(node);
+    }
+    // Two batches, so the second merges into existing lists
+    const std::span<const ry::Edge> all(edges);
+    batched.add_edges(all.first(300));
+    batched.add_edges(all.subspan(300));
+    for (auto [src, dest] : edges) {
+      reference.add_edge(src, dest);
+    }
+    batched.remove_nodes(removed);
+    for (auto node : removed) {
+      reference.remove_node(node);
+    }
+
+    ASSERT_EQ(batched.getNodes(), reference.getNodes());
+    for (auto node : reference.getNodes()) {
+      ASSERT_EQ(batched.getNeighbors(node), reference.getNeighbors(node));
+      ASSERT_EQ(batched.getPredecessors(node),
+                reference.getPredecessors(node));
+      batched.forEachNeighborWithIndex(
+          node, [&](ry::nodeId_t neighbor, std::size_t index) {
+            ASSERT_EQ(batched.denseIndex(neighbor), index);
+          });
+    }
+  }
+
+  // A missing endpoint adds none of the batch
+  ry::AdjacencyListGraph g(true);
+  g.add_node(1);
+  g.add_node(2);
+  const std::vector<ry::Edge> bad{{1, 2}, {2, 3}};
+  ASSERT_THROW(g.add_edges(bad), ry::InvalidNodeIdError);
+  ASSERT_FALSE(g.isAdjacent(1, 2));
+  ASSERT_EQ(g.getPredecessors(2), std::vector<ry::nodeId_t>());
+}
+
+TEST(Graph, VisitedSet) {
+  ry::VisitedSet visited;
+  visited.reset(4);
+  ASSERT_TRUE(visited.insert(2));
+  ASSERT_FALSE(visited.insert(2));
+  ASSERT_TRUE(visited.contains(2));
+  visited.erase(2);
+  ASSERT_FALSE(visited.contains(2));
+  visited.insert(3);
+
+  // A new epoch forgets everything, and may grow the set
+  visited.reset(8);
+  for (std::size_t i = 0; i < 8; ++i) {
+    ASSERT_FALSE(visited.contains(i));
+  }
+  ASSERT_TRUE(visited.insert(7));
+}
+
+TEST(Graph, TraversalsFromRoot) {
+  ry::AdjacencyListGraph g;
+  for (ry::nodeId_t node : {10, 20, 30, 40, 50}) {
+    g.add_node(node);
+  }
+  g.add_edge(10, 20);
+  g.add_edge(10, 30);
+  g.add_edge(20, 40);
+  g.add_edge(30, 40);
+  g.add_edge(50, 10);
+
+  // One visited set across back-to-back queries
+  ry::VisitedSet visited;
+  for (int repeat = 0; repeat < 2; ++repeat) {
+    ASSERT_EQ(ry::bfs(g, 10, visited),
+              std::vector<ry::nodeId_t>({10, 20, 30, 40}));
+    ASSERT_EQ(ry::bfs(g, 30, visited), std::vector<ry::nodeId_t>({30, 40}));
+    ASSERT_EQ(ry::bfs(g, 50, visited),
+              std::vector<ry::nodeId_t>({50, 10, 20, 30, 40}));
+    ASSERT_EQ(ry::dfsPreorder(g, 10, visited),
+              std::vector<ry::nodeId_t>({10, 30, 40, 20}));
+    ASSERT_EQ(ry::dfsPostorderIterative(g, 20, visited),
+              std::vector<ry::nodeId_t>({40, 20}));
+  }
+  ASSERT_EQ(ry::bfs(g, 10, visited), ry::bfs(g));
+  ASSERT_THROW(ry::bfs(g, 60, visited), ry::InvalidNodeIdError);
+
+  // Traversals without a root start at the smallest node
+  ASSERT_EQ(g.firstNode(), 10);
+  g.remove_node(10);
+  ASSERT_EQ(g.firstNode(), 20);
+  ASSERT_EQ(ry::bfs(g), std::vector<ry::nodeId_t>({20, 40}));
+
+  // Released scratch sets are rebuilt by the next traversal
+  ry::release_scratch_visited();
+  ASSERT_EQ(ry::dfsPreorder(g), std::vector<ry::nodeId_t>({20, 40}));
+
+  ry::AdjacencyListGraph empty;
+  ASSERT_EQ(empty.firstNode(), std::nullopt);
+  ASSERT_EQ(ry::bfs(empty), std::vector<ry::nodeId_t>());
+  ASSERT_EQ(ry::dfsPostorderIterative(empty), std::vector<ry::nodeId_t>());
+}
+
+TEST(Graph, AdjacencyMatrix) {
+  ry::AdjacencyMatrixGraph g;
+  ASSERT_EQ(g.getNodes(), std::vector<ry::nodeId_t>());
+  for (ry::nodeId_t node : {1, 3, 17, 130}) {
+    g.add_node(node);
+  }
+  ASSERT_EQ(g.getNodes(), std::vector<ry::nodeId_t>({1, 3, 17, 130}));
+  ASSERT_EQ(g.firstNode(), 1);
+  ASSERT_EQ(g.numNodes(), 4);
+  ASSERT_GE(g.capacity(), 131);
+
+  g.add_edge(1, 130);
+  g.add_edge(1, 3);
+  g.add_edge(3, 17);
+  g.add_edge(130, 1);
+  ASSERT_TRUE(g.isAdjacent(1, 130));
+  ASSERT_FALSE(g.isAdjacent(130, 3));
+  ASSERT_FALSE(g.isAdjacent(1, 5000));
+  ASSERT_EQ(g.getNeighbors(1), std::vector<ry::nodeId_t>({3, 130}));
+  ASSERT_EQ(g.degree(1), 2);
+  ASSERT_THROW(g.add_edge(1, 2), ry::InvalidNodeIdError);
+  ASSERT_THROW(g.add_node(ry::AdjacencyMatrixGraph::kMaxNodeId + 1),
+               ry::InvalidNodeIdError);
+
+  // Growing keeps the edges
+  g.add_node(1000);
+  g.add_edge(1000, 17);
+  ASSERT_EQ(g.getNeighbors(1), std::vector<ry::nodeId_t>({3, 130}));
+  ASSERT_EQ(g.getNeighbors(1000), std::vector<ry::nodeId_t>({17}));
+
+  g.remove_node(130);
+  ASSERT_FALSE(g.contains(130));
+  ASSERT_EQ(g.numNodes(), 4);
+  ASSERT_EQ(g.getNeighbors(1), std::vector<ry::nodeId_t>({3}));
+  ASSERT_EQ(g.getNeighbors(130), std::vector<ry::nodeId_t>());
+}
+
+TEST(Graph, AdjacencyMatrixMatchesList) {
+  // Dense enough that neighbor batches fill up, with removed nodes
+  ry::AdjacencyMatrixGraph matrix;
+  ry::AdjacencyListGraph list;
+  const ry::nodeId_t n = 300;
+  for (ry::nodeId_t node = 0; node < n; ++node) {
+    matrix.add_node(node);
+    list.add_node(node);
+  }
+  for (ry::nodeId_t src = 0; src < n; ++src) {
+    for (ry::nodeId_t dest = 0; dest < n; ++dest) {
+      if ((src * 7 + dest * 13) % 5 == 0 && src / 10 != dest / 10 + 3) {
+        matrix.add_edge(src, dest);
+        list.add_edge(src, dest);
+      }
+    }
+  }
+  for (ry::nodeId_t node : {0, 77, 299}) {
+    matrix.remove_node(node);
+    list.remove_node(node);
+  }
+  ASSERT_EQ(matrix.getNodes(), list.getNodes());
+  for (auto node : list.getNodes()) {
+    ASSERT_EQ(matrix.getNeighbors(node), list.getNeighbors(node));
+    std::vector<ry::nodeId_t> seen;
+    matrix.forEachNeighbor(
+        node, [&](ry::nodeId_t neighbor) { seen.push_back(neighbor); });
+    ASSERT_EQ(seen, list.getNeighbors(node));
+  }
+  ASSERT_EQ(ry::bfs(matrix), ry::bfs(list));
+  ASSERT_EQ(ry::dfsPostorderIterative2(matrix),
+            ry::dfsPostorderIterative2(list));
+}
+
+TEST(Graph, AdjacencyMatrixBfsLevels) {
+  // A path 0 -> 1 -> ... -> 99, shortcuts 0 -> 50 -> 90, and an
+  // unreachable node
+  ry::AdjacencyMatrixGraph g(128);
+  for (ry::nodeId_t node = 0; node <= 100; ++node) {
+    g.add_node(node);
+  }
+  for (ry::nodeId_t node = 0; node + 1 < 100; ++node) {
+    g.add_edge(node, node + 1);
+  }
+  g.add_edge(0, 50);
+  g.add_edge(50, 90);
+  auto levels = g.bfsLevels(0);
+  ASSERT_EQ(levels.size(), g.capacity());
+  ASSERT_EQ(levels[0], 0);
+  ASSERT_EQ(levels[49], 49);
+  ASSERT_EQ(levels[50], 1);
+  ASSERT_EQ(levels[89], 40);
+  ASSERT_EQ(levels[90], 2);
+  ASSERT_EQ(levels[99], 11);
+  ASSERT_EQ(levels[100], ry::kUnreached);
+  ASSERT_EQ(levels[120], ry::kUnreached);
+  ASSERT_THROW(g.bfsLevels(101), ry::InvalidNodeIdError);
+
+  // Complete graph: every other node is one step away
+  ry::AdjacencyMatrixGraph complete;
+  for (ry::nodeId_t node = 0; node < 200; ++node) {
+    complete.add_node(node);
+  }
+  for (ry::nodeId_t src = 0; src < 200; ++src) {
+    for (ry::nodeId_t dest = 0; dest < 200; ++dest) {
+      complete.add_edge(src, dest);
+    }
+  }
+  levels = complete.bfsLevels(5);
+  ASSERT_EQ(levels[5], 0);
+  ASSERT_EQ(std::count(levels.begin(), levels.begin() + 200, 1), 199);
 }
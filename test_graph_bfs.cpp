@@ -0,0 +1,65 @@
+#include "graph_bfs.hpp"
+#include "graph_reference.hpp"
+#include "thread_pool.hpp"
+#include <gtest/gtest.h>
+
+TEST(GraphBfs, MatchesSerial) {
+  for (bool symmetric : {false, true}) {
+    auto g = ry::reference::random_graph(20000, 60000, symmetric, 1);
+    auto transpose = g.transpose();
+    for (ry::nodeId_t root : {0, 5, 20150}) {
+      auto expected = ry::reference::bfs_levels(g, root);
+      for (std::size_t threads : {1, 4}) {
+        ry::NumThreadsGuard guard(threads);
+        for (auto direction :
+             {ry::BfsDirection::Auto, ry::BfsDirection::TopDown,
+              ry::BfsDirection::BottomUp}) {
+          ASSERT_EQ(ry::parallelBfsLevels(g, transpose, root, direction),
+                    expected);
+        }
+        if (symmetric) {
+          ASSERT_EQ(ry::parallelBfsLevels(g, g, root), expected);
+        }
+      }
+    }
+    ASSERT_EQ(ry::parallelBfsLevels(g, 7), ry::reference::bfs_levels(g, 7));
+  }
+}
+
+TEST(GraphBfs, LevelsOfBfs) {
+  // bfs visits nodes in order of level
+  ry::AdjacencyListGraph list;
+  for (ry::nodeId_t node = 0; node < 6; ++node) {
+    list.add_node(node * 10);
+  }
+  list.add_edge(0, 10);
+  list.add_edge(0, 20);
+  list.add_edge(10, 30);
+  list.add_edge(20, 40);
+  list.add_edge(40, 30);
+  list.add_edge(30, 0);
+  ry::CsrGraph g(list);
+  auto levels = ry::parallelBfsLevels(g, 0);
+  ASSERT_EQ(levels, std::vector<std::size_t>(
+                        {0, 1, 1, 2, 2, ry::kUnreached}));
+  std::size_t previous = 0;
+  for (auto node : ry::bfs(g)) {
+    ASSERT_GE(levels[g.indexOf(node)], previous);
+    previous = levels[g.indexOf(node)];
+  }
+
+  ASSERT_THROW(ry::parallelBfsLevels(g, 5), ry::InvalidNodeIdError);
+  ASSERT_THROW(ry::parallelBfsLevels(g, ry::CsrGraph(), 0),
+               std::runtime_error);
+}
+
+TEST(GraphBfs, Transpose) {
+  std::vector<ry::Edge> edges{{1, 5}, {1, 9}, {5, 9}, {9, 1}, {9, 9}};
+  ry::CsrGraph g(edges);
+  auto t = g.transpose();
+  ASSERT_EQ(t.getNodes(), g.getNodes());
+  ASSERT_EQ(t.getNeighbors(9), std::vector<ry::nodeId_t>({1, 5, 9}));
+  ASSERT_EQ(t.getNeighbors(1), std::vector<ry::nodeId_t>({9}));
+  ASSERT_EQ(t.getNeighbors(5), std::vector<ry::nodeId_t>({1}));
+  ASSERT_TRUE(std::ranges::equal(t.transpose().targets(), g.targets()));
+}
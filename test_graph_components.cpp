@@ -0,0 +1,59 @@
+#include "graph_components.hpp"
+#include "graph_reference.hpp"
+#include "thread_pool.hpp"
+#include <gtest/gtest.h>
+
+TEST(GraphComponents, MatchesSerial) {
+  // Below and above the edge count where one component takes most nodes
+  for (auto [m, symmetric] : {std::pair{30000, false}, std::pair{30000, true},
+                              std::pair{150000, false},
+                              std::pair{150000, true}}) {
+    auto g = ry::reference::random_graph(50000, m, symmetric, 1);
+    auto transpose = g.transpose();
+    auto expected = ry::reference::components(g, transpose);
+    const auto count =
+        static_cast<std::size_t>(
+            *std::max_element(expected.begin(), expected.end())) +
+        1;
+    for (std::size_t threads : {1, 4}) {
+      ry::NumThreadsGuard guard(threads);
+      std::vector<ry::Components> results{
+          ry::connectedComponents(g, transpose), ry::connectedComponents(g),
+          ry::connectedComponents(static_cast<const ry::Graph &>(g))};
+      if (symmetric) {
+        results.push_back(ry::connectedComponents(g, g));
+      }
+      for (const auto &components : results) {
+        ASSERT_EQ(components.labels, expected);
+        ASSERT_EQ(components.count, count);
+      }
+    }
+  }
+}
+
+TEST(GraphComponents, AdjacencyList) {
+  ry::AdjacencyListGraph g;
+  for (ry::nodeId_t node : {50, 40, 30, 20, 10}) {
+    g.add_node(node);
+  }
+  g.add_edge(50, 30);
+  g.add_edge(10, 30);
+  g.add_edge(20, 40);
+  g.remove_node(40);
+
+  // Dense indices 0..4 are 50, 40 (removed), 30, 20, 10
+  auto components = ry::connectedComponents(g);
+  ASSERT_EQ(components.count, 2);
+  ASSERT_EQ(components.labels,
+            std::vector<ry::nodeIndex_t>({0, ry::kNoComponent, 0, 1, 0}));
+
+  ASSERT_EQ(ry::connectedComponents(ry::AdjacencyListGraph()).count, 0);
+  ASSERT_EQ(ry::connectedComponents(ry::CsrGraph()).count, 0);
+  ry::CsrGraph empty;
+  ASSERT_EQ(ry::connectedComponents(empty, empty).count, 0);
+}
+
+TEST(GraphComponents, Transpose) {
+  auto g = ry::reference::random_graph(100, 200, false, 2);
+  ASSERT_THROW(ry::connectedComponents(g, ry::CsrGraph()), std::runtime_error);
+}
@@ -0,0 +1,152 @@
+#include "graph_csr.hpp"
+#include "graph_reference.hpp"
+#include "thread_pool.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+// The graph from the AdjacencyList traversal tests
+ry::AdjacencyListGraph make_list_graph() {
+  ry::AdjacencyListGraph g;
+  for (ry::nodeId_t node = 0; node < 5; ++node) {
+    g.add_node(node);
+  }
+  g.add_edge(0, 1);
+  g.add_edge(0, 2);
+  g.add_edge(1, 3);
+  g.add_edge(2, 4);
+  g.add_edge(3, 4);
+  g.add_edge(4, 1);
+  return g;
+}
+} // namespace
+
+TEST(GraphCsr, FromGraph) {
+  auto list = make_list_graph();
+  ry::CsrGraph g(list);
+  ASSERT_EQ(g.numNodes(), 5);
+  ASSERT_EQ(g.numEdges(), 6);
+  ASSERT_EQ(g.getNodes(), list.getNodes());
+  ASSERT_EQ(g.firstNode(), list.firstNode());
+  for (auto node : list.getNodes()) {
+    ASSERT_EQ(g.getNeighbors(node), list.getNeighbors(node));
+  }
+  ASSERT_TRUE(g.isAdjacent(4, 1));
+  ASSERT_FALSE(g.isAdjacent(1, 4));
+  ASSERT_FALSE(g.isAdjacent(1, 99));
+  ASSERT_EQ(g.getNeighbors(99), std::vector<ry::nodeId_t>());
+
+  // Traversals only use the Graph interface
+  ASSERT_EQ(ry::bfs(g), ry::bfs(list));
+  ASSERT_EQ(ry::bfs2(g), ry::bfs2(list));
+  ASSERT_EQ(ry::dfsPreorder(g), ry::dfsPreorder(list));
+  ASSERT_EQ(ry::dfsPreorder2(g), ry::dfsPreorder2(list));
+  ASSERT_EQ(ry::dfsPostorderRecursive(g), ry::dfsPostorderRecursive(list));
+  ASSERT_EQ(ry::dfsPostorderIterative(g), ry::dfsPostorderIterative(list));
+  ASSERT_EQ(ry::dfsPostorderIterative2(g), ry::dfsPostorderIterative2(list));
+  ASSERT_EQ(ry::detectCyclesDfs(g), ry::detectCyclesDfs(list));
+
+  ASSERT_THROW(g.add_node(7), std::logic_error);
+  ASSERT_THROW(g.add_edge(0, 4), std::logic_error);
+  ASSERT_THROW(g.remove_node(0), std::logic_error);
+  ASSERT_EQ(ry::CsrGraph(ry::AdjacencyListGraph()).numNodes(), 0);
+}
+
+TEST(GraphCsr, FromEdges) {
+  // Sparse ids, a repeated edge, a self loop and an isolated node
+  std::vector<ry::Edge> edges{
+      {1000, 7}, {7, 1000000}, {1000, 3}, {1000, 7}, {3, 3}};
+  std::vector<ry::nodeId_t> extra{42, 7};
+  ry::CsrGraph g(edges, extra);
+  ASSERT_EQ(g.getNodes(),
+            std::vector<ry::nodeId_t>({3, 7, 42, 1000, 1000000}));
+  ASSERT_EQ(g.numEdges(), 4);
+  ASSERT_EQ(g.getNeighbors(1000), std::vector<ry::nodeId_t>({3, 7}));
+  ASSERT_EQ(g.getNeighbors(42), std::vector<ry::nodeId_t>());
+  ASSERT_TRUE(g.isAdjacent(3, 3));
+
+  // Dense indices follow id order
+  ASSERT_EQ(g.indexOf(1000), 3);
+  ASSERT_EQ(g.nodeId(1), 7);
+  ASSERT_EQ(std::vector<ry::nodeIndex_t>(g.neighbors(3).begin(),
+                                         g.neighbors(3).end()),
+            std::vector<ry::nodeIndex_t>({0, 1}));
+  ASSERT_EQ(g.degree(1), 1);
+  ASSERT_FALSE(g.contains(8));
+  ASSERT_THROW(g.indexOf(8), ry::InvalidNodeIdError);
+}
+
+TEST(GraphCsr, Weighted) {
+  // Out of order, with a repeated edge whose lighter weight is kept
+  std::vector<ry::WeightedEdge> edges{
+      {10, 30, 2.5f}, {10, 20, 1}, {20, 30, 4}, {10, 30, 0.5f}, {10, 30, 3}};
+  ry::CsrGraph g(edges);
+  ASSERT_TRUE(g.weighted());
+  ASSERT_EQ(g.numEdges(), 3);
+  ASSERT_EQ(g.getNeighbors(10), std::vector<ry::nodeId_t>({20, 30}));
+  ASSERT_EQ(std::vector<ry::weight_t>(g.weights(0).begin(),
+                                      g.weights(0).end()),
+            std::vector<ry::weight_t>({1, 0.5f}));
+  ASSERT_EQ(g.weights(2).size(), 0);
+
+  // Weights follow their edges
+  auto transpose = g.transpose();
+  ASSERT_TRUE(transpose.weighted());
+  ASSERT_EQ(std::vector<ry::weight_t>(transpose.weights(2).begin(),
+                                      transpose.weights(2).end()),
+            std::vector<ry::weight_t>({0.5f, 4}));
+
+  ASSERT_FALSE(ry::CsrGraph(std::vector<ry::Edge>{{1, 2}}).weighted());
+  std::vector<ry::WeightedEdge> negative{{1, 2, -1}};
+  ASSERT_THROW(ry::CsrGraph{negative}, std::runtime_error);
+}
+
+TEST(GraphCsr, ForEachNeighbor) {
+  // More neighbors than one translation batch holds
+  std::vector<ry::Edge> edges;
+  for (ry::nodeId_t dest = 1; dest <= 150; ++dest) {
+    edges.emplace_back(0, dest * 10);
+  }
+  ry::CsrGraph g(edges);
+  std::vector<ry::nodeId_t> seen;
+  g.forEachNeighbor(0,
+                    [&](ry::nodeId_t neighbor) { seen.push_back(neighbor); });
+  ASSERT_EQ(seen, g.getNeighbors(0));
+  ASSERT_EQ(seen.size(), 150);
+  ASSERT_EQ(seen.back(), 1500);
+  g.forEachNeighbor(7, [](ry::nodeId_t) { FAIL(); });
+
+  // Dense indices come with the ids
+  g.forEachNeighborWithIndex(0, [&](ry::nodeId_t neighbor, std::size_t index) {
+    ASSERT_EQ(index, g.denseIndex(neighbor));
+    ASSERT_EQ(g.nodeId(static_cast<ry::nodeIndex_t>(index)), neighbor);
+  });
+  ASSERT_EQ(g.denseIndexBound(), 151);
+}
+
+TEST(GraphCsr, MatchesAdjacencyList) {
+  // Enough edges to build in parallel chunks, with both dense and sparse ids
+  for (ry::nodeId_t n : {ry::nodeId_t{5000}, ry::nodeId_t{1} << 40}) {
+    auto edges = ry::reference::random_edges(n, 100000, 1);
+    ry::NumThreadsGuard guard(1);
+    ry::CsrGraph serial(edges);
+    ry::set_num_threads(4);
+    ry::CsrGraph parallel(edges);
+    ASSERT_EQ(parallel.getNodes(), serial.getNodes());
+    ASSERT_TRUE(std::ranges::equal(parallel.offsets(), serial.offsets()));
+    ASSERT_TRUE(std::ranges::equal(parallel.targets(), serial.targets()));
+
+    ry::AdjacencyListGraph list;
+    for (auto [src, dest] : edges) {
+      list.add_node(src);
+      list.add_node(dest);
+      list.add_edge(src, dest);
+    }
+    ASSERT_EQ(serial.getNodes(), list.getNodes());
+    for (auto node : list.getNodes()) {
+      ASSERT_EQ(serial.getNeighbors(node), list.getNeighbors(node));
+    }
+    ry::CsrGraph copy(list);
+    ASSERT_TRUE(std::ranges::equal(copy.targets(), serial.targets()));
+    ASSERT_EQ(ry::bfs(serial), ry::bfs(list));
+  }
+}
@@ -0,0 +1,118 @@
+#include "graph_dag.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <unordered_map>
+
+namespace {
+// Whether every edge of g goes forward in order
+bool is_topological(const ry::Graph &g,
+                    const std::vector<ry::nodeId_t> &order) {
+  std::unordered_map<ry::nodeId_t, std::size_t> position;
+  for (std::size_t k = 0; k < order.size(); ++k) {
+    position[order[k]] = k;
+  }
+  if (position.size() != g.getNodes().size()) {
+    return false;
+  }
+  for (auto node : g.getNodes()) {
+    for (auto neighbor : g.getNeighbors(node)) {
+      if (position.at(node) >= position.at(neighbor)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+} // namespace
+
+TEST(GraphDag, RejectsCycle) {
+  ry::DagGraph g;
+  for (ry::nodeId_t node = 1; node <= 4; ++node) {
+    g.add_node(node);
+  }
+  g.add_edge(1, 2);
+  g.add_edge(2, 3);
+  g.add_edge(3, 4);
+  g.add_edge(1, 2);
+  EXPECT_EQ(g.topologicalOrder(), std::vector<ry::nodeId_t>({1, 2, 3, 4}));
+
+  try {
+    g.add_edge(4, 2);
+    FAIL() << "Expected CycleError";
+  } catch (const ry::CycleError &e) {
+    EXPECT_EQ(e.cycle(), std::vector<ry::nodeId_t>({2, 3, 4}));
+  }
+  EXPECT_FALSE(g.isAdjacent(4, 2));
+  EXPECT_FALSE(g.try_add_edge(3, 3));
+  EXPECT_FALSE(g.try_add_edge(4, 1));
+  EXPECT_EQ(g.topologicalOrder(), std::vector<ry::nodeId_t>({1, 2, 3, 4}));
+  EXPECT_THROW(g.add_edge(1, 5), ry::InvalidNodeIdError);
+
+  // Edges against the order move the nodes between their ends
+  g.add_node(5);
+  g.add_edge(5, 1);
+  EXPECT_EQ(g.topologicalOrder(), std::vector<ry::nodeId_t>({5, 1, 2, 3, 4}));
+  g.add_node(6);
+  g.add_node(7);
+  g.add_edge(4, 6);
+  g.add_edge(7, 3);
+  EXPECT_EQ(g.topologicalOrder(),
+            std::vector<ry::nodeId_t>({5, 1, 2, 7, 3, 4, 6}));
+  EXPECT_TRUE(is_topological(g, g.topologicalOrder()));
+  EXPECT_FALSE(g.try_add_edge(6, 7));
+}
+
+TEST(GraphDag, RemoveNode) {
+  ry::DagGraph g;
+  for (ry::nodeId_t node = 1; node <= 3; ++node) {
+    g.add_node(node);
+  }
+  g.add_edge(1, 2);
+  g.add_edge(2, 3);
+  EXPECT_FALSE(g.try_add_edge(3, 1));
+  g.remove_node(2);
+  g.remove_node(2);
+  // Node 4 takes the index of 2, with none of its edges
+  g.add_node(4);
+  EXPECT_TRUE(g.getNeighbors(4).empty());
+  g.add_edge(3, 1);
+  g.add_edge(1, 4);
+  EXPECT_EQ(g.topologicalOrder(), std::vector<ry::nodeId_t>({3, 1, 4}));
+  EXPECT_FALSE(g.try_add_edge(4, 3));
+}
+
+TEST(GraphDag, RandomInsertions) {
+  constexpr std::size_t n = 200;
+  std::mt19937_64 gen(24);
+  std::uniform_int_distribution<ry::nodeId_t> id(0, n - 1);
+  ry::DagGraph g;
+  ry::AdjacencyListGraph reference;
+  for (ry::nodeId_t node = 0; node < n; ++node) {
+    g.add_node(node);
+    reference.add_node(node);
+  }
+  std::size_t rejected = 0;
+  for (int k = 0; k < 2000; ++k) {
+    const auto src = id(gen), dest = id(gen);
+    auto trial = reference;
+    trial.add_edge(src, dest);
+    const bool cyclic = std::get<0>(ry::detectCyclesDfs(trial));
+    try {
+      g.add_edge(src, dest);
+      ASSERT_FALSE(cyclic);
+      reference = trial;
+    } catch (const ry::CycleError &e) {
+      ASSERT_TRUE(cyclic);
+      ++rejected;
+      // The cycle runs from dest along existing edges back to src
+      const auto &cycle = e.cycle();
+      ASSERT_EQ(cycle.front(), dest);
+      ASSERT_EQ(cycle.back(), src);
+      for (std::size_t i = 0; i + 1 < cycle.size(); ++i) {
+        ASSERT_TRUE(g.isAdjacent(cycle[i], cycle[i + 1]));
+      }
+    }
+  }
+  EXPECT_GT(rejected, 0u);
+  EXPECT_TRUE(is_topological(g, g.topologicalOrder()));
+}
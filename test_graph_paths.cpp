@@ -0,0 +1,99 @@
+#include "graph_paths.hpp"
+#include "graph_reference.hpp"
+#include "thread_pool.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+// Distances by Bellman-Ford, relaxing every edge until nothing changes
+std::vector<double> reference_distances(const ry::CsrGraph &g,
+                                        ry::nodeId_t source) {
+  std::vector<double> res(g.numNodes(), ry::kNoPath);
+  res[g.indexOf(source)] = 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (ry::nodeIndex_t u = 0; u < g.numNodes(); ++u) {
+      auto targets = g.neighbors(u);
+      auto weights = g.weights(u);
+      for (std::size_t k = 0; k < targets.size(); ++k) {
+        const double weight = weights.empty() ? 1 : weights[k];
+        if (res[u] + weight < res[targets[k]]) {
+          res[targets[k]] = res[u] + weight;
+          changed = true;
+        }
+      }
+    }
+  }
+  return res;
+}
+} // namespace
+
+TEST(GraphPaths, SmallGraph) {
+  // The direct edge 1 -> 4 is heavier than the path through 2 and 3, and
+  // the repeated edge 2 -> 3 keeps its lighter weight
+  std::vector<ry::WeightedEdge> edges{
+      {1, 4, 10}, {1, 2, 1}, {2, 3, 5}, {2, 3, 2}, {3, 4, 3}, {4, 5, 0}};
+  std::vector<ry::nodeId_t> isolated{9};
+  ry::CsrGraph g(edges, isolated);
+  const std::vector<double> expected{0, 1, 3, 6, 6, ry::kNoPath};
+  ASSERT_EQ(ry::dijkstra(g, 1), expected);
+  ASSERT_EQ(ry::deltaStepping(g, 1), expected);
+  ASSERT_EQ(ry::deltaStepping(g, 1, 0.5), expected);
+  ASSERT_EQ(ry::deltaStepping(g, 1, 100), expected);
+
+  ry::ShortestPathQuery query(g);
+  ASSERT_EQ(query.distance(1, 4), 6);
+  ASSERT_EQ(query.path(1, 5), std::vector<ry::nodeId_t>({1, 2, 3, 4, 5}));
+  ASSERT_EQ(query.path(3, 3), std::vector<ry::nodeId_t>({3}));
+  ASSERT_EQ(query.distance(4, 1), ry::kNoPath);
+  ASSERT_EQ(query.path(1, 9), std::vector<ry::nodeId_t>());
+  ASSERT_EQ(query.distance(2, 5), 5);
+  ASSERT_THROW(query.distance(1, 7), ry::InvalidNodeIdError);
+  ASSERT_THROW(ry::dijkstra(g, 7), ry::InvalidNodeIdError);
+  ASSERT_THROW(ry::deltaStepping(g, 1, -1), std::runtime_error);
+}
+
+TEST(GraphPaths, MatchesBellmanFord) {
+  auto g = ry::reference::random_weighted_graph(5000, 25000, 1);
+  ry::ShortestPathQuery query(g);
+  for (ry::nodeId_t source : {0, 17, 4999}) {
+    auto expected = reference_distances(g, source);
+    ASSERT_EQ(ry::dijkstra(g, source), expected);
+    for (std::size_t threads : {1, 4}) {
+      ry::NumThreadsGuard guard(threads);
+      for (double delta : {0.0, 1.0, 7.5, 1000.0}) {
+        ASSERT_EQ(ry::deltaStepping(g, source, delta), expected);
+      }
+    }
+    // Queries reuse their state
+    for (ry::nodeId_t target : {1, 2500, 4998}) {
+      ASSERT_EQ(query.distance(source, target),
+                expected[g.indexOf(target)]);
+      auto path = query.path(source, target);
+      if (expected[g.indexOf(target)] == ry::kNoPath) {
+        ASSERT_TRUE(path.empty());
+        continue;
+      }
+      double length = 0;
+      for (std::size_t k = 1; k < path.size(); ++k) {
+        auto from = g.indexOf(path[k - 1]);
+        auto neighbors = g.neighbors(from);
+        auto it = std::lower_bound(neighbors.begin(), neighbors.end(),
+                                   g.indexOf(path[k]));
+        ASSERT_TRUE(it != neighbors.end() && *it == g.indexOf(path[k]));
+        length += g.weights(from)[static_cast<std::size_t>(
+            it - neighbors.begin())];
+      }
+      ASSERT_EQ(length, expected[g.indexOf(target)]);
+    }
+  }
+}
+
+TEST(GraphPaths, Unweighted) {
+  // Edges of unweighted graphs weigh 1, so distances are BFS levels
+  std::vector<ry::Edge> edges{{0, 1}, {1, 2}, {0, 2}, {2, 3}};
+  ry::CsrGraph g(edges);
+  ASSERT_FALSE(g.weighted());
+  const std::vector<double> expected{0, 1, 1, 2};
+  ASSERT_EQ(ry::dijkstra(g, 0), expected);
+  ASSERT_EQ(ry::deltaStepping(g, 0), expected);
+}
@@ -0,0 +1,139 @@
+#include "graph_reference.hpp"
+#include "graph_scc.hpp"
+#include "thread_pool.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+// Whether each index reaches every other, by a BFS from each
+std::vector<std::vector<char>> reachability(const ry::CsrGraph &g) {
+  std::vector<std::vector<char>> res(g.numNodes(),
+                                     std::vector<char>(g.numNodes(), 0));
+  for (ry::nodeIndex_t root = 0; root < g.numNodes(); ++root) {
+    std::vector<ry::nodeIndex_t> work{root};
+    res[root][root] = 1;
+    for (std::size_t head = 0; head < work.size(); ++head) {
+      for (auto v : g.neighbors(work[head])) {
+        if (!res[root][v]) {
+          res[root][v] = 1;
+          work.push_back(v);
+        }
+      }
+    }
+  }
+  return res;
+}
+
+// A path 0 -> 1 -> ... -> n - 1
+std::vector<ry::Edge> path_edges(std::size_t n) {
+  std::vector<ry::Edge> res;
+  for (ry::nodeId_t node = 0; node + 1 < n; ++node) {
+    res.emplace_back(node, node + 1);
+  }
+  return res;
+}
+} // namespace
+
+TEST(GraphScc, SmallGraph) {
+  // Cycles {1, 2, 3} and {4, 5}, joined by 3 -> 4, and 6 on its own
+  std::vector<ry::Edge> edges{{1, 2}, {2, 3}, {3, 1}, {3, 4},
+                              {4, 5}, {5, 4}, {6, 6}};
+  ry::CsrGraph g(edges);
+  auto components = ry::stronglyConnectedComponents(g);
+  ASSERT_EQ(components.count, 3);
+  // Sinks complete first
+  ASSERT_EQ(components.labels,
+            std::vector<ry::nodeIndex_t>({1, 1, 1, 0, 0, 2}));
+}
+
+TEST(GraphScc, MatchesReachability) {
+  auto edges = ry::reference::random_edges(300, 450, 1);
+  std::vector<ry::nodeId_t> isolated{310};
+  ry::CsrGraph g(edges, isolated);
+  auto reaches = reachability(g);
+  auto components = ry::stronglyConnectedComponents(g);
+  for (ry::nodeIndex_t u = 0; u < g.numNodes(); ++u) {
+    for (ry::nodeIndex_t v = 0; v < g.numNodes(); ++v) {
+      ASSERT_EQ(components.labels[u] == components.labels[v],
+                reaches[u][v] && reaches[v][u]);
+    }
+    for (auto v : g.neighbors(u)) {
+      ASSERT_GE(components.labels[u], components.labels[v]);
+    }
+  }
+}
+
+TEST(GraphScc, Deep) {
+  // Far deeper than a recursive DFS could go
+  const std::size_t n = 1000000;
+  auto edges = path_edges(n);
+  auto chain = ry::stronglyConnectedComponents(ry::CsrGraph(edges));
+  ASSERT_EQ(chain.count, n);
+  ASSERT_EQ(chain.labels.front(), n - 1);
+  edges.emplace_back(n - 1, 0);
+  auto cycle = ry::stronglyConnectedComponents(ry::CsrGraph(edges));
+  ASSERT_EQ(cycle.count, 1);
+
+  edges.pop_back();
+  auto levels = ry::topologicalLevels(ry::CsrGraph(edges));
+  ASSERT_EQ(levels.numLevels(), n);
+  ASSERT_EQ(levels.level(n - 1)[0], n - 1);
+}
+
+TEST(GraphScc, AdjacencyList) {
+  ry::AdjacencyListGraph g;
+  for (ry::nodeId_t node : {30, 20, 10, 40}) {
+    g.add_node(node);
+  }
+  g.add_edge(10, 20);
+  g.add_edge(20, 10);
+  g.add_edge(20, 30);
+  g.remove_node(40);
+  g.add_node(50);
+  g.add_edge(50, 50);
+
+  // Dense indices 0..3 are 30, 20, 10, 50
+  auto components = ry::stronglyConnectedComponents(g);
+  ASSERT_EQ(components.count, 3);
+  ASSERT_EQ(components.labels, std::vector<ry::nodeIndex_t>({0, 1, 1, 2}));
+}
+
+TEST(GraphScc, TopologicalLevels) {
+  // Diamond 0 -> {1, 2} -> 3 with a shortcut 0 -> 3, and 4 on its own
+  std::vector<ry::Edge> edges{{0, 1}, {0, 2}, {1, 3}, {2, 3}, {0, 3}};
+  std::vector<ry::nodeId_t> isolated{4};
+  ry::CsrGraph g(edges, isolated);
+  auto levels = ry::topologicalLevels(g);
+  ASSERT_EQ(levels.order, std::vector<ry::nodeIndex_t>({0, 4, 1, 2, 3}));
+  ASSERT_EQ(levels.offsets, std::vector<std::size_t>({0, 2, 4, 5}));
+  ASSERT_EQ(levels.level(1).size(), 2);
+
+  edges.emplace_back(3, 1);
+  ASSERT_THROW(ry::topologicalLevels(ry::CsrGraph(edges)), std::runtime_error);
+  ASSERT_EQ(ry::topologicalLevels(ry::CsrGraph()).numLevels(), 0);
+}
+
+TEST(GraphScc, TopologicalLevelsParallel) {
+  ry::CsrGraph g(ry::reference::random_edges(50000, 200000, 2, true));
+  auto transpose = g.transpose();
+  ry::NumThreadsGuard guard(1);
+  auto serial = ry::topologicalLevels(g);
+  ry::set_num_threads(4);
+  auto parallel = ry::topologicalLevels(g);
+  ASSERT_EQ(parallel.order, serial.order);
+  ASSERT_EQ(parallel.offsets, serial.offsets);
+
+  // Each node is one level after its latest predecessor
+  std::vector<std::size_t> levelOf(g.numNodes());
+  for (std::size_t k = 0; k < serial.numLevels(); ++k) {
+    for (auto u : serial.level(k)) {
+      levelOf[u] = k;
+    }
+  }
+  for (ry::nodeIndex_t v = 0; v < g.numNodes(); ++v) {
+    std::size_t expected = 0;
+    for (auto u : transpose.neighbors(v)) {
+      expected = std::max(expected, levelOf[u] + 1);
+    }
+    ASSERT_EQ(levelOf[v], expected);
+  }
+}
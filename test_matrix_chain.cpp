@@ -0,0 +1,77 @@
+#include "matrix_chain.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+Matrix<double> make_matrix(std::size_t nrows, std::size_t ncols, int seed) {
+  Matrix<double> res(nrows, ncols, uninitialized);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = static_cast<double>((k * 3 + seed) % 7) - 3;
+  }
+  return res;
+}
+} // namespace
+
+// Same problems as LeetCode.MatrixChainMultiplication
+TEST(MatrixChain, Order) {
+  auto order = matrix_chain_order({10, 100, 5, 50});
+  EXPECT_EQ(order.cost, 7500);
+  EXPECT_EQ(chain_order_to_string(order), "((A0A1)A2)");
+
+  order = matrix_chain_order({30, 35, 15, 5, 10, 20, 25});
+  EXPECT_EQ(order.cost, 15125);
+  EXPECT_EQ(chain_order_to_string(order), "((A0(A1A2))((A3A4)A5))");
+
+  // A model can overrule the multiply count
+  ChainCostModel wideIsCheap;
+  wideIsCheap.cost = [](std::size_t, std::size_t, std::size_t n) {
+    return n == 50 ? 1.0 : 1000.0;
+  };
+  order = matrix_chain_order({10, 100, 5, 50}, wideIsCheap);
+  EXPECT_EQ(order.cost, 2);
+  EXPECT_EQ(chain_order_to_string(order), "(A0(A1A2))");
+}
+
+TEST(MatrixChain, Multiply) {
+  // Tall/skinny operands where the order matters a lot
+  std::vector<std::size_t> dims{40, 3, 35, 2, 30, 4, 25};
+  std::vector<Matrix<double>> mats;
+  for (std::size_t i = 0; i + 1 < dims.size(); ++i) {
+    mats.push_back(make_matrix(dims[i], dims[i + 1], static_cast<int>(i)));
+  }
+
+  // Left to right reference
+  auto expected = mats[0].to_vector();
+  for (std::size_t i = 1; i < mats.size(); ++i) {
+    expected = matrix_multiply_naive(expected, dims[0], dims[i],
+                                     mats[i].to_vector(), dims[i], dims[i + 1]);
+  }
+
+  MatrixBufferPool<double> pool;
+  auto res = multiply_chain(std::span<const Matrix<double>>(mats), {}, &pool);
+  ASSERT_EQ(res.nrows(), 40);
+  ASSERT_EQ(res.ncols(), 25);
+  ASSERT_EQ(res.to_vector(), expected);
+
+  // A second chain reuses the pool's buffers
+  auto allocations = pool.allocations();
+  res = multiply_chain(std::span<const Matrix<double>>(mats), {}, &pool);
+  ASSERT_EQ(pool.allocations(), allocations);
+  ASSERT_EQ(res.to_vector(), expected);
+
+  // Calibrated models must still give the same product
+  auto model = calibrate_chain_cost_model<double>({4, 16});
+  res = multiply_chain(std::span<const Matrix<double>>(mats), model);
+  ASSERT_EQ(res.to_vector(), expected);
+}
+
+TEST(MatrixChain, Errors) {
+  std::vector<Matrix<double>> mats;
+  ASSERT_THROW(multiply_chain(std::span<const Matrix<double>>(mats)),
+               std::runtime_error);
+  mats.push_back(make_matrix(3, 4, 0));
+  ASSERT_EQ(multiply_chain(std::span<const Matrix<double>>(mats)).to_vector(),
+            mats[0].to_vector());
+  mats.push_back(make_matrix(5, 2, 0));
+  ASSERT_THROW(multiply_chain(std::span<const Matrix<double>>(mats)),
+               std::runtime_error);
+}
@@ -0,0 +1,99 @@
+#include "matrix_expr.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+Matrix<double> make_matrix(std::size_t nrows, std::size_t ncols, int seed) {
+  Matrix<double> res(nrows, ncols, uninitialized);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = static_cast<double>((k * 5 + seed) % 13) - 6;
+  }
+  return res;
+}
+
+// Reference for D = alpha * A * B + C - E computed with explicit temporaries
+std::vector<double> reference(double alpha, const Matrix<double> &a,
+                              const Matrix<double> &b, const Matrix<double> &c,
+                              const Matrix<double> &e) {
+  auto ab = matrix_multiply_naive(a.to_vector(), a.nrows(), a.ncols(),
+                                  b.to_vector(), b.nrows(), b.ncols());
+  auto cv = c.to_vector();
+  auto ev = e.to_vector();
+  for (std::size_t k = 0; k < ab.size(); ++k) {
+    ab[k] = alpha * ab[k] + cv[k] - ev[k];
+  }
+  return ab;
+}
+} // namespace
+
+TEST(MatrixExpr, FusedSumAndProduct) {
+  auto a = make_matrix(9, 7, 1);
+  auto b = make_matrix(7, 5, 2);
+  auto c = make_matrix(9, 5, 3);
+  auto e = make_matrix(9, 5, 4);
+
+  auto d = evaluate(2 * a * b + c - e);
+  ASSERT_EQ(d.to_vector(), reference(2, a, b, c, e));
+
+  // Scalars on either side of the product fold into alpha
+  auto d2 = evaluate(c + a * (b * 3.0) - e);
+  ASSERT_EQ(d2.to_vector(), reference(3, a, b, c, e));
+}
+
+TEST(MatrixExpr, AccumulateInPlace) {
+  auto a = make_matrix(6, 4, 5);
+  auto b = make_matrix(4, 8, 6);
+  auto c = make_matrix(6, 8, 7);
+  auto expected = reference(0.5, a, b, c, Matrix<double>(6, 8));
+
+  c += 0.5 * a * b;
+  ASSERT_EQ(c.to_vector(), expected);
+
+  // Writes into a view of a larger matrix
+  Matrix<double> big(10, 10);
+  assign(big.view().submatrix(2, 1, 6, 8), a * b);
+  ASSERT_EQ(big(1, 1), 0);
+  // c0 + 0.5 * a * b - a * b + 0.5 * a * b == c0
+  c -= big.view().submatrix(2, 1, 6, 8);
+  c += 0.5 * a * b;
+  ASSERT_EQ(c.to_vector(), make_matrix(6, 8, 7).to_vector());
+}
+
+TEST(MatrixExpr, Aliasing) {
+  auto a = make_matrix(5, 5, 8);
+  auto b = make_matrix(5, 5, 9);
+  auto expected =
+      matrix_multiply_naive(a.to_vector(), 5, 5, b.to_vector(), 5, 5);
+
+  // The product reads a while writing it
+  assign(a, a * b);
+  ASSERT_EQ(a.to_vector(), expected);
+
+  // Element-wise alias with a different layout
+  Matrix<double> t(a);
+  assign(t, a.view().transpose() + a);
+  for (std::size_t j = 0; j < 5; ++j) {
+    for (std::size_t i = 0; i < 5; ++i) {
+      ASSERT_EQ(t(i, j), a(j, i) + a(i, j));
+    }
+  }
+}
+
+TEST(MatrixExpr, NestedProductsAndErrors) {
+  auto a = make_matrix(4, 3, 10);
+  auto b = make_matrix(3, 4, 11);
+  auto c = make_matrix(4, 4, 12);
+  // (a * b) has to be materialized before multiplying by c
+  auto d = evaluate((a * b) * c - c);
+  auto ab = matrix_multiply_naive(a.to_vector(), 4, 3, b.to_vector(), 3, 4);
+  auto expected = matrix_multiply_naive(ab, 4, 4, c.to_vector(), 4, 4);
+  auto cv = c.to_vector();
+  for (std::size_t k = 0; k < expected.size(); ++k) {
+    expected[k] -= cv[k];
+  }
+  ASSERT_EQ(d.to_vector(), expected);
+
+  ASSERT_THROW(a + b, std::runtime_error);
+  ASSERT_THROW(a * c, std::runtime_error);
+  Matrix<double> wrong(3, 3);
+  ASSERT_THROW(assign(wrong, a * b), std::runtime_error);
+}
@@ -0,0 +1,217 @@
+#include "matrix_factor.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+Matrix<double> make_matrix(std::size_t nrows, std::size_t ncols, int seed) {
+  Matrix<double> res(nrows, ncols, uninitialized);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = std::sin(static_cast<double>(k * 7 + seed * 13));
+  }
+  return res;
+}
+
+// b * b^T + n * I
+Matrix<double> make_spd(std::size_t n, int seed) {
+  auto b = make_matrix(n, n, seed);
+  auto res = matrix_multiply(b, b.view().transpose());
+  for (std::size_t k = 0; k < n; ++k) {
+    res(k, k) += static_cast<double>(n);
+  }
+  return res;
+}
+
+void expect_near(MatrixView<const double> actual,
+                 MatrixView<const double> expected, double tol) {
+  ASSERT_EQ(actual.nrows(), expected.nrows());
+  ASSERT_EQ(actual.ncols(), expected.ncols());
+  for (std::size_t col = 0; col < actual.ncols(); ++col) {
+    for (std::size_t row = 0; row < actual.nrows(); ++row) {
+      ASSERT_NEAR(actual(row, col), expected(row, col), tol)
+          << "(" << row << ", " << col << ")";
+    }
+  }
+}
+
+// P * L * U from an LU factorization of an m x n matrix
+Matrix<double> lu_product(const LuFactorization<double> &f) {
+  const std::size_t m = f.lu.nrows(), n = f.lu.ncols(), mn = std::min(m, n);
+  Matrix<double> l(m, mn), u(mn, n);
+  for (std::size_t col = 0; col < mn; ++col) {
+    l(col, col) = 1;
+    for (std::size_t row = col + 1; row < m; ++row) {
+      l(row, col) = f.lu(row, col);
+    }
+  }
+  for (std::size_t col = 0; col < n; ++col) {
+    for (std::size_t row = 0; row <= std::min(col, mn - 1); ++row) {
+      u(row, col) = f.lu(row, col);
+    }
+  }
+  auto res = matrix_multiply(l, u);
+  for (std::size_t i = mn; i-- > 0;) {
+    for (std::size_t col = 0; col < n; ++col) {
+      std::swap(res(i, col), res(f.pivots[i], col));
+    }
+  }
+  return res;
+}
+} // namespace
+
+TEST(MatrixFactor, TriangularSolve) {
+  // Large enough to recurse and to split b across threads
+  const std::size_t n = 150, nrhs = 300;
+  // Small off-diagonal entries keep unit triangles well conditioned too
+  auto a = make_matrix(n, n, 1);
+  for (std::size_t k = 0; k < a.numel(); ++k) {
+    a.data()[k] /= static_cast<double>(n);
+  }
+  for (std::size_t k = 0; k < n; ++k) {
+    a(k, k) += 2;
+  }
+  for (std::size_t threads : {1, 4}) {
+    ry::NumThreadsGuard guard(threads);
+    for (auto side : {SolveSide::Left, SolveSide::Right}) {
+      for (auto uplo : {Triangle::Lower, Triangle::Upper}) {
+        for (auto op : {MatrixOp::None, MatrixOp::Transpose}) {
+          for (auto diag : {Diagonal::NonUnit, Diagonal::Unit}) {
+            // The triangle the solve should see
+            Matrix<double> tri(n, n);
+            for (std::size_t col = 0; col < n; ++col) {
+              for (std::size_t row = 0; row < n; ++row) {
+                const bool inside =
+                    uplo == Triangle::Lower ? row >= col : row <= col;
+                if (row == col && diag == Diagonal::Unit) {
+                  tri(row, col) = 1;
+                } else if (inside) {
+                  tri(row, col) = a(row, col);
+                }
+              }
+            }
+            const bool left = side == SolveSide::Left;
+            auto b = left ? make_matrix(n, nrhs, 2) : make_matrix(nrhs, n, 2);
+            auto x = b;
+            triangular_solve(side, uplo, op, diag, 2.0, a, x.view());
+            auto product = left ? matrix_multiply(tri, op, x, MatrixOp::None)
+                                : matrix_multiply(x, MatrixOp::None, tri, op);
+            for (std::size_t k = 0; k < b.numel(); ++k) {
+              b.data()[k] *= 2;
+            }
+            expect_near(product, b, 1e-10);
+          }
+        }
+      }
+    }
+  }
+
+  Matrix<double> b(n + 1, 3);
+  ASSERT_THROW(triangular_solve(SolveSide::Left, Triangle::Lower,
+                                MatrixOp::None, Diagonal::NonUnit, 1.0, a,
+                                b.view()),
+               std::runtime_error);
+}
+
+TEST(MatrixFactor, Lu) {
+  struct Shape {
+    std::size_t m, n, block;
+  };
+  // One column, unblocked, several panels with partial last ones, and wide
+  // and tall rectangles
+  for (auto [m, n, block] :
+       {Shape{1, 1, 16}, Shape{9, 9, 64}, Shape{150, 150, 16},
+        Shape{150, 150, kFactorBlock}, Shape{90, 40, 16}, Shape{40, 90, 16}}) {
+    auto a = make_matrix(m, n, 3);
+    for (std::size_t threads : {1, 4}) {
+      ry::NumThreadsGuard guard(threads);
+      auto f = lu_factor(a, block);
+      ASSERT_EQ(f.pivots.size(), std::min(m, n));
+      expect_near(lu_product(f), a, 1e-12);
+      // Partial pivoting keeps every entry of L at most 1
+      for (std::size_t col = 0; col < std::min(m, n); ++col) {
+        for (std::size_t row = col + 1; row < m; ++row) {
+          ASSERT_LE(std::abs(f.lu(row, col)), 1.0);
+        }
+      }
+    }
+  }
+
+  // Strided views factor in place
+  auto big = make_matrix(60, 60, 4);
+  auto expected = lu_factor(big.view().submatrix(5, 5, 40, 40).transpose(), 8);
+  auto pivots =
+      lu_factor_in_place(big.view().submatrix(5, 5, 40, 40).transpose(), 8);
+  ASSERT_EQ(pivots, expected.pivots);
+  expect_near(big.view().submatrix(5, 5, 40, 40).transpose(), expected.lu,
+              0);
+}
+
+TEST(MatrixFactor, LuSolve) {
+  auto a = make_matrix(70, 70, 5);
+  auto b = make_matrix(70, 3, 6);
+  auto x = lu_solve(lu_factor(a, 16), b);
+  expect_near(matrix_multiply(a, x), b, 1e-10);
+
+  // Rank 1: the factorization succeeds but the solve can't
+  Matrix<double> singular(4, 4, std::vector<double>(16, 1.0));
+  auto f = lu_factor(singular);
+  ASSERT_EQ(f.lu(3, 3), 0);
+  ASSERT_THROW(lu_solve(f, b.view().rows(0, 4)), std::runtime_error);
+  ASSERT_THROW(lu_solve(lu_factor(make_matrix(4, 5, 1)), b.view().rows(0, 4)),
+               std::runtime_error);
+}
+
+TEST(MatrixFactor, Cholesky) {
+  for (std::size_t n : {1, 10, 150}) {
+    auto a = make_spd(n, 7);
+    for (std::size_t threads : {1, 4}) {
+      ry::NumThreadsGuard guard(threads);
+      for (std::size_t block : {std::size_t{16}, kFactorBlock}) {
+        auto l = cholesky_factor(a, block);
+        expect_near(matrix_multiply(l, l.view().transpose()), a,
+                    1e-12 * static_cast<double>(n));
+        for (std::size_t col = 1; col < n; ++col) {
+          ASSERT_EQ(l(0, col), 0);
+        }
+      }
+    }
+  }
+
+  // Only the lower triangle is read or written
+  auto a = make_spd(40, 8);
+  auto marked = a;
+  for (std::size_t col = 1; col < 40; ++col) {
+    for (std::size_t row = 0; row < col; ++row) {
+      marked(row, col) = -1;
+    }
+  }
+  cholesky_factor_in_place(marked.view(), 16);
+  auto l = cholesky_factor(a, 16);
+  for (std::size_t col = 0; col < 40; ++col) {
+    for (std::size_t row = 0; row < 40; ++row) {
+      ASSERT_EQ(marked(row, col), row < col ? -1 : l(row, col));
+    }
+  }
+
+  auto b = make_matrix(40, 2, 9);
+  expect_near(matrix_multiply(a, cholesky_solve(l, b)), b, 1e-10);
+
+  auto indefinite = a;
+  indefinite(30, 30) = -1;
+  ASSERT_THROW(cholesky_factor(indefinite, 16), std::runtime_error);
+  ASSERT_THROW(cholesky_factor(make_matrix(3, 4, 1)), std::runtime_error);
+}
+
+TEST(MatrixFactor, ParallelMatchesSerial) {
+  // Big enough that the trailing updates and block-row solves go parallel.
+  // Threads only split the output, so results are identical.
+  auto a = make_matrix(400, 400, 10);
+  auto spd = make_spd(400, 11);
+  ry::NumThreadsGuard guard(1);
+  auto lu = lu_factor(a, 64);
+  auto l = cholesky_factor(spd, 64);
+  ry::set_num_threads(4);
+  auto luParallel = lu_factor(a, 64);
+  auto lParallel = cholesky_factor(spd, 64);
+  ASSERT_EQ(luParallel.pivots, lu.pivots);
+  ASSERT_EQ(luParallel.lu.to_vector(), lu.lu.to_vector());
+  ASSERT_EQ(lParallel.to_vector(), l.to_vector());
+}
@@ -0,0 +1,138 @@
+#include "matrix_file.hpp"
+#include <cstdint>
+#include <fstream>
+#include <gtest/gtest.h>
+
+namespace {
+Matrix<double> make_matrix(std::size_t nrows, std::size_t ncols, int seed) {
+  Matrix<double> res(nrows, ncols, uninitialized);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = static_cast<double>((k * 5 + seed) % 9) - 4;
+  }
+  return res;
+}
+
+std::filesystem::path temp_path(const std::string &name) {
+  return std::filesystem::temp_directory_path() / ("cpp_practice_" + name);
+}
+
+// Overwrite a 64-bit header field: nrows at 24, ncols at 32, dataOffset at 40
+void patch_header(const std::filesystem::path &path, std::streamoff offset,
+                  std::uint64_t value) {
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  file.seekp(offset);
+  file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+} // namespace
+
+TEST(MatrixFile, RoundTrip) {
+  auto m = make_matrix(7, 5, 1);
+  auto path = temp_path("file_round_trip");
+  for (auto layout : {MatrixLayout::ColumnMajor, MatrixLayout::RowMajor}) {
+    save_matrix_file(path, m, layout);
+    auto info = read_matrix_file_info(path);
+    ASSERT_EQ(info.dtype, MatrixDtype::Float64);
+    ASSERT_EQ(info.layout, layout);
+    ASSERT_EQ(info.nrows, 7);
+    ASSERT_EQ(info.ncols, 5);
+    ASSERT_EQ(std::filesystem::file_size(path), 64 + 7 * 5 * sizeof(double));
+
+    auto mapped = map_matrix_file<double>(path);
+    ASSERT_EQ(mapped.layout(), layout);
+    ASSERT_EQ(mapped.view().row_stride(),
+              layout == MatrixLayout::RowMajor ? 5 : 1);
+    Matrix<double> loaded(mapped.view());
+    ASSERT_EQ(loaded.to_vector(), m.to_vector());
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(mapped.view().data()) % 64, 0);
+  }
+
+  // Views of any layout save, and mapped matrices work with the matrix API
+  save_matrix_file(path, m.view().transpose());
+  auto mt = map_matrix_file<double>(path);
+  ASSERT_EQ(matrix_multiply(mt, m).to_vector(),
+            matrix_multiply(m.view().transpose(), m).to_vector());
+
+  ASSERT_THROW(map_matrix_file<float>(path), std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST(MatrixFile, Invalid) {
+  auto path = temp_path("file_invalid");
+  ASSERT_THROW(read_matrix_file_info(path), std::runtime_error);
+  {
+    std::ofstream out(path);
+    out << "not a matrix";
+  }
+  ASSERT_THROW(read_matrix_file_info(path), std::runtime_error);
+
+  save_matrix_file(path, make_matrix(4, 4, 2));
+  std::filesystem::resize_file(path, 64 + 15 * sizeof(double));
+  ASSERT_THROW(map_matrix_file<double>(path), std::runtime_error);
+
+  // Dimensions whose byte count wraps to 0 must not pass the size check
+  save_matrix_file(path, make_matrix(4, 4, 2));
+  patch_header(path, 24, std::uint64_t{1} << 62);
+  ASSERT_THROW(read_matrix_file_info(path), std::runtime_error);
+  patch_header(path, 24, 4);
+  patch_header(path, 32, ~std::uint64_t{0});
+  ASSERT_THROW(read_matrix_file_info(path), std::runtime_error);
+
+  // Data offsets that don't start on a cache line
+  save_matrix_file(path, make_matrix(4, 4, 2));
+  std::filesystem::resize_file(path, 128 + 16 * sizeof(double));
+  for (std::uint64_t offset : {72, 96}) {
+    patch_header(path, 40, offset);
+    ASSERT_THROW(read_matrix_file_info(path), std::runtime_error) << offset;
+  }
+  patch_header(path, 40, 128);
+  ASSERT_EQ(read_matrix_file_info(path).dataOffset, 128);
+
+  // A mapping smaller than the matrix it is said to hold
+  MatrixFileInfo info{MatrixDtype::Float64, MatrixLayout::ColumnMajor, 4, 7};
+  ASSERT_THROW(MappedMatrix<const double>(ry::MappedFile(path), info),
+               std::runtime_error);
+  info.ncols = 4;
+  info.dataOffset = 128;
+  ASSERT_EQ(MappedMatrix<const double>(ry::MappedFile(path), info).numel(),
+            16);
+
+  // Files too large to size are refused before anything is written
+  ASSERT_THROW(create_matrix_file<double>(path, std::size_t{1} << 32,
+                                          std::size_t{1} << 32),
+               std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST(MatrixFile, OutOfCoreMultiply) {
+  auto aPath = temp_path("file_ooc_a");
+  auto bPath = temp_path("file_ooc_b");
+  auto cPath = temp_path("file_ooc_c");
+  auto a = make_matrix(67, 45, 1);
+  auto b = make_matrix(45, 53, 2);
+  save_matrix_file(aPath, a);
+  save_matrix_file(bPath, b, MatrixLayout::RowMajor);
+  auto ma = map_matrix_file<double>(aPath);
+  auto mb = map_matrix_file<double>(bPath);
+  auto expected = matrix_multiply(a, b);
+
+  // Budgets small enough for uneven tiles in every dimension
+  for (std::size_t budget : {std::size_t{512}, std::size_t{8192},
+                             kOutOfCoreMemoryBudget}) {
+    auto c = matrix_multiply_out_of_core(ma, mb, cPath, budget);
+    ASSERT_EQ(Matrix<double>(c.view()).to_vector(), expected.to_vector())
+        << budget;
+  }
+  ASSERT_EQ(Matrix<double>(map_matrix_file<double>(cPath).view()).to_vector(),
+            expected.to_vector());
+
+  auto c = make_matrix(67, 53, 3);
+  auto res = c;
+  matrix_multiply_add(2.0, a, b, -1.0, c);
+  matrix_multiply_add_out_of_core(2.0, ma, mb, -1.0, res, 4096);
+  ASSERT_EQ(res.to_vector(), c.to_vector());
+
+  ASSERT_THROW(matrix_multiply_out_of_core(ma, ma, cPath), std::runtime_error);
+  for (const auto &path : {aPath, bPath, cPath}) {
+    std::filesystem::remove(path);
+  }
+}
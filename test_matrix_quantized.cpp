@@ -0,0 +1,125 @@
+#include "matrix_quantized.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+template <typename T>
+Matrix<T> make_matrix(std::size_t nrows, std::size_t ncols, int seed) {
+  Matrix<T> res(nrows, ncols, uninitialized);
+  const int lo = std::numeric_limits<T>::min();
+  const int span = std::numeric_limits<T>::max() - lo + 1;
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = static_cast<T>(lo + (k * 7919 + seed * 104729) % span);
+  }
+  return res;
+}
+
+// sum_l (a - za) * (b - zb) in 64 bits
+template <typename TA, typename TB>
+std::vector<std::int64_t> reference(MatrixView<const TA> a, std::int32_t za,
+                                    MatrixView<const TB> b, std::int32_t zb) {
+  std::vector<std::int64_t> res(a.nrows() * b.ncols());
+  for (std::size_t j = 0; j < b.ncols(); ++j) {
+    for (std::size_t i = 0; i < a.nrows(); ++i) {
+      std::int64_t sum = 0;
+      for (std::size_t l = 0; l < a.ncols(); ++l) {
+        sum += static_cast<std::int64_t>(a(i, l) - za) * (b(l, j) - zb);
+      }
+      res[i + j * a.nrows()] = sum;
+    }
+  }
+  return res;
+}
+
+template <typename T> std::vector<std::int64_t> widen(const Matrix<T> &m) {
+  auto data = m.to_vector();
+  return std::vector<std::int64_t>(data.begin(), data.end());
+}
+} // namespace
+
+TEST(MatrixQuantized, KernelsMatchReference) {
+  // Odd k pads a pair; sizes cover partial register tiles and several blocks
+  struct Shape {
+    std::size_t m, k, n;
+  };
+  for (auto [m, k, n] :
+       {Shape{1, 1, 1}, Shape{37, 21, 13}, Shape{70, 1030, 45}}) {
+    auto a = make_matrix<std::int8_t>(m, k, 1);
+    auto b = make_matrix<std::int8_t>(k, n, 2);
+    auto expected = reference<std::int8_t, std::int8_t>(a, 0, b, 0);
+    for (auto isa : {ry::GemmIsa::Scalar, ry::GemmIsa::Sse42,
+                     ry::GemmIsa::Avx2, ry::GemmIsa::Avx512}) {
+      if (!ry::gemm_isa_supported(isa)) {
+        continue;
+      }
+      auto kernel = ry::qgemm_kernel_for_isa(isa);
+      Matrix<std::int32_t> c(m, n);
+      ry::qgemm(m, n, k, a.data(), 1, m, b.data(), 1, k, c.data(), 1, m,
+                kernel, ry::GemmBlocking{32, 64, 24});
+      ASSERT_EQ(widen(c), expected) << kernel.name << " " << m << "x" << k
+                                    << "x" << n;
+    }
+  }
+}
+
+TEST(MatrixQuantized, ZeroPointsAndLayouts) {
+  auto a = make_matrix<std::uint8_t>(90, 77, 3);
+  auto b = make_matrix<std::int8_t>(77, 60, 4);
+  QuantParams qa{0.5f, 128}, qb{0.25f, -3};
+  auto expected = reference<std::uint8_t, std::int8_t>(a, 128, b, -3);
+  for (std::size_t threads : {1, 4}) {
+    ry::NumThreadsGuard guard(threads);
+    auto c = quantized_matrix_multiply<std::int32_t>(a, qa, b, qb);
+    ASSERT_EQ(widen(c), expected) << threads;
+
+    // Transposed and row-major views go through the same packing
+    auto bt = matrix_transpose(b);
+    Matrix<std::int32_t> ct(90, 60);
+    quantized_matrix_multiply(a, qa, bt.view().transpose(), qb, ct.view());
+    ASSERT_EQ(widen(ct), expected);
+  }
+
+  auto a16 = make_matrix<std::int16_t>(20, 3, 5);
+  auto b16 = make_matrix<std::int16_t>(3, 10, 6);
+  ASSERT_EQ(widen(quantized_matrix_multiply<std::int32_t>(a16, {}, b16, {})),
+            (reference<std::int16_t, std::int16_t>(a16, 0, b16, 0)));
+
+  ASSERT_THROW(quantized_matrix_multiply<std::int32_t>(a, qa, a, qa),
+               std::runtime_error);
+}
+
+TEST(MatrixQuantized, Outputs) {
+  Matrix<float> x(40, 30), y(30, 20);
+  for (std::size_t k = 0; k < x.numel(); ++k) {
+    x.data()[k] = std::sin(static_cast<float>(k));
+  }
+  for (std::size_t k = 0; k < y.numel(); ++k) {
+    y.data()[k] = std::cos(static_cast<float>(k)) + 0.5f;
+  }
+  auto qx = choose_quant_params<std::int8_t>(-1, 1);
+  auto qy = choose_quant_params<std::uint8_t>(-0.5f, 1.5f);
+  ASSERT_NE(qy.zeroPoint, 0);
+  auto xq = quantize<std::int8_t>(x, qx);
+  auto yq = quantize<std::uint8_t>(y, qy);
+  // Round trip error is at most half a step
+  auto xBack = dequantize<float>(xq, qx);
+  for (std::size_t k = 0; k < x.numel(); ++k) {
+    ASSERT_NEAR(xBack.data()[k], x.data()[k], qx.scale / 2 + 1e-6f);
+  }
+
+  // Real output is the product of the dequantized operands
+  auto expected = matrix_multiply(xBack, dequantize<float>(yq, qy));
+  auto real = quantized_matrix_multiply<float>(xq, qx, yq, qy);
+  for (std::size_t k = 0; k < real.numel(); ++k) {
+    ASSERT_NEAR(real.data()[k], expected.data()[k], 1e-4f);
+  }
+
+  // Requantized output rounds and saturates
+  QuantParams qc{0.05f, 10};
+  auto requant = quantized_matrix_multiply<std::int8_t>(xq, qx, yq, qy, qc);
+  for (std::size_t k = 0; k < requant.numel(); ++k) {
+    const float want = std::clamp(
+        std::nearbyint(expected.data()[k] / qc.scale) + qc.zeroPoint, -128.0f,
+        127.0f);
+    ASSERT_NEAR(requant.data()[k], want, 1) << k;
+  }
+}
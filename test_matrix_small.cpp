@@ -0,0 +1,62 @@
+#include "matrix_small.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+template <std::size_t R, std::size_t C>
+Matrix<double, R, C> make_small(int seed) {
+  Matrix<double, R, C> res;
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = static_cast<double>((k * 7 + seed) % 11) - 5;
+  }
+  return res;
+}
+} // namespace
+
+TEST(MatrixSmall, Multiply) {
+  // Usable at compile time
+  constexpr Matrix<int, 2, 3> a(std::array<int, 6>{1, 2, 3, 4, 5, 6});
+  constexpr auto aat = a * a.transpose();
+  static_assert(aat == Matrix<int, 2, 2>(std::array<int, 4>{35, 44, 44, 56}));
+  static_assert(Matrix<int, 3, 3>::identity() * a.transpose() ==
+                a.transpose());
+
+  // Matches the dynamic kernel for every shape from 3x3 to 8x8
+  auto check = [](auto r, auto k, auto c) {
+    auto x = make_small<r(), k()>(1);
+    auto y = make_small<k(), c()>(2);
+    auto expected = matrix_multiply(Matrix<double>(x.view()),
+                                    Matrix<double>(y.view()));
+    auto res = x * y;
+    ASSERT_EQ(Matrix<double>(res.view()).to_vector(), expected.to_vector());
+  };
+  [&]<std::size_t... N>(std::index_sequence<N...>) {
+    (check(std::integral_constant<std::size_t, N + 3>{},
+           std::integral_constant<std::size_t, N + 3>{},
+           std::integral_constant<std::size_t, N + 3>{}),
+     ...);
+  }(std::make_index_sequence<6>{});
+  check(std::integral_constant<std::size_t, 3>{},
+        std::integral_constant<std::size_t, 8>{},
+        std::integral_constant<std::size_t, 5>{});
+}
+
+TEST(MatrixSmall, Batched) {
+  // A count that isn't a multiple of the chunk or the padding
+  const std::size_t count = 1001;
+  MatrixBatch<double, 4, 3> a(count);
+  MatrixBatch<double, 3, 5> b(count);
+  MatrixBatch<double, 4, 5> c(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    a.set(i, make_small<4, 3>(static_cast<int>(i)));
+    b.set(i, make_small<3, 5>(static_cast<int>(2 * i)));
+  }
+  batched_matrix_multiply(a, b, c);
+  for (std::size_t i = 0; i < count; ++i) {
+    ASSERT_EQ(c.get(i), a.get(i) * b.get(i)) << "matrix " << i;
+  }
+  ASSERT_EQ(c(7, 1, 2), c.get(7)(1, 2));
+
+  ASSERT_THROW(c.get(count), std::out_of_range);
+  MatrixBatch<double, 3, 5> wrongCount(count - 1);
+  ASSERT_THROW(batched_matrix_multiply(a, wrongCount, c), std::runtime_error);
+}
@@ -0,0 +1,113 @@
+#include "matrix_sparse.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+// Integer-valued so every kernel is exact. About one entry in density_inv is
+// nonzero.
+Matrix<double> make_sparse_dense(std::size_t nrows, std::size_t ncols,
+                                 std::size_t densityInv, int seed) {
+  Matrix<double> res(nrows, ncols);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    if ((k * 7919 + seed) % densityInv == 0) {
+      res.data()[k] = static_cast<double>((k + seed) % 9) - 4;
+    }
+  }
+  return res;
+}
+
+Matrix<double> make_dense(std::size_t nrows, std::size_t ncols, int seed) {
+  Matrix<double> res(nrows, ncols);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = static_cast<double>((k * 5 + seed) % 7) - 3;
+  }
+  return res;
+}
+} // namespace
+
+TEST(MatrixSparse, Conversions) {
+  // [1 0 2]
+  // [0 0 3]
+  // [4 5 0]
+  Matrix<double> dense(3, 3, {1, 0, 4, 0, 0, 5, 2, 3, 0});
+  auto csr = CsrMatrix<double>::from_dense(dense);
+  ASSERT_EQ(csr.nnz(), 5);
+  ASSERT_EQ(std::vector<sparse_index_t>(csr.row_ptr().begin(),
+                                        csr.row_ptr().end()),
+            (std::vector<sparse_index_t>{0, 2, 3, 5}));
+  ASSERT_EQ(std::vector<sparse_index_t>(csr.col_idx().begin(),
+                                        csr.col_idx().end()),
+            (std::vector<sparse_index_t>{0, 2, 2, 0, 1}));
+  ASSERT_EQ(std::vector<double>(csr.values().begin(), csr.values().end()),
+            (std::vector<double>{1, 2, 3, 4, 5}));
+  ASSERT_EQ(csr.to_dense().to_vector(), dense.to_vector());
+
+  auto csc = CscMatrix<double>::from_dense(dense);
+  ASSERT_EQ(std::vector<sparse_index_t>(csc.col_ptr().begin(),
+                                        csc.col_ptr().end()),
+            (std::vector<sparse_index_t>{0, 2, 3, 5}));
+  ASSERT_EQ(std::vector<sparse_index_t>(csc.row_idx().begin(),
+                                        csc.row_idx().end()),
+            (std::vector<sparse_index_t>{0, 2, 2, 0, 1}));
+  ASSERT_EQ(csc.to_dense().to_vector(), dense.to_vector());
+
+  // Round trips between the formats on something less regular
+  auto big = make_sparse_dense(37, 53, 13, 1);
+  auto bigCsr = CsrMatrix<double>::from_dense(big);
+  ASSERT_EQ(bigCsr.to_csc().to_dense().to_vector(), big.to_vector());
+  ASSERT_EQ(bigCsr.to_csc().to_csr().to_dense().to_vector(), big.to_vector());
+  ASSERT_LT(bigCsr.memory_bytes(), big.numel() * sizeof(double));
+
+  ASSERT_THROW(CsrMatrix<double>(2, 2, {0, 1}, {0}, {1.0}),
+               std::runtime_error);
+  ASSERT_THROW(CsrMatrix<double>(2, 2, {0, 1, 1}, {2}, {1.0}),
+               std::out_of_range);
+  ASSERT_NO_THROW(CscMatrix<double>(2, 2, {0, 1, 1}, {1}, {1.0}));
+}
+
+TEST(MatrixSparse, Kernels) {
+  for (std::size_t threads : {1, 4}) {
+    ry::NumThreadsGuard guard(threads);
+    auto dense = make_sparse_dense(300, 200, 20, 2);
+    auto csr = CsrMatrix<double>::from_dense(dense);
+    auto csc = CscMatrix<double>::from_dense(dense);
+
+    auto x = make_dense(200, 1, 3).to_vector();
+    auto expected = matrix_multiply(dense, Matrix<double>(200, 1, x));
+    ASSERT_EQ(matrix_multiply(csr, x), expected.to_vector());
+    ASSERT_EQ(matrix_multiply(csc, x), expected.to_vector());
+
+    // y = 2 * a * x - y
+    auto y0 = make_dense(300, 1, 4).to_vector();
+    std::vector<double> yExpected(300);
+    for (std::size_t i = 0; i < 300; ++i) {
+      yExpected[i] = 2 * expected.data()[i] - y0[i];
+    }
+    for (int format = 0; format < 2; ++format) {
+      auto y = y0;
+      if (format == 0) {
+        spmv(2.0, csr, std::span<const double>(x), -1.0, std::span(y));
+      } else {
+        spmv(2.0, csc, std::span<const double>(x), -1.0, std::span(y));
+      }
+      ASSERT_EQ(y, yExpected) << "format " << format;
+    }
+
+    // SpMM with a strided b and an accumulating c
+    auto bigB = make_dense(250, 90, 5);
+    auto b = bigB.view().submatrix(10, 3, 200, 70);
+    auto c0 = make_dense(300, 70, 6);
+    auto cExpected = c0;
+    matrix_multiply_add(3.0, dense, b, 2.0, cExpected);
+    auto c = c0;
+    spmm(3.0, csr, b, 2.0, c);
+    ASSERT_EQ(c.to_vector(), cExpected.to_vector());
+    c = c0;
+    spmm(3.0, csc, b, 2.0, c);
+    ASSERT_EQ(c.to_vector(), cExpected.to_vector());
+    ASSERT_EQ(matrix_multiply(csr, b).to_vector(),
+              matrix_multiply(dense, b).to_vector());
+
+    ASSERT_THROW(matrix_multiply(csr, bigB), std::runtime_error);
+    ASSERT_THROW(matrix_multiply(csc, y0), std::runtime_error);
+  }
+}
@@ -0,0 +1,90 @@
+#include "matrix_strassen.hpp"
+#include <cstdlib>
+#include <gtest/gtest.h>
+
+namespace {
+Matrix<double> make_matrix(std::size_t nrows, std::size_t ncols, int seed) {
+  Matrix<double> res(nrows, ncols, uninitialized);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = static_cast<double>((k * 5 + seed) % 9) - 4;
+  }
+  return res;
+}
+} // namespace
+
+TEST(MatrixStrassen, MatchesBlocked) {
+  // Small integer-valued entries keep every algorithm exact. Odd sizes
+  // exercise the peeling and unbalanced shapes the cache-oblivious split.
+  struct Shape {
+    std::size_t m, k, n;
+  };
+  for (auto [m, k, n] : {Shape{64, 64, 64}, Shape{67, 61, 71},
+                         Shape{100, 20, 45}, Shape{9, 130, 40}}) {
+    auto a = make_matrix(m, k, 1);
+    auto b = make_matrix(k, n, 2);
+    auto expected = make_matrix(m, n, 3);
+    auto c = expected;
+    matrix_multiply_add(2.0, a, b, -1.0, expected);
+
+    for (bool strassen : {true, false}) {
+      auto res = c;
+      matrix_multiply_add_recursive(2.0, a, b, -1.0, res,
+                                    RecursiveMultiplyOptions{8, strassen});
+      ASSERT_EQ(res.to_vector(), expected.to_vector())
+          << m << "x" << k << "x" << n << " strassen " << strassen;
+    }
+  }
+
+  // Strided views as operands
+  auto big = make_matrix(80, 80, 4);
+  auto a = big.view().submatrix(3, 5, 40, 36);
+  auto b = big.view().submatrix(10, 2, 36, 50).transpose().transpose();
+  auto expected = matrix_multiply(a, b);
+  Matrix<double> res(40, 50, uninitialized);
+  matrix_multiply_add_recursive(1.0, a, b, 0.0, res,
+                                RecursiveMultiplyOptions{16, true});
+  ASSERT_EQ(res.to_vector(), expected.to_vector());
+
+  ASSERT_THROW(matrix_multiply_add_recursive(1.0, a, a, 0.0, res),
+               std::runtime_error);
+}
+
+TEST(MatrixStrassen, CrossoverCache) {
+  auto path =
+      std::filesystem::temp_directory_path() / "cpp_practice_strassen_test";
+  std::filesystem::remove(path);
+  ASSERT_FALSE(load_strassen_crossover(path, "double-avx2-t1"));
+
+  ASSERT_TRUE(store_strassen_crossover(path, "double-avx2-t1", 512));
+  ASSERT_TRUE(store_strassen_crossover(path, "float-avx2-t1", 1024));
+  ASSERT_EQ(load_strassen_crossover(path, "double-avx2-t1"), 512);
+  ASSERT_EQ(load_strassen_crossover(path, "float-avx2-t1"), 1024);
+
+  // Replacing a key keeps the others
+  ASSERT_TRUE(store_strassen_crossover(path, "double-avx2-t1", 256));
+  ASSERT_EQ(load_strassen_crossover(path, "double-avx2-t1"), 256);
+  ASSERT_EQ(load_strassen_crossover(path, "float-avx2-t1"), 1024);
+  std::filesystem::remove(path);
+
+  std::vector<std::size_t> sizes{16, 32};
+  auto crossover = tune_strassen_crossover<double>(sizes);
+  ASSERT_TRUE(crossover == 16 || crossover == 32 || crossover == 64);
+}
+
+TEST(MatrixStrassen, CrossoverFollowsThreads) {
+  auto path = std::filesystem::temp_directory_path() /
+              "cpp_practice_strassen_threads_test";
+  std::filesystem::remove(path);
+  ::setenv("RY_STRASSEN_CACHE", path.c_str(), 1);
+  ry::NumThreadsGuard guard(1);
+  ASSERT_TRUE(store_strassen_crossover(path, strassen_cache_key<float>(), 96));
+  ry::set_num_threads(2);
+  ASSERT_TRUE(store_strassen_crossover(path, strassen_cache_key<float>(), 48));
+
+  for (std::size_t threads : {1, 2, 1}) {
+    ry::set_num_threads(threads);
+    EXPECT_EQ(strassen_crossover<float>(), threads == 1 ? 96 : 48);
+  }
+  ::unsetenv("RY_STRASSEN_CACHE");
+  std::filesystem::remove(path);
+}
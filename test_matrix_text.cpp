@@ -0,0 +1,199 @@
+#include "matrix_text.hpp"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <sstream>
+
+namespace {
+Matrix<double> make_matrix(std::size_t nrows, std::size_t ncols, int seed) {
+  Matrix<double> res(nrows, ncols, uninitialized);
+  for (std::size_t k = 0; k < res.numel(); ++k) {
+    res.data()[k] = std::sin(static_cast<double>(k * 3 + seed)) *
+                    std::pow(10.0, static_cast<double>(k % 40) - 20);
+  }
+  return res;
+}
+
+template <typename M> std::string to_text(const M &matrix, TextFormat format) {
+  std::ostringstream out;
+  write_matrix_text(out, matrix, format);
+  return out.str();
+}
+
+std::filesystem::path temp_path(const std::string &name) {
+  return std::filesystem::temp_directory_path() / ("cpp_practice_" + name);
+}
+} // namespace
+
+TEST(MatrixText, Formats) {
+  Matrix<double> m(2, 3, {1, 4, 2.5, -5, 0.1, 6});
+  ASSERT_EQ(to_text(m, TextFormat::Csv), "1,2.5,0.1\n4,-5,6\n");
+  ASSERT_EQ(to_text(m, TextFormat::Tsv), "1\t2.5\t0.1\n4\t-5\t6\n");
+  ASSERT_EQ(to_text(m, TextFormat::MatrixMarket),
+            "%%MatrixMarket matrix array real general\n2 3\n"
+            "1\n4\n2.5\n-5\n0.1\n6\n");
+  ASSERT_EQ(to_text(Matrix<int>(1, 2, {7, -8}), TextFormat::MatrixMarket),
+            "%%MatrixMarket matrix array integer general\n1 2\n7\n-8\n");
+
+  ASSERT_EQ(text_format_for("a/b.CSV"), TextFormat::Csv);
+  ASSERT_EQ(text_format_for("b.tsv"), TextFormat::Tsv);
+  ASSERT_EQ(text_format_for("c.mtx"), TextFormat::MatrixMarket);
+  ASSERT_THROW(text_format_for("d.txt"), std::runtime_error);
+}
+
+TEST(MatrixText, RoundTrip) {
+  // Shortest round-trip text reads back to the same bits, extremes included
+  auto m = make_matrix(37, 11, 1);
+  m(0, 0) = std::numeric_limits<double>::max();
+  m(1, 0) = std::numeric_limits<double>::denorm_min();
+  m(2, 0) = -0.0;
+  for (auto format :
+       {TextFormat::Csv, TextFormat::Tsv, TextFormat::MatrixMarket}) {
+    auto text = to_text(m, format);
+    ASSERT_EQ(parse_matrix_text<double>(text, format).to_vector(),
+              m.to_vector());
+    // Views of any layout
+    ASSERT_EQ(parse_matrix_text<double>(to_text(m.view().transpose(), format),
+                                        format)
+                  .to_vector(),
+              matrix_transpose(m).to_vector());
+  }
+  Matrix<float> f(3, 2, {0.1f, 1e-30f, -3.5f, 1e30f, 7, 0});
+  ASSERT_EQ(parse_matrix_text<float>(to_text(f, TextFormat::Csv),
+                                     TextFormat::Csv)
+                .to_vector(),
+            f.to_vector());
+  Matrix<std::int64_t> ints(2, 2, {std::numeric_limits<std::int64_t>::min(),
+                                   -1, 0, 42});
+  ASSERT_EQ(parse_matrix_text<std::int64_t>(to_text(ints, TextFormat::Tsv),
+                                            TextFormat::Tsv)
+                .to_vector(),
+            ints.to_vector());
+
+  auto path = temp_path("text_round_trip.csv");
+  write_matrix_text(path, m);
+  ASSERT_EQ(read_matrix_text<double>(path).to_vector(), m.to_vector());
+  std::filesystem::remove(path);
+}
+
+TEST(MatrixText, ParseDelimited) {
+  // CRLF, blank lines, a missing final newline, blanks around values and
+  // a leading '+'
+  auto m = parse_matrix_text<double>("1, 2 ,+3\r\n\n4,5,6e-1", TextFormat::Csv);
+  ASSERT_EQ(m.nrows(), 2);
+  ASSERT_EQ(m.to_vector(), (std::vector<double>{1, 4, 2, 5, 3, 0.6}));
+  ASSERT_EQ(parse_matrix_text<double>("", TextFormat::Csv).numel(), 0);
+
+  auto error = [](std::string_view text, TextFormat format) {
+    try {
+      parse_matrix_text<int>(text, format);
+    } catch (const std::runtime_error &e) {
+      return std::string(e.what());
+    }
+    return std::string("no error");
+  };
+  ASSERT_EQ(error("1,2\n3\n", TextFormat::Csv), "Row 2: expected 2 values");
+  ASSERT_EQ(error("1,2\n3,4,5\n", TextFormat::Csv),
+            "Row 2: expected 2 values");
+  ASSERT_EQ(error("1\t2\n3\tx\n", TextFormat::Tsv),
+            "Row 2: Cannot parse \"x\"");
+  ASSERT_EQ(error("1,2.5\n", TextFormat::Csv), "Row 1: expected 2 values");
+  ASSERT_EQ(error("99999999999\n", TextFormat::Csv),
+            "Row 1: Out of range value \"99999999999\"");
+}
+
+TEST(MatrixText, MatrixMarket) {
+  const std::string coordinate = "%%MatrixMarket matrix coordinate real "
+                                 "general\n% a comment\n\n3 4 4\n1 1 1.5\n"
+                                 "3 2 -2\n1 4 3\n3 2 1\n";
+  auto dense = parse_matrix_text<double>(coordinate, TextFormat::MatrixMarket);
+  Matrix<double> expected(3, 4);
+  expected(0, 0) = 1.5;
+  expected(2, 1) = -1;
+  expected(0, 3) = 3;
+  ASSERT_EQ(dense.to_vector(), expected.to_vector());
+
+  // Repeats are added up in sparse form too, and round trip
+  auto sparse = parse_matrix_market_sparse<double>(coordinate);
+  ASSERT_EQ(sparse.nnz(), 3);
+  ASSERT_EQ(sparse.to_dense().to_vector(), expected.to_vector());
+  std::ostringstream out;
+  write_matrix_market(out, sparse);
+  ASSERT_EQ(out.str(), "%%MatrixMarket matrix coordinate real general\n"
+                       "3 4 3\n1 1 1.5\n3 2 -1\n1 4 3\n");
+  auto reread = parse_matrix_market_sparse<double>(out.str());
+  ASSERT_TRUE(std::ranges::equal(reread.values(), sparse.values()));
+  ASSERT_TRUE(std::ranges::equal(reread.row_idx(), sparse.row_idx()));
+
+  auto symmetric = parse_matrix_text<int>(
+      "%%MatrixMarket matrix coordinate pattern symmetric\n3 3 2\n2 1\n3 3\n",
+      TextFormat::MatrixMarket);
+  ASSERT_EQ(symmetric.to_vector(),
+            (std::vector<int>{0, 1, 0, 1, 0, 0, 0, 0, 1}));
+  auto packed = parse_matrix_text<int>(
+      "%%MatrixMarket matrix array integer symmetric\n2 2\n1\n2\n3\n",
+      TextFormat::MatrixMarket);
+  ASSERT_EQ(packed.to_vector(), (std::vector<int>{1, 2, 2, 3}));
+
+  auto mm = [](std::string_view text) {
+    return parse_matrix_text<double>(text, TextFormat::MatrixMarket);
+  };
+  ASSERT_THROW(mm("1 2\n3 4\n"), std::runtime_error);
+  ASSERT_THROW(mm("%%MatrixMarket matrix array complex general\n1 1\n1 0\n"),
+               std::runtime_error);
+  ASSERT_THROW(mm("%%MatrixMarket matrix array real general\n2 2\n1\n2\n3\n"),
+               std::runtime_error);
+  ASSERT_THROW(mm("%%MatrixMarket matrix coordinate real general\n2 2 1\n"
+                  "3 1 1\n"),
+               std::runtime_error);
+}
+
+TEST(MatrixText, Parallel) {
+  // Over kTextParallelBytes, so both the writer and the parser split it
+  auto m = make_matrix(1000, 120, 2);
+  ry::NumThreadsGuard guard(1);
+  const auto serial = to_text(m, TextFormat::Csv);
+  ASSERT_GT(serial.size(), kTextParallelBytes);
+  const auto market = to_text(m, TextFormat::MatrixMarket);
+  ry::set_num_threads(4);
+  ASSERT_EQ(to_text(m, TextFormat::Csv), serial);
+  ASSERT_EQ(to_text(m, TextFormat::MatrixMarket), market);
+  ASSERT_EQ(parse_matrix_text<double>(serial, TextFormat::Csv).to_vector(),
+            m.to_vector());
+  ASSERT_EQ(
+      parse_matrix_text<double>(market, TextFormat::MatrixMarket).to_vector(),
+      m.to_vector());
+
+  // Pieces of array files start mid-column, including in a single row and
+  // in the packed columns of symmetric files
+  auto row = make_matrix(1, 60000, 3);
+  ASSERT_GT(to_text(row, TextFormat::MatrixMarket).size(), kTextParallelBytes);
+  ASSERT_EQ(parse_matrix_text<double>(to_text(row, TextFormat::MatrixMarket),
+                                      TextFormat::MatrixMarket)
+                .to_vector(),
+            row.to_vector());
+  const std::size_t n = 700;
+  std::string packed = "%%MatrixMarket matrix array integer symmetric\n" +
+                       std::to_string(n) + " " + std::to_string(n) + "\n";
+  Matrix<int> expected(n, n);
+  for (std::size_t j = 0; j < n; ++j) {
+    for (std::size_t i = j; i < n; ++i) {
+      const int value = static_cast<int>(i * n + j);
+      packed += std::to_string(value) + "\n";
+      expected(i, j) = expected(j, i) = value;
+    }
+  }
+  ASSERT_GT(packed.size(), kTextParallelBytes);
+  ASSERT_EQ(
+      parse_matrix_text<int>(packed, TextFormat::MatrixMarket).to_vector(),
+      expected.to_vector());
+
+  // Errors in any piece surface with the right row
+  auto broken = serial;
+  broken[broken.size() - 10] = 'x';
+  try {
+    parse_matrix_text<double>(broken, TextFormat::Csv);
+    FAIL() << "no error";
+  } catch (const std::runtime_error &e) {
+    ASSERT_EQ(std::string(e.what()).substr(0, 9), "Row 1000:");
+  }
+}
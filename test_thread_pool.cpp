@@ -0,0 +1,114 @@
+#include "thread_pool.hpp"
+#include <atomic>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(ThreadPool, VisitsEveryItemOnce) {
+  ry::ThreadPool pool(4);
+  ASSERT_EQ(pool.size(), 4);
+  std::vector<std::atomic<int>> counts(1000);
+  std::atomic<bool> badWorker{false};
+  pool.parallel_for(counts.size(), [&](std::size_t i, std::size_t worker) {
+    if (worker >= 4) {
+      badWorker = true;
+    }
+    ++counts[i];
+  });
+  ASSERT_FALSE(badWorker);
+  for (auto &c : counts) {
+    ASSERT_EQ(c, 1);
+  }
+}
+
+TEST(ThreadPool, NestedAndResize) {
+  ry::ThreadPool pool(3);
+  std::atomic<int> total{0};
+  pool.parallel_for(8, [&](std::size_t, std::size_t) {
+    // Nested loops run inline on the calling worker
+    pool.parallel_for(8, [&](std::size_t, std::size_t) { ++total; });
+  });
+  ASSERT_EQ(total, 64);
+
+  pool.resize(1);
+  ASSERT_EQ(pool.size(), 1);
+  total = 0;
+  pool.parallel_for(10, [&](std::size_t, std::size_t) { ++total; });
+  ASSERT_EQ(total, 10);
+}
+
+TEST(ThreadPool, Lease) {
+  ry::ThreadPool pool(4);
+  std::atomic<bool> resized{false};
+  std::jthread resizer;
+  {
+    ry::ThreadPool::Lease lease(pool);
+    ASSERT_EQ(lease.size(), 4);
+    // The resize waits for the lease, so every loop keeps its worker count
+    resizer = std::jthread([&] {
+      pool.resize(2);
+      resized = true;
+    });
+    std::vector<std::atomic<int>> perWorker(lease.size());
+    for (int repeat = 0; repeat < 20; ++repeat) {
+      lease.parallel_for(100, [&](std::size_t, std::size_t worker) {
+        ++perWorker.at(worker);
+      });
+      // Loops on the pool itself run inside the lease
+      pool.parallel_for(10, [&](std::size_t, std::size_t worker) {
+        ++perWorker.at(worker);
+      });
+    }
+    ASSERT_FALSE(resized);
+    ASSERT_THROW(pool.resize(3), std::logic_error);
+
+    // Nested leases and loops are serial
+    lease.parallel_for(4, [&](std::size_t, std::size_t) {
+      ry::ThreadPool::Lease inner(pool);
+      if (inner.size() != 1) {
+        throw std::runtime_error("nested lease of size " +
+                                 std::to_string(inner.size()));
+      }
+    });
+  }
+  resizer.join();
+  ASSERT_EQ(pool.size(), 2);
+
+  // Resizing from a body would wait for the loop it is part of
+  ASSERT_THROW(pool.parallel_for(
+                   4, [&](std::size_t, std::size_t) { pool.resize(1); }),
+               std::logic_error);
+  ASSERT_EQ(pool.size(), 2);
+}
+
+TEST(ThreadPool, PropagatesExceptions) {
+  ry::ThreadPool pool(4);
+  ASSERT_THROW(pool.parallel_for(100,
+                                 [](std::size_t i, std::size_t) {
+                                   if (i == 42) {
+                                     throw std::runtime_error("boom");
+                                   }
+                                 }),
+               std::runtime_error);
+  // The pool is still usable afterwards
+  std::atomic<int> total{0};
+  pool.parallel_for(5, [&](std::size_t, std::size_t) { ++total; });
+  ASSERT_EQ(total, 5);
+}
+
+TEST(ThreadPool, NumThreadsGuard) {
+  const auto before = ry::get_num_threads();
+  {
+    ry::NumThreadsGuard outer(3);
+    ASSERT_EQ(ry::get_num_threads(), 3);
+    ASSERT_EQ(ry::default_thread_pool().size(), 3);
+    {
+      ry::NumThreadsGuard inner(2);
+      ry::set_num_threads(5);
+    }
+    ASSERT_EQ(ry::get_num_threads(), 3);
+  }
+  ASSERT_EQ(ry::get_num_threads(), before);
+}
@@ -0,0 +1,141 @@
+#include "matrix_ops.hpp"
+#include <gtest/gtest.h>
+
+namespace {
+std::vector<double> iota_vector(std::size_t n) {
+  std::vector<double> res(n);
+  for (std::size_t k = 0; k < n; ++k) {
+    res[k] = static_cast<double>(k);
+  }
+  return res;
+}
+
+Matrix<double> make_matrix(std::size_t nrows, std::size_t ncols) {
+  return Matrix<double>(nrows, ncols, iota_vector(nrows * ncols));
+}
+
+// a^T computed one element at a time
+Matrix<double> naive_transpose(MatrixView<const double> a) {
+  Matrix<double> res(a.ncols(), a.nrows());
+  for (std::size_t col = 0; col < a.ncols(); ++col) {
+    for (std::size_t row = 0; row < a.nrows(); ++row) {
+      res(col, row) = a(row, col);
+    }
+  }
+  return res;
+}
+
+struct Shape {
+  std::size_t m, n;
+};
+// Full micro tiles, partial tiles and multiple blocks in each dimension
+const Shape kShapes[] = {{1, 1},  {1, 9},   {9, 1},    {7, 13},
+                         {16, 8}, {64, 64}, {65, 130}, {200, 3}};
+} // namespace
+
+TEST(Transpose, OutOfPlace) {
+  for (auto [m, n] : kShapes) {
+    // Padded leading dimensions on both sides
+    const std::size_t lda = m + 3, ldb = n + 5;
+    auto a = iota_vector(lda * n);
+    std::vector<double> b(ldb * m, -1);
+    ry::transpose(m, n, a.data(), lda, b.data(), ldb);
+    for (std::size_t i = 0; i < m; ++i) {
+      for (std::size_t j = 0; j < n; ++j) {
+        ASSERT_EQ(b[j + i * ldb], a[i + j * lda]) << m << "x" << n;
+      }
+      for (std::size_t j = n; j < ldb; ++j) {
+        ASSERT_EQ(b[j + i * ldb], -1) << "padding written";
+      }
+    }
+  }
+}
+
+TEST(Transpose, InPlace) {
+  for (std::size_t n : {1, 2, 9, 63, 64, 130}) {
+    const std::size_t lda = n + 2;
+    auto a = iota_vector(lda * n);
+    auto expected = a;
+    ry::transpose(n, n, a.data(), lda, expected.data(), lda);
+    ry::transpose_in_place(n, a.data(), lda);
+    ASSERT_EQ(a, expected) << n;
+  }
+  for (auto [m, n] : kShapes) {
+    auto a = make_matrix(m, n);
+    auto expected = naive_transpose(a);
+    transpose_in_place(a);
+    ASSERT_EQ(a.nrows(), n);
+    ASSERT_EQ(a.ncols(), m);
+    ASSERT_EQ(a.to_vector(), expected.to_vector()) << m << "x" << n;
+  }
+
+  // Square views, including row-major and generally strided ones
+  auto big = make_matrix(40, 40);
+  auto expected = Matrix<double>(big);
+  transpose_in_place(big.view().submatrix(3, 5, 20, 20));
+  transpose_in_place(expected.view().submatrix(3, 5, 20, 20).transpose());
+  ASSERT_EQ(big.to_vector(), expected.to_vector());
+  auto strided = MatrixView<double>(big.data(), 10, 10, 2, 80);
+  auto before = naive_transpose(strided);
+  transpose_in_place(strided);
+  ASSERT_EQ(Matrix<double>(strided).to_vector(), before.to_vector());
+  ASSERT_THROW(transpose_in_place(big.view().columns(0, 3)),
+               std::runtime_error);
+}
+
+TEST(Transpose, Layouts) {
+  auto a = make_matrix(37, 70);
+  for (std::size_t threads : {1, 4}) {
+    ry::NumThreadsGuard guard(threads);
+    ASSERT_EQ(matrix_transpose(a).to_vector(),
+              naive_transpose(a).to_vector());
+
+    auto rowMajor = to_layout(a, MatrixLayout::RowMajor);
+    ASSERT_EQ(rowMajor, naive_transpose(a).to_vector());
+    ASSERT_EQ(to_layout(a, MatrixLayout::ColumnMajor), a.to_vector());
+    MatrixView<const double> view(rowMajor.data(), 37, 70,
+                                  MatrixLayout::RowMajor);
+    ASSERT_EQ(Matrix<double>(view).to_vector(), a.to_vector());
+    ASSERT_EQ(view.to_vector(), a.to_vector());
+  }
+
+  // Large enough to split across threads
+  auto big = make_matrix(1100, 1000);
+  ry::NumThreadsGuard guard(4);
+  auto parallel = matrix_transpose(big);
+  ASSERT_EQ(parallel.to_vector(), naive_transpose(big).to_vector());
+
+  Matrix<double> wrong(70, 36);
+  ASSERT_THROW(matrix_copy<double>(a, wrong), std::runtime_error);
+}
+
+TEST(Transpose, MultiplyFlags) {
+  auto a = make_matrix(12, 7);
+  auto b = make_matrix(9, 12);
+  auto at = matrix_transpose(a);
+  auto bt = matrix_transpose(b);
+  auto expected = matrix_multiply(at, bt);
+  ASSERT_EQ(
+      matrix_multiply(a, MatrixOp::Transpose, b, MatrixOp::Transpose)
+          .to_vector(),
+      expected.to_vector());
+  ASSERT_EQ(matrix_multiply(at, MatrixOp::None, b, MatrixOp::Transpose)
+                .to_vector(),
+            expected.to_vector());
+
+  Matrix<double> c(7, 9);
+  matrix_multiply_add(1.0, a, MatrixOp::Transpose, bt, MatrixOp::None, 0.0,
+                      c);
+  ASSERT_EQ(c.to_vector(), expected.to_vector());
+
+  // Row-major data used in place, with a row-major result
+  auto aRows = to_layout(at, MatrixLayout::RowMajor);
+  auto res = matrix_multiply(aRows, 7, 12, MatrixLayout::RowMajor,
+                             bt.to_vector(), 12, 9, MatrixLayout::ColumnMajor,
+                             MatrixLayout::RowMajor);
+  ASSERT_EQ(res, to_layout(expected, MatrixLayout::RowMajor));
+  ASSERT_THROW(matrix_multiply(aRows, 7, 11, MatrixLayout::RowMajor,
+                               bt.to_vector(), 12, 9,
+                               MatrixLayout::ColumnMajor),
+               std::runtime_error);
+}
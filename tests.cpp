@@ -21,6 +21,178 @@ TEST(MatrixMultiply, SquareIdentity) {
   ASSERT_EQ_MATRIX(c, a, 2, 2);
 }
 
+namespace {
+// Small integer entries keep every partial sum exact so blocked and naive
+// results can be compared with ==
+std::vector<double> make_test_matrix(std::size_t nrows, std::size_t ncols,
+                                     int seed) {
+  std::vector<double> res(nrows * ncols);
+  for (std::size_t k = 0; k < res.size(); ++k) {
+    res[k] = static_cast<double>((k * 7 + seed) % 11) - 5;
+  }
+  return res;
+}
+} // namespace
+
+// Odd sizes exercise the partial edge tiles of the micro-kernel
+TEST(MatrixMultiply, BlockedMatchesNaive) {
+  std::size_t m = 37, k = 53, n = 29;
+  auto a = make_test_matrix(m, k, 1);
+  auto b = make_test_matrix(k, n, 2);
+  ASSERT_EQ(matrix_multiply(a, m, k, b, k, n),
+            matrix_multiply_naive(a, m, k, b, k, n));
+}
+
+// Tiny blocks force several iterations of every blocking loop
+TEST(MatrixMultiply, GemmCrossesBlocks) {
+  std::size_t m = 45, k = 70, n = 33;
+  auto a = make_test_matrix(m, k, 3);
+  auto b = make_test_matrix(k, n, 4);
+  auto expected = matrix_multiply_naive(a, m, k, b, k, n);
+
+  auto kernel = ry::default_gemm_kernel<double>();
+  ry::GemmBlocking blocking{8, 16, 12};
+  std::vector<double> c(m * n, 1.0);
+  ry::gemm(m, n, k, 1.0, a.data(), 1, m, b.data(), 1, k, 0.0, c.data(), 1, m,
+           kernel, blocking);
+  ASSERT_EQ(c, expected);
+
+  // beta = 1 accumulates and alpha scales the product
+  ry::gemm(m, n, k, 2.0, a.data(), 1, m, b.data(), 1, k, 1.0, c.data(), 1, m,
+           kernel, blocking);
+  for (std::size_t i = 0; i < c.size(); ++i) {
+    ASSERT_EQ(c[i], 3 * expected[i]);
+  }
+}
+
+// Every kernel the host can run must agree with the naive loop
+TEST(MatrixMultiply, SimdKernels) {
+  std::size_t m = 67, k = 41, n = 31;
+  auto a = make_test_matrix(m, k, 5);
+  auto b = make_test_matrix(k, n, 6);
+  auto expected = matrix_multiply_naive(a, m, k, b, k, n);
+  std::vector<float> af(a.begin(), a.end()), bf(b.begin(), b.end());
+  auto expectedf = matrix_multiply_naive(af, m, k, bf, k, n);
+
+  for (auto isa : {ry::GemmIsa::Scalar, ry::GemmIsa::Sse42, ry::GemmIsa::Avx2,
+                   ry::GemmIsa::Avx512}) {
+    if (!ry::gemm_isa_supported(isa)) {
+      ASSERT_THROW(ry::gemm_kernel_for_isa<double>(isa), std::runtime_error);
+      continue;
+    }
+    SCOPED_TRACE(ry::gemm_isa_name(isa));
+    auto kernel = ry::gemm_kernel_for_isa<double>(isa);
+    std::vector<double> c(m * n);
+    ry::gemm(m, n, k, 1.0, a.data(), 1, m, b.data(), 1, k, 0.0, c.data(), 1,
+             m, kernel, ry::GemmBlocking{2 * kernel.mr, 16, 3 * kernel.nr});
+    ASSERT_EQ(c, expected);
+
+    auto kernelf = ry::gemm_kernel_for_isa<float>(isa);
+    std::vector<float> cf(m * n);
+    ry::gemm(m, n, k, 1.0f, af.data(), 1, m, bf.data(), 1, k, 0.0f, cf.data(),
+             1, m, kernelf, ry::default_gemm_blocking(kernelf));
+    ASSERT_EQ(cf, expectedf);
+  }
+}
+
+TEST(MatrixMultiply, Parallel) {
+  std::size_t m = 300, k = 70, n = 210;
+  auto a = make_test_matrix(m, k, 7);
+  auto b = make_test_matrix(k, n, 8);
+  auto expected = matrix_multiply_naive(a, m, k, b, k, n);
+
+  ry::ThreadPool pool(4);
+  auto kernel = ry::default_gemm_kernel<double>();
+  std::vector<double> c(m * n);
+  ry::gemm_parallel(m, n, k, 1.0, a.data(), 1, m, b.data(), 1, k, 0.0,
+                    c.data(), 1, m, kernel, ry::default_gemm_blocking(kernel),
+                    pool);
+  ASSERT_EQ(c, expected);
+
+  // Tiles cover the output exactly and respect the register tile
+  auto [tileM, tileN] = ry::gemm_output_tiling(m, n, kernel.mr, kernel.nr, 4);
+  ASSERT_EQ(tileM % kernel.mr, 0);
+  ASSERT_EQ(tileN % kernel.nr, 0);
+  ASSERT_GE(tileM, std::min<std::size_t>(64, m));
+}
+
+TEST(Matrix, StorageAndCopies) {
+  Matrix<double> m(3, 5);
+  ASSERT_EQ(m.numel(), 15);
+  ASSERT_EQ(reinterpret_cast<std::uintptr_t>(m.data()) %
+                Matrix<double>::alignment,
+            0);
+  ASSERT_EQ(m.to_vector(), std::vector<double>(15, 0.0));
+
+  m(2, 4) = 7;
+  Matrix<double> copy(m);
+  ASSERT_NE(copy.data(), m.data());
+  ASSERT_EQ(copy(2, 4), 7);
+
+  Matrix<double> moved(std::move(copy));
+  ASSERT_EQ(moved(2, 4), 7);
+  ASSERT_EQ(copy.data(), nullptr);
+
+  ASSERT_THROW(Matrix<double>(2, 2, std::vector<double>(3)),
+               std::runtime_error);
+}
+
+TEST(Matrix, Views) {
+  // 4 x 3 column-major: element (i, j) == 10 * i + j
+  Matrix<int> m(4, 3);
+  for (std::size_t j = 0; j < 3; ++j) {
+    for (std::size_t i = 0; i < 4; ++i) {
+      m(i, j) = static_cast<int>(10 * i + j);
+    }
+  }
+  auto sub = m.view().submatrix(1, 1, 2, 2);
+  ASSERT_EQ(sub.to_vector(), std::vector<int>({11, 21, 12, 22}));
+  ASSERT_EQ(sub.transpose().to_vector(), std::vector<int>({11, 12, 21, 22}));
+  ASSERT_EQ(m.view().columns(2, 1).to_vector(),
+            std::vector<int>({2, 12, 22, 32}));
+  ASSERT_EQ(m.view().rows(3, 1).to_vector(), std::vector<int>({30, 31, 32}));
+  ASSERT_THROW(m.view().submatrix(3, 0, 2, 1), std::out_of_range);
+
+  // Writes through a view land in the matrix
+  sub(0, 0) = -1;
+  ASSERT_EQ(m(1, 1), -1);
+  ASSERT_EQ(matrix_to_string(m.view().submatrix(0, 0, 1, 2)), "\t0\t1\t\n");
+}
+
+TEST(MatrixMultiply, Views) {
+  std::size_t m = 23, k = 17, n = 19;
+  Matrix<double> big(40, 40, make_test_matrix(40, 40, 9));
+  // Panels of a larger matrix, one of them transposed
+  auto a = big.view().submatrix(3, 5, m, k);
+  auto bt = big.view().submatrix(11, 2, n, k);
+  auto c = matrix_multiply(a, bt.transpose());
+
+  auto expected = matrix_multiply_naive(a.to_vector(), m, k,
+                                        bt.transpose().to_vector(), k, n);
+  ASSERT_EQ(c.nrows(), m);
+  ASSERT_EQ(c.ncols(), n);
+  ASSERT_EQ(c.to_vector(), expected);
+
+  // Accumulate into a view of an existing matrix
+  Matrix<double> out(m + 2, n + 2);
+  matrix_multiply_add(2.0, a, bt.transpose(), 0.0,
+                      out.view().submatrix(1, 1, m, n));
+  matrix_multiply_add(1.0, a, bt.transpose(), 1.0,
+                      out.view().submatrix(1, 1, m, n));
+  for (std::size_t j = 0; j < n; ++j) {
+    for (std::size_t i = 0; i < m; ++i) {
+      ASSERT_EQ(out(i + 1, j + 1), 3 * expected[i + j * m]);
+    }
+  }
+  ASSERT_EQ(out(0, 0), 0);
+  ASSERT_THROW(matrix_multiply(a, bt), std::runtime_error);
+}
+
+TEST(MatrixMultiply, SizeMismatch) {
+  std::vector<double> a(6), b(6);
+  ASSERT_THROW(matrix_multiply(a, 2, 3, b, 2, 3), std::runtime_error);
+}
+
 // C++11/14/17/20 feature review
 TEST(ModernCpp, WeakPtr) {
   ASSERT_TRUE(ry::use_weak_ptr());
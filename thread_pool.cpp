@@ -0,0 +1,221 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+// Set while a thread is running a parallel_for body so nested loops run
+// inline instead of deadlocking on the pool they are already part of
+thread_local bool tInParallelRegion = false;
+
+struct ParallelRegionGuard {
+  ParallelRegionGuard() {
+    tInParallelRegion = true;
+  }
+  ~ParallelRegionGuard() {
+    tInParallelRegion = false;
+  }
+};
+
+std::size_t resolve_num_threads(std::size_t numThreads) {
+  if (numThreads == 0) {
+    numThreads = std::thread::hardware_concurrency();
+  }
+  return std::max<std::size_t>(numThreads, 1);
+}
+
+std::size_t initial_num_threads() {
+  if (const char *env = std::getenv("RY_NUM_THREADS")) {
+    try {
+      return resolve_num_threads(std::stoul(env));
+    } catch (const std::exception &) {
+      // Ignore malformed values
+    }
+  }
+  return resolve_num_threads(0);
+}
+} // namespace
+
+namespace ry {
+ThreadPool::ThreadPool(std::size_t numThreads) {
+  start_workers(resolve_num_threads(numThreads));
+}
+
+ThreadPool::~ThreadPool() {
+  stop_workers();
+}
+
+void ThreadPool::resize(std::size_t numThreads) {
+  numThreads = resolve_num_threads(numThreads);
+  if (tInParallelRegion || held_by_this_thread()) {
+    throw std::logic_error("Cannot resize a thread pool from inside one of "
+                           "its loops or leases");
+  }
+  std::lock_guard<std::mutex> run{this->fRunLock};
+  if (numThreads == this->fSize) {
+    return;
+  }
+  stop_workers();
+  start_workers(numThreads);
+}
+
+void ThreadPool::start_workers(std::size_t numThreads) {
+  this->fStop = false;
+  this->fSize = numThreads;
+  // Worker 0 is whichever thread calls parallel_for
+  const std::size_t generation = this->fGeneration;
+  for (std::size_t worker = 1; worker < numThreads; ++worker) {
+    this->fWorkers.emplace_back(
+        [this, worker, generation] { worker_loop(worker, generation); });
+  }
+}
+
+void ThreadPool::stop_workers() {
+  {
+    std::lock_guard<std::mutex> l{this->fLock};
+    this->fStop = true;
+  }
+  this->fWorkReady.notify_all();
+  for (auto &t : this->fWorkers) {
+    t.join();
+  }
+  this->fWorkers.clear();
+}
+
+void ThreadPool::worker_loop(std::size_t worker,
+                             std::size_t seenGeneration) {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> l(this->fLock);
+      this->fWorkReady.wait(l, [this, seenGeneration] {
+        return this->fStop || this->fGeneration != seenGeneration;
+      });
+      if (this->fStop) {
+        return;
+      }
+      seenGeneration = this->fGeneration;
+      ++this->fBusyWorkers;
+    }
+    run_items(worker);
+    {
+      std::lock_guard<std::mutex> l{this->fLock};
+      --this->fBusyWorkers;
+    }
+    this->fWorkDone.notify_all();
+  }
+}
+
+void ThreadPool::run_items(std::size_t worker) {
+  ParallelRegionGuard region;
+  while (true) {
+    std::size_t item;
+    {
+      std::lock_guard<std::mutex> l{this->fLock};
+      if (this->fNextItem >= this->fCount || this->fError) {
+        break;
+      }
+      item = this->fNextItem++;
+    }
+    try {
+      (*this->fBody)(item, worker);
+    } catch (...) {
+      std::lock_guard<std::mutex> l{this->fLock};
+      if (!this->fError) {
+        this->fError = std::current_exception();
+      }
+    }
+  }
+}
+
+void ThreadPool::parallel_for(std::size_t count, const body_t &body) {
+  if (count == 0) {
+    return;
+  }
+  auto runSerially = [count, &body] {
+    for (std::size_t i = 0; i < count; ++i) {
+      body(i, 0);
+    }
+  };
+  if (tInParallelRegion) {
+    runSerially();
+    return;
+  }
+
+  // A lease taken by this thread already holds the lock
+  std::unique_lock<std::mutex> run(this->fRunLock, std::defer_lock);
+  if (!held_by_this_thread()) {
+    run.lock();
+  }
+  if (this->fSize == 1 || count == 1) {
+    ParallelRegionGuard region;
+    runSerially();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l{this->fLock};
+    this->fBody = &body;
+    this->fCount = count;
+    this->fNextItem = 0;
+    this->fError = nullptr;
+    ++this->fGeneration;
+  }
+  this->fWorkReady.notify_all();
+  run_items(0);
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> l(this->fLock);
+    // Every item has been claimed; wait for the ones still running
+    this->fNextItem = this->fCount;
+    this->fWorkDone.wait(l, [this] { return this->fBusyWorkers == 0; });
+    this->fBody = nullptr;
+    error = std::exchange(this->fError, nullptr);
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+ThreadPool::Lease::Lease(ThreadPool &pool) : fPool(pool), fSize(1) {
+  if (tInParallelRegion) {
+    return;
+  }
+  if (!pool.held_by_this_thread()) {
+    fRun = std::unique_lock<std::mutex>(pool.fRunLock);
+    pool.fOwner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+  }
+  fSize = pool.fSize;
+}
+
+ThreadPool::Lease::~Lease() {
+  if (fRun.owns_lock()) {
+    fPool.fOwner.store(std::thread::id(), std::memory_order_relaxed);
+  }
+}
+
+namespace {
+std::mutex gDefaultPoolLock;
+std::size_t gNumThreads = initial_num_threads();
+} // namespace
+
+std::size_t get_num_threads() {
+  std::lock_guard<std::mutex> l{gDefaultPoolLock};
+  return gNumThreads;
+}
+
+void set_num_threads(std::size_t numThreads) {
+  numThreads = resolve_num_threads(numThreads);
+  // Resized first so a refused resize leaves the count unchanged
+  default_thread_pool().resize(numThreads);
+  std::lock_guard<std::mutex> l{gDefaultPoolLock};
+  gNumThreads = numThreads;
+}
+
+ThreadPool &default_thread_pool() {
+  static ThreadPool pool(get_num_threads());
+  return pool;
+}
+} // namespace ry
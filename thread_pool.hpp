@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ry {
+
+/**
+ * @brief Fixed set of worker threads for fork-join loops
+ *
+ * The thread calling parallel_for is one of the workers, so a pool of size 1
+ * runs everything inline and spawns no threads.
+ */
+class ThreadPool {
+public:
+  /**
+   * @brief Body of a parallel loop: body(item, worker) where worker is in
+   * [0, size()) and is unique among concurrently running calls, so it can
+   * index per-thread scratch space.
+   */
+  using body_t = std::function<void(std::size_t, std::size_t)>;
+
+  explicit ThreadPool(std::size_t numThreads);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  /**
+   * @brief Number of workers. Another thread may resize the pool right after
+   * this returns, so kernels that size per-worker scratch from it take a
+   * Lease instead.
+   *
+   */
+  std::size_t size() const {
+    return fSize;
+  }
+
+  /**
+   * @brief Change the number of threads. Waits for running loops and leases
+   * to finish. Throws std::logic_error if called from a parallel_for body or
+   * under a lease of this pool, which would wait for itself.
+   *
+   * @param numThreads - 0 means std::thread::hardware_concurrency()
+   */
+  void resize(std::size_t numThreads);
+
+  /**
+   * @brief Run body(i, worker) for every i in [0, count) and wait for all of
+   * them. Items are handed out dynamically so uneven items balance out. The
+   * first exception thrown by body is rethrown here. Calls made from inside a
+   * body run serially on the calling worker.
+   *
+   * @param count
+   * @param body
+   */
+  void parallel_for(std::size_t count, const body_t &body);
+
+  /**
+   * @brief The pool held by one thread for a whole kernel, so its size() stays
+   * the worker count of every parallel_for until the lease ends. Other threads'
+   * loops and resizes wait meanwhile. Inside a parallel_for body the size is 1,
+   * as nested loops run serially on worker 0.
+   *
+   */
+  class Lease {
+  public:
+    explicit Lease(ThreadPool &pool);
+    ~Lease();
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+
+    std::size_t size() const {
+      return fSize;
+    }
+    void parallel_for(std::size_t count, const body_t &body) const {
+      fPool.parallel_for(count, body);
+    }
+
+  private:
+    ThreadPool &fPool;
+    std::unique_lock<std::mutex> fRun;
+    std::size_t fSize;
+  };
+
+private:
+  bool held_by_this_thread() const {
+    return fOwner.load(std::memory_order_relaxed) ==
+           std::this_thread::get_id();
+  }
+  void start_workers(std::size_t numThreads);
+  void stop_workers();
+  void worker_loop(std::size_t worker, std::size_t seenGeneration);
+  void run_items(std::size_t worker);
+
+  std::atomic<std::size_t> fSize = 1;
+  std::vector<std::thread> fWorkers;
+  // Serializes parallel_for, resize and leases
+  std::mutex fRunLock;
+  // Thread holding fRunLock for a lease, whose loops then run without it
+  std::atomic<std::thread::id> fOwner;
+
+  // State of the loop in flight, guarded by fLock
+  std::mutex fLock;
+  std::condition_variable fWorkReady;
+  std::condition_variable fWorkDone;
+  const body_t *fBody = nullptr;
+  std::size_t fCount = 0;
+  std::size_t fNextItem = 0;
+  std::size_t fGeneration = 0;
+  std::size_t fBusyWorkers = 0;
+  std::exception_ptr fError;
+  bool fStop = false;
+};
+
+/**
+ * @brief Number of threads used by the library's parallel kernels. Defaults
+ * to the RY_NUM_THREADS environment variable if set, and to
+ * std::thread::hardware_concurrency() otherwise.
+ *
+ * @return std::size_t
+ */
+std::size_t get_num_threads();
+
+/**
+ * @brief Set the number of threads used by the library's parallel kernels
+ *
+ * @param numThreads - 0 means std::thread::hardware_concurrency()
+ */
+void set_num_threads(std::size_t numThreads);
+
+/**
+ * @brief Sets the number of threads for its lifetime, then restores the count
+ * it replaced, so tests and benchmarks don't leak their setting
+ *
+ */
+class NumThreadsGuard {
+public:
+  explicit NumThreadsGuard(std::size_t numThreads)
+      : fRestore(get_num_threads()) {
+    set_num_threads(numThreads);
+  }
+  ~NumThreadsGuard() {
+    set_num_threads(fRestore);
+  }
+  NumThreadsGuard(const NumThreadsGuard &) = delete;
+  NumThreadsGuard &operator=(const NumThreadsGuard &) = delete;
+
+private:
+  std::size_t fRestore;
+};
+
+/**
+ * @brief Pool shared by the library's parallel kernels, sized by
+ * set_num_threads
+ *
+ * @return ThreadPool&
+ */
+ThreadPool &default_thread_pool();
+} // namespace ry
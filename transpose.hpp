@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+/**
+ * Cache-blocked transposes of column-major arrays. Converting between
+ * row-major and column-major is the same operation: the row-major m x n array
+ * is the column-major n x m transpose.
+ *
+ * A naive transpose reads with unit stride and writes with stride ld (or the
+ * reverse), so every write lands on a different cache line and, for large ld,
+ * a different page. Here the array is split into kTransposeBlock-square
+ * blocks whose source and destination columns both fit in the L1 TLB, and each
+ * block into micro tiles one cache line on a side, which are loaded and stored
+ * a whole line at a time.
+ */
+namespace ry {
+
+/**
+ * @brief Side of the blocks a transpose works on at a time
+ *
+ */
+inline constexpr std::size_t kTransposeBlock = 64;
+
+/**
+ * @brief Transposes with fewer elements than this run on a single thread
+ *
+ */
+inline constexpr std::size_t kTransposeParallelThreshold = 1 << 20;
+
+namespace detail {
+// One cache line of T on each side
+template <typename T>
+inline constexpr std::size_t kTransposeMicro =
+    std::max<std::size_t>(1, 64 / sizeof(T));
+
+// b = a^T for a B x B tile. Fixed bounds let the compiler keep the tile in
+// registers and use full-width loads and stores on both sides.
+template <typename T, std::size_t B>
+void transpose_micro(const T *a, std::size_t lda, T *b, std::size_t ldb) {
+  T tile[B][B];
+  for (std::size_t j = 0; j < B; ++j) {
+    for (std::size_t i = 0; i < B; ++i) {
+      tile[i][j] = a[i + j * lda];
+    }
+  }
+  for (std::size_t i = 0; i < B; ++i) {
+    for (std::size_t j = 0; j < B; ++j) {
+      b[j + i * ldb] = tile[i][j];
+    }
+  }
+}
+
+// b = a^T for an m x n block of a
+template <typename T>
+void transpose_block(std::size_t m, std::size_t n, const T *a, std::size_t lda,
+                     T *b, std::size_t ldb) {
+  constexpr std::size_t B = kTransposeMicro<T>;
+  std::size_t j = 0;
+  for (; j + B <= n; j += B) {
+    std::size_t i = 0;
+    for (; i + B <= m; i += B) {
+      transpose_micro<T, B>(a + i + j * lda, lda, b + j + i * ldb, ldb);
+    }
+    for (; i < m; ++i) {
+      for (std::size_t jj = j; jj < j + B; ++jj) {
+        b[jj + i * ldb] = a[i + jj * lda];
+      }
+    }
+  }
+  for (; j < n; ++j) {
+    for (std::size_t i = 0; i < m; ++i) {
+      b[j + i * ldb] = a[i + j * lda];
+    }
+  }
+}
+
+// Run body(i0, j0) for the top-left corner of every kTransposeBlock-square
+// block of an m x n array, on default_thread_pool() when large
+template <typename F>
+void for_each_transpose_block(std::size_t m, std::size_t n, F &&body) {
+  const std::size_t blocksM = (m + kTransposeBlock - 1) / kTransposeBlock;
+  const std::size_t blocksN = (n + kTransposeBlock - 1) / kTransposeBlock;
+  auto run = [&](std::size_t block, std::size_t) {
+    body((block % blocksM) * kTransposeBlock,
+         (block / blocksM) * kTransposeBlock);
+  };
+  auto &pool = default_thread_pool();
+  if (pool.size() > 1 && m * n >= kTransposeParallelThreshold) {
+    pool.parallel_for(blocksM * blocksN, run);
+  } else {
+    for (std::size_t block = 0; block < blocksM * blocksN; ++block) {
+      run(block, 0);
+    }
+  }
+}
+} // namespace detail
+
+/**
+ * @brief b = a^T where a is m x n column-major with leading dimension lda and
+ * b is n x m column-major with leading dimension ldb. a and b must not
+ * overlap.
+ *
+ * @tparam T
+ */
+template <typename T>
+void transpose(std::size_t m, std::size_t n, const T *a, std::size_t lda, T *b,
+               std::size_t ldb) {
+  detail::for_each_transpose_block(m, n, [&](std::size_t i0, std::size_t j0) {
+    detail::transpose_block(std::min(kTransposeBlock, m - i0),
+                            std::min(kTransposeBlock, n - j0),
+                            a + i0 + j0 * lda, lda, b + j0 + i0 * ldb, ldb);
+  });
+}
+
+/**
+ * @brief Transpose the n x n column-major array a with leading dimension lda
+ * in place. Blocks above the diagonal are swapped with their mirror images
+ * through a block-sized buffer.
+ *
+ * @tparam T
+ */
+template <typename T>
+void transpose_in_place(std::size_t n, T *a, std::size_t lda) {
+  constexpr std::size_t B = kTransposeBlock;
+  detail::for_each_transpose_block(n, n, [&](std::size_t i0, std::size_t j0) {
+    if (i0 > j0) {
+      return;
+    }
+    const std::size_t mcur = std::min(B, n - i0);
+    const std::size_t ncur = std::min(B, n - j0);
+    T *upper = a + i0 + j0 * lda;
+    T *lower = a + j0 + i0 * lda;
+    T tmp[B * B];
+    detail::transpose_block(mcur, ncur, upper, lda, tmp, B);
+    if (i0 != j0) {
+      detail::transpose_block(ncur, mcur, lower, lda, upper, lda);
+    }
+    for (std::size_t i = 0; i < mcur; ++i) {
+      std::copy(tmp + i * B, tmp + i * B + ncur, lower + i * lda);
+    }
+  });
+}
+
+/**
+ * @brief Transpose the contiguous m x n column-major array a in place, leaving
+ * the n x m column-major transpose. Square arrays take the blocked path.
+ * Otherwise elements are moved along the cycles of the permutation
+ * i + j * m -> j + i * n, which needs m * n bits of bookkeeping but no second
+ * copy of the data.
+ *
+ * @tparam T
+ */
+template <typename T>
+void transpose_in_place(std::size_t m, std::size_t n, T *a) {
+  if (m == n) {
+    transpose_in_place(n, a, n);
+    return;
+  }
+  const std::size_t size = m * n;
+  if (m <= 1 || n <= 1) {
+    return;
+  }
+  // The first and last elements stay put. Index p = i + j * m moves to
+  // i * n + j, which is p * n mod (size - 1) but can't overflow.
+  std::vector<bool> moved(size);
+  for (std::size_t start = 1; start + 1 < size; ++start) {
+    if (moved[start]) {
+      continue;
+    }
+    T value = a[start];
+    std::size_t p = start;
+    do {
+      p = p % m * n + p / m;
+      std::swap(value, a[p]);
+      moved[p] = true;
+    } while (p != start);
+  }
+}
+} // namespace ry